@@ -1,57 +1,91 @@
 #include <GLXW/glxw.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
 
 #include <assimp/cimport.h>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include "utils/utils.h"
 #include "utils/models.h"
+#include "utils/weld.h"
+#include "utils/threads.h"
+#include "utils/meshopt.h"
+#include "utils/simplify.h"
+#include "utils/quantize.h"
+#include "utils/bounds.h"
+#include "utils/clusters.h"
+#include "utils/linearalg.h"
+#include "utils/scene.h"
+#include "utils/cache.h"
+#include "utils/meshimport.h"
+#include "utils/meshclean.h"
 
 // 3 per position + 3 per normal + UV
 #define FLOATS_PER_VERTEX (3 + 3 + 2)
 
+#if MESH_IMPORT_FLOATS_PER_VERTEX != FLOATS_PER_VERTEX
+#error "Vertices of the streaming importer have a different layout"
+#endif
+
 // real case: 1.0f and 0.999969f should be considered equal
 #define MODEL_FLOAT_EPS 0.00005f
 
-// should be enough, actually only 18432 in torus.blend
-#define MAX_VERTICES 65536
+// bump when the output for the same input and options changes, so old
+// cache entries are not used anymore
+#define CONVERT_CACHE_VERSION 2
 
-// should be enough, actually only 3456 in torus.blend
-#define MAX_INDICES 16384
+// Indices are stored as 32-bit values, and weldVertices reserves the
+// largest one, so this is the upper bound for unique vertices. Before
+// welding every triangle has its own 3 vertices, which limits the input
+// to about 1.4 billion triangles. In practice memory is the limit:
+// a 10M triangles mesh needs about 1 GB for unwelded vertices.
+#define MAX_VERTICES_NUMBER 0xFFFFFFFEu
 
-GLfloat*
-importedModelCreate(const char* fname, unsigned int meshNumber,
-    size_t* outVerticesBufferSize, unsigned int* outVerticesNumber)
+typedef struct
+{
+    GLfloat* vertices;
+    unsigned int verticesNumber;
+    unsigned int* indices;
+    size_t indicesNumber; // all LODs
+    unsigned int lodsNumber;
+    ModelLod lods[MODEL_MAX_LODS];
+    unsigned int materialIndex;
+    ModelCluster* clusters; // of all LODs
+    size_t clustersNumber;
+} IndexedModel;
+
+static const struct aiScene*
+importedSceneOpen(const char* fname)
 {
-    *outVerticesBufferSize = 0;
-    *outVerticesNumber = 0;
     const struct aiScene* scene = aiImportFile(
             fname,
-            aiProcess_CalcTangentSpace | aiProcess_Triangulate | 
+            aiProcess_CalcTangentSpace | aiProcess_Triangulate |
             aiProcess_JoinIdenticalVertices | aiProcess_SortByPType
         );
 
     if(scene == NULL)
-    {
         fprintf(stderr, "Failed to load model %s\n", fname);
-        return NULL;
-    }
+    return scene;
+}
 
+static const struct aiMesh*
+importedMeshGet(const char* fname, const struct aiScene* scene,
+    unsigned int meshNumber)
+{
     if(scene->mNumMeshes <= meshNumber)
     {
         fprintf(stderr,
                 "There is no mesh #%u in model (%u only), fname = %s\n",
                 meshNumber, scene->mNumMeshes, fname
             );
-        aiReleaseImport(scene);
         return NULL;
     }
 
-    struct aiMesh* mesh = scene->mMeshes[meshNumber];
-    unsigned int facesNum = mesh->mNumFaces;
-    // unsigned int verticesNum = mesh->mNumVertices;
+    const struct aiMesh* mesh = scene->mMeshes[meshNumber];
 
     if(mesh->mTextureCoords[0] == NULL)
     {
@@ -59,17 +93,70 @@ importedModelCreate(const char* fname, unsigned int meshNumber,
                 "mesh->mTextureCoords[0] == NULL, fname = %s\n",
                 fname
             );
-        aiReleaseImport(scene);
         return NULL;
     }
 
+    if(mesh->mNormals == NULL)
+    {
+        fprintf(stderr,
+                "mesh->mNormals == NULL, fname = %s\n",
+                fname
+            );
+        return NULL;
+    }
+
+    if((size_t)mesh->mNumFaces*3 > MAX_VERTICES_NUMBER)
+    {
+        fprintf(stderr,
+                "Too many faces: %u, fname = %s\n",
+                mesh->mNumFaces, fname
+            );
+        return NULL;
+    }
+
+    return mesh;
+}
+
+static void
+importedVertexWrite(const struct aiMesh* mesh, unsigned int index,
+    GLfloat* outVertex)
+{
+    struct aiVector3D pos = mesh->mVertices[index];
+    struct aiVector3D uv = mesh->mTextureCoords[0][index];
+    struct aiVector3D normal = mesh->mNormals[index];
+    outVertex[0] = pos.x;
+    outVertex[1] = pos.y;
+    outVertex[2] = pos.z;
+    outVertex[3] = normal.x;
+    outVertex[4] = normal.y;
+    outVertex[5] = normal.z;
+    outVertex[6] = uv.x;
+    outVertex[7] = 1.0f - uv.y;
+}
+
+GLfloat*
+importedModelCreate(const char* fname, const struct aiMesh* mesh,
+    size_t* outVerticesBufferSize, size_t* outVerticesNumber)
+{
+    *outVerticesBufferSize = 0;
+    *outVerticesNumber = 0;
+
+    unsigned int facesNum = mesh->mNumFaces;
     unsigned int verticesPerFace = 3;
-    *outVerticesNumber = facesNum*verticesPerFace;
-    *outVerticesBufferSize = *outVerticesNumber * sizeof(GLfloat)
+    size_t verticesNumber = (size_t)facesNum*verticesPerFace;
+    size_t verticesBufferSize = verticesNumber * sizeof(GLfloat)
                                 * FLOATS_PER_VERTEX;
-    GLfloat* verticesBuffer = (GLfloat*)malloc(*outVerticesBufferSize);
+    GLfloat* verticesBuffer = (GLfloat*)malloc(verticesBufferSize);
+    if(verticesBuffer == NULL)
+    {
+        fprintf(stderr,
+                "Failed to allocate %llu bytes for vertices, fname = %s\n",
+                (unsigned long long)verticesBufferSize, fname
+            );
+        return NULL;
+    }
 
-    unsigned int verticesBufferIndex = 0;
+    size_t verticesBufferIndex = 0;
 
     for(unsigned int i = 0; i < facesNum; ++i)
     {
@@ -81,198 +168,2363 @@ importedModelCreate(const char* fname, unsigned int meshNumber,
                     mesh->mFaces[i].mNumIndices, i, fname
                 );
             free(verticesBuffer);
-            aiReleaseImport(scene);
             return NULL;
         }
 
         for(unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; ++j)
         {
             unsigned int index = mesh->mFaces[i].mIndices[j];
-            struct aiVector3D pos = mesh->mVertices[index];
-            struct aiVector3D uv = mesh->mTextureCoords[0][index];
-            struct aiVector3D normal = mesh->mNormals[index];
-            verticesBuffer[verticesBufferIndex++] = pos.x;
-            verticesBuffer[verticesBufferIndex++] = pos.y;
-            verticesBuffer[verticesBufferIndex++] = pos.z;
-            verticesBuffer[verticesBufferIndex++] = normal.x;
-            verticesBuffer[verticesBufferIndex++] = normal.y;
-            verticesBuffer[verticesBufferIndex++] = normal.z;
-            verticesBuffer[verticesBufferIndex++] = uv.x;
-            verticesBuffer[verticesBufferIndex++] = 1.0f - uv.y;
+            importedVertexWrite(mesh, index,
+                                verticesBuffer + verticesBufferIndex);
+            verticesBufferIndex += FLOATS_PER_VERTEX;
         }
     }
 
-    aiReleaseImport(scene);
-
+    *outVerticesNumber = verticesNumber;
+    *outVerticesBufferSize = verticesBufferSize;
     return verticesBuffer;
 }
 
+/*
+ * Copies vertices and faces of already indexed mesh (see
+ * aiProcess_JoinIdenticalVertices) as they are. Unlike
+ * importedModelCreate + importedModelWeld this doesn't expand every face
+ * to 3 vertices and doesn't weld them back, but vertices equal only up
+ * to MODEL_FLOAT_EPS are kept separate.
+ */
 bool
-importedModelSave(const char* fname, GLfloat* verticesBuffer,
-    unsigned int verticesNumber)
+importedModelCreateIndexed(const char* fname, const struct aiMesh* mesh,
+    IndexedModel* outModel)
 {
-    bool error = false;
-    unsigned int verticesArrSize = 0;
-    unsigned int indicesArrSize = 0;
-    unsigned int usedIndices = 0;
-    
-    GLfloat* vertices = (GLfloat*)malloc(sizeof(GLfloat) * MAX_VERTICES);
-    if(vertices == NULL)
+    memset(outModel, 0, sizeof(IndexedModel));
+
+    unsigned int facesNum = mesh->mNumFaces;
+    unsigned int verticesNum = mesh->mNumVertices;
+    unsigned int verticesPerFace = 3;
+    size_t indicesNumber = (size_t)facesNum*verticesPerFace;
+
+    GLfloat* vertices = (GLfloat*)malloc(
+                            (size_t)verticesNum * FLOATS_PER_VERTEX *
+                            sizeof(GLfloat)
+                        );
+    unsigned int* indices = (unsigned int*)malloc(
+                            indicesNumber * sizeof(unsigned int)
+                        );
+    if(vertices == NULL || indices == NULL)
     {
-        fprintf(stderr, "Failed to allocate memory for vertices\n");
+        fprintf(stderr,
+                "Failed to allocate memory for indexed model, fname = %s\n",
+                fname
+            );
+        free(indices);
+        free(vertices);
         return false;
     }
 
+    for(unsigned int i = 0; i < verticesNum; ++i)
+        importedVertexWrite(mesh, i,
+                            vertices + (size_t)i*FLOATS_PER_VERTEX);
+
+    for(unsigned int i = 0; i < facesNum; ++i)
+    {
+        if(mesh->mFaces[i].mNumIndices != verticesPerFace)
+        {
+            fprintf(stderr,
+                    "mesh->mFaces[i].numIndices = %u (3 expected),"
+                    " i = %u, fname = %s\n",
+                    mesh->mFaces[i].mNumIndices, i, fname
+                );
+            free(indices);
+            free(vertices);
+            return false;
+        }
+
+        memcpy(indices + (size_t)i*verticesPerFace, mesh->mFaces[i].mIndices,
+               sizeof(unsigned int)*verticesPerFace);
+    }
+
+    outModel->vertices = vertices;
+    outModel->verticesNumber = verticesNum;
+    outModel->indices = indices;
+    outModel->indicesNumber = indicesNumber;
+    outModel->lodsNumber = 1;
+    outModel->lods[0].indicesNumber = indicesNumber;
+    outModel->materialIndex = mesh->mMaterialIndex;
+    return true;
+}
+
+/*
+ * Welds the triangle soup in place, so it takes about one copy of the
+ * soup plus the indices. verticesBuffer is taken by outModel, or freed
+ * if welding fails.
+ */
+bool
+importedModelWeld(GLfloat* verticesBuffer, size_t verticesNumber,
+    IndexedModel* outModel)
+{
+    memset(outModel, 0, sizeof(IndexedModel));
+    unsigned int usedIndices = 0;
+
     unsigned int* indices = (unsigned int*)malloc(
-                                    sizeof(unsigned int) * MAX_INDICES
+                                    sizeof(unsigned int) * verticesNumber
                                 );
     if(indices == NULL)
     {
         fprintf(stderr, "Failed to allocate memory for indices\n");
-        free(vertices);
-        return false;   
+        free(verticesBuffer);
+        return false;
     }
 
-    for(unsigned int vtx = 0; vtx < verticesNumber; ++vtx)
+    // unique vertices are compacted to the start of the buffer
+    uint64_t weldStartTimeMs = getCurrentTimeMs();
+    if(!weldVertices(verticesBuffer, verticesNumber, FLOATS_PER_VERTEX,
+                     MODEL_FLOAT_EPS, MAX_VERTICES_NUMBER,
+                     verticesBuffer, indices, &usedIndices))
     {
-        unsigned int foundIndex = 0;
-        bool indexFound = false;
-        for(unsigned int idx = 0; !indexFound && idx < usedIndices; ++idx)
-        {
-            indexFound = true;
-            // compare X, Y, Z, NX, NY, NZ, U and V
-            for(unsigned int k = 0; indexFound && k < FLOATS_PER_VERTEX; ++k)
-            {
-                if(fabs(verticesBuffer[vtx * FLOATS_PER_VERTEX + k] -
-                    vertices[idx * FLOATS_PER_VERTEX + k]) > MODEL_FLOAT_EPS)
-                {
-                    indexFound = false;
-                }
-            }
+        free(indices);
+        free(verticesBuffer);
+        return false;
+    }
+    fprintf(stderr, "importedModelWeld - welding took %u ms\n",
+            (unsigned int)(getCurrentTimeMs() - weldStartTimeMs));
 
-            if(indexFound) foundIndex = idx;
-        }
+    GLfloat* vertices = verticesBuffer;
+    GLfloat* shrunkVertices = (GLfloat*)realloc(vertices,
+                            (size_t)usedIndices * FLOATS_PER_VERTEX *
+                            sizeof(GLfloat)
+                        );
+    if(shrunkVertices != NULL)
+        vertices = shrunkVertices;
 
-        if(!indexFound)
-        {
-            // save X, Y, Z, NX, NY, NZ, U and V
-            for(unsigned int k = 0; k < FLOATS_PER_VERTEX; ++k)
-            {
-                if(verticesArrSize >= MAX_VERTICES)
-                {
-                    error = true;
-                    break;
-                }
-                vertices[verticesArrSize++] = verticesBuffer[
-                                                    vtx * FLOATS_PER_VERTEX + k
-                                                ];
-            }
-    
-            foundIndex = usedIndices;
-            usedIndices++;
-        }
+    outModel->vertices = vertices;
+    outModel->verticesNumber = usedIndices;
+    outModel->indices = indices;
+    outModel->indicesNumber = verticesNumber;
+    outModel->lodsNumber = 1;
+    outModel->lods[0].indicesNumber = verticesNumber;
+    return true;
+}
 
-        if(error || (indicesArrSize >= MAX_INDICES))
-        {
-            error = true;
-            break;
-        }
+/*
+ * Welds vertices of an already indexed mesh and takes its indices.
+ * weldVertices takes the first match, and vertices of the mesh are in
+ * order of first use, so the result is the same as welding every
+ * triangle corner with importedModelWeld, but only unique vertices are
+ * compared and no triangle soup is built.
+ */
+static bool
+importedModelWeldIndexed(MeshImport* mesh, IndexedModel* outModel)
+{
+    memset(outModel, 0, sizeof(IndexedModel));
+    unsigned int usedIndices = 0;
 
-        indices[indicesArrSize++] = foundIndex;
+    GLfloat* vertices = (GLfloat*)malloc(
+                    (size_t)mesh->verticesNumber * FLOATS_PER_VERTEX *
+                    sizeof(GLfloat)
+                );
+    unsigned int* remap = (unsigned int*)malloc(
+                    sizeof(unsigned int) * ((size_t)mesh->verticesNumber + 1)
+                );
+    if(vertices == NULL || remap == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for vertices\n");
+        free(remap);
+        free(vertices);
+        return false;
     }
 
-    if(error)
+    uint64_t weldStartTimeMs = getCurrentTimeMs();
+    if(!weldVertices(mesh->vertices, mesh->verticesNumber, FLOATS_PER_VERTEX,
+                     MODEL_FLOAT_EPS, MAX_VERTICES_NUMBER,
+                     vertices, remap, &usedIndices))
     {
-        free(indices);
+        free(remap);
         free(vertices);
         return false;
     }
 
-    assert(indicesArrSize == verticesNumber);
+    for(size_t i = 0; i < mesh->indicesNumber; ++i)
+        mesh->indices[i] = remap[mesh->indices[i]];
+    free(remap);
+    fprintf(stderr, "importedModelWeldIndexed - welding took %u ms\n",
+            (unsigned int)(getCurrentTimeMs() - weldStartTimeMs));
+
+    GLfloat* shrunkVertices = (GLfloat*)realloc(vertices,
+                            (size_t)usedIndices * FLOATS_PER_VERTEX *
+                            sizeof(GLfloat)
+                        );
+    if(shrunkVertices != NULL)
+        vertices = shrunkVertices;
+
+    outModel->vertices = vertices;
+    outModel->verticesNumber = usedIndices;
+    outModel->indices = mesh->indices;
+    outModel->indicesNumber = mesh->indicesNumber;
+    outModel->lodsNumber = 1;
+    outModel->lods[0].indicesNumber = mesh->indicesNumber;
+    mesh->indices = NULL;
+    meshImportFree(mesh);
+    return true;
+}
+
+/*
+ * Bounds of the whole model, of every submesh and of its LODs, padded by
+ * the error of quantized positions so they cover the decoded vertices.
+ * Spheres of clusters are padded the same way.
+ */
+static bool
+importedModelBounds(IndexedModel* model, ModelSubmesh* submeshes,
+    unsigned int submeshesNumber, const ModelVertexFormat* format,
+    ModelBounds* outBounds)
+{
+    if(!boundsCompute(model->vertices, model->verticesNumber,
+                      FLOATS_PER_VERTEX, NULL, 0, outBounds))
+        return false;
+
+    float error[3] = { 0.0f, 0.0f, 0.0f };
+    if(format != NULL)
+        quantizePositionError(format, outBounds, error);
+    boundsExpand(outBounds, error);
+
+    const unsigned int* indices = model->indices;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        ModelSubmesh* submesh = &submeshes[i];
+        const GLfloat* vertices = model->vertices +
+                            (size_t)submesh->baseVertex*FLOATS_PER_VERTEX;
+        if(!boundsCompute(vertices, submesh->verticesNumber,
+                          FLOATS_PER_VERTEX, NULL, 0, &submesh->bounds))
+            return false;
+        boundsExpand(&submesh->bounds, error);
+
+        for(unsigned int j = 0; j < submesh->lodsNumber; ++j)
+        {
+            ModelLod* lod = &submesh->lods[j];
+            if(!boundsCompute(vertices, submesh->verticesNumber,
+                              FLOATS_PER_VERTEX,
+                              indices + lod->indicesOffset,
+                              lod->indicesNumber, &lod->bounds))
+                return false;
+            boundsExpand(&lod->bounds, error);
+        }
+        indices += submesh->indicesNumber;
+    }
+
+    float errorLength = sqrtf(error[0]*error[0] + error[1]*error[1] +
+                              error[2]*error[2]);
+    for(size_t i = 0; i < model->clustersNumber; ++i)
+        model->clusters[i].radius += errorLength;
+    return true;
+}
+
+/*
+ * Vertices are converted to the given format before saving, NULL means
+ * 8 floats per vertex. Bounds of submeshes are computed here.
+ */
+bool
+importedModelSave(const char* fname, IndexedModel* model,
+    ModelSubmesh* submeshes, unsigned int submeshesNumber,
+    const ModelVertexFormat* format, bool compress)
+{
+    ModelBounds bounds;
+    if(!importedModelBounds(model, submeshes, submeshesNumber, format,
+                            &bounds))
+        return false;
 
-    unsigned char indexSize = 1;
-    if(verticesNumber > 255) indexSize *= 2;
-    if(verticesNumber > 65535) indexSize *= 2;
+    const void* verticesData = model->vertices;
+    void* quantizedVertices = NULL;
+    size_t verticesDataSize = (size_t)model->verticesNumber *
+                                FLOATS_PER_VERTEX * sizeof(GLfloat);
+    if(format != NULL &&
+       (format->positionFormat != MODEL_POSITION_FLOAT3 ||
+        format->normalFormat != MODEL_NORMAL_FLOAT3 ||
+        format->uvFormat != MODEL_UV_FLOAT2))
+    {
+        quantizedVertices = quantizeVertices(format, model->vertices,
+                                             model->verticesNumber,
+                                             &verticesDataSize);
+        if(quantizedVertices == NULL)
+            return false;
+        verticesData = quantizedVertices;
+    }
 
-    unsigned int modelSize = (unsigned int) (
-                                verticesNumber*FLOATS_PER_VERTEX*sizeof(GLfloat)
-                            );
-    unsigned int indexedModelSize = (unsigned int) (
-                                usedIndices*FLOATS_PER_VERTEX*sizeof(GLfloat)
-                                    + verticesNumber*indexSize
-                            );
+    // index bytes read by a draw of LOD 0 of every submesh, compared
+    // to 32-bit indices
+    size_t modelSize = 0;
+    size_t indexedModelSize = verticesDataSize;
+    size_t drawIndicesSize = 0, drawIndices32Size = 0;
+    unsigned int submeshes16Number = 0;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        unsigned int indexSize = submeshes[i].indexSize;
+        if(indexSize == 0)
+            indexSize = modelIndexSize(submeshes[i].verticesNumber,
+                                       MODEL_INDICES_NEVER_8BIT);
+        if(indexSize <= 2)
+            submeshes16Number++;
+        indexedModelSize += submeshes[i].indicesNumber*indexSize;
+        drawIndicesSize += submeshes[i].lods[0].indicesNumber*indexSize;
+        drawIndices32Size += submeshes[i].lods[0].indicesNumber*
+                                sizeof(uint32_t);
+        modelSize += submeshes[i].lods[0].indicesNumber*FLOATS_PER_VERTEX*
+                        sizeof(GLfloat);
+    }
     float ratio = (float)indexedModelSize*100.0f / (float)modelSize;
     fprintf(stderr,
-            "importedModelSave - fname = %s, verticesNumber = %u, "
-            "usedIndices = %u\n", fname, verticesNumber, usedIndices
+            "importedModelSave - fname = %s, indicesNumber = %llu, "
+            "verticesNumber = %u, submeshesNumber = %u\n", fname,
+            (unsigned long long)model->indicesNumber, model->verticesNumber,
+            submeshesNumber
+        );
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+        fprintf(stderr,
+                "importedModelSave - submesh %u: baseVertex = %u, "
+                "verticesNumber = %u, indicesNumber = %llu, indexSize = %u, "
+                "lodsNumber = %u, materialIndex = %u\n",
+                i, submeshes[i].baseVertex, submeshes[i].verticesNumber,
+                (unsigned long long)submeshes[i].indicesNumber,
+                submeshes[i].indexSize,
+                submeshes[i].lodsNumber, submeshes[i].materialIndex
+            );
+    if(model->verticesNumber > 0)
+        fprintf(stderr,
+                "importedModelSave - vertexSize = %u, verticesDataSize = "
+                "%llu\n",
+                (unsigned int)(verticesDataSize / model->verticesNumber),
+                (unsigned long long)verticesDataSize
+            );
+    fprintf(stderr,
+            "importedModelSave - modelSize = %llu, indexedModelSize = %llu, "
+            "ratio = %f%%\n", (unsigned long long)modelSize,
+            (unsigned long long)indexedModelSize, ratio
         );
+    if(drawIndices32Size > 0)
+        fprintf(stderr,
+                "importedModelSave - %u of %u submeshes have 8 or 16-bit "
+                "indices, index bandwidth = %llu bytes per draw, %.1f%% "
+                "saved compared to 32-bit indices\n",
+                submeshes16Number, submeshesNumber,
+                (unsigned long long)drawIndicesSize,
+                100.0f - (float)drawIndicesSize*100.0f /
+                         (float)drawIndices32Size
+            );
     fprintf(stderr,
-            "importedModelSave - modelSize = %u, indexedModelSize = %u, "
-            "ratio = %f%%\n", modelSize, indexedModelSize, ratio
+            "importedModelSave - bounds = (%f, %f, %f) - (%f, %f, %f), "
+            "sphere center = (%f, %f, %f), radius = %f\n",
+            bounds.min[0], bounds.min[1], bounds.min[2],
+            bounds.max[0], bounds.max[1], bounds.max[2],
+            bounds.center[0], bounds.center[1], bounds.center[2],
+            bounds.radius
         );
 
     bool res = modelSave(
             fname,
-            vertices,
-            usedIndices * FLOATS_PER_VERTEX * sizeof(GLfloat),
-            indices,
-            verticesNumber
+            verticesData,
+            verticesDataSize,
+            model->indices,
+            submeshes,
+            submeshesNumber,
+            model->clusters,
+            model->clustersNumber,
+            format,
+            &bounds,
+            compress
         );
-
-    free(indices);
-    free(vertices);
+    free(quantizedVertices);
     return res;
 }
 
 void
-importedModelFree(GLfloat* model)
+indexedModelFree(IndexedModel* model)
 {
-    free(model);
+    free(model->clusters);
+    free(model->indices);
+    free(model->vertices);
+    memset(model, 0, sizeof(IndexedModel));
 }
 
-int
-main(int argc, char* argv[])
+typedef struct
 {
-    if(argc < 2) {
-        printf("Usage: emdconv <input file> <output file> [mesh number]\n");
-        return 1;
+    bool direct;
+    bool optimizeVertexCache;
+    float overdrawThreshold; // 0 if triangles are not sorted for overdraw
+    bool optimizeVertexFetch;
+    unsigned int lodRatiosNumber;
+    float lodRatios[MODEL_MAX_LODS - 1]; // relative to LOD 0
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    bool compress;
+    bool allMeshes;
+    const char* sceneFile; // implies allMeshes
+    unsigned int indexPolicy; // MODEL_INDICES_*
+    bool buildClusters;
+    const char* cacheDir; // NULL if the cache is not used
+} ConvertOptions;
+
+typedef struct
+{
+    char infile[FILENAME_MAX];
+    char outfile[FILENAME_MAX];
+    unsigned int meshNumber;
+
+    bool succeeded;
+    bool cacheHit;
+    size_t trianglesNumber;
+    uint64_t inputSize;
+    uint64_t timeUs;
+} ConvertJob;
+
+typedef struct
+{
+    const ConvertOptions* options;
+    ConvertJob* jobs;
+    size_t jobsNumber;
+    size_t nextJob;
+    Mutex* mutex;
+} ConvertQueue;
+
+/*
+ * Removes degenerate and repeated triangles of a welded model and
+ * vertices left without triangles. Must be called before LODs are
+ * built.
+ */
+static bool
+importedModelClean(const char* fname, IndexedModel* model)
+{
+    uint64_t startTimeMs = getCurrentTimeMs();
+    size_t indicesNumber, degenerateNumber, duplicatesNumber;
+    if(!meshRemoveBadTriangles(model->indices, model->indicesNumber,
+                               model->vertices, FLOATS_PER_VERTEX,
+                               &indicesNumber, &degenerateNumber,
+                               &duplicatesNumber))
+        return false;
+
+    if(indicesNumber == 0 && model->indicesNumber > 0)
+    {
+        fprintf(stderr,
+                "importedModelClean - all %llu triangles are degenerate, "
+                "fname = %s\n",
+                (unsigned long long)model->indicesNumber / 3, fname
+            );
+        return false;
     }
 
-    char* infile = argv[1];
-    char* outfile = argv[2];
+    // vertices are only compacted if something was removed
+    unsigned int verticesNumber = model->verticesNumber;
+    if(indicesNumber != model->indicesNumber &&
+       !meshRemoveUnusedVertices(model->vertices, model->verticesNumber,
+                                 FLOATS_PER_VERTEX, model->indices,
+                                 indicesNumber, &verticesNumber))
+        return false;
+
+    fprintf(stderr,
+            "importedModelClean - fname = %s, removed %llu degenerate and "
+            "%llu duplicate triangles of %llu, %u unused vertices, "
+            "took %u ms\n", fname, (unsigned long long)degenerateNumber,
+            (unsigned long long)duplicatesNumber,
+            (unsigned long long)model->indicesNumber / 3,
+            model->verticesNumber - verticesNumber,
+            (unsigned int)(getCurrentTimeMs() - startTimeMs)
+        );
 
-    unsigned int meshNumber = 0;
-    if(argc > 3) {
-        meshNumber = (unsigned int) atoi(argv[3]);
+    model->verticesNumber = verticesNumber;
+    model->indicesNumber = indicesNumber;
+    model->lods[0].indicesNumber = indicesNumber;
+    return true;
+}
+
+/*
+ * Appends simplified LODs to model->indices, every LOD is built from
+ * the previous one. Stops early when the mesh can't be simplified
+ * any further.
+ */
+static bool
+importedModelBuildLods(const char* fname, IndexedModel* model,
+    const ConvertOptions* options)
+{
+    if(options->lodRatiosNumber == 0 || model->lods[0].indicesNumber == 0)
+        return true;
+
+    size_t lod0IndicesNumber = model->lods[0].indicesNumber;
+    size_t maxIndicesNumber = lod0IndicesNumber * (options->lodRatiosNumber + 1);
+    unsigned int* indices = (unsigned int*)realloc(model->indices,
+                                sizeof(unsigned int) * maxIndicesNumber);
+    if(indices == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for LODs, fname = %s\n",
+                fname);
+        return false;
     }
+    model->indices = indices;
 
-    printf("Infile: %s\n", infile);
-    printf("Outfile: %s\n", outfile);
-    printf("Mesh number: %u\n", meshNumber);
+    uint64_t startTimeMs = getCurrentTimeMs();
+    for(unsigned int i = 0; i < options->lodRatiosNumber; ++i)
+    {
+        const ModelLod* prev = &model->lods[model->lodsNumber - 1];
+        size_t targetIndicesNumber = (size_t)(options->lodRatios[i] *
+                                              (float)lod0IndicesNumber);
+        if(targetIndicesNumber >= prev->indicesNumber)
+            continue;
+
+        ModelLod* lod = &model->lods[model->lodsNumber];
+        lod->indicesOffset = prev->indicesOffset + prev->indicesNumber;
+        if(!meshSimplify(model->indices + prev->indicesOffset,
+                         prev->indicesNumber, model->vertices,
+                         model->verticesNumber, FLOATS_PER_VERTEX,
+                         MODEL_FLOAT_EPS, targetIndicesNumber,
+                         model->indices + lod->indicesOffset,
+                         &lod->indicesNumber, &lod->error))
+            return false;
+
+        if(lod->indicesNumber == prev->indicesNumber ||
+           lod->indicesNumber == 0)
+        {
+            fprintf(stderr,
+                    "importedModelBuildLods - fname = %s, can't simplify "
+                    "below %llu triangles\n",
+                    fname, (unsigned long long)prev->indicesNumber / 3
+                );
+            break;
+        }
+
+        // errors accumulate since every LOD is built from the previous one
+        if(lod->error < prev->error)
+            lod->error = prev->error;
+
+        fprintf(stderr,
+                "importedModelBuildLods - fname = %s, LOD %u: %llu triangles "
+                "(%.1f%%), error = %f\n",
+                fname, model->lodsNumber,
+                (unsigned long long)lod->indicesNumber / 3,
+                (float)lod->indicesNumber * 100.0f / (float)lod0IndicesNumber,
+                lod->error
+            );
+        model->lodsNumber++;
+        model->indicesNumber = lod->indicesOffset + lod->indicesNumber;
+    }
+
+    fprintf(stderr, "importedModelBuildLods - fname = %s, took %u ms\n",
+            fname, (unsigned int)(getCurrentTimeMs() - startTimeMs));
+
+    indices = (unsigned int*)realloc(model->indices,
+                                sizeof(unsigned int) * model->indicesNumber);
+    if(indices != NULL)
+        model->indices = indices;
+    return true;
+}
+
+static bool
+importedModelOptimize(const char* fname, IndexedModel* model,
+    const ConvertOptions* options)
+{
+    if(options->optimizeVertexCache)
+    {
+        float acmrBefore, atvrBefore, acmrAfter, atvrAfter;
+        meshAnalyzeVertexCache(model->indices, model->indicesNumber,
+                               model->verticesNumber, MESHOPT_CACHE_SIZE,
+                               &acmrBefore, &atvrBefore);
+
+        // every LOD is drawn on its own, so optimize them separately
+        uint64_t startTimeMs = getCurrentTimeMs();
+        for(unsigned int i = 0; i < model->lodsNumber; ++i)
+        {
+            if(!meshOptimizeVertexCache(
+                    model->indices + model->lods[i].indicesOffset,
+                    model->lods[i].indicesNumber, model->verticesNumber,
+                    MESHOPT_CACHE_SIZE))
+                return false;
+        }
+        uint64_t timeMs = getCurrentTimeMs() - startTimeMs;
+
+        meshAnalyzeVertexCache(model->indices, model->indicesNumber,
+                               model->verticesNumber, MESHOPT_CACHE_SIZE,
+                               &acmrAfter, &atvrAfter);
+        fprintf(stderr,
+                "importedModelOptimize - fname = %s, vertex cache: "
+                "ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, took %u ms\n",
+                fname, acmrBefore, acmrAfter, atvrBefore, atvrAfter,
+                (unsigned int)timeMs
+            );
+    }
 
-    unsigned int modelVerticesNumber;
-    size_t modelVerticesBufferSize;
-    GLfloat * modelVerticesBuffer = importedModelCreate(
-                                            infile,
-                                            meshNumber, 
-                                            &modelVerticesBufferSize, 
-                                            &modelVerticesNumber
-                                        );
-    if(modelVerticesBuffer == NULL)
+    if(options->overdrawThreshold > 0.0f)
     {
-        fprintf(stderr, "importedModelCreate returned null\n");
-        return 2;
+        // overdraw of LOD 0 only, LODs cover the same pixels
+        float overdrawBefore, overdrawAfter, acmrBefore, acmrAfter, atvr;
+        const ModelLod* lod0 = &model->lods[0];
+        meshAnalyzeOverdraw(model->indices + lod0->indicesOffset,
+                            lod0->indicesNumber, model->vertices,
+                            FLOATS_PER_VERTEX, model->verticesNumber,
+                            &overdrawBefore);
+        meshAnalyzeVertexCache(model->indices, model->indicesNumber,
+                               model->verticesNumber, MESHOPT_CACHE_SIZE,
+                               &acmrBefore, &atvr);
+
+        uint64_t startTimeMs = getCurrentTimeMs();
+        for(unsigned int i = 0; i < model->lodsNumber; ++i)
+        {
+            if(!meshOptimizeOverdraw(
+                    model->indices + model->lods[i].indicesOffset,
+                    model->lods[i].indicesNumber, model->vertices,
+                    FLOATS_PER_VERTEX, model->verticesNumber,
+                    MESHOPT_CACHE_SIZE, options->overdrawThreshold))
+                return false;
+        }
+        uint64_t timeMs = getCurrentTimeMs() - startTimeMs;
+
+        meshAnalyzeOverdraw(model->indices + lod0->indicesOffset,
+                            lod0->indicesNumber, model->vertices,
+                            FLOATS_PER_VERTEX, model->verticesNumber,
+                            &overdrawAfter);
+        meshAnalyzeVertexCache(model->indices, model->indicesNumber,
+                               model->verticesNumber, MESHOPT_CACHE_SIZE,
+                               &acmrAfter, &atvr);
+        fprintf(stderr,
+                "importedModelOptimize - fname = %s, overdraw %.3f -> %.3f, "
+                "ACMR %.3f -> %.3f, took %u ms\n",
+                fname, overdrawBefore, overdrawAfter, acmrBefore, acmrAfter,
+                (unsigned int)timeMs
+            );
     }
 
-    if(!importedModelSave(outfile, modelVerticesBuffer, modelVerticesNumber))
+    if(options->optimizeVertexFetch)
     {
-        fprintf(stderr, "importedModelSave failed\n");
-        importedModelFree(modelVerticesBuffer);
-        return 3;
+        float overfetchBefore, overfetchAfter;
+        size_t vertexSize = FLOATS_PER_VERTEX * sizeof(GLfloat);
+        meshAnalyzeVertexFetch(model->indices, model->indicesNumber,
+                               model->verticesNumber, vertexSize,
+                               &overfetchBefore);
+
+        uint64_t startTimeMs = getCurrentTimeMs();
+        unsigned int verticesNumber;
+        if(!meshOptimizeVertexFetch(model->vertices, vertexSize,
+                                    model->indices, model->indicesNumber,
+                                    model->verticesNumber, &verticesNumber))
+            return false;
+        uint64_t timeMs = getCurrentTimeMs() - startTimeMs;
+
+        if(verticesNumber != model->verticesNumber)
+            fprintf(stderr,
+                    "importedModelOptimize - fname = %s, %u unused vertices "
+                    "removed\n", fname, model->verticesNumber - verticesNumber
+                );
+        model->verticesNumber = verticesNumber;
+
+        meshAnalyzeVertexFetch(model->indices, model->indicesNumber,
+                               model->verticesNumber, vertexSize,
+                               &overfetchAfter);
+        fprintf(stderr,
+                "importedModelOptimize - fname = %s, vertex fetch: "
+                "overfetch %.3f -> %.3f, took %u ms\n",
+                fname, overfetchBefore, overfetchAfter, (unsigned int)timeMs
+            );
     }
 
-    printf("Done!\n");
+    return true;
+}
+
+/*
+ * Splits every LOD into clusters for culling on the CPU, clusters of
+ * a LOD follow each other.
+ */
+static bool
+importedModelBuildClusters(const char* fname, IndexedModel* model)
+{
+    uint64_t startTimeMs = getCurrentTimeMs();
+    for(unsigned int i = 0; i < model->lodsNumber; ++i)
+    {
+        ModelLod* lod = &model->lods[i];
+        lod->firstCluster = model->clustersNumber;
+        if(!clustersBuild(model->vertices, model->verticesNumber,
+                          FLOATS_PER_VERTEX,
+                          model->indices + lod->indicesOffset,
+                          lod->indicesNumber, &model->clusters,
+                          &model->clustersNumber))
+            return false;
+        lod->clustersNumber = model->clustersNumber - lod->firstCluster;
+    }
+
+    size_t conesNumber = 0;
+    for(size_t i = 0; i < model->clustersNumber; ++i)
+        if(model->clusters[i].coneCutoff < 1.0f)
+            conesNumber++;
+
+    if(model->clustersNumber > 0)
+        fprintf(stderr,
+                "importedModelBuildClusters - fname = %s, %llu clusters, "
+                "%.1f triangles per cluster, %.1f%% have normal cones, "
+                "took %u ms\n", fname,
+                (unsigned long long)model->clustersNumber,
+                (float)model->indicesNumber / 3.0f /
+                (float)model->clustersNumber,
+                (float)conesNumber*100.0f / (float)model->clustersNumber,
+                (unsigned int)(getCurrentTimeMs() - startTimeMs)
+            );
+    return true;
+}
+
+static uint64_t
+importedMeshHashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+static uint64_t
+importedMeshHash(const struct aiMesh* mesh)
+{
+    size_t verticesSize = (size_t)mesh->mNumVertices *
+                          sizeof(struct aiVector3D);
+    uint64_t hash = 14695981039346656037ull;
+    hash = importedMeshHashBytes(hash, &mesh->mMaterialIndex,
+                                 sizeof(mesh->mMaterialIndex));
+    hash = importedMeshHashBytes(hash, mesh->mVertices, verticesSize);
+    hash = importedMeshHashBytes(hash, mesh->mNormals, verticesSize);
+    hash = importedMeshHashBytes(hash, mesh->mTextureCoords[0],
+                                 verticesSize);
+    for(unsigned int i = 0; i < mesh->mNumFaces; ++i)
+        hash = importedMeshHashBytes(hash, mesh->mFaces[i].mIndices,
+                        sizeof(unsigned int)*mesh->mFaces[i].mNumIndices);
+    return hash;
+}
+
+static bool
+importedMeshEqual(const struct aiMesh* a, const struct aiMesh* b)
+{
+    size_t verticesSize = (size_t)a->mNumVertices *
+                          sizeof(struct aiVector3D);
+    if(a->mNumVertices != b->mNumVertices ||
+       a->mNumFaces != b->mNumFaces ||
+       a->mMaterialIndex != b->mMaterialIndex ||
+       memcmp(a->mVertices, b->mVertices, verticesSize) != 0 ||
+       memcmp(a->mNormals, b->mNormals, verticesSize) != 0 ||
+       memcmp(a->mTextureCoords[0], b->mTextureCoords[0],
+              verticesSize) != 0)
+        return false;
+
+    for(unsigned int i = 0; i < a->mNumFaces; ++i)
+    {
+        if(a->mFaces[i].mNumIndices != b->mFaces[i].mNumIndices ||
+           memcmp(a->mFaces[i].mIndices, b->mFaces[i].mIndices,
+                  sizeof(unsigned int)*a->mFaces[i].mNumIndices) != 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Finds meshes equal to an earlier one, e.g. copies of a linked object
+ * that importers often make, so every distinct mesh is stored once.
+ * outMeshSubmesh maps every mesh of the scene to its submesh,
+ * outUniqueMeshes lists meshes that become submeshes. Meshes are checked
+ * with importedMeshGet first.
+ */
+static bool
+importedMeshesDedup(const char* fname, const struct aiScene* scene,
+    unsigned int* outMeshSubmesh, unsigned int* outUniqueMeshes,
+    unsigned int* outUniqueNumber)
+{
+    uint64_t* hashes = (uint64_t*)malloc(
+                            sizeof(uint64_t)*scene->mNumMeshes + 1);
+    if(hashes == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for hashes, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    unsigned int uniqueNumber = 0;
+    for(unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+        const struct aiMesh* mesh = scene->mMeshes[i];
+        uint64_t hash = importedMeshHash(mesh);
+        unsigned int submesh = uniqueNumber;
+        for(unsigned int j = 0; j < uniqueNumber; ++j)
+        {
+            if(hashes[j] == hash &&
+               importedMeshEqual(scene->mMeshes[outUniqueMeshes[j]], mesh))
+            {
+                submesh = j;
+                break;
+            }
+        }
+
+        if(submesh == uniqueNumber)
+        {
+            hashes[uniqueNumber] = hash;
+            outUniqueMeshes[uniqueNumber++] = i;
+        }
+        outMeshSubmesh[i] = submesh;
+    }
+
+    free(hashes);
+    *outUniqueNumber = uniqueNumber;
+    return true;
+}
+
+typedef struct
+{
+    SceneNode* nodes;
+    unsigned int nodesNumber;
+    uint32_t* meshes;
+    unsigned int meshesNumber;
+    char* names;
+    size_t namesSize;
+} ImportedScene;
+
+static void
+importedSceneFree(ImportedScene* imported)
+{
+    free(imported->names);
+    free(imported->meshes);
+    free(imported->nodes);
+    memset(imported, 0, sizeof(ImportedScene));
+}
 
-    importedModelFree(modelVerticesBuffer);
+/*
+ * Flattens the node hierarchy breadth first, so parents always come
+ * before their children, and computes world transforms of nodes.
+ */
+static bool
+importedSceneBuild(const char* fname, const struct aiScene* scene,
+    const unsigned int* meshSubmesh, ImportedScene* outImported)
+{
+    memset(outImported, 0, sizeof(ImportedScene));
+
+    unsigned int nodesAllocated = 64;
+    const struct aiNode** queue = (const struct aiNode**)malloc(
+                                    sizeof(struct aiNode*)*nodesAllocated);
+    if(queue == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for nodes, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    unsigned int nodesNumber = 1;
+    size_t meshesNumber = 0;
+    size_t namesSize = 0;
+    queue[0] = scene->mRootNode;
+    for(unsigned int i = 0; i < nodesNumber; ++i)
+    {
+        const struct aiNode* node = queue[i];
+        meshesNumber += node->mNumMeshes;
+        namesSize += node->mName.length + 1;
+        if(node->mNumChildren > nodesAllocated - nodesNumber)
+        {
+            while(node->mNumChildren > nodesAllocated - nodesNumber)
+                nodesAllocated *= 2;
+            const struct aiNode** newQueue = (const struct aiNode**)realloc(
+                    queue, sizeof(struct aiNode*)*nodesAllocated);
+            if(newQueue == NULL)
+            {
+                fprintf(stderr, "Failed to allocate memory for nodes, "
+                        "fname = %s\n", fname);
+                free(queue);
+                return false;
+            }
+            queue = newQueue;
+        }
+        memcpy(queue + nodesNumber, node->mChildren,
+               sizeof(struct aiNode*)*node->mNumChildren);
+        nodesNumber += node->mNumChildren;
+    }
+
+    SceneNode* nodes = (SceneNode*)calloc(nodesNumber, sizeof(SceneNode));
+    uint32_t* meshes = (uint32_t*)malloc(sizeof(uint32_t)*meshesNumber + 1);
+    char* names = (char*)malloc(namesSize);
+    if(nodes == NULL || meshes == NULL || names == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for nodes, fname = %s\n",
+                fname);
+        free(names);
+        free(meshes);
+        free(nodes);
+        free(queue);
+        return false;
+    }
+
+    // children of a node follow each other in the queue
+    nodes[0].parent = SCENE_NO_PARENT;
+    unsigned int nextChild = 1;
+    meshesNumber = 0;
+    namesSize = 0;
+    for(unsigned int i = 0; i < nodesNumber; ++i)
+    {
+        const struct aiNode* node = queue[i];
+        SceneNode* sceneNode = &nodes[i];
+        for(unsigned int j = 0; j < node->mNumChildren; ++j)
+            nodes[nextChild++].parent = i;
+
+        // aiMatrix4x4 is row-major
+        const struct aiMatrix4x4* t = &node->mTransformation;
+        Matrix local = {{
+                t->a1, t->b1, t->c1, t->d1,
+                t->a2, t->b2, t->c2, t->d2,
+                t->a3, t->b3, t->c3, t->d3,
+                t->a4, t->b4, t->c4, t->d4
+            }};
+        Matrix world = local;
+        if(sceneNode->parent != SCENE_NO_PARENT)
+        {
+            Matrix parent;
+            memcpy(parent.m, nodes[sceneNode->parent].transform,
+                   sizeof(parent.m));
+            world = matrixMulMat(&local, &parent);
+        }
+        memcpy(sceneNode->localTransform, local.m, sizeof(local.m));
+        memcpy(sceneNode->transform, world.m, sizeof(world.m));
+
+        sceneNode->nameOffset = (uint32_t)namesSize;
+        memcpy(names + namesSize, node->mName.data, node->mName.length);
+        names[namesSize + node->mName.length] = '\0';
+        namesSize += node->mName.length + 1;
+
+        sceneNode->firstMesh = (uint32_t)meshesNumber;
+        sceneNode->meshesNumber = node->mNumMeshes;
+        for(unsigned int j = 0; j < node->mNumMeshes; ++j)
+            meshes[meshesNumber++] = meshSubmesh[node->mMeshes[j]];
+    }
+    free(queue);
+
+    outImported->nodes = nodes;
+    outImported->nodesNumber = nodesNumber;
+    outImported->meshes = meshes;
+    outImported->meshesNumber = (unsigned int)meshesNumber;
+    outImported->names = names;
+    outImported->namesSize = namesSize;
+    return true;
+}
+
+/*
+ * Mesh references of nodes become references to all the chunks of a
+ * mesh if it was split, see indexedModelsSplit.
+ */
+static bool
+importedSceneSplit(const char* fname, ImportedScene* imported,
+    const unsigned int* meshFirstSubmesh)
+{
+    size_t meshesNumber = 0;
+    for(unsigned int i = 0; i < imported->meshesNumber; ++i)
+    {
+        uint32_t mesh = imported->meshes[i];
+        meshesNumber += meshFirstSubmesh[mesh + 1] - meshFirstSubmesh[mesh];
+    }
+    if(meshesNumber == imported->meshesNumber)
+        return true;
+
+    uint32_t* meshes = (uint32_t*)malloc(sizeof(uint32_t)*meshesNumber + 1);
+    if(meshes == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for nodes, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    uint32_t meshIndex = 0;
+    for(unsigned int i = 0; i < imported->nodesNumber; ++i)
+    {
+        SceneNode* node = &imported->nodes[i];
+        uint32_t firstMesh = meshIndex;
+        for(uint32_t j = 0; j < node->meshesNumber; ++j)
+        {
+            uint32_t mesh = imported->meshes[node->firstMesh + j];
+            for(unsigned int k = meshFirstSubmesh[mesh];
+                k < meshFirstSubmesh[mesh + 1]; ++k)
+                meshes[meshIndex++] = k;
+        }
+        node->firstMesh = firstMesh;
+        node->meshesNumber = meshIndex - firstMesh;
+    }
+
+    free(imported->meshes);
+    imported->meshes = meshes;
+    imported->meshesNumber = meshIndex;
+    return true;
+}
+
+/*
+ * Cleans up a welded model, builds its LODs and optimizes it, the model
+ * is freed on failure. With --direct faces are kept as imported.
+ */
+static bool
+convertMeshProcess(const char* infile, const ConvertOptions* options,
+    IndexedModel* outModel)
+{
+    if(!options->direct && !importedModelClean(infile, outModel))
+    {
+        fprintf(stderr, "importedModelClean failed\n");
+        indexedModelFree(outModel);
+        return false;
+    }
+
+    if(!importedModelBuildLods(infile, outModel, options))
+    {
+        fprintf(stderr, "importedModelBuildLods failed\n");
+        indexedModelFree(outModel);
+        return false;
+    }
+
+    if(!importedModelOptimize(infile, outModel, options))
+    {
+        fprintf(stderr, "importedModelOptimize failed\n");
+        indexedModelFree(outModel);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+convertMesh(const char* infile, const struct aiMesh* mesh,
+    const ConvertOptions* options, IndexedModel* outModel)
+{
+    if(options->direct)
+    {
+        if(!importedModelCreateIndexed(infile, mesh, outModel))
+        {
+            fprintf(stderr, "importedModelCreateIndexed failed\n");
+            return false;
+        }
+    }
+    else
+    {
+        size_t modelVerticesNumber;
+        size_t modelVerticesBufferSize;
+        GLfloat * modelVerticesBuffer = importedModelCreate(
+                                                infile,
+                                                mesh,
+                                                &modelVerticesBufferSize,
+                                                &modelVerticesNumber
+                                            );
+        if(modelVerticesBuffer == NULL)
+        {
+            fprintf(stderr, "importedModelCreate returned null\n");
+            return false;
+        }
+
+        bool res = importedModelWeld(modelVerticesBuffer,
+                                     modelVerticesNumber, outModel);
+        if(!res)
+        {
+            fprintf(stderr, "importedModelWeld failed\n");
+            return false;
+        }
+        outModel->materialIndex = mesh->mMaterialIndex;
+    }
+
+    return convertMeshProcess(infile, options, outModel);
+}
+
+/*
+ * Like convertMesh, for meshes of the streaming importer. The mesh is
+ * freed if the conversion succeeds.
+ */
+static bool
+convertMeshImported(const char* infile, MeshImport* mesh,
+    const ConvertOptions* options, IndexedModel* outModel)
+{
+    if(options->direct)
+    {
+        memset(outModel, 0, sizeof(IndexedModel));
+        outModel->vertices = mesh->vertices;
+        outModel->verticesNumber = mesh->verticesNumber;
+        outModel->indices = mesh->indices;
+        outModel->indicesNumber = mesh->indicesNumber;
+        outModel->lodsNumber = 1;
+        outModel->lods[0].indicesNumber = mesh->indicesNumber;
+        memset(mesh, 0, sizeof(MeshImport));
+    }
+    else if(!importedModelWeldIndexed(mesh, outModel))
+    {
+        fprintf(stderr, "importedModelWeldIndexed failed\n");
+        return false;
+    }
+
+    return convertMeshProcess(infile, options, outModel);
+}
+
+/*
+ * Puts vertices and indices of all the models one after another and
+ * frees the models. Indices stay relative to the first vertex of their
+ * model, which becomes baseVertex of the submesh.
+ */
+static bool
+indexedModelsMerge(const char* fname, IndexedModel* models,
+    unsigned int modelsNumber, IndexedModel* outModel,
+    ModelSubmesh* outSubmeshes)
+{
+    memset(outModel, 0, sizeof(IndexedModel));
+
+    size_t verticesNumber = 0;
+    size_t indicesNumber = 0;
+    size_t clustersNumber = 0;
+    for(unsigned int i = 0; i < modelsNumber; ++i)
+    {
+        ModelSubmesh* submesh = &outSubmeshes[i];
+        memset(submesh, 0, sizeof(ModelSubmesh));
+        submesh->baseVertex = (unsigned int)verticesNumber;
+        submesh->verticesNumber = models[i].verticesNumber;
+        submesh->indicesNumber = models[i].indicesNumber;
+        submesh->materialIndex = models[i].materialIndex;
+        submesh->lodsNumber = models[i].lodsNumber;
+        memcpy(submesh->lods, models[i].lods, sizeof(submesh->lods));
+        for(unsigned int j = 0; j < submesh->lodsNumber; ++j)
+            submesh->lods[j].firstCluster += clustersNumber;
+        clustersNumber += models[i].clustersNumber;
+
+        verticesNumber += models[i].verticesNumber;
+        indicesNumber += models[i].indicesNumber;
+        if(verticesNumber > MAX_VERTICES_NUMBER)
+        {
+            fprintf(stderr, "Too many vertices in all meshes, fname = %s\n",
+                    fname);
+            for(unsigned int j = 0; j < modelsNumber; ++j)
+                indexedModelFree(&models[j]);
+            return false;
+        }
+    }
+
+    // nothing to merge, just take the buffers
+    if(modelsNumber == 1)
+    {
+        *outModel = models[0];
+        memset(&models[0], 0, sizeof(IndexedModel));
+        return true;
+    }
+
+    GLfloat* vertices = (GLfloat*)malloc(
+                            verticesNumber * FLOATS_PER_VERTEX *
+                            sizeof(GLfloat) + 1
+                        );
+    unsigned int* indices = (unsigned int*)malloc(
+                            indicesNumber * sizeof(unsigned int) + 1
+                        );
+    ModelCluster* clusters = (ModelCluster*)malloc(
+                            clustersNumber * sizeof(ModelCluster) + 1
+                        );
+    if(vertices == NULL || indices == NULL || clusters == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for meshes, fname = %s\n",
+                fname);
+        free(clusters);
+        free(indices);
+        free(vertices);
+        for(unsigned int i = 0; i < modelsNumber; ++i)
+            indexedModelFree(&models[i]);
+        return false;
+    }
+
+    for(unsigned int i = 0; i < modelsNumber; ++i)
+    {
+        memcpy(vertices + (size_t)outSubmeshes[i].baseVertex *
+                          FLOATS_PER_VERTEX,
+               models[i].vertices,
+               (size_t)models[i].verticesNumber * FLOATS_PER_VERTEX *
+               sizeof(GLfloat));
+        memcpy(indices + outModel->indicesNumber, models[i].indices,
+               models[i].indicesNumber * sizeof(unsigned int));
+        outModel->indicesNumber += models[i].indicesNumber;
+        if(models[i].clustersNumber > 0)
+            memcpy(clusters + outModel->clustersNumber, models[i].clusters,
+                   models[i].clustersNumber * sizeof(ModelCluster));
+        outModel->clustersNumber += models[i].clustersNumber;
+        indexedModelFree(&models[i]);
+    }
+
+    outModel->clusters = clusters;
+    outModel->vertices = vertices;
+    outModel->verticesNumber = (unsigned int)verticesNumber;
+    outModel->indices = indices;
+    return true;
+}
+
+#define SPLIT_NO_CHUNK 0xFFFFFFFFu
+
+/*
+ * Assigns triangles to chunks. Triangles of LOD 0 are taken in order,
+ * which keeps the vertex cache order, and a chunk is closed when the
+ * next triangle doesn't fit into budget vertices. Triangles of other
+ * LODs go to the chunk where their first vertex is first used.
+ * Returns the number of chunks.
+ */
+static unsigned int
+splitAssign(const IndexedModel* model, unsigned int budget,
+    uint32_t* vertexStamp, uint32_t* vertexChunk, uint32_t* triangleChunk)
+{
+    for(unsigned int i = 0; i < model->verticesNumber; ++i)
+    {
+        vertexStamp[i] = SPLIT_NO_CHUNK;
+        vertexChunk[i] = SPLIT_NO_CHUNK;
+    }
+
+    const ModelLod* lod0 = &model->lods[0];
+    uint32_t chunk = 0;
+    unsigned int chunkVerticesNumber = 0;
+    for(size_t i = 0; i < lod0->indicesNumber; i += 3)
+    {
+        const unsigned int* triangle = model->indices +
+                                       lod0->indicesOffset + i;
+        unsigned int added = clusterNewVertices(triangle, vertexStamp,
+                                                chunk);
+        if(chunkVerticesNumber + added > budget)
+        {
+            chunk++;
+            chunkVerticesNumber = 0;
+            added = clusterNewVertices(triangle, vertexStamp, chunk);
+        }
+
+        for(int k = 0; k < 3; ++k)
+        {
+            vertexStamp[triangle[k]] = chunk;
+            if(vertexChunk[triangle[k]] == SPLIT_NO_CHUNK)
+                vertexChunk[triangle[k]] = chunk;
+        }
+        chunkVerticesNumber += added;
+        triangleChunk[(lod0->indicesOffset + i) / 3] = chunk;
+    }
+
+    for(unsigned int j = 1; j < model->lodsNumber; ++j)
+    {
+        const ModelLod* lod = &model->lods[j];
+        for(size_t i = 0; i < lod->indicesNumber; i += 3)
+        {
+            uint32_t first = vertexChunk[model->indices[lod->indicesOffset +
+                                                        i]];
+            triangleChunk[(lod->indicesOffset + i) / 3] =
+                first == SPLIT_NO_CHUNK ? 0 : first;
+        }
+    }
+    return chunk + 1;
+}
+
+/*
+ * Copies triangles and vertices of every chunk to its own model,
+ * vertices are numbered in order of the first use. Fails with
+ * *outTooBig set if a chunk has more than maxVertices vertices because
+ * of vertices of coarse LODs.
+ */
+static bool
+splitBuild(const char* fname, const IndexedModel* model,
+    unsigned int maxVertices, const uint32_t* triangleChunk,
+    unsigned int chunksNumber, uint32_t* vertexStamp, uint32_t* vertexLocal,
+    IndexedModel* outChunks, bool* outTooBig)
+{
+    *outTooBig = false;
+
+    // triangles of a chunk are counted by LOD, so every LOD of the chunk
+    // stays contiguous
+    size_t* lodIndicesNumber = (size_t*)calloc(
+                        (size_t)chunksNumber*MODEL_MAX_LODS, sizeof(size_t));
+    if(lodIndicesNumber == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for chunks, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    for(unsigned int j = 0; j < model->lodsNumber; ++j)
+    {
+        const ModelLod* lod = &model->lods[j];
+        for(size_t i = 0; i < lod->indicesNumber; i += 3)
+        {
+            uint32_t chunk = triangleChunk[(lod->indicesOffset + i) / 3];
+            lodIndicesNumber[(size_t)chunk*MODEL_MAX_LODS + j] += 3;
+        }
+    }
+
+    bool res = true;
+    for(unsigned int c = 0; c < chunksNumber && res; ++c)
+    {
+        IndexedModel* chunk = &outChunks[c];
+        chunk->lodsNumber = model->lodsNumber;
+        chunk->materialIndex = model->materialIndex;
+        for(unsigned int j = 0; j < model->lodsNumber; ++j)
+        {
+            chunk->lods[j].indicesOffset = chunk->indicesNumber;
+            chunk->lods[j].indicesNumber =
+                                lodIndicesNumber[(size_t)c*MODEL_MAX_LODS + j];
+            chunk->lods[j].error = model->lods[j].error;
+            chunk->indicesNumber += chunk->lods[j].indicesNumber;
+        }
+
+        chunk->indices = (unsigned int*)malloc(
+                            sizeof(unsigned int)*chunk->indicesNumber + 1);
+        chunk->vertices = (GLfloat*)malloc(
+                            sizeof(GLfloat)*FLOATS_PER_VERTEX*maxVertices);
+        if(chunk->indices == NULL || chunk->vertices == NULL)
+        {
+            fprintf(stderr,
+                    "Failed to allocate memory for chunks, fname = %s\n",
+                    fname);
+            res = false;
+            break;
+        }
+
+        size_t indicesNumber = 0;
+        for(unsigned int j = 0; j < model->lodsNumber && res; ++j)
+        {
+            const ModelLod* lod = &model->lods[j];
+            for(size_t i = 0; i < lod->indicesNumber && res; i += 3)
+            {
+                if(triangleChunk[(lod->indicesOffset + i) / 3] != c)
+                    continue;
+
+                for(int k = 0; k < 3; ++k)
+                {
+                    unsigned int index = model->indices[lod->indicesOffset +
+                                                        i + k];
+                    if(vertexStamp[index] != c)
+                    {
+                        if(chunk->verticesNumber == maxVertices)
+                        {
+                            *outTooBig = true;
+                            res = false;
+                            break;
+                        }
+                        vertexStamp[index] = c;
+                        vertexLocal[index] = chunk->verticesNumber;
+                        memcpy(chunk->vertices +
+                               (size_t)chunk->verticesNumber*FLOATS_PER_VERTEX,
+                               model->vertices +
+                               (size_t)index*FLOATS_PER_VERTEX,
+                               sizeof(GLfloat)*FLOATS_PER_VERTEX);
+                        chunk->verticesNumber++;
+                    }
+                    chunk->indices[indicesNumber++] = vertexLocal[index];
+                }
+            }
+        }
+
+        GLfloat* vertices = (GLfloat*)realloc(chunk->vertices,
+                sizeof(GLfloat)*FLOATS_PER_VERTEX*chunk->verticesNumber + 1);
+        if(vertices != NULL)
+            chunk->vertices = vertices;
+    }
+
+    free(lodIndicesNumber);
+    if(!res)
+    {
+        for(unsigned int c = 0; c < chunksNumber; ++c)
+            indexedModelFree(&outChunks[c]);
+    }
+    return res;
+}
+
+/*
+ * Splits the model into chunks of at most maxVertices vertices, every
+ * chunk has all LODs of the model. Vertices used by several chunks are
+ * copied. Returns the chunks, the caller frees them, or NULL with
+ * *outChunksNumber set to 0 if the model can't be split.
+ */
+static IndexedModel*
+indexedModelSplit(const char* fname, const IndexedModel* model,
+    unsigned int maxVertices, unsigned int* outChunksNumber)
+{
+    *outChunksNumber = 0;
+
+    uint32_t* vertexStamp = (uint32_t*)malloc(
+                        sizeof(uint32_t)*3*((size_t)model->verticesNumber + 1));
+    uint32_t* triangleChunk = (uint32_t*)malloc(
+                        sizeof(uint32_t)*(model->indicesNumber / 3 + 1));
+    if(vertexStamp == NULL || triangleChunk == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for chunks, fname = %s\n",
+                fname);
+        free(triangleChunk);
+        free(vertexStamp);
+        return NULL;
+    }
+    uint32_t* vertexChunk = vertexStamp + model->verticesNumber + 1;
+    uint32_t* vertexLocal = vertexChunk + model->verticesNumber + 1;
+
+    // vertices of coarse LODs missing in a chunk are rare, so the budget
+    // of LOD 0 is lowered only when a chunk overflows because of them
+    IndexedModel* chunks = NULL;
+    unsigned int budget = maxVertices;
+    while(budget >= 3)
+    {
+        unsigned int chunksNumber = splitAssign(model, budget, vertexStamp,
+                                                vertexChunk, triangleChunk);
+        chunks = (IndexedModel*)calloc(chunksNumber, sizeof(IndexedModel));
+        if(chunks == NULL)
+        {
+            fprintf(stderr,
+                    "Failed to allocate memory for chunks, fname = %s\n",
+                    fname);
+            break;
+        }
+
+        for(unsigned int i = 0; i < model->verticesNumber; ++i)
+            vertexStamp[i] = SPLIT_NO_CHUNK;
+
+        bool tooBig;
+        if(splitBuild(fname, model, maxVertices, triangleChunk, chunksNumber,
+                      vertexStamp, vertexLocal, chunks, &tooBig))
+        {
+            *outChunksNumber = chunksNumber;
+            break;
+        }
+
+        free(chunks);
+        chunks = NULL;
+        if(!tooBig)
+            break;
+        budget -= budget / 8 + 1;
+    }
+
+    free(triangleChunk);
+    free(vertexStamp);
+    return chunks;
+}
+
+/*
+ * Replaces models with more than 65535 vertices by chunks that fit
+ * 16-bit indices. outModelFirst[i] is the first chunk of the model i,
+ * outModelFirst[modelsNumber] is the new number of models. Models that
+ * can't be split are kept as is and get 32-bit indices. Models are freed
+ * on failure.
+ */
+static bool
+indexedModelsSplit(const char* fname, IndexedModel** models,
+    unsigned int* modelsNumber, unsigned int* outModelFirst)
+{
+    unsigned int newModelsNumber = 0;
+    IndexedModel* newModels = NULL;
+    size_t verticesBefore = 0, verticesAfter = 0;
+    bool res = true;
+    for(unsigned int i = 0; i < *modelsNumber; ++i)
+    {
+        IndexedModel* model = &(*models)[i];
+        outModelFirst[i] = newModelsNumber;
+        verticesBefore += model->verticesNumber;
+
+        IndexedModel* chunks = model;
+        unsigned int chunksNumber = 1;
+        if(model->verticesNumber > MODEL_MAX_16BIT_VERTICES)
+        {
+            chunks = indexedModelSplit(fname, model, MODEL_MAX_16BIT_VERTICES,
+                                       &chunksNumber);
+            if(chunks == NULL)
+            {
+                fprintf(stderr,
+                        "indexedModelsSplit - fname = %s, mesh %u with %u "
+                        "vertices can't be split, it keeps 32-bit indices\n",
+                        fname, i, model->verticesNumber
+                    );
+                chunks = model;
+                chunksNumber = 1;
+            }
+        }
+
+        IndexedModel* grown = (IndexedModel*)realloc(newModels,
+                    sizeof(IndexedModel)*(newModelsNumber + chunksNumber));
+        if(grown == NULL)
+        {
+            fprintf(stderr,
+                    "Failed to allocate memory for chunks, fname = %s\n",
+                    fname);
+            if(chunks != model)
+            {
+                for(unsigned int j = 0; j < chunksNumber; ++j)
+                    indexedModelFree(&chunks[j]);
+                free(chunks);
+            }
+            res = false;
+            break;
+        }
+        newModels = grown;
+
+        unsigned int chunksVerticesNumber = 0;
+        for(unsigned int j = 0; j < chunksNumber; ++j)
+            chunksVerticesNumber += chunks[j].verticesNumber;
+        verticesAfter += chunksVerticesNumber;
+        memcpy(newModels + newModelsNumber, chunks,
+               sizeof(IndexedModel)*chunksNumber);
+        newModelsNumber += chunksNumber;
+        if(chunks != model)
+        {
+            fprintf(stderr,
+                    "indexedModelsSplit - fname = %s, mesh %u: %u vertices "
+                    "split into %u chunks with %u vertices\n",
+                    fname, i, model->verticesNumber, chunksNumber,
+                    chunksVerticesNumber
+                );
+            indexedModelFree(model);
+            free(chunks);
+        }
+        memset(model, 0, sizeof(IndexedModel));
+    }
+
+    if(!res)
+    {
+        for(unsigned int i = 0; i < *modelsNumber; ++i)
+            indexedModelFree(&(*models)[i]);
+        for(unsigned int i = 0; i < newModelsNumber; ++i)
+            indexedModelFree(&newModels[i]);
+        free(newModels);
+        return false;
+    }
+
+    if(verticesAfter != verticesBefore)
+        fprintf(stderr,
+                "indexedModelsSplit - fname = %s, %llu vertices copied "
+                "between chunks\n", fname,
+                (unsigned long long)(verticesAfter - verticesBefore)
+            );
+
+    outModelFirst[*modelsNumber] = newModelsNumber;
+    free(*models);
+    *models = newModels;
+    *modelsNumber = newModelsNumber;
+    return true;
+}
+
+/*
+ * Chooses meshes of the scene to convert, outMeshes[i] becomes submesh i.
+ * With a scene file equal meshes become one submesh and outMeshSubmesh
+ * maps every mesh of the scene to its submesh.
+ */
+static bool
+convertMeshesChoose(const char* infile, const struct aiScene* scene,
+    unsigned int meshNumber, const ConvertOptions* options,
+    unsigned int* outMeshes, unsigned int* outMeshSubmesh,
+    unsigned int* outMeshesNumber)
+{
+    if(!options->allMeshes)
+    {
+        outMeshes[0] = meshNumber;
+        *outMeshesNumber = 1;
+        return true;
+    }
+
+    for(unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+        if(importedMeshGet(infile, scene, i) == NULL)
+            return false;
+        outMeshes[i] = i;
+        outMeshSubmesh[i] = i;
+    }
+    *outMeshesNumber = scene->mNumMeshes;
+
+    if(options->sceneFile == NULL)
+        return true;
+
+    if(!importedMeshesDedup(infile, scene, outMeshSubmesh, outMeshes,
+                            outMeshesNumber))
+        return false;
+
+    if(*outMeshesNumber != scene->mNumMeshes)
+        fprintf(stderr,
+                "convertMeshesChoose - fname = %s, %u of %u meshes are "
+                "copies of others\n", infile,
+                scene->mNumMeshes - *outMeshesNumber, scene->mNumMeshes
+            );
+    return true;
+}
+
+/*
+ * Imports and converts meshes with assimp, the caller frees outModels.
+ * Nodes of the scene are put to outImported if options->sceneFile is set.
+ */
+static bool
+convertModelImport(const char* infile, unsigned int meshNumber,
+    const ConvertOptions* options, IndexedModel** outModels,
+    unsigned int* outMeshesNumber, ImportedScene* outImported)
+{
+    const struct aiScene* scene = importedSceneOpen(infile);
+    if(scene == NULL)
+        return false;
+
+    // meshes to convert, then the submesh of every mesh of the scene
+    unsigned int* meshes = (unsigned int*)malloc(
+                        sizeof(unsigned int)*2*((size_t)scene->mNumMeshes + 1));
+    if(meshes == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for meshes, fname = %s\n",
+                infile);
+        aiReleaseImport(scene);
+        return false;
+    }
+    unsigned int* meshSubmesh = meshes + scene->mNumMeshes + 1;
+
+    unsigned int meshesNumber;
+    if(!convertMeshesChoose(infile, scene, meshNumber, options, meshes,
+                            meshSubmesh, &meshesNumber))
+    {
+        free(meshes);
+        aiReleaseImport(scene);
+        return false;
+    }
+
+    IndexedModel* models = (IndexedModel*)calloc(meshesNumber + 1,
+                                                 sizeof(IndexedModel));
+    if(meshesNumber == 0 || models == NULL)
+    {
+        fprintf(stderr, "No meshes to convert, fname = %s\n", infile);
+        free(models);
+        free(meshes);
+        aiReleaseImport(scene);
+        return false;
+    }
+
+    bool res = options->sceneFile == NULL ||
+               importedSceneBuild(infile, scene, meshSubmesh, outImported);
+    for(unsigned int i = 0; i < meshesNumber && res; ++i)
+    {
+        const struct aiMesh* mesh = importedMeshGet(infile, scene,
+                                                    meshes[i]);
+        if(mesh == NULL || !convertMesh(infile, mesh, options, &models[i]))
+        {
+            for(unsigned int j = 0; j < i; ++j)
+                indexedModelFree(&models[j]);
+            res = false;
+        }
+    }
+    free(meshes);
+    aiReleaseImport(scene);
+
+    if(!res)
+    {
+        importedSceneFree(outImported);
+        free(models);
+        return false;
+    }
+
+    *outModels = models;
+    *outMeshesNumber = meshesNumber;
+    return true;
+}
+
+/*
+ * Imports OBJ and binary PLY files with the streaming importer instead
+ * of assimp. The whole file is a single mesh.
+ */
+static bool
+convertModelImportNative(const char* infile, unsigned int meshNumber,
+    const ConvertOptions* options, IndexedModel** outModels,
+    unsigned int* outMeshesNumber)
+{
+    if(meshNumber != 0 && !options->allMeshes)
+    {
+        fprintf(stderr,
+                "There is no mesh #%u in model (1 only), fname = %s\n",
+                meshNumber, infile
+            );
+        return false;
+    }
+
+    IndexedModel* models = (IndexedModel*)calloc(1, sizeof(IndexedModel));
+    if(models == NULL)
+    {
+        fprintf(stderr, "No meshes to convert, fname = %s\n", infile);
+        return false;
+    }
+
+    MeshImport mesh;
+    if(!meshImportLoad(infile, MAX_VERTICES_NUMBER, &mesh))
+    {
+        free(models);
+        return false;
+    }
+
+    if(!convertMeshImported(infile, &mesh, options, &models[0]))
+    {
+        meshImportFree(&mesh);
+        free(models);
+        return false;
+    }
+
+    *outModels = models;
+    *outMeshesNumber = 1;
+    return true;
+}
+
+/*
+ * Converts the mesh meshNumber, or every mesh of the scene to submeshes
+ * of a single file if options->allMeshes is set. Nodes of the scene are
+ * saved to options->sceneFile if it's set.
+ */
+static bool
+convertModel(const char* infile, const char* outfile, unsigned int meshNumber,
+    const ConvertOptions* options, size_t* outTrianglesNumber)
+{
+    *outTrianglesNumber = 0;
+
+    uint64_t startTimeMs = getCurrentTimeMs();
+    IndexedModel* models;
+    unsigned int meshesNumber;
+    ImportedScene imported;
+    memset(&imported, 0, sizeof(imported));
+    // scene files need nodes, only assimp imports them
+    bool res = options->sceneFile == NULL && meshImportSupported(infile) ?
+        convertModelImportNative(infile, meshNumber, options, &models,
+                                 &meshesNumber) :
+        convertModelImport(infile, meshNumber, options, &models,
+                           &meshesNumber, &imported);
+    if(!res)
+        return false;
+
+    // the first submesh of every converted mesh, since they can be split
+    unsigned int* meshFirstSubmesh = (unsigned int*)malloc(
+                            sizeof(unsigned int)*((size_t)meshesNumber + 1));
+    if(meshFirstSubmesh == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for submeshes, "
+                "fname = %s\n", infile);
+        for(unsigned int i = 0; i < meshesNumber; ++i)
+            indexedModelFree(&models[i]);
+        free(models);
+        importedSceneFree(&imported);
+        return false;
+    }
+
+    unsigned int submeshesNumber = meshesNumber;
+    if(options->indexPolicy == MODEL_INDICES_PREFER_16BIT)
+        res = indexedModelsSplit(infile, &models, &submeshesNumber,
+                                 meshFirstSubmesh);
+    else
+    {
+        for(unsigned int i = 0; i <= meshesNumber; ++i)
+            meshFirstSubmesh[i] = i;
+    }
+
+    // after splitting, so clusters never cross submeshes
+    for(unsigned int i = 0; i < submeshesNumber && res &&
+                            options->buildClusters; ++i)
+    {
+        if(!importedModelBuildClusters(infile, &models[i]))
+        {
+            for(unsigned int j = 0; j < submeshesNumber; ++j)
+                indexedModelFree(&models[j]);
+            res = false;
+        }
+    }
+
+    ModelSubmesh* submeshes = NULL;
+    if(res)
+    {
+        submeshes = (ModelSubmesh*)calloc(submeshesNumber + 1,
+                                          sizeof(ModelSubmesh));
+        if(submeshes == NULL)
+        {
+            fprintf(stderr,
+                    "Failed to allocate memory for submeshes, fname = %s\n",
+                    infile);
+            for(unsigned int i = 0; i < submeshesNumber; ++i)
+                indexedModelFree(&models[i]);
+            res = false;
+        }
+    }
+
+    if(!res)
+    {
+        importedSceneFree(&imported);
+        free(meshFirstSubmesh);
+        free(models);
+        return false;
+    }
+
+    IndexedModel model;
+    res = indexedModelsMerge(infile, models, submeshesNumber, &model,
+                             submeshes);
+    free(models);
+    if(res && options->sceneFile != NULL)
+    {
+        res = importedSceneSplit(infile, &imported, meshFirstSubmesh);
+        if(!res)
+            indexedModelFree(&model);
+    }
+    free(meshFirstSubmesh);
+    if(!res)
+    {
+        importedSceneFree(&imported);
+        free(submeshes);
+        return false;
+    }
+
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+        submeshes[i].indexSize = modelIndexSize(submeshes[i].verticesNumber,
+                                                options->indexPolicy);
+
+    uint64_t importedTimeMs = getCurrentTimeMs();
+    fprintf(stderr, "convertModel - fname = %s, import of %u meshes took "
+            "%u ms\n", infile, meshesNumber,
+            (unsigned int)(importedTimeMs - startTimeMs));
+
+    ModelVertexFormat format;
+    quantizeVertexFormatInit(&format, options->positionFormat,
+                             options->normalFormat, options->uvFormat,
+                             model.vertices, model.verticesNumber);
+
+    if(!importedModelSave(outfile, &model, submeshes, submeshesNumber,
+                          &format, options->compress))
+    {
+        fprintf(stderr, "importedModelSave failed\n");
+        importedSceneFree(&imported);
+        free(submeshes);
+        indexedModelFree(&model);
+        return false;
+    }
+
+    if(options->sceneFile != NULL)
+    {
+        fprintf(stderr,
+                "convertModel - fname = %s, %u nodes, %u mesh references\n",
+                options->sceneFile, imported.nodesNumber,
+                imported.meshesNumber
+            );
+        if(!sceneSave(options->sceneFile, outfile, submeshesNumber,
+                      imported.nodes, imported.nodesNumber, imported.meshes,
+                      imported.meshesNumber, imported.names,
+                      imported.namesSize))
+        {
+            importedSceneFree(&imported);
+            free(submeshes);
+            indexedModelFree(&model);
+            return false;
+        }
+        importedSceneFree(&imported);
+    }
+
+    fprintf(stderr, "convertModel - fname = %s, save took %u ms\n",
+            outfile, (unsigned int)(getCurrentTimeMs() - importedTimeMs));
+
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+        *outTrianglesNumber += submeshes[i].lods[0].indicesNumber / 3;
+    free(submeshes);
+    indexedModelFree(&model);
+    return true;
+}
+
+/*
+ * The key covers the input file, the mesh number and every option that
+ * changes the output, so any change of them is a miss.
+ */
+static bool
+convertCacheKey(const char* infile, unsigned int meshNumber,
+    const ConvertOptions* options, CacheKey* outKey)
+{
+    uint32_t values[] = {
+        CONVERT_CACHE_VERSION,
+        options->allMeshes ? 0 : meshNumber,
+        options->direct,
+        options->optimizeVertexCache,
+        options->optimizeVertexFetch,
+        options->positionFormat,
+        options->normalFormat,
+        options->uvFormat,
+        options->compress,
+        options->allMeshes,
+        options->indexPolicy,
+        options->buildClusters,
+        options->lodRatiosNumber
+    };
+
+    cacheKeyInit(outKey);
+    cacheKeyAdd(outKey, values, sizeof(values));
+    cacheKeyAdd(outKey, options->lodRatios,
+                sizeof(float)*options->lodRatiosNumber);
+    cacheKeyAdd(outKey, &options->overdrawThreshold,
+                sizeof(options->overdrawThreshold));
+    return cacheKeyAddFile(outKey, infile);
+}
+
+/*
+ * Copies the output from options->cacheDir if the same conversion was
+ * done before, otherwise converts the model and stores the output
+ * there. Scene files refer to the output file by name, so conversions
+ * with options->sceneFile are not cached.
+ */
+static bool
+convertModelCached(const char* infile, const char* outfile,
+    unsigned int meshNumber, const ConvertOptions* options,
+    size_t* outTrianglesNumber, bool* outCacheHit)
+{
+    *outCacheHit = false;
+
+    CacheKey key;
+    if(options->cacheDir == NULL || options->sceneFile != NULL ||
+       !convertCacheKey(infile, meshNumber, options, &key))
+        return convertModel(infile, outfile, meshNumber, options,
+                            outTrianglesNumber);
+
+    uint64_t trianglesNumber;
+    if(cacheLookup(options->cacheDir, &key, outfile, &trianglesNumber))
+    {
+        fprintf(stderr, "convertModelCached - fname = %s, cache hit\n",
+                infile);
+        *outTrianglesNumber = (size_t)trianglesNumber;
+        *outCacheHit = true;
+        return true;
+    }
+
+    if(!convertModel(infile, outfile, meshNumber, options,
+                     outTrianglesNumber))
+        return false;
+
+    // the output is fine even if it can't be cached
+    cacheStore(options->cacheDir, &key, outfile,
+               (uint64_t)*outTrianglesNumber);
+    return true;
+}
+
+static void
+convertWorker(void* arg)
+{
+    ConvertQueue* queue = (ConvertQueue*)arg;
+
+    for(;;)
+    {
+        mutexLock(queue->mutex);
+        size_t jobIdx = queue->nextJob;
+        if(jobIdx < queue->jobsNumber)
+            queue->nextJob++;
+        mutexUnlock(queue->mutex);
+
+        if(jobIdx >= queue->jobsNumber)
+            break;
+
+        ConvertJob* job = &queue->jobs[jobIdx];
+        struct stat st;
+        if(stat(job->infile, &st) == 0)
+            job->inputSize = (uint64_t)st.st_size;
+
+        uint64_t startTimeUs = getCurrentTimeUs();
+        job->succeeded = convertModelCached(job->infile, job->outfile,
+                                            job->meshNumber, queue->options,
+                                            &job->trianglesNumber,
+                                            &job->cacheHit);
+        job->timeUs = getCurrentTimeUs() - startTimeUs;
+    }
+}
+
+/*
+ * Manifest format: one "<input file> <output file> [mesh number]" per
+ * line, file names can't contain spaces. Empty lines and lines starting
+ * with '#' are ignored.
+ */
+static ConvertJob*
+batchManifestRead(const char* fname, size_t* outJobsNumber)
+{
+    *outJobsNumber = 0;
+
+    FILE* fd = fopen(fname, "r");
+    if(fd == NULL)
+    {
+        fprintf(stderr, "Failed to open manifest %s\n", fname);
+        return NULL;
+    }
+
+    size_t jobsNumber = 0;
+    size_t jobsAllocated = 64;
+    ConvertJob* jobs = (ConvertJob*)malloc(sizeof(ConvertJob)*jobsAllocated);
+    if(jobs == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory for batch jobs\n");
+        fclose(fd);
+        return NULL;
+    }
+
+    char line[2*FILENAME_MAX + 64];
+    unsigned int lineNumber = 0;
+    while(fgets(line, sizeof(line), fd) != NULL)
+    {
+        lineNumber++;
+
+        char* ptr = line;
+        while(*ptr == ' ' || *ptr == '\t')
+            ptr++;
+        if(*ptr == '#' || *ptr == '\r' || *ptr == '\n' || *ptr == '\0')
+            continue;
+
+        if(jobsNumber == jobsAllocated)
+        {
+            jobsAllocated *= 2;
+            ConvertJob* newJobs = (ConvertJob*)realloc(jobs,
+                                    sizeof(ConvertJob)*jobsAllocated);
+            if(newJobs == NULL)
+            {
+                fprintf(stderr, "Failed to allocate memory for batch jobs\n");
+                free(jobs);
+                fclose(fd);
+                return NULL;
+            }
+            jobs = newJobs;
+        }
+
+        ConvertJob* job = &jobs[jobsNumber];
+        memset(job, 0, sizeof(ConvertJob));
+
+        char infile[FILENAME_MAX], outfile[FILENAME_MAX];
+        char format[32];
+        snprintf(format, sizeof(format), "%%%ds %%%ds %%u",
+                 FILENAME_MAX - 1, FILENAME_MAX - 1);
+        if(sscanf(ptr, format, infile, outfile, &job->meshNumber) < 2)
+        {
+            fprintf(stderr, "Invalid line %u in manifest %s\n",
+                    lineNumber, fname);
+            free(jobs);
+            fclose(fd);
+            return NULL;
+        }
+        strcpy(job->infile, infile);
+        strcpy(job->outfile, outfile);
+        jobsNumber++;
+    }
+
+    fclose(fd);
+    *outJobsNumber = jobsNumber;
+    return jobs;
+}
+
+static int
+batchConvert(const char* manifest, unsigned int threadsNumber,
+    const ConvertOptions* options)
+{
+    ConvertQueue queue;
+    queue.options = options;
+    queue.nextJob = 0;
+    queue.jobs = batchManifestRead(manifest, &queue.jobsNumber);
+    if(queue.jobs == NULL)
+        return 1;
+
+    queue.mutex = mutexCreate();
+    if(queue.mutex == NULL)
+    {
+        free(queue.jobs);
+        return 1;
+    }
+
+    if(threadsNumber > queue.jobsNumber)
+        threadsNumber = (unsigned int)queue.jobsNumber;
+    if(threadsNumber == 0)
+        threadsNumber = 1;
+
+    printf("Batch: %s, %u files, %u threads\n", manifest,
+           (unsigned int)queue.jobsNumber, threadsNumber);
+
+    uint64_t startTimeUs = getCurrentTimeUs();
+
+    Thread** threads = (Thread**)malloc(sizeof(Thread*)*threadsNumber);
+    unsigned int threadsStarted = 0;
+    if(threads != NULL)
+    {
+        for(; threadsStarted < threadsNumber; ++threadsStarted)
+        {
+            threads[threadsStarted] = threadCreate(convertWorker, &queue);
+            if(threads[threadsStarted] == NULL)
+                break;
+        }
+    }
+
+    // if no thread could be started do all the work here
+    if(threadsStarted == 0)
+        convertWorker(&queue);
+
+    for(unsigned int i = 0; i < threadsStarted; ++i)
+        threadJoin(threads[i]);
+    free(threads);
+
+    double totalTimeSec = (double)(getCurrentTimeUs() - startTimeUs) / 1e6;
+
+    // report in manifest order, whatever order the jobs finished in
+    size_t failedNumber = 0;
+    size_t cacheHitsNumber = 0;
+    size_t totalTriangles = 0;
+    uint64_t totalInputSize = 0;
+    for(size_t i = 0; i < queue.jobsNumber; ++i)
+    {
+        const ConvertJob* job = &queue.jobs[i];
+        if(!job->succeeded)
+        {
+            failedNumber++;
+            printf("  %s -> %s [%u]: FAILED\n", job->infile, job->outfile,
+                   job->meshNumber);
+            continue;
+        }
+
+        double timeSec = (double)job->timeUs / 1e6;
+        if(timeSec <= 0.0)
+            timeSec = 1e-6;
+        double inputMb = (double)job->inputSize / (1024.0*1024.0);
+        printf("  %s -> %s [%u]: %llu triangles, %.2f MB, %.1f ms, "
+               "%.0f triangles/s, %.1f MB/s%s\n",
+               job->infile, job->outfile, job->meshNumber,
+               (unsigned long long)job->trianglesNumber, inputMb,
+               timeSec * 1000.0, (double)job->trianglesNumber / timeSec,
+               inputMb / timeSec, job->cacheHit ? ", cached" : "");
+        if(job->cacheHit)
+            cacheHitsNumber++;
+        totalTriangles += job->trianglesNumber;
+        totalInputSize += job->inputSize;
+    }
+
+    if(totalTimeSec <= 0.0)
+        totalTimeSec = 1e-6;
+    double totalInputMb = (double)totalInputSize / (1024.0*1024.0);
+    printf("Total: %u files, %u failed, %llu triangles, %.2f MB in %.1f ms: "
+           "%.0f triangles/s, %.1f MB/s\n",
+           (unsigned int)queue.jobsNumber, (unsigned int)failedNumber,
+           (unsigned long long)totalTriangles, totalInputMb,
+           totalTimeSec * 1000.0, (double)totalTriangles / totalTimeSec,
+           totalInputMb / totalTimeSec);
+    if(options->cacheDir != NULL)
+        printf("Cache: %s, %u hits, %u misses, hit rate %.1f%%\n",
+               options->cacheDir, (unsigned int)cacheHitsNumber,
+               (unsigned int)(queue.jobsNumber - cacheHitsNumber),
+               queue.jobsNumber == 0 ? 0.0 :
+                    (double)cacheHitsNumber * 100.0 /
+                    (double)queue.jobsNumber);
+
+    mutexDestroy(queue.mutex);
+    free(queue.jobs);
+    return failedNumber == 0 ? 0 : 3;
+}
+
+static bool
+lodRatiosParse(const char* str, ConvertOptions* options)
+{
+    options->lodRatiosNumber = 0;
+    while(*str != '\0')
+    {
+        char* end;
+        float ratio = strtof(str, &end);
+        if(end == str || ratio <= 0.0f || ratio >= 1.0f)
+        {
+            fprintf(stderr, "Invalid LOD ratio: %s\n", str);
+            return false;
+        }
+
+        if(options->lodRatiosNumber == MODEL_MAX_LODS - 1)
+        {
+            fprintf(stderr, "Too many LODs, at most %d are supported\n",
+                    MODEL_MAX_LODS - 1);
+            return false;
+        }
+
+        if(*end != ',' && *end != '\0')
+        {
+            fprintf(stderr, "Invalid LOD ratio: %s\n", str);
+            return false;
+        }
+
+        options->lodRatios[options->lodRatiosNumber++] = ratio;
+        str = (*end == ',') ? end + 1 : end;
+    }
+
+    return true;
+}
+
+static void
+printUsage()
+{
+    printf("Usage: emdconv [options] <input file> <output file> "
+           "[mesh number]\n");
+    printf("       emdconv [options] --batch <manifest> [-j <threads>]\n");
+    printf("OBJ and binary PLY files are read by a built-in streaming "
+           "importer unless\n");
+    printf("--scene is used, other formats are imported with assimp.\n");
+    printf("  --direct    save vertices and faces as imported, "
+           "without welding and\n");
+    printf("              removal of degenerate and duplicate "
+           "triangles\n");
+    printf("  --vcache    reorder triangles for post-transform "
+           "vertex cache\n");
+    printf("  --overdraw  sort clusters of triangles to reduce overdraw "
+           "after --vcache,\n");
+    printf("              which it implies, ACMR may grow by the given "
+           "factor, e.g. 1.05\n");
+    printf("  --vfetch    reorder vertices in order of first use\n");
+    printf("  --lods      comma separated triangle ratios of simplified "
+           "LODs, e.g. 0.5,0.25\n");
+    printf("  --position  store positions as half or unorm16\n");
+    printf("  --normal    store normals as oct16 or oct8\n");
+    printf("  --uv        store UVs as unorm16\n");
+    printf("  --compress  compress vertices and indices\n");
+    printf("  --indices   index size policy: never-8-bit, allow-32 or "
+           "prefer-16 (default),\n");
+    printf("              which splits meshes over 65535 vertices\n");
+    printf("  --clusters  split LODs into clusters of up to %d vertices "
+           "and %d triangles\n", CLUSTER_MAX_VERTICES, CLUSTER_MAX_TRIANGLES);
+    printf("              for culling on the CPU\n");
+    printf("  --all       save every mesh of the scene as a submesh, "
+           "mesh number is ignored\n");
+    printf("  --scene     also save nodes of the scene to the given file, "
+           "implies --all\n");
+    printf("  --cache     directory to reuse outputs of conversions "
+           "with the same input\n");
+    printf("              and options from, can be shared by "
+           "several processes\n");
+    printf("  --batch     convert every \"<input> <output> [mesh number]\" "
+           "line of manifest\n");
+    printf("  -j          number of threads for --batch, default is 1\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+    ConvertOptions options;
+    memset(&options, 0, sizeof(options));
+    options.indexPolicy = MODEL_INDICES_PREFER_16BIT;
+    const char* manifest = NULL;
+    unsigned int threadsNumber = 1;
+
+    int argIdx = 1;
+    while(argIdx < argc && argv[argIdx][0] == '-')
+    {
+        if(strcmp(argv[argIdx], "--direct") == 0)
+            options.direct = true;
+        else if(strcmp(argv[argIdx], "--vcache") == 0)
+            options.optimizeVertexCache = true;
+        else if(strcmp(argv[argIdx], "--overdraw") == 0 && argIdx + 1 < argc)
+        {
+            char* end;
+            options.overdrawThreshold = strtof(argv[++argIdx], &end);
+            if(*end != '\0' || !(options.overdrawThreshold >= 1.0f))
+            {
+                fprintf(stderr, "Invalid overdraw threshold: %s\n",
+                        argv[argIdx]);
+                printUsage();
+                return 1;
+            }
+            options.optimizeVertexCache = true;
+        }
+        else if(strcmp(argv[argIdx], "--vfetch") == 0)
+            options.optimizeVertexFetch = true;
+        else if(strcmp(argv[argIdx], "--compress") == 0)
+            options.compress = true;
+        else if(strcmp(argv[argIdx], "--all") == 0)
+            options.allMeshes = true;
+        else if(strcmp(argv[argIdx], "--clusters") == 0)
+            options.buildClusters = true;
+        else if(strcmp(argv[argIdx], "--scene") == 0 && argIdx + 1 < argc)
+        {
+            options.sceneFile = argv[++argIdx];
+            options.allMeshes = true;
+        }
+        else if(strcmp(argv[argIdx], "--lods") == 0 && argIdx + 1 < argc)
+        {
+            if(!lodRatiosParse(argv[++argIdx], &options))
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[argIdx], "--position") == 0 && argIdx + 1 < argc)
+        {
+            argIdx++;
+            if(strcmp(argv[argIdx], "half") == 0)
+                options.positionFormat = MODEL_POSITION_HALF3;
+            else if(strcmp(argv[argIdx], "unorm16") == 0)
+                options.positionFormat = MODEL_POSITION_UNORM16;
+            else
+            {
+                fprintf(stderr, "Unknown position format %s\n", argv[argIdx]);
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[argIdx], "--normal") == 0 && argIdx + 1 < argc)
+        {
+            argIdx++;
+            if(strcmp(argv[argIdx], "oct16") == 0)
+                options.normalFormat = MODEL_NORMAL_OCT16;
+            else if(strcmp(argv[argIdx], "oct8") == 0)
+                options.normalFormat = MODEL_NORMAL_OCT8;
+            else
+            {
+                fprintf(stderr, "Unknown normal format %s\n", argv[argIdx]);
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[argIdx], "--uv") == 0 && argIdx + 1 < argc)
+        {
+            argIdx++;
+            if(strcmp(argv[argIdx], "unorm16") == 0)
+                options.uvFormat = MODEL_UV_UNORM16;
+            else
+            {
+                fprintf(stderr, "Unknown UV format %s\n", argv[argIdx]);
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[argIdx], "--indices") == 0 && argIdx + 1 < argc)
+        {
+            argIdx++;
+            if(strcmp(argv[argIdx], "never-8-bit") == 0)
+                options.indexPolicy = MODEL_INDICES_NEVER_8BIT;
+            else if(strcmp(argv[argIdx], "prefer-16") == 0)
+                options.indexPolicy = MODEL_INDICES_PREFER_16BIT;
+            else if(strcmp(argv[argIdx], "allow-32") == 0)
+                options.indexPolicy = MODEL_INDICES_ALLOW_32BIT;
+            else
+            {
+                fprintf(stderr, "Unknown index policy %s\n", argv[argIdx]);
+                printUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[argIdx], "--cache") == 0 && argIdx + 1 < argc)
+            options.cacheDir = argv[++argIdx];
+        else if(strcmp(argv[argIdx], "--batch") == 0 && argIdx + 1 < argc)
+            manifest = argv[++argIdx];
+        else if(strcmp(argv[argIdx], "-j") == 0 && argIdx + 1 < argc)
+            threadsNumber = (unsigned int) atoi(argv[++argIdx]);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[argIdx]);
+            printUsage();
+            return 1;
+        }
+        argIdx++;
+    }
+
+    if(manifest != NULL)
+    {
+        if(options.sceneFile != NULL)
+        {
+            fprintf(stderr, "--scene can't be used with --batch\n");
+            printUsage();
+            return 1;
+        }
+        return batchConvert(manifest, threadsNumber, &options);
+    }
+
+    if(argc - argIdx < 2) {
+        printUsage();
+        return 1;
+    }
+
+    char* infile = argv[argIdx];
+    char* outfile = argv[argIdx + 1];
+
+    unsigned int meshNumber = 0;
+    if(argc - argIdx > 2) {
+        meshNumber = (unsigned int) atoi(argv[argIdx + 2]);
+    }
+
+    printf("Infile: %s\n", infile);
+    printf("Outfile: %s\n", outfile);
+    if(options.allMeshes)
+        printf("Mesh number: all\n");
+    else
+        printf("Mesh number: %u\n", meshNumber);
+
+    size_t trianglesNumber;
+    bool cacheHit;
+    if(!convertModelCached(infile, outfile, meshNumber, &options,
+                           &trianglesNumber, &cacheHit))
+        return 3;
+
+    if(options.cacheDir != NULL)
+        printf("Cache: %s\n", cacheHit ? "hit" : "miss");
+
+    printf("Done!\n");
     return 0;
 }
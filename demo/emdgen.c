@@ -0,0 +1,573 @@
+#include <GLXW/glxw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "utils/utils.h"
+#include "utils/models.h"
+#include "utils/bounds.h"
+
+/*
+ * Generates meshes of any size for benchmarks of emdconv and of model
+ * loading. Every shape is a grid of quads in (u, v) mapped onto the
+ * surface, so the number of triangles is chosen by the grid size.
+ */
+
+// 3 per position + 3 per normal + UV, the same as in emdconv
+#define FLOATS_PER_VERTEX (3 + 3 + 2)
+
+// the largest 32-bit index is reserved like in weldVertices, a triangle
+// soup has as many vertices as indices
+#define MAX_VERTICES_NUMBER 0xFFFFFFFEu
+#define MAX_TRIANGLES_NUMBER (MAX_VERTICES_NUMBER / 3)
+
+#define GEN_PI 3.14159265358979323846
+
+// radii of the torus
+#define GEN_TORUS_MAJOR 1.0
+#define GEN_TORUS_MINOR 0.4
+
+// octaves of the terrain noise and the height of the terrain
+#define GEN_TERRAIN_OCTAVES 6
+#define GEN_TERRAIN_HEIGHT 0.25
+
+enum
+{
+    GEN_SHAPE_SPHERE,
+    GEN_SHAPE_TORUS,
+    GEN_SHAPE_GRID,
+    GEN_SHAPE_TERRAIN,
+    GEN_SHAPES_NUMBER
+};
+
+static const char* const genShapeNames[GEN_SHAPES_NUMBER] = {
+    "sphere", "torus", "grid", "terrain"
+};
+
+// columns per row of the grid, so that quads are roughly square
+static const double genShapeAspects[GEN_SHAPES_NUMBER] = {
+    2.0, GEN_TORUS_MAJOR / GEN_TORUS_MINOR, 1.0, 1.0
+};
+
+typedef struct
+{
+    unsigned int shape;
+    unsigned int seed;
+    bool soup;
+    bool compress;
+} GenOptions;
+
+typedef struct
+{
+    GLfloat* vertices;
+    unsigned int verticesNumber;
+    unsigned int* indices;
+    size_t indicesNumber;
+} GenMesh;
+
+static uint32_t
+genHash(int32_t x, int32_t y, uint32_t seed)
+{
+    uint32_t h = (uint32_t)x * 0x8DA6B343u ^ (uint32_t)y * 0xD8163841u ^
+                 seed * 0xCB1AB31Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// value noise in [0, 1] with smooth interpolation between lattice points
+static double
+genValueNoise(double x, double y, uint32_t seed)
+{
+    double cellX = floor(x), cellY = floor(y);
+    double fx = x - cellX, fy = y - cellY;
+    int32_t ix = (int32_t)cellX, iy = (int32_t)cellY;
+
+    double v00 = (double)genHash(ix, iy, seed) / 4294967295.0;
+    double v10 = (double)genHash(ix + 1, iy, seed) / 4294967295.0;
+    double v01 = (double)genHash(ix, iy + 1, seed) / 4294967295.0;
+    double v11 = (double)genHash(ix + 1, iy + 1, seed) / 4294967295.0;
+
+    double sx = fx*fx*(3.0 - 2.0*fx);
+    double sy = fy*fy*(3.0 - 2.0*fy);
+    double top = v00 + (v10 - v00)*sx;
+    double bottom = v01 + (v11 - v01)*sx;
+    return top + (bottom - top)*sy;
+}
+
+// fractal noise, x and y are in [-1, 1]
+static double
+genTerrainHeight(double x, double y, uint32_t seed)
+{
+    double height = 0.0, amplitude = 0.5, frequency = 4.0;
+    for(unsigned int i = 0; i < GEN_TERRAIN_OCTAVES; ++i)
+    {
+        height += amplitude * genValueNoise(x*frequency, y*frequency,
+                                            seed + i);
+        amplitude *= 0.5;
+        frequency *= 2.0;
+    }
+    return (height - 0.5) * GEN_TERRAIN_HEIGHT * 2.0;
+}
+
+/*
+ * Position and normal of the point (u, v) of the shape, both are in
+ * [0, 1]. The surface is counter-clockwise when u grows to the right
+ * and v grows up as seen from outside.
+ */
+static void
+genShapePoint(unsigned int shape, double u, double v, uint32_t seed,
+    double step, GLfloat* outVertex)
+{
+    double pos[3], normal[3];
+    if(shape == GEN_SHAPE_SPHERE)
+    {
+        // from the south pole to the north one
+        double theta = u * 2.0 * GEN_PI;
+        double phi = (1.0 - v) * GEN_PI;
+        normal[0] = sin(phi) * cos(theta);
+        normal[1] = cos(phi);
+        normal[2] = -sin(phi) * sin(theta);
+        memcpy(pos, normal, sizeof(pos));
+    }
+    else if(shape == GEN_SHAPE_TORUS)
+    {
+        double theta = u * 2.0 * GEN_PI;
+        double phi = v * 2.0 * GEN_PI;
+        normal[0] = cos(phi) * cos(theta);
+        normal[1] = sin(phi);
+        normal[2] = -cos(phi) * sin(theta);
+        pos[0] = (GEN_TORUS_MAJOR + GEN_TORUS_MINOR*cos(phi)) * cos(theta);
+        pos[1] = GEN_TORUS_MINOR * sin(phi);
+        pos[2] = -(GEN_TORUS_MAJOR + GEN_TORUS_MINOR*cos(phi)) * sin(theta);
+    }
+    else
+    {
+        // the XZ plane facing up, v grows towards -Z
+        double x = u*2.0 - 1.0, z = 1.0 - v*2.0;
+        pos[0] = x;
+        pos[1] = 0.0;
+        pos[2] = z;
+        normal[0] = 0.0;
+        normal[1] = 1.0;
+        normal[2] = 0.0;
+
+        if(shape == GEN_SHAPE_TERRAIN)
+        {
+            // central differences one grid step away
+            pos[1] = genTerrainHeight(x, z, seed);
+            double dx = genTerrainHeight(x + step, z, seed) -
+                        genTerrainHeight(x - step, z, seed);
+            double dz = genTerrainHeight(x, z + step, seed) -
+                        genTerrainHeight(x, z - step, seed);
+            normal[0] = -dx;
+            normal[1] = 2.0*step;
+            normal[2] = -dz;
+            double length = sqrt(normal[0]*normal[0] + normal[1]*normal[1] +
+                                 normal[2]*normal[2]);
+            for(int k = 0; k < 3; ++k)
+                normal[k] /= length;
+        }
+    }
+
+    for(int k = 0; k < 3; ++k)
+    {
+        outVertex[k] = (GLfloat)pos[k];
+        outVertex[3 + k] = (GLfloat)normal[k];
+    }
+    outVertex[6] = (GLfloat)u;
+    outVertex[7] = (GLfloat)(1.0 - v);
+}
+
+/*
+ * Chooses the grid size for about trianglesNumber triangles. The rows
+ * at the poles of the sphere have one triangle per quad.
+ */
+static void
+genGridSize(unsigned int shape, uint64_t trianglesNumber,
+    unsigned int* outColumns, unsigned int* outRows)
+{
+    double aspect = genShapeAspects[shape];
+    double rows = sqrt((double)trianglesNumber / (2.0 * aspect));
+    unsigned int minRows = (shape == GEN_SHAPE_SPHERE) ? 2 : 1;
+    if(rows < (double)minRows)
+        rows = (double)minRows;
+    *outRows = (unsigned int)(rows + 0.5);
+
+    uint64_t trianglesPerColumn = 2*(uint64_t)(*outRows) -
+                                  (shape == GEN_SHAPE_SPHERE ? 2 : 0);
+    uint64_t columns = (trianglesNumber + trianglesPerColumn/2) /
+                       trianglesPerColumn;
+    *outColumns = columns < 3 ? 3 : (unsigned int)columns;
+}
+
+static bool
+genMeshCreate(const GenOptions* options, uint64_t trianglesNumber,
+    GenMesh* outMesh)
+{
+    memset(outMesh, 0, sizeof(GenMesh));
+
+    unsigned int columns, rows;
+    genGridSize(options->shape, trianglesNumber, &columns, &rows);
+
+    size_t verticesNumber = ((size_t)columns + 1) * ((size_t)rows + 1);
+    size_t indicesNumber = (size_t)columns * rows * 6;
+    if(options->shape == GEN_SHAPE_SPHERE)
+        indicesNumber -= (size_t)columns * 6;
+
+    // there are always less vertices than indices
+    if(indicesNumber > MAX_VERTICES_NUMBER)
+    {
+        fprintf(stderr, "genMeshCreate - too many triangles: %llu\n",
+                (unsigned long long)(indicesNumber / 3));
+        return false;
+    }
+
+    GLfloat* vertices = (GLfloat*)malloc(
+                            verticesNumber * FLOATS_PER_VERTEX *
+                            sizeof(GLfloat)
+                        );
+    unsigned int* indices = (unsigned int*)malloc(
+                            indicesNumber * sizeof(unsigned int)
+                        );
+    if(vertices == NULL || indices == NULL)
+    {
+        fprintf(stderr,
+                "genMeshCreate - failed to allocate memory for %llu "
+                "vertices and %llu indices\n",
+                (unsigned long long)verticesNumber,
+                (unsigned long long)indicesNumber
+            );
+        free(indices);
+        free(vertices);
+        return false;
+    }
+
+    double step = 2.0 / (double)columns;
+    GLfloat* vertex = vertices;
+    for(unsigned int j = 0; j <= rows; ++j)
+    {
+        for(unsigned int i = 0; i <= columns; ++i)
+        {
+            genShapePoint(options->shape, (double)i / (double)columns,
+                          (double)j / (double)rows, options->seed, step,
+                          vertex);
+            vertex += FLOATS_PER_VERTEX;
+        }
+    }
+
+    // a quad is split by its diagonal from the bottom left corner,
+    // the sphere skips triangles that would be degenerate at the poles
+    size_t index = 0;
+    for(unsigned int j = 0; j < rows; ++j)
+    {
+        bool southPole = options->shape == GEN_SHAPE_SPHERE && j == 0;
+        bool northPole = options->shape == GEN_SHAPE_SPHERE &&
+                         j == rows - 1;
+        for(unsigned int i = 0; i < columns; ++i)
+        {
+            unsigned int bottomLeft = j*(columns + 1) + i;
+            unsigned int bottomRight = bottomLeft + 1;
+            unsigned int topLeft = bottomLeft + columns + 1;
+            unsigned int topRight = topLeft + 1;
+
+            if(!northPole)
+            {
+                indices[index++] = bottomLeft;
+                indices[index++] = topRight;
+                indices[index++] = topLeft;
+            }
+            if(!southPole)
+            {
+                indices[index++] = bottomLeft;
+                indices[index++] = bottomRight;
+                indices[index++] = topRight;
+            }
+        }
+    }
+
+    outMesh->vertices = vertices;
+    outMesh->verticesNumber = (unsigned int)verticesNumber;
+    outMesh->indices = indices;
+    outMesh->indicesNumber = index;
+    return true;
+}
+
+static void
+genMeshFree(GenMesh* mesh)
+{
+    free(mesh->indices);
+    free(mesh->vertices);
+    memset(mesh, 0, sizeof(GenMesh));
+}
+
+// every triangle gets its own 3 vertices, like before welding
+static bool
+genMeshUnweld(GenMesh* mesh)
+{
+    GLfloat* vertices = (GLfloat*)malloc(
+                            mesh->indicesNumber * FLOATS_PER_VERTEX *
+                            sizeof(GLfloat)
+                        );
+    if(vertices == NULL)
+    {
+        fprintf(stderr,
+                "genMeshUnweld - failed to allocate memory for %llu "
+                "vertices\n", (unsigned long long)mesh->indicesNumber);
+        return false;
+    }
+
+    for(size_t i = 0; i < mesh->indicesNumber; ++i)
+    {
+        memcpy(vertices + i*FLOATS_PER_VERTEX,
+               mesh->vertices + (size_t)mesh->indices[i]*FLOATS_PER_VERTEX,
+               sizeof(GLfloat) * FLOATS_PER_VERTEX);
+        mesh->indices[i] = (unsigned int)i;
+    }
+
+    free(mesh->vertices);
+    mesh->vertices = vertices;
+    mesh->verticesNumber = (unsigned int)mesh->indicesNumber;
+    return true;
+}
+
+static bool
+genSaveEmd(const char* fname, const GenMesh* mesh, bool compress)
+{
+    ModelBounds bounds;
+    if(!boundsCompute(mesh->vertices, mesh->verticesNumber,
+                      FLOATS_PER_VERTEX, NULL, 0, &bounds))
+        return false;
+
+    ModelSubmesh submesh;
+    memset(&submesh, 0, sizeof(submesh));
+    submesh.verticesNumber = mesh->verticesNumber;
+    submesh.indicesNumber = mesh->indicesNumber;
+    submesh.lodsNumber = 1;
+    submesh.lods[0].indicesNumber = mesh->indicesNumber;
+    submesh.lods[0].bounds = bounds;
+    submesh.bounds = bounds;
+
+    return modelSave(fname, mesh->vertices,
+                     (size_t)mesh->verticesNumber * FLOATS_PER_VERTEX *
+                     sizeof(GLfloat),
+                     mesh->indices, &submesh, 1, NULL, 0, NULL, &bounds,
+                     compress);
+}
+
+/*
+ * Binary PLY in the byte order of this machine, with the same vertex
+ * properties the streaming importer of emdconv reads. UVs are flipped
+ * back the way importers expect them.
+ */
+static bool
+genSavePly(const char* fname, const GenMesh* mesh)
+{
+    FILE* fd = fopen(fname, "wb");
+    if(fd == NULL)
+    {
+        fprintf(stderr, "genSavePly - failed to open file, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    const uint16_t byteOrderMark = 1;
+    bool littleEndian = *(const unsigned char*)&byteOrderMark == 1;
+    bool res = fprintf(fd,
+                       "ply\n"
+                       "format %s 1.0\n"
+                       "comment generated by emdgen\n"
+                       "element vertex %u\n"
+                       "property float x\n"
+                       "property float y\n"
+                       "property float z\n"
+                       "property float nx\n"
+                       "property float ny\n"
+                       "property float nz\n"
+                       "property float s\n"
+                       "property float t\n"
+                       "element face %llu\n"
+                       "property list uchar uint vertex_indices\n"
+                       "end_header\n",
+                       littleEndian ? "binary_little_endian" :
+                                      "binary_big_endian",
+                       mesh->verticesNumber,
+                       (unsigned long long)(mesh->indicesNumber / 3)) > 0;
+
+    for(unsigned int i = 0; i < mesh->verticesNumber && res; ++i)
+    {
+        GLfloat vertex[FLOATS_PER_VERTEX];
+        memcpy(vertex, mesh->vertices + (size_t)i*FLOATS_PER_VERTEX,
+               sizeof(vertex));
+        vertex[7] = 1.0f - vertex[7];
+        res = fwrite(vertex, sizeof(vertex), 1, fd) == 1;
+    }
+
+    // 1 byte of the vertex count and 3 indices
+    unsigned char face[1 + 3*sizeof(uint32_t)];
+    face[0] = 3;
+    for(size_t i = 0; i + 2 < mesh->indicesNumber && res; i += 3)
+    {
+        uint32_t triangle[3] = {
+            mesh->indices[i], mesh->indices[i + 1], mesh->indices[i + 2]
+        };
+        memcpy(face + 1, triangle, sizeof(triangle));
+        res = fwrite(face, sizeof(face), 1, fd) == 1;
+    }
+
+    if(fclose(fd) != 0)
+        res = false;
+    if(!res)
+    {
+        fprintf(stderr, "genSavePly - failed to write file, fname = %s\n",
+                fname);
+        remove(fname);
+    }
+    return res;
+}
+
+static bool
+genEndsWith(const char* str, const char* suffix)
+{
+    size_t strLength = strlen(str);
+    size_t suffixLength = strlen(suffix);
+    return strLength >= suffixLength &&
+           strcmp(str + strLength - suffixLength, suffix) == 0;
+}
+
+// "1000", "1k", "2.5M" and so on
+static bool
+genTrianglesParse(const char* str, uint64_t* outTrianglesNumber)
+{
+    char* end;
+    double value = strtod(str, &end);
+    if(end == str)
+        return false;
+
+    if(*end == 'k' || *end == 'K')
+    {
+        value *= 1000.0;
+        end++;
+    }
+    else if(*end == 'm' || *end == 'M')
+    {
+        value *= 1000000.0;
+        end++;
+    }
+
+    if(*end != '\0' || !(value >= 1.0) ||
+       value > (double)MAX_TRIANGLES_NUMBER)
+        return false;
+
+    *outTrianglesNumber = (uint64_t)value;
+    return true;
+}
+
+static void
+printUsage()
+{
+    printf("Usage: emdgen [options] <shape> <triangles> <output file>\n");
+    printf("Shapes are sphere, torus, grid and terrain. The number of "
+           "triangles is\n");
+    printf("approximate and can be given like 1000, 1k or 2.5M. The "
+           "output is an EMD\n");
+    printf("file, or a binary PLY file for emdconv if the name ends "
+           "with .ply.\n");
+    printf("  --soup      give every triangle its own 3 vertices, "
+           "like before welding\n");
+    printf("  --compress  compress vertices and indices of EMD files\n");
+    printf("  --seed      seed of the terrain noise, default is 1\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+    GenOptions options;
+    memset(&options, 0, sizeof(options));
+    options.seed = 1;
+
+    int argIdx = 1;
+    while(argIdx < argc && argv[argIdx][0] == '-')
+    {
+        if(strcmp(argv[argIdx], "--soup") == 0)
+            options.soup = true;
+        else if(strcmp(argv[argIdx], "--compress") == 0)
+            options.compress = true;
+        else if(strcmp(argv[argIdx], "--seed") == 0 && argIdx + 1 < argc)
+            options.seed = (unsigned int) atoi(argv[++argIdx]);
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[argIdx]);
+            printUsage();
+            return 1;
+        }
+        argIdx++;
+    }
+
+    if(argc - argIdx < 3)
+    {
+        printUsage();
+        return 1;
+    }
+
+    const char* shapeName = argv[argIdx];
+    const char* outfile = argv[argIdx + 2];
+
+    options.shape = GEN_SHAPES_NUMBER;
+    for(unsigned int i = 0; i < GEN_SHAPES_NUMBER; ++i)
+        if(strcmp(shapeName, genShapeNames[i]) == 0)
+            options.shape = i;
+    if(options.shape == GEN_SHAPES_NUMBER)
+    {
+        fprintf(stderr, "Unknown shape %s\n", shapeName);
+        printUsage();
+        return 1;
+    }
+
+    uint64_t trianglesNumber;
+    if(!genTrianglesParse(argv[argIdx + 1], &trianglesNumber))
+    {
+        fprintf(stderr, "Invalid number of triangles: %s\n",
+                argv[argIdx + 1]);
+        printUsage();
+        return 1;
+    }
+
+    uint64_t startTimeMs = getCurrentTimeMs();
+    GenMesh mesh;
+    if(!genMeshCreate(&options, trianglesNumber, &mesh))
+        return 3;
+
+    if(options.soup && !genMeshUnweld(&mesh))
+    {
+        genMeshFree(&mesh);
+        return 3;
+    }
+    uint64_t genTimeMs = getCurrentTimeMs() - startTimeMs;
+
+    startTimeMs = getCurrentTimeMs();
+    bool res = genEndsWith(outfile, ".ply") ?
+               genSavePly(outfile, &mesh) :
+               genSaveEmd(outfile, &mesh, options.compress);
+    uint64_t saveTimeMs = getCurrentTimeMs() - startTimeMs;
+
+    printf("Shape: %s%s\n", shapeName, options.soup ? ", soup" : "");
+    printf("Outfile: %s\n", outfile);
+    printf("Triangles: %llu, vertices: %u\n",
+           (unsigned long long)(mesh.indicesNumber / 3),
+           mesh.verticesNumber);
+    printf("Generation took %u ms, saving took %u ms\n",
+           (unsigned int)genTimeMs, (unsigned int)saveTimeMs);
+
+    genMeshFree(&mesh);
+    if(!res)
+        return 3;
+
+    printf("Done!\n");
+    return 0;
+}
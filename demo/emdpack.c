@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/pack.h"
+
+/*
+ * Packs models, textures and shaders into one file for the demo. Files
+ * are stored under the names given, so they should be relative to the
+ * directory the demo runs in, e.g. models/sphere.emd.
+ */
+
+static void
+printUsage()
+{
+    printf("Usage: emdpack <output file> <files...>\n");
+    printf("       emdpack --list <pack file>\n");
+    printf("Files are stored under the given names, run it from the "
+           "directory the demo\n");
+    printf("runs in: emdpack assets.pak models/*.emd textures/*.dds "
+           "shaders/*.glsl\n");
+}
+
+static int
+listPack(const char* fname)
+{
+    Pack* pack = packOpen(fname);
+    if(pack == NULL)
+        return 2;
+
+    size_t filesNumber = packGetFilesNumber(pack);
+    for(size_t i = 0; i < filesNumber; ++i)
+    {
+        size_t size;
+        const char* name = packGetFileName(pack, i, &size);
+        printf("%10llu %s\n", (unsigned long long)size, name);
+    }
+    printf("Files: %u\n", (unsigned int)filesNumber);
+
+    packClose(pack);
+    return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+    if(argc == 3 && strcmp(argv[1], "--list") == 0)
+        return listPack(argv[2]);
+
+    if(argc < 3 || argv[1][0] == '-')
+    {
+        printUsage();
+        return 1;
+    }
+
+    const char* outfile = argv[1];
+    if(!packSave(outfile, (const char* const*)(argv + 2),
+                 (size_t)(argc - 2)))
+        return 3;
+
+    printf("Outfile: %s\n", outfile);
+    printf("Files: %d\n", argc - 2);
+    printf("Done!\n");
+    return 0;
+}
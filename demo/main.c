@@ -39,8 +39,13 @@ static const Vector CAMERA_START_POS = {{ 0.0f, 0.0f, 5.0f, 0.0f }};
 #define FONT_TEXTURE_COORD_DELTA 0.002
 
 #define TEXTURES_NUM 7
-#define VAOS_NUM 6
-#define VBOS_NUM 11
+#define VAOS_NUM 1
+#define VBOS_NUM 1
+
+// one unit at distance 1 is 600 / (2 * tan(70 / 2)) pixels high,
+// see matrixPerspective call and window size
+#define LOD_PIXELS_PER_UNIT 428.4f
+#define LOD_MAX_ERROR_PIXELS 1.0f
 
 typedef struct
 {
@@ -51,6 +56,9 @@ typedef struct
     bool textureArrayInitialized;
     bool vaoArrayInitialized;
     bool vboArrayInitialized;
+    bool geometryArenaInitialized;
+    bool packInitialized;
+    bool modelLoaderInitialized;
 
     GLFWwindow* window;
     Camera* camera;
@@ -59,8 +67,72 @@ typedef struct
     GLuint textureArray[TEXTURES_NUM];
     GLuint vaoArray[VAOS_NUM];
     GLuint vboArray[VBOS_NUM];
+    GeometryArena* geometryArena;
+    Pack* pack; // NULL when loose files are used
+    ModelLoader* modelLoader;
+    uint64_t createTimeMs;
 } CommonResources;
 
+// bytes the GPU copies per frame while models are loading
+#define MODEL_UPLOAD_BUDGET (1024*1024)
+
+// models are decoded by this many worker threads
+#define MODEL_LOADER_THREADS 2
+
+// all models share these buffers, for every vertex format used
+#define GEOMETRY_ARENA_VERTICES_SIZE (16*1024*1024)
+#define GEOMETRY_ARENA_INDICES_SIZE (8*1024*1024)
+
+typedef struct
+{
+    const char* fname;
+    ModelInfo* info;
+    ModelLoadRequest* request; // NULL when loaded
+} PendingModel;
+
+/*
+ * Uploads the next part of pending models, all of them share
+ * MODEL_UPLOAD_BUDGET. Returns MODEL_LOAD_DONE when the last one
+ * is loaded.
+ */
+static int
+pendingModelsPoll(PendingModel* models, size_t modelsNumber,
+    GeometryArena* arena, size_t* modelsLoading)
+{
+    size_t budgetBytes = MODEL_UPLOAD_BUDGET;
+    for(size_t i = 0; i < modelsNumber; ++i)
+    {
+        PendingModel* model = &models[i];
+        if(model->request == NULL)
+            continue;
+
+        int res = modelLoadPoll(model->request, arena, &budgetBytes,
+                                model->info);
+        if(res == MODEL_LOAD_FAILED)
+            return MODEL_LOAD_FAILED;
+
+        if(res == MODEL_LOAD_DONE)
+        {
+            modelLoadRequestFree(model->request);
+            model->request = NULL;
+            (*modelsLoading)--;
+        }
+    }
+    return *modelsLoading == 0 ? MODEL_LOAD_DONE : MODEL_LOAD_PENDING;
+}
+
+static void
+pendingModelsFree(PendingModel* models, size_t modelsNumber)
+{
+    for(size_t i = 0; i < modelsNumber; ++i)
+    {
+        if(models[i].request == NULL)
+            continue;
+        modelLoadRequestFree(models[i].request);
+        models[i].request = NULL;
+    }
+}
+
 static void
 windowSizeCallback(GLFWwindow * window, int width, int height)
 {
@@ -68,6 +140,168 @@ windowSizeCallback(GLFWwindow * window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
+typedef struct
+{
+    GLint positionScale;
+    GLint positionBias;
+    GLint uvScale;
+    GLint uvBias;
+    GLint normalOctahedral;
+} VertexFormatUniforms;
+
+// visible clusters next to each other are drawn as one range
+#define CLUSTER_RANGES_BATCH 64
+
+/*
+ * Draws clusters of the LOD which pass modelClusterVisible, ranges are
+ * sent to GL in batches with glMultiDrawElementsBaseVertex.
+ */
+static void
+modelDrawClusters(const ModelInfo* info, const ModelSubmesh* submesh,
+    const ModelLod* lod, const float* planes, const float* cameraPos)
+{
+    GLsizei counts[CLUSTER_RANGES_BATCH];
+    const void* offsets[CLUSTER_RANGES_BATCH];
+    GLint baseVertices[CLUSTER_RANGES_BATCH];
+    GLsizei rangesNumber = 0;
+    size_t rangeEnd = 0;
+
+    size_t lodOffset = submesh->indicesOffset +
+                       lod->indicesOffset * submesh->indexSize;
+    for(size_t i = 0; i < lod->clustersNumber; ++i)
+    {
+        const ModelCluster* cluster = &info->clusters[lod->firstCluster + i];
+        if(!modelClusterVisible(cluster, planes, cameraPos))
+            continue;
+
+        size_t offset = lodOffset +
+                        cluster->indicesOffset * submesh->indexSize;
+        if(rangesNumber > 0 && offset == rangeEnd)
+        {
+            counts[rangesNumber - 1] += (GLsizei)cluster->indicesNumber;
+            rangeEnd += cluster->indicesNumber * submesh->indexSize;
+            continue;
+        }
+
+        if(rangesNumber == CLUSTER_RANGES_BATCH)
+        {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts,
+                submesh->indicesType, offsets, rangesNumber, baseVertices);
+            rangesNumber = 0;
+        }
+
+        counts[rangesNumber] = (GLsizei)cluster->indicesNumber;
+        offsets[rangesNumber] = (const void*)offset;
+        baseVertices[rangesNumber] = (GLint)submesh->baseVertex;
+        rangesNumber++;
+        rangeEnd = offset + cluster->indicesNumber * submesh->indexSize;
+    }
+
+    if(rangesNumber > 0)
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts,
+            submesh->indicesType, offsets, rangesNumber, baseVertices);
+}
+
+/*
+ * Models in the geometry arena share vertex arrays, *boundVertexArray
+ * is the one bound now, it's bound again only if it differs.
+ */
+static void
+modelDraw(const ModelInfo* info, const Matrix* m, const Matrix* mvp,
+    const Vector* cameraPos, const VertexFormatUniforms* uniforms,
+    GLuint* boundVertexArray)
+{
+    // not loaded yet
+    if(info->submeshesNumber == 0)
+        return;
+
+    if(info->vertexArray != *boundVertexArray)
+    {
+        glBindVertexArray(info->vertexArray);
+        *boundVertexArray = info->vertexArray;
+    }
+
+    const ModelVertexFormat* format = &info->vertexFormat;
+    glUniform3fv(uniforms->positionScale, 1, format->positionScale);
+    glUniform3fv(uniforms->positionBias, 1, format->positionBias);
+    glUniform2fv(uniforms->uvScale, 1, format->uvScale);
+    glUniform2fv(uniforms->uvBias, 1, format->uvBias);
+    glUniform1i(uniforms->normalOctahedral,
+        format->normalFormat != MODEL_NORMAL_FLOAT3);
+
+    // scale of the model matrix, bounding spheres grow by the largest one
+    float scale = 0.0f;
+    for(int i = 0; i < 3; ++i)
+    {
+        float len = sqrtf(m->m[i*4 + 0]*m->m[i*4 + 0] +
+                          m->m[i*4 + 1]*m->m[i*4 + 1] +
+                          m->m[i*4 + 2]*m->m[i*4 + 2]);
+        if(len > scale)
+            scale = len;
+    }
+
+    // clusters are culled in model space
+    float planes[6*4];
+    float modelCameraPos[3] = { 0.0f, 0.0f, 0.0f };
+    if(info->clustersNumber > 0)
+    {
+        modelFrustumPlanes(mvp->m, planes);
+        Matrix invM = matrixInverseAffine(m);
+        Vector worldCameraPos = {{ cameraPos->x, cameraPos->y, cameraPos->z,
+                                   1.0f }};
+        Vector pos = matrixMulVec(&invM, &worldCameraPos);
+        modelCameraPos[0] = pos.x;
+        modelCameraPos[1] = pos.y;
+        modelCameraPos[2] = pos.z;
+    }
+
+    for(unsigned int i = 0; i < info->submeshesNumber; ++i)
+    {
+        const ModelSubmesh* submesh = &info->submeshes[i];
+
+        // distance to the nearest point of the bounding sphere, files
+        // without bounds use the model origin, i.e. m[12..14]
+        Vector center = {{ 0.0f, 0.0f, 0.0f, 1.0f }};
+        float radius = 0.0f;
+        if(info->hasBounds)
+        {
+            center.x = submesh->bounds.center[0];
+            center.y = submesh->bounds.center[1];
+            center.z = submesh->bounds.center[2];
+            radius = submesh->bounds.radius * scale;
+        }
+        Vector worldCenter = matrixMulVec(m, &center);
+        float dx = worldCenter.x - cameraPos->x;
+        float dy = worldCenter.y - cameraPos->y;
+        float dz = worldCenter.z - cameraPos->z;
+        float distance = sqrtf(dx*dx + dy*dy + dz*dz) - radius;
+        if(distance < 0.0f)
+            distance = 0.0f;
+
+        // LOD errors are in model space, so is the distance passed,
+        // a model scaled to zero is drawn with the finest LOD
+        if(scale > 0.0f)
+            distance /= scale;
+        else
+            distance = 0.0f;
+
+        const ModelLod* lod = modelLodSelect(submesh, distance,
+                                             LOD_PIXELS_PER_UNIT,
+                                             LOD_MAX_ERROR_PIXELS);
+        if(lod->clustersNumber > 0)
+        {
+            modelDrawClusters(info, submesh, lod, planes, modelCameraPos);
+            continue;
+        }
+
+        size_t offset = submesh->indicesOffset +
+                        lod->indicesOffset * submesh->indexSize;
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)lod->indicesNumber,
+            submesh->indicesType, (const void*)offset,
+            (GLint)submesh->baseVertex);
+    }
+}
+
 static void
 errorCallback(int code, const char* descr)
 {
@@ -75,11 +309,29 @@ errorCallback(int code, const char* descr)
 }
 
 static int
-commonResourcesCreate(CommonResources* resources)
+commonResourcesCreate(CommonResources* resources, const char* packName)
 {
     // set *Initialized fields to false
 
     memset(resources, 0, sizeof(CommonResources));
+    resources->createTimeMs = getCurrentTimeMs();
+
+    // open the asset pack, all files are loaded from it
+
+    if(packName != NULL)
+    {
+        resources->pack = packOpen(packName);
+        if(!resources->pack)
+        {
+            fprintf(stderr, "Failed to open asset pack\n");
+            return -1;
+        }
+
+        resources->packInitialized = true;
+
+        // the disk reads the pack while the window is being created
+        packPrefetch(resources->pack);
+    }
 
     // initialize window
 
@@ -143,7 +395,7 @@ commonResourcesCreate(CommonResources* resources)
     // vertexShader, fragmentShader
     GLuint shaders[2];
 
-    shaders[0] = loadShader("shaders/vertexShader.glsl",
+    shaders[0] = loadShader(resources->pack, "shaders/vertexShader.glsl",
         GL_VERTEX_SHADER,
         &errorFlag);
     if(errorFlag) {
@@ -152,7 +404,7 @@ commonResourcesCreate(CommonResources* resources)
         return -1;
     }
 
-    shaders[1] = loadShader("shaders/fragmentShader.glsl",
+    shaders[1] = loadShader(resources->pack, "shaders/fragmentShader.glsl",
         GL_FRAGMENT_SHADER,
         &errorFlag);
     if(errorFlag) {
@@ -177,7 +429,7 @@ commonResourcesCreate(CommonResources* resources)
 
     // initialize fontProgramId
 
-    shaders[0] = loadShader("shaders/fontVertexShader.glsl",
+    shaders[0] = loadShader(resources->pack, "shaders/fontVertexShader.glsl",
         GL_VERTEX_SHADER,
         &errorFlag);
     if(errorFlag) {
@@ -186,7 +438,7 @@ commonResourcesCreate(CommonResources* resources)
         return -1;
     }
 
-    shaders[1] = loadShader("shaders/fontFragmentShader.glsl",
+    shaders[1] = loadShader(resources->pack, "shaders/fontFragmentShader.glsl",
         GL_FRAGMENT_SHADER,
         &errorFlag);
     if(errorFlag) {
@@ -221,6 +473,30 @@ commonResourcesCreate(CommonResources* resources)
     glGenBuffers(VBOS_NUM, resources->vboArray);
     resources->vboArrayInitialized = true;
 
+    // initialize geometryArena
+    resources->geometryArena = geometryArenaCreate(
+            GEOMETRY_ARENA_VERTICES_SIZE,
+            GEOMETRY_ARENA_INDICES_SIZE
+        );
+
+    if(!resources->geometryArena)
+    {
+        fprintf(stderr, "Failed to create geometry arena\n");
+        return -1;
+    }
+
+    resources->geometryArenaInitialized = true;
+
+    // initialize modelLoader
+    resources->modelLoader = modelLoaderCreate(MODEL_LOADER_THREADS);
+    if(!resources->modelLoader)
+    {
+        fprintf(stderr, "Failed to create model loader\n");
+        return -1;
+    }
+
+    resources->modelLoaderInitialized = true;
+
     return 0;
 }
 
@@ -248,6 +524,15 @@ commonResourcesDestroy(CommonResources* resources)
     if(resources->vboArrayInitialized)
         glDeleteBuffers(VBOS_NUM, resources->vboArray);
 
+    if(resources->geometryArenaInitialized)
+        geometryArenaDestroy(resources->geometryArena);
+
+    if(resources->modelLoaderInitialized)
+        modelLoaderDestroy(resources->modelLoader);
+
+    if(resources->packInitialized)
+        packClose(resources->pack);
+
     glfwTerminate();
 }
 
@@ -418,43 +703,30 @@ mainInternal(CommonResources* resources)
     GLuint redTexture       = resources->textureArray[5];
     GLuint blueTexture      = resources->textureArray[6];
 
-    if(!loadDDSTexture("textures/font.dds", fontTexture))
+    if(!loadDDSTexture(resources->pack, "textures/font.dds", fontTexture))
         return -1;
 
-    if(!loadDDSTexture("textures/grass.dds", grassTexture))
+    if(!loadDDSTexture(resources->pack, "textures/grass.dds", grassTexture))
         return -1;
 
-    if(!loadDDSTexture("textures/skybox.dds", skyboxTexture))
+    if(!loadDDSTexture(resources->pack, "textures/skybox.dds", skyboxTexture))
         return -1;
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    if(!loadDDSTexture("textures/tower.dds", towerTexture))
+    if(!loadDDSTexture(resources->pack, "textures/tower.dds", towerTexture))
         return -1;
 
+    fprintf(stderr, "Shaders and textures loaded in %u ms\n",
+        (unsigned int)(getCurrentTimeMs() - resources->createTimeMs));
+
     loadOneColorTexture(0.05f, 0.5f, 0.1f, garkGreenTexture);
     loadOneColorTexture(1.0f, 0.0f, 0.0f, redTexture);
     loadOneColorTexture(0.0f, 0.0f, 1.0f, blueTexture);
 
-    GLuint fontVAO          = resources->vaoArray[ 0];
-    GLuint grassVAO         = resources->vaoArray[ 1];
-    GLuint skyboxVAO        = resources->vaoArray[ 2];
-    GLuint towerVAO         = resources->vaoArray[ 3];
-    GLuint torusVAO         = resources->vaoArray[ 4];
-    GLuint sphereVAO        = resources->vaoArray[ 5];
-
-    GLuint fontVBO          = resources->vboArray[ 0];
-    GLuint grassVBO         = resources->vboArray[ 1];
-    GLuint grassIndicesVBO  = resources->vboArray[ 2];
-    GLuint skyboxVBO        = resources->vboArray[ 3];
-    GLuint skyboxIndicesVBO = resources->vboArray[ 4];
-    GLuint towerVBO         = resources->vboArray[ 5];
-    GLuint towerIndicesVBO  = resources->vboArray[ 6];
-    GLuint torusVBO         = resources->vboArray[ 7];
-    GLuint torusIndicesVBO  = resources->vboArray[ 8];
-    GLuint sphereVBO        = resources->vboArray[ 9];
-    GLuint sphereIndicesVBO = resources->vboArray[10];
+    GLuint fontVAO = resources->vaoArray[0];
+    GLuint fontVBO = resources->vboArray[0];
 
     // prepare text rendering
 
@@ -470,32 +742,32 @@ mainInternal(CommonResources* resources)
             "textureSampler"
         );
 
-    // load models
-
-    GLsizei grassIndicesNumber, skyboxIndicesNumber, towerIndicesNumber,
-        torusIndicesNumber, sphereIndicesNumber;
-    GLenum grassIndexType, skyboxIndexType, towerIndexType, torusIndexType, 
-        sphereIndexType;
+    // load models, they are drawn once uploaded
 
-    if(!modelLoad("models/grass.emd", grassVAO, grassVBO, grassIndicesVBO,
-        &grassIndicesNumber, &grassIndexType))
-        return -1;
+    ModelInfo grassInfo, skyboxInfo, towerInfo, torusInfo, sphereInfo;
+    PendingModel pendingModels[] = {
+        { "models/grass.emd", &grassInfo, NULL },
+        { "models/skybox.emd", &skyboxInfo, NULL },
+        { "models/tower.emd", &towerInfo, NULL },
+        { "models/torus.emd", &torusInfo, NULL },
+        { "models/sphere.emd", &sphereInfo, NULL },
+    };
+    size_t pendingModelsNumber = sizeof(pendingModels) /
+                                 sizeof(pendingModels[0]);
 
-    if(!modelLoad("models/skybox.emd", skyboxVAO, skyboxVBO, skyboxIndicesVBO,
-        &skyboxIndicesNumber, &skyboxIndexType))
-        return -1;
-
-    if(!modelLoad("models/tower.emd", towerVAO, towerVBO, towerIndicesVBO,
-        &towerIndicesNumber, &towerIndexType))
-        return -1;
-
-    if(!modelLoad("models/torus.emd", torusVAO, torusVBO, torusIndicesVBO,
-        &torusIndicesNumber, &torusIndexType))
-        return -1;
-
-    if(!modelLoad("models/sphere.emd", sphereVAO, sphereVBO, sphereIndicesVBO,
-        &sphereIndicesNumber, &sphereIndexType))
-        return -1;
+    for(size_t i = 0; i < pendingModelsNumber; ++i)
+    {
+        memset(pendingModels[i].info, 0, sizeof(ModelInfo));
+        pendingModels[i].request = modelLoadRequest(resources->modelLoader,
+                                                    resources->pack,
+                                                    pendingModels[i].fname);
+        if(pendingModels[i].request == NULL)
+        {
+            pendingModelsFree(pendingModels, pendingModelsNumber);
+            return -1;
+        }
+    }
+    size_t modelsLoading = pendingModelsNumber;
 
     Matrix projection = matrixPerspective(70.0f, 4.0f / 3.0f, 1.0f, 250.0f);
 
@@ -522,6 +794,28 @@ mainInternal(CommonResources* resources)
             "materialEmission"
         );
 
+    VertexFormatUniforms vertexFormatUniforms;
+    vertexFormatUniforms.positionScale = getUniformLocation(
+            resources->programId,
+            "positionScale"
+        );
+    vertexFormatUniforms.positionBias = getUniformLocation(
+            resources->programId,
+            "positionBias"
+        );
+    vertexFormatUniforms.uvScale = getUniformLocation(
+            resources->programId,
+            "uvScale"
+        );
+    vertexFormatUniforms.uvBias = getUniformLocation(
+            resources->programId,
+            "uvBias"
+        );
+    vertexFormatUniforms.normalOctahedral = getUniformLocation(
+            resources->programId,
+            "normalOctahedral"
+        );
+
     glEnable(GL_DOUBLEBUFFER);
     glEnable(GL_CULL_FACE);
     glEnable(GL_MULTISAMPLE);
@@ -554,12 +848,36 @@ mainInternal(CommonResources* resources)
     uint64_t lastFpsCounterFlushTimeMs = 0;
     uint64_t lastKeyPressCheckMs = 0;
     float fps = 0.0;
+    uint64_t maxFrameTimeMs = 0;
 
     while(glfwWindowShouldClose(resources->window) == GL_FALSE)
     {
         if(glfwGetKey(resources->window, GLFW_KEY_Q) == GLFW_PRESS)
             break;
 
+        if(modelsLoading > 0)
+        {
+            int res = pendingModelsPoll(pendingModels, pendingModelsNumber,
+                                        resources->geometryArena,
+                                        &modelsLoading);
+            if(res == MODEL_LOAD_FAILED)
+            {
+                pendingModelsFree(pendingModels, pendingModelsNumber);
+                modelInfoFree(&sphereInfo);
+                modelInfoFree(&torusInfo);
+                modelInfoFree(&towerInfo);
+                modelInfoFree(&skyboxInfo);
+                modelInfoFree(&grassInfo);
+                return -1;
+            }
+            if(res == MODEL_LOAD_DONE)
+                fprintf(stderr, "All models loaded in %u ms since start, "
+                        "the longest frame took %u ms\n",
+                        (unsigned int)(getCurrentTimeMs() -
+                                       resources->createTimeMs),
+                        (unsigned int)maxFrameTimeMs);
+        }
+
         glUseProgram(resources->programId);
 
         currentTimeMs = getCurrentTimeMs();
@@ -568,6 +886,8 @@ mainInternal(CommonResources* resources)
         uint64_t prevDeltaTimeMs = currentTimeMs - prevTimeMs;
 
         prevTimeMs = currentTimeMs;
+        if(prevDeltaTimeMs > maxFrameTimeMs)
+            maxFrameTimeMs = prevDeltaTimeMs;
 
         float rotationTimeMs = 100000.0;
         float currentRotation = (float)startDeltaTimeMs / rotationTimeMs;
@@ -586,8 +906,9 @@ mainInternal(CommonResources* resources)
         if(currentTimeMs - lastFpsCounterFlushTimeMs > 200)
         {
             snprintf(globStatusLineBuff, sizeof(globStatusLineBuff),
-                    "FPS: %.1f, Time: %u%09u, X: %.1f, Y: %.1f, Z: %.1f",
-                    fps,
+                    "FPS: %.1f, Max: %u ms, Time: %u%09u, "
+                    "X: %.1f, Y: %.1f, Z: %.1f",
+                    fps, (unsigned int)maxFrameTimeMs,
                     (uint32_t)(currentTimeMs / 1000000000),
                     (uint32_t)(currentTimeMs % 1000000000),
                     cameraPos.x, cameraPos.y, cameraPos.z
@@ -653,6 +974,9 @@ mainInternal(CommonResources* resources)
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // the font vertex array is bound at the end of every frame
+        GLuint boundVertexArray = 0;
+
         // TODO implement ModelLoader and Model classes
 
         // tower
@@ -666,16 +990,14 @@ mainInternal(CommonResources* resources)
         Matrix towerMVP = matrixMulMat(&towerM, &vp);
 
         glBindTexture(GL_TEXTURE_2D, towerTexture);
-        glBindVertexArray(towerVAO);
         glUniformMatrix4fv(uniformMVP, 1, GL_FALSE, &towerMVP.m[0]);
         glUniformMatrix4fv(uniformM, 1, GL_FALSE, &towerM.m[0]);
 
         glUniform1f(uniformMaterialSpecularFactor, 1.0f);
         glUniform1f(uniformMaterialSpecularIntensity, 0.0f);
         glUniform3f(uniformMaterialEmission, 0.0f, 0.0f, 0.0f);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, towerIndicesVBO);
-        glDrawElements(GL_TRIANGLES, towerIndicesNumber, 
-            towerIndexType, NULL);
+        modelDraw(&towerInfo, &towerM, &towerMVP, &cameraPos,
+            &vertexFormatUniforms, &boundVertexArray);
 
         // torus
 
@@ -688,15 +1010,13 @@ mainInternal(CommonResources* resources)
         Matrix torusMVP = matrixMulMat(&torusM, &vp);
 
         glBindTexture(GL_TEXTURE_2D, garkGreenTexture);
-        glBindVertexArray(torusVAO);
         glUniformMatrix4fv(uniformMVP, 1, GL_FALSE, &torusMVP.m[0]);
         glUniformMatrix4fv(uniformM, 1, GL_FALSE, &torusM.m[0]);
         glUniform1f(uniformMaterialSpecularFactor, 1.0f);
         glUniform1f(uniformMaterialSpecularIntensity, 1.0f);
         glUniform3f(uniformMaterialEmission, 0.0f, 0.0f, 0.0f);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, torusIndicesVBO);
-        glDrawElements(GL_TRIANGLES, torusIndicesNumber, 
-            torusIndexType, NULL);
+        modelDraw(&torusInfo, &torusM, &torusMVP, &cameraPos,
+            &vertexFormatUniforms, &boundVertexArray);
 
         // grass
 
@@ -709,15 +1029,13 @@ mainInternal(CommonResources* resources)
         Matrix grassMVP = matrixMulMat(&grassM, &vp);
 
         glBindTexture(GL_TEXTURE_2D, grassTexture);
-        glBindVertexArray(grassVAO);
         glUniformMatrix4fv(uniformMVP, 1, GL_FALSE, &grassMVP.m[0]);
         glUniformMatrix4fv(uniformM, 1, GL_FALSE, &grassM.m[0]);
         glUniform1f(uniformMaterialSpecularFactor, 32.0f);
         glUniform1f(uniformMaterialSpecularIntensity, 2.0f);
         glUniform3f(uniformMaterialEmission, 0.0f, 0.0f, 0.0f);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grassIndicesVBO);
-        glDrawElements(GL_TRIANGLES, grassIndicesNumber, 
-            grassIndexType, NULL);
+        modelDraw(&grassInfo, &grassM, &grassMVP, &cameraPos,
+            &vertexFormatUniforms, &boundVertexArray);
 
         // skybox
 
@@ -731,15 +1049,13 @@ mainInternal(CommonResources* resources)
         Matrix skyboxMVP = matrixMulMat(&skyboxM, &vp);
 
         glBindTexture(GL_TEXTURE_2D, skyboxTexture);
-        glBindVertexArray(skyboxVAO);
         glUniformMatrix4fv(uniformMVP, 1, GL_FALSE, &skyboxMVP.m[0]);
         glUniformMatrix4fv(uniformM, 1, GL_FALSE, &skyboxM.m[0]);
         glUniform1f(uniformMaterialSpecularFactor, 1.0f);
         glUniform1f(uniformMaterialSpecularIntensity, 0.0f);
         glUniform3f(uniformMaterialEmission, 0.0f, 0.0f, 0.0f);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyboxIndicesVBO);
-        glDrawElements(GL_TRIANGLES, skyboxIndicesNumber, 
-            skyboxIndexType, NULL);
+        modelDraw(&skyboxInfo, &skyboxM, &skyboxMVP, &cameraPos,
+            &vertexFormatUniforms, &boundVertexArray);
 
         // point light source
 
@@ -750,15 +1066,13 @@ mainInternal(CommonResources* resources)
             Matrix pointLightMVP = matrixMulMat(&pointLightM, &vp);
 
             glBindTexture(GL_TEXTURE_2D, redTexture);
-            glBindVertexArray(sphereVAO);
             glUniformMatrix4fv(uniformMVP, 1, GL_FALSE, &pointLightMVP.m[0]);
             glUniformMatrix4fv(uniformM, 1, GL_FALSE, &pointLightM.m[0]);
             glUniform1f(uniformMaterialSpecularFactor, 1.0f);
             glUniform1f(uniformMaterialSpecularIntensity, 1.0f);
             glUniform3f(uniformMaterialEmission, 0.5f, 0.5f, 0.5f);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIndicesVBO);
-            glDrawElements(GL_TRIANGLES, sphereIndicesNumber,
-                sphereIndexType, NULL);
+            modelDraw(&sphereInfo, &pointLightM, &pointLightMVP, &cameraPos,
+            &vertexFormatUniforms, &boundVertexArray);
         }
 
         // spot light source
@@ -770,15 +1084,13 @@ mainInternal(CommonResources* resources)
             Matrix spotLightMVP = matrixMulMat(&spotLightM, &vp);
 
             glBindTexture(GL_TEXTURE_2D, blueTexture);
-            glBindVertexArray(sphereVAO);
             glUniformMatrix4fv(uniformMVP, 1, GL_FALSE, &spotLightMVP.m[0]);
             glUniformMatrix4fv(uniformM, 1, GL_FALSE, &spotLightM.m[0]);
             glUniform1f(uniformMaterialSpecularFactor, 1.0f);
             glUniform1f(uniformMaterialSpecularIntensity, 1.0f);
             glUniform3f(uniformMaterialEmission, 0.5f, 0.5f, 0.5f);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIndicesVBO);
-            glDrawElements(GL_TRIANGLES, sphereIndicesNumber,
-                sphereIndexType, NULL);
+            modelDraw(&sphereInfo, &spotLightM, &spotLightMVP, &cameraPos,
+            &vertexFormatUniforms, &boundVertexArray);
         }
 
         // render text
@@ -794,16 +1106,23 @@ mainInternal(CommonResources* resources)
         glfwPollEvents();
     }
 
+    pendingModelsFree(pendingModels, pendingModelsNumber);
+    modelInfoFree(&sphereInfo);
+    modelInfoFree(&torusInfo);
+    modelInfoFree(&towerInfo);
+    modelInfoFree(&skyboxInfo);
+    modelInfoFree(&grassInfo);
     return 0;
 }
 
+// the only argument is an asset pack made by emdpack
 int
-main()
+main(int argc, char** argv)
 {
     int code;
     CommonResources resources;
 
-    if(commonResourcesCreate(&resources) == -1)
+    if(commonResourcesCreate(&resources, argc > 1 ? argv[1] : NULL) == -1)
         code = 1;
     else
         code = mainInternal(&resources);
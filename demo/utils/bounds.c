@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "bounds.h"
+
+/*
+ * The bounding sphere is the minimal one, found with Welzl's algorithm
+ * ("Smallest enclosing disks (balls and ellipsoids)", 1991) written as
+ * nested loops instead of recursion. Points are shuffled first, then
+ * the expected running time is linear.
+ */
+
+// relative tolerance of "point is inside the sphere" checks
+#define BOUNDS_EPS 1e-10
+
+typedef struct
+{
+    double center[3];
+    double radius2;
+} BoundsSphere;
+
+static double
+dist2(const double* a, const double* b)
+{
+    double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return dx*dx + dy*dy + dz*dz;
+}
+
+static bool
+sphereContains(const BoundsSphere* sphere, const double* point)
+{
+    return dist2(sphere->center, point) <=
+           sphere->radius2 * (1.0 + BOUNDS_EPS) + BOUNDS_EPS * BOUNDS_EPS;
+}
+
+static void
+sphereFrom2(BoundsSphere* sphere, const double* a, const double* b)
+{
+    for(int k = 0; k < 3; ++k)
+        sphere->center[k] = (a[k] + b[k]) * 0.5;
+    sphere->radius2 = dist2(a, b) * 0.25;
+}
+
+static void
+cross(const double* a, const double* b, double* out)
+{
+    out[0] = a[1]*b[2] - a[2]*b[1];
+    out[1] = a[2]*b[0] - a[0]*b[2];
+    out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+// circumscribed circle of a triangle, or the widest pair if it's flat
+static void
+sphereFrom3(BoundsSphere* sphere, const double* a, const double* b,
+    const double* c)
+{
+    double ab[3], ac[3], n[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+    }
+    cross(ab, ac, n);
+    double n2 = n[0]*n[0] + n[1]*n[1] + n[2]*n[2];
+    double ab2 = ab[0]*ab[0] + ab[1]*ab[1] + ab[2]*ab[2];
+    double ac2 = ac[0]*ac[0] + ac[1]*ac[1] + ac[2]*ac[2];
+
+    if(n2 <= 1e-12 * ab2 * ac2)
+    {
+        double bc2 = dist2(b, c);
+        if(ab2 >= ac2 && ab2 >= bc2)
+            sphereFrom2(sphere, a, b);
+        else if(ac2 >= bc2)
+            sphereFrom2(sphere, a, c);
+        else
+            sphereFrom2(sphere, b, c);
+        return;
+    }
+
+    double t1[3], t2[3];
+    cross(n, ab, t1);
+    cross(ac, n, t2);
+    double offset[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        offset[k] = (ac2*t1[k] + ab2*t2[k]) / (2.0 * n2);
+        sphere->center[k] = a[k] + offset[k];
+    }
+    sphere->radius2 = offset[0]*offset[0] + offset[1]*offset[1] +
+                      offset[2]*offset[2];
+}
+
+// circumscribed sphere of a tetrahedron, falls back to the smallest
+// sphere through three of the points if it's flat
+static void
+sphereFrom4(BoundsSphere* sphere, const double* a, const double* b,
+    const double* c, const double* d)
+{
+    double ab[3], ac[3], ad[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+        ad[k] = d[k] - a[k];
+    }
+
+    double acxad[3], adxab[3], abxac[3];
+    cross(ac, ad, acxad);
+    cross(ad, ab, adxab);
+    cross(ab, ac, abxac);
+    double det = ab[0]*acxad[0] + ab[1]*acxad[1] + ab[2]*acxad[2];
+    double ab2 = ab[0]*ab[0] + ab[1]*ab[1] + ab[2]*ab[2];
+    double ac2 = ac[0]*ac[0] + ac[1]*ac[1] + ac[2]*ac[2];
+    double ad2 = ad[0]*ad[0] + ad[1]*ad[1] + ad[2]*ad[2];
+    double scale = sqrt(ab2 * ac2 * ad2);
+
+    if(fabs(det) <= 1e-9 * scale)
+    {
+        const double* points[4] = { a, b, c, d };
+        bool found = false;
+        for(int skip = 0; skip < 4; ++skip)
+        {
+            const double* p[3];
+            int n = 0;
+            for(int i = 0; i < 4; ++i)
+                if(i != skip)
+                    p[n++] = points[i];
+
+            BoundsSphere candidate;
+            sphereFrom3(&candidate, p[0], p[1], p[2]);
+            if(!sphereContains(&candidate, points[skip]))
+                continue;
+            if(!found || candidate.radius2 < sphere->radius2)
+                *sphere = candidate;
+            found = true;
+        }
+        if(!found)
+            sphereFrom3(sphere, a, b, c);
+        return;
+    }
+
+    double offset[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        offset[k] = (ab2*acxad[k] + ac2*adxab[k] + ad2*abxac[k]) /
+                    (2.0 * det);
+        sphere->center[k] = a[k] + offset[k];
+    }
+    sphere->radius2 = offset[0]*offset[0] + offset[1]*offset[1] +
+                      offset[2]*offset[2];
+}
+
+static void
+minimalSphere(const double* points, size_t pointsNumber,
+    BoundsSphere* outSphere)
+{
+    BoundsSphere sphere;
+    memcpy(sphere.center, points, sizeof(sphere.center));
+    sphere.radius2 = 0.0;
+
+    for(size_t i = 1; i < pointsNumber; ++i)
+    {
+        const double* pi = points + i*3;
+        if(sphereContains(&sphere, pi))
+            continue;
+
+        // pi is on the boundary of the sphere of points 0..i
+        memcpy(sphere.center, pi, sizeof(sphere.center));
+        sphere.radius2 = 0.0;
+        for(size_t j = 0; j < i; ++j)
+        {
+            const double* pj = points + j*3;
+            if(sphereContains(&sphere, pj))
+                continue;
+
+            sphereFrom2(&sphere, pi, pj);
+            for(size_t k = 0; k < j; ++k)
+            {
+                const double* pk = points + k*3;
+                if(sphereContains(&sphere, pk))
+                    continue;
+
+                sphereFrom3(&sphere, pi, pj, pk);
+                for(size_t l = 0; l < k; ++l)
+                {
+                    const double* pl = points + l*3;
+                    if(!sphereContains(&sphere, pl))
+                        sphereFrom4(&sphere, pi, pj, pk, pl);
+                }
+            }
+        }
+    }
+
+    *outSphere = sphere;
+}
+
+/*
+ * Computes bounds of the vertices used by indices, or of all the
+ * vertices if indices is NULL. Positions are the first 3 floats of
+ * every vertex.
+ */
+bool
+boundsCompute(const GLfloat* vertices, unsigned int verticesNumber,
+    unsigned int floatsPerVertex, const unsigned int* indices,
+    size_t indicesNumber, ModelBounds* outBounds)
+{
+    memset(outBounds, 0, sizeof(ModelBounds));
+
+    unsigned char* used = (unsigned char*)calloc(verticesNumber + 1, 1);
+    double* points = (double*)malloc(sizeof(double) * 3 *
+                                     ((size_t)verticesNumber + 1));
+    if(used == NULL || points == NULL)
+    {
+        fprintf(stderr, "boundsCompute - malloc failed\n");
+        free(points);
+        free(used);
+        return false;
+    }
+
+    size_t pointsNumber = 0;
+    size_t count = indices != NULL ? indicesNumber : verticesNumber;
+    for(size_t i = 0; i < count; ++i)
+    {
+        unsigned int index = indices != NULL ? indices[i] : (unsigned int)i;
+        if(index >= verticesNumber || used[index])
+            continue;
+        used[index] = 1;
+
+        const GLfloat* pos = vertices + (size_t)index*floatsPerVertex;
+        for(int k = 0; k < 3; ++k)
+            points[pointsNumber*3 + k] = pos[k];
+        pointsNumber++;
+    }
+    free(used);
+
+    if(pointsNumber == 0)
+    {
+        free(points);
+        return true;
+    }
+
+    double minValues[3], maxValues[3];
+    memcpy(minValues, points, sizeof(minValues));
+    memcpy(maxValues, points, sizeof(maxValues));
+    for(size_t i = 1; i < pointsNumber; ++i)
+    {
+        for(int k = 0; k < 3; ++k)
+        {
+            double value = points[i*3 + k];
+            if(value < minValues[k]) minValues[k] = value;
+            if(value > maxValues[k]) maxValues[k] = value;
+        }
+    }
+
+    // shuffle with a fixed seed so the result doesn't change between runs
+    uint32_t state = 2463534242u;
+    for(size_t i = pointsNumber - 1; i > 0; --i)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        size_t j = (size_t)state % (i + 1);
+        double tmp[3];
+        memcpy(tmp, points + i*3, sizeof(tmp));
+        memcpy(points + i*3, points + j*3, sizeof(tmp));
+        memcpy(points + j*3, tmp, sizeof(tmp));
+    }
+
+    BoundsSphere sphere;
+    minimalSphere(points, pointsNumber, &sphere);
+
+    // rounding the center to floats moves it a bit, so measure the
+    // radius again from the rounded center
+    double center[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        outBounds->center[k] = (float)sphere.center[k];
+        center[k] = outBounds->center[k];
+        outBounds->min[k] = (float)minValues[k];
+        outBounds->max[k] = (float)maxValues[k];
+    }
+
+    double radius2 = 0.0;
+    for(size_t i = 0; i < pointsNumber; ++i)
+    {
+        double d2 = dist2(center, points + i*3);
+        if(d2 > radius2)
+            radius2 = d2;
+    }
+    outBounds->radius = nextafterf((float)sqrt(radius2), INFINITY);
+
+    free(points);
+    return true;
+}
+
+/*
+ * Grows bounds by error along every axis, e.g. to cover positions
+ * moved by quantization.
+ */
+void
+boundsExpand(ModelBounds* bounds, const float* error)
+{
+    for(int k = 0; k < 3; ++k)
+    {
+        bounds->min[k] -= error[k];
+        bounds->max[k] += error[k];
+    }
+    bounds->radius += sqrtf(error[0]*error[0] + error[1]*error[1] +
+                            error[2]*error[2]);
+}
@@ -0,0 +1,13 @@
+#ifndef AFISKON_BOUNDS_H
+#define AFISKON_BOUNDS_H
+
+#include <stdbool.h>
+#include <GLXW/glxw.h>
+#include "models.h"
+
+bool boundsCompute(const GLfloat* vertices, unsigned int verticesNumber,
+				unsigned int floatsPerVertex, const unsigned int* indices,
+				size_t indicesNumber, ModelBounds* outBounds);
+void boundsExpand(ModelBounds* bounds, const float* error);
+
+#endif // AFISKON_BOUNDS_H
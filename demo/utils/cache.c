@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "cache.h"
+#include "filemapping.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define cacheMkdir(dir) _mkdir(dir)
+#define cacheGetPid() ((unsigned int)_getpid())
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define cacheMkdir(dir) mkdir(dir, 0777)
+#define cacheGetPid() ((unsigned int)getpid())
+#endif
+
+/*
+ * Cache entries are files named after the key, the file is a header
+ * followed by the cached data. Entries are written to a temporary file
+ * first and renamed into place, so processes sharing the directory never
+ * see a partially written entry. Keys are never reused for different
+ * data, so it doesn't matter which of several processes writing the same
+ * entry wins.
+ */
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint64_t key[2];
+    uint64_t value;
+    uint64_t dataSize;
+} CacheHeader;
+
+#pragma pack(pop)
+
+static const char cacheSignature[] = "EAXCHE";
+static const char cacheVersion = 1;
+
+#define CACHE_PRIME1 0x9E3779B185EBCA87ull
+#define CACHE_PRIME2 0xC2B2AE3D27D4EB4Full
+
+// temporary files left by crashed processes are skipped
+#define CACHE_MAX_TEMP_ATTEMPTS 64
+
+#define CACHE_COPY_BUFFER_SIZE (64*1024)
+
+static uint64_t
+cacheRotl(uint64_t value, int shift)
+{
+    return (value << shift) | (value >> (64 - shift));
+}
+
+// the finalizer of MurmurHash3
+static uint64_t
+cacheMix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+void
+cacheKeyInit(CacheKey* key)
+{
+    key->hash[0] = CACHE_PRIME1;
+    key->hash[1] = CACHE_PRIME2;
+}
+
+/*
+ * Two independent lanes eat the data 8 bytes at a time, which is
+ * several times faster than hashing byte by byte. The size is mixed in,
+ * so consecutive calls can't be confused with a single one.
+ */
+void
+cacheKeyAdd(CacheKey* key, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t h1 = key->hash[0];
+    uint64_t h2 = key->hash[1];
+
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h1 = cacheRotl(h1 ^ (word * CACHE_PRIME1), 31) * CACHE_PRIME2;
+        h2 = cacheRotl(h2 ^ (word * CACHE_PRIME2), 29) * CACHE_PRIME1;
+    }
+
+    uint64_t tail[2] = { 0, (uint64_t)size };
+    memcpy(&tail[0], bytes + i, size - i);
+    for(int k = 0; k < 2; ++k)
+    {
+        h1 = cacheRotl(h1 ^ (tail[k] * CACHE_PRIME1), 31) * CACHE_PRIME2;
+        h2 = cacheRotl(h2 ^ (tail[k] * CACHE_PRIME2), 29) * CACHE_PRIME1;
+    }
+
+    key->hash[0] = cacheMix(h1 ^ cacheRotl(h2, 17));
+    key->hash[1] = cacheMix(h2 + key->hash[0]);
+}
+
+bool
+cacheKeyAddFile(CacheKey* key, const char* fname)
+{
+    FILE* fd = fopen(fname, "rb");
+    if(fd == NULL)
+    {
+        fprintf(stderr, "cacheKeyAddFile - failed to open file, "
+                "fname = %s, strerror = %s\n", fname, strerror(errno));
+        return false;
+    }
+
+    unsigned char* buffer = (unsigned char*)malloc(CACHE_COPY_BUFFER_SIZE);
+    if(buffer == NULL)
+    {
+        fprintf(stderr, "cacheKeyAddFile - malloc failed, fname = %s\n",
+                fname);
+        fclose(fd);
+        return false;
+    }
+
+    size_t size;
+    while((size = fread(buffer, 1, CACHE_COPY_BUFFER_SIZE, fd)) > 0)
+        cacheKeyAdd(key, buffer, size);
+
+    bool res = ferror(fd) == 0;
+    if(!res)
+        fprintf(stderr, "cacheKeyAddFile - failed to read file, "
+                "fname = %s\n", fname);
+    free(buffer);
+    fclose(fd);
+    return res;
+}
+
+static bool
+cachePath(const char* dir, const CacheKey* key, char* outPath,
+          size_t pathSize)
+{
+    int res = snprintf(outPath, pathSize, "%s/%016llx%016llx.emd", dir,
+                       (unsigned long long)key->hash[0],
+                       (unsigned long long)key->hash[1]);
+    if(res < 0 || (size_t)res >= pathSize)
+    {
+        fprintf(stderr, "cachePath - path is too long, dir = %s\n", dir);
+        return false;
+    }
+    return true;
+}
+
+// copies the rest of from, the number of bytes copied is returned
+static bool
+cacheCopy(FILE* from, FILE* to, uint64_t* outSize)
+{
+    *outSize = 0;
+
+    unsigned char* buffer = (unsigned char*)malloc(CACHE_COPY_BUFFER_SIZE);
+    if(buffer == NULL)
+        return false;
+
+    size_t size;
+    bool res = true;
+    while(res && (size = fread(buffer, 1, CACHE_COPY_BUFFER_SIZE, from)) > 0)
+    {
+        res = fwrite(buffer, size, 1, to) == 1;
+        *outSize += size;
+    }
+
+    free(buffer);
+    return res && ferror(from) == 0;
+}
+
+/*
+ * Copies the cached data to outfile. Like every output of emdconv it is
+ * written to a temporary file and renamed into place, so a missing or
+ * damaged entry is a miss which doesn't touch outfile.
+ */
+bool
+cacheLookup(const char* dir, const CacheKey* key, const char* outfile,
+            uint64_t* outValue)
+{
+    char fname[FILENAME_MAX];
+    if(!cachePath(dir, key, fname, sizeof(fname)))
+        return false;
+
+    FILE* fd = fopen(fname, "rb");
+    if(fd == NULL)
+        return false;
+
+    CacheHeader header;
+    if(fread(&header, sizeof(header), 1, fd) != 1 ||
+       strncmp(header.signature, cacheSignature,
+               sizeof(cacheSignature)) != 0 ||
+       header.version != cacheVersion ||
+       header.key[0] != key->hash[0] || header.key[1] != key->hash[1] ||
+       header.dataSize == 0 || header.dataSize > SIZE_MAX)
+    {
+        fprintf(stderr, "cacheLookup - invalid entry, fname = %s\n", fname);
+        fclose(fd);
+        return false;
+    }
+
+    size_t dataSize = (size_t)header.dataSize;
+    FileMapping* mapping = fileMappingCreateWritable(outfile, dataSize);
+    if(mapping == NULL)
+    {
+        fclose(fd);
+        return false;
+    }
+
+    bool res = fread(fileMappingGetPointer(mapping), 1, dataSize,
+                     fd) == dataSize && fgetc(fd) == EOF && ferror(fd) == 0;
+    fclose(fd);
+    if(!res)
+    {
+        fprintf(stderr, "cacheLookup - failed to copy entry, fname = %s\n",
+                fname);
+        fileMappingDestroy(mapping);
+        return false;
+    }
+
+    if(!fileMappingCommit(mapping, dataSize))
+        return false;
+
+    *outValue = header.value;
+    return true;
+}
+
+/*
+ * Stores the file fname and a number with it, the directory is created
+ * if it doesn't exist.
+ */
+bool
+cacheStore(const char* dir, const CacheKey* key, const char* fname,
+           uint64_t value)
+{
+    // the temporary file name is the entry name with a suffix
+    char entryPath[FILENAME_MAX - 32];
+    if(!cachePath(dir, key, entryPath, sizeof(entryPath)))
+        return false;
+
+    FILE* in = fopen(fname, "rb");
+    if(in == NULL)
+    {
+        fprintf(stderr, "cacheStore - failed to open file, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    // fails if it already exists, which is fine
+    cacheMkdir(dir);
+
+    // "x" makes fopen fail if the file exists, so every writer gets
+    // its own temporary file
+    char tempPath[FILENAME_MAX];
+    FILE* out = NULL;
+    for(unsigned int i = 0; i < CACHE_MAX_TEMP_ATTEMPTS && out == NULL; ++i)
+    {
+        snprintf(tempPath, sizeof(tempPath), "%s.%u.%u.tmp", entryPath,
+                 cacheGetPid(), i);
+        out = fopen(tempPath, "wbx");
+    }
+    if(out == NULL)
+    {
+        fprintf(stderr, "cacheStore - failed to create temporary file, "
+                "fname = %s\n", entryPath);
+        fclose(in);
+        return false;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.signature, cacheSignature);
+    header.version = cacheVersion;
+    header.key[0] = key->hash[0];
+    header.key[1] = key->hash[1];
+    header.value = value;
+
+    // the header is written again when the size is known
+    bool res = fwrite(&header, sizeof(header), 1, out) == 1 &&
+               cacheCopy(in, out, &header.dataSize) &&
+               fseek(out, 0, SEEK_SET) == 0 &&
+               fwrite(&header, sizeof(header), 1, out) == 1;
+    fclose(in);
+    if(fclose(out) != 0)
+        res = false;
+
+    if(!res)
+    {
+        fprintf(stderr, "cacheStore - failed to write file, fname = %s\n",
+                tempPath);
+        remove(tempPath);
+        return false;
+    }
+
+    // rename replaces the entry atomically on POSIX systems, on Windows
+    // it fails if another process has stored the entry already
+    if(rename(tempPath, entryPath) != 0)
+    {
+        remove(tempPath);
+        FILE* fd = fopen(entryPath, "rb");
+        if(fd == NULL)
+        {
+            fprintf(stderr, "cacheStore - failed to rename file, "
+                    "fname = %s\n", tempPath);
+            return false;
+        }
+        fclose(fd);
+    }
+
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef AFISKON_CACHE_H
+#define AFISKON_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 128-bit hash of everything the cached file depends on
+typedef struct
+{
+    uint64_t hash[2];
+} CacheKey;
+
+void cacheKeyInit(CacheKey* key);
+void cacheKeyAdd(CacheKey* key, const void* data, size_t size);
+bool cacheKeyAddFile(CacheKey* key, const char* fname);
+
+bool cacheLookup(const char* dir, const CacheKey* key, const char* outfile,
+				uint64_t* outValue);
+bool cacheStore(const char* dir, const CacheKey* key, const char* fname,
+				uint64_t value);
+
+#endif // AFISKON_CACHE_H
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "clusters.h"
+#include "bounds.h"
+
+/*
+ * Clusters are consecutive triangles, so every cluster is a range of
+ * the index buffer drawn with glDrawElements and no mesh shaders are
+ * needed. Triangles are taken in order, which is local enough after
+ * vertex cache optimization, and a cluster is closed when the next
+ * triangle doesn't fit into CLUSTER_MAX_VERTICES or
+ * CLUSTER_MAX_TRIANGLES. The normal cone follows meshoptimizer's
+ * meshopt_computeClusterBounds.
+ */
+
+#define CLUSTER_NO_STAMP 0xFFFFFFFFu
+
+// normals spread wider than this cosine to the axis make the cone empty
+#define CLUSTER_MIN_CONE_DOT 0.1f
+
+/*
+ * Vertices of the triangle not in the group yet, i.e. not stamped with
+ * its number, repeated vertices are counted once. Groups are clusters
+ * here and chunks of meshes split by emdconv.
+ */
+unsigned int
+clusterNewVertices(const unsigned int* triangle, const uint32_t* stamp,
+    uint32_t group)
+{
+    unsigned int added = 0;
+    for(int k = 0; k < 3; ++k)
+    {
+        if(stamp[triangle[k]] == group ||
+           (k > 0 && triangle[k] == triangle[0]) ||
+           (k > 1 && triangle[k] == triangle[1]))
+            continue;
+        added++;
+    }
+    return added;
+}
+
+// not normalized normal of the triangle, returns its length
+static float
+clusterTriangleNormal(const GLfloat* vertices, unsigned int floatsPerVertex,
+    const unsigned int* triangle, float* outNormal)
+{
+    const GLfloat* a = vertices + (size_t)triangle[0]*floatsPerVertex;
+    const GLfloat* b = vertices + (size_t)triangle[1]*floatsPerVertex;
+    const GLfloat* c = vertices + (size_t)triangle[2]*floatsPerVertex;
+    float ab[3], ac[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+    }
+    outNormal[0] = ab[1]*ac[2] - ab[2]*ac[1];
+    outNormal[1] = ab[2]*ac[0] - ab[0]*ac[2];
+    outNormal[2] = ab[0]*ac[1] - ab[1]*ac[0];
+    return sqrtf(outNormal[0]*outNormal[0] + outNormal[1]*outNormal[1] +
+                 outNormal[2]*outNormal[2]);
+}
+
+// the axis is the average of unit normals of triangles
+static void
+clusterCone(const GLfloat* vertices, unsigned int floatsPerVertex,
+    const unsigned int* indices, size_t indicesNumber, ModelCluster* cluster)
+{
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for(size_t i = 0; i < indicesNumber; i += 3)
+    {
+        float n[3];
+        float len = clusterTriangleNormal(vertices, floatsPerVertex,
+                                          indices + i, n);
+        if(len > 0.0f)
+            for(int k = 0; k < 3; ++k)
+                axis[k] += n[k] / len;
+    }
+
+    cluster->coneAxis[0] = 0.0f;
+    cluster->coneAxis[1] = 0.0f;
+    cluster->coneAxis[2] = 1.0f;
+    cluster->coneCutoff = 1.0f;
+
+    float axisLen = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] +
+                          axis[2]*axis[2]);
+    if(axisLen <= 0.0f)
+        return;
+    for(int k = 0; k < 3; ++k)
+        axis[k] /= axisLen;
+
+    // the smallest cosine of the angle between a normal and the axis,
+    // degenerate triangles face nowhere and are skipped
+    float minDot = 1.0f;
+    for(size_t i = 0; i < indicesNumber; i += 3)
+    {
+        float n[3];
+        float len = clusterTriangleNormal(vertices, floatsPerVertex,
+                                          indices + i, n);
+        if(len <= 0.0f)
+            continue;
+        float dot = (n[0]*axis[0] + n[1]*axis[1] + n[2]*axis[2]) / len;
+        if(dot < minDot)
+            minDot = dot;
+    }
+
+    if(minDot <= CLUSTER_MIN_CONE_DOT)
+        return;
+
+    memcpy(cluster->coneAxis, axis, sizeof(cluster->coneAxis));
+    // sine of the largest angle, the sphere test in modelClusterVisible
+    // expects it
+    cluster->coneCutoff = sqrtf(1.0f - minDot*minDot);
+}
+
+static bool
+clusterClose(const GLfloat* vertices, unsigned int floatsPerVertex,
+    const unsigned int* indices, size_t firstIndex, size_t lastIndex,
+    const unsigned int* clusterVertices, unsigned int clusterVerticesNumber,
+    ModelCluster* outCluster)
+{
+    GLfloat points[CLUSTER_MAX_VERTICES*3];
+    for(unsigned int i = 0; i < clusterVerticesNumber; ++i)
+        memcpy(points + i*3,
+               vertices + (size_t)clusterVertices[i]*floatsPerVertex,
+               sizeof(GLfloat)*3);
+
+    ModelBounds bounds;
+    if(!boundsCompute(points, clusterVerticesNumber, 3, NULL, 0, &bounds))
+        return false;
+
+    memset(outCluster, 0, sizeof(ModelCluster));
+    outCluster->indicesOffset = firstIndex;
+    outCluster->indicesNumber = (unsigned int)(lastIndex - firstIndex);
+    memcpy(outCluster->center, bounds.center, sizeof(outCluster->center));
+    outCluster->radius = bounds.radius;
+    clusterCone(vertices, floatsPerVertex, indices + firstIndex,
+                lastIndex - firstIndex, outCluster);
+    return true;
+}
+
+/*
+ * Splits triangles of indices into clusters and appends them to
+ * *clusters, which is reallocated. indicesOffset of the new clusters
+ * is relative to indices. Positions are the first 3 floats of every
+ * vertex.
+ */
+bool
+clustersBuild(const GLfloat* vertices, unsigned int verticesNumber,
+    unsigned int floatsPerVertex, const unsigned int* indices,
+    size_t indicesNumber, ModelCluster** clusters, size_t* clustersNumber)
+{
+    if(indicesNumber < 3)
+        return true;
+
+    // every cluster has at least one triangle
+    size_t maxClustersNumber = *clustersNumber + indicesNumber / 3;
+    ModelCluster* newClusters = (ModelCluster*)realloc(*clusters,
+                                sizeof(ModelCluster)*maxClustersNumber);
+    uint32_t* stamp = (uint32_t*)malloc(sizeof(uint32_t) *
+                                        ((size_t)verticesNumber + 1));
+    if(newClusters == NULL || stamp == NULL)
+    {
+        fprintf(stderr, "clustersBuild - malloc failed\n");
+        if(newClusters != NULL)
+            *clusters = newClusters;
+        free(stamp);
+        return false;
+    }
+    *clusters = newClusters;
+
+    for(unsigned int i = 0; i < verticesNumber; ++i)
+        stamp[i] = CLUSTER_NO_STAMP;
+
+    unsigned int clusterVertices[CLUSTER_MAX_VERTICES];
+    unsigned int clusterVerticesNumber = 0;
+    unsigned int clusterTrianglesNumber = 0;
+    uint32_t cluster = 0;
+    size_t firstIndex = 0;
+    size_t trianglesEnd = indicesNumber - indicesNumber % 3;
+    for(size_t i = 0; i < trianglesEnd; i += 3)
+    {
+        const unsigned int* triangle = indices + i;
+        unsigned int added = clusterNewVertices(triangle, stamp, cluster);
+        if(clusterTrianglesNumber == CLUSTER_MAX_TRIANGLES ||
+           clusterVerticesNumber + added > CLUSTER_MAX_VERTICES)
+        {
+            if(!clusterClose(vertices, floatsPerVertex, indices, firstIndex,
+                             i, clusterVertices, clusterVerticesNumber,
+                             &newClusters[(*clustersNumber)++]))
+            {
+                free(stamp);
+                return false;
+            }
+            cluster++;
+            firstIndex = i;
+            clusterVerticesNumber = 0;
+            clusterTrianglesNumber = 0;
+        }
+
+        for(int k = 0; k < 3; ++k)
+        {
+            if(stamp[triangle[k]] == cluster)
+                continue;
+            stamp[triangle[k]] = cluster;
+            clusterVertices[clusterVerticesNumber++] = triangle[k];
+        }
+        clusterTrianglesNumber++;
+    }
+
+    bool res = clusterClose(vertices, floatsPerVertex, indices, firstIndex,
+                            trianglesEnd, clusterVertices,
+                            clusterVerticesNumber,
+                            &newClusters[(*clustersNumber)++]);
+    free(stamp);
+
+    newClusters = (ModelCluster*)realloc(*clusters,
+                                sizeof(ModelCluster)*(*clustersNumber));
+    if(newClusters != NULL)
+        *clusters = newClusters;
+    return res;
+}
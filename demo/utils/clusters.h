@@ -0,0 +1,21 @@
+#ifndef AFISKON_CLUSTERS_H
+#define AFISKON_CLUSTERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <GLXW/glxw.h>
+#include "models.h"
+
+// limits of a cluster, the same as of a typical mesh shader meshlet
+#define CLUSTER_MAX_VERTICES 64
+#define CLUSTER_MAX_TRIANGLES 124
+
+bool clustersBuild(const GLfloat* vertices, unsigned int verticesNumber,
+				unsigned int floatsPerVertex, const unsigned int* indices,
+				size_t indicesNumber, ModelCluster** clusters,
+				size_t* clustersNumber);
+unsigned int clusterNewVertices(const unsigned int* triangle,
+				const uint32_t* stamp, uint32_t group);
+
+#endif // AFISKON_CLUSTERS_H
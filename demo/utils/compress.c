@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "compress.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPRESS_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Indices: every index is coded as a difference with the previous one,
+ * zigzag mapped to unsigned and written as varint (7 bits per byte, the
+ * high bit means there are more bytes). Neighbouring triangles share
+ * vertices, so most differences fit into one byte.
+ *
+ * Vertices: byte k of every vertex goes to byte plane k as a difference
+ * with byte k of the previous vertex. Coordinates of neighbouring
+ * vertices are close, so high bytes of floats and most bytes of
+ * quantized values become runs of small values, which are compressed
+ * with LZ. The LZ stream is similar to LZ4: a sequence is a token
+ * (4 bits of literals length, 4 bits of match length - 4), literals,
+ * 2 bytes of match offset; lengths of 15 and more continue in the next
+ * bytes, 255 meaning there is one more byte. The last sequence has
+ * literals only.
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+// the last bytes are always literals, so matches never end at the end
+#define LZ_LAST_LITERALS 8
+// the decoder copies by 16 bytes and may write this much past the end
+#define LZ_SLACK 16
+
+static uint32_t
+read32(const unsigned char* ptr)
+{
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static unsigned char*
+lzWriteLength(unsigned char* out, size_t length)
+{
+    while(length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+static unsigned char*
+lzWriteSequence(unsigned char* out, const unsigned char* literals,
+    size_t literalsLength, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength - LZ_MIN_MATCH;
+    unsigned char token = (unsigned char)(
+                            ((literalsLength < 15 ? literalsLength : 15) << 4) |
+                            (matchCode < 15 ? matchCode : 15)
+                        );
+    *out++ = token;
+    if(literalsLength >= 15)
+        out = lzWriteLength(out, literalsLength - 15);
+    memcpy(out, literals, literalsLength);
+    out += literalsLength;
+
+    *out++ = (unsigned char)(offset & 0xFF);
+    *out++ = (unsigned char)(offset >> 8);
+    if(matchCode >= 15)
+        out = lzWriteLength(out, matchCode - 15);
+    return out;
+}
+
+/*
+ * Greedy compressor with a hash table of the last position of every
+ * 4 bytes. Returns compressed size or 0 if memory allocation failed.
+ */
+static size_t
+lzCompress(const unsigned char* in, size_t inSize, unsigned char* out)
+{
+    size_t* table = (size_t*)calloc((size_t)1 << LZ_HASH_BITS, sizeof(size_t));
+    if(table == NULL)
+    {
+        fprintf(stderr, "lzCompress - calloc failed\n");
+        return 0;
+    }
+
+    unsigned char* outPtr = out;
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t limit = inSize > LZ_LAST_LITERALS ? inSize - LZ_LAST_LITERALS : 0;
+
+    while(pos + LZ_MIN_MATCH <= limit)
+    {
+        uint32_t value = read32(in + pos);
+        uint32_t hash = (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[hash]; // position + 1, 0 is empty
+        table[hash] = pos + 1;
+
+        if(candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+           read32(in + candidate - 1) != value)
+        {
+            // skip faster through data that doesn't compress
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while(pos + length < limit && in[match + length] == in[pos + length])
+            length++;
+
+        outPtr = lzWriteSequence(outPtr, in + anchor, pos - anchor,
+                                 pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    // last literals
+    size_t literalsLength = inSize - anchor;
+    *outPtr++ = (unsigned char)((literalsLength < 15 ? literalsLength : 15) << 4);
+    if(literalsLength >= 15)
+        outPtr = lzWriteLength(outPtr, literalsLength - 15);
+    memcpy(outPtr, in + anchor, literalsLength);
+    outPtr += literalsLength;
+
+    free(table);
+    return (size_t)(outPtr - out);
+}
+
+static bool
+lzReadLength(const unsigned char** ptr, const unsigned char* end,
+    size_t* inOutLength)
+{
+    const unsigned char* p = *ptr;
+    unsigned char value;
+    do
+    {
+        if(p == end)
+            return false;
+        value = *p++;
+        *inOutLength += value;
+    } while(value == 255);
+    *ptr = p;
+    return true;
+}
+
+/*
+ * out should have LZ_SLACK bytes after outSize for fast copying.
+ * Returns false if the data is corrupted or doesn't decompress
+ * to exactly outSize bytes.
+ */
+static bool
+lzDecompress(const unsigned char* in, size_t inSize, unsigned char* out,
+    size_t outSize)
+{
+    const unsigned char* ip = in;
+    const unsigned char* inEnd = in + inSize;
+    unsigned char* op = out;
+    unsigned char* outEnd = out + outSize;
+
+    for(;;)
+    {
+        if(ip == inEnd)
+            return false;
+
+        unsigned char token = *ip++;
+        size_t literalsLength = token >> 4;
+        if(literalsLength == 15 && !lzReadLength(&ip, inEnd, &literalsLength))
+            return false;
+
+        if(literalsLength > (size_t)(inEnd - ip) ||
+           literalsLength > (size_t)(outEnd - op))
+            return false;
+
+        if(literalsLength <= 16 && (size_t)(inEnd - ip) >= 16)
+            memcpy(op, ip, 16);
+        else
+            memcpy(op, ip, literalsLength);
+        ip += literalsLength;
+        op += literalsLength;
+
+        if(ip == inEnd)
+            break;
+
+        if(inEnd - ip < 2)
+            return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        size_t matchLength = (token & 15);
+        if(matchLength == 15 && !lzReadLength(&ip, inEnd, &matchLength))
+            return false;
+        matchLength += LZ_MIN_MATCH;
+
+        if(offset == 0 || offset > (size_t)(op - out) ||
+           matchLength > (size_t)(outEnd - op))
+            return false;
+
+        const unsigned char* match = op - offset;
+        if(offset >= 16)
+        {
+            // may copy up to 15 bytes too many, they are overwritten later
+            // or land in the slack
+            for(size_t i = 0; i < matchLength; i += 16)
+                memcpy(op + i, match + i, 16);
+        }
+        else
+        {
+            for(size_t i = 0; i < matchLength; ++i)
+                op[i] = match[i];
+        }
+        op += matchLength;
+    }
+
+    return op == outEnd;
+}
+
+size_t
+compressIndicesBound(size_t indicesNumber)
+{
+    // 32-bit value takes at most 5 bytes
+    return indicesNumber * 5;
+}
+
+/*
+ * outData should be at least compressIndicesBound bytes.
+ * Returns the compressed size.
+ */
+size_t
+compressIndices(const unsigned int* indices, size_t indicesNumber,
+    unsigned char* outData)
+{
+    unsigned char* ptr = outData;
+    uint32_t prev = 0;
+
+    for(size_t i = 0; i < indicesNumber; ++i)
+    {
+        uint32_t delta = (uint32_t)indices[i] - prev;
+        uint32_t zigzag = (delta << 1) ^ (0u - (delta >> 31));
+        while(zigzag >= 0x80)
+        {
+            *ptr++ = (unsigned char)(zigzag | 0x80);
+            zigzag >>= 7;
+        }
+        *ptr++ = (unsigned char)zigzag;
+        prev = indices[i];
+    }
+
+    return (size_t)(ptr - outData);
+}
+
+/*
+ * Decodes indices and stores them as indexSize bytes values.
+ * Returns false if the data is corrupted.
+ */
+bool
+decompressIndices(const unsigned char* data, size_t dataSize,
+    size_t indicesNumber, unsigned int indexSize, void* outIndices)
+{
+    const unsigned char* ptr = data;
+    const unsigned char* end = data + dataSize;
+    uint32_t maxIndex = indexSize == 1 ? 0xFF :
+                        (indexSize == 2 ? 0xFFFF : 0xFFFFFFFF);
+    uint32_t prev = 0;
+
+    if(indexSize != 1 && indexSize != 2 && indexSize != 4)
+        return false;
+
+    for(size_t i = 0; i < indicesNumber; ++i)
+    {
+        uint32_t zigzag;
+        if(ptr < end && *ptr < 0x80)
+            zigzag = *ptr++; // the most common case
+        else
+        {
+            zigzag = 0;
+            unsigned int shift = 0;
+            unsigned char value;
+            do
+            {
+                if(ptr == end || shift > 28)
+                    return false;
+                value = *ptr++;
+                zigzag |= (uint32_t)(value & 0x7F) << shift;
+                shift += 7;
+            } while(value & 0x80);
+        }
+
+        uint32_t index = prev + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+        if(index > maxIndex)
+            return false;
+        prev = index;
+
+        if(indexSize == 1)
+            ((uint8_t*)outIndices)[i] = (uint8_t)index;
+        else if(indexSize == 2)
+            ((uint16_t*)outIndices)[i] = (uint16_t)index;
+        else
+            ((uint32_t*)outIndices)[i] = index;
+    }
+
+    return ptr == end;
+}
+
+size_t
+compressVerticesBound(size_t verticesDataSize)
+{
+    return verticesDataSize + verticesDataSize / 255 + 16;
+}
+
+/*
+ * outData should be at least compressVerticesBound bytes.
+ * Returns the compressed size or 0 on error.
+ */
+size_t
+compressVertices(const unsigned char* vertices, size_t verticesNumber,
+    size_t vertexSize, unsigned char* outData)
+{
+    if(vertexSize == 0 || vertexSize > COMPRESS_MAX_VERTEX_SIZE)
+    {
+        fprintf(stderr, "compressVertices - unsupported vertex size %u\n",
+                (unsigned int)vertexSize);
+        return 0;
+    }
+
+    size_t dataSize = verticesNumber * vertexSize;
+    unsigned char* planes = (unsigned char*)malloc(dataSize + 1);
+    if(planes == NULL)
+    {
+        fprintf(stderr, "compressVertices - malloc failed\n");
+        return 0;
+    }
+
+    for(size_t k = 0; k < vertexSize; ++k)
+    {
+        unsigned char* plane = planes + k*verticesNumber;
+        unsigned char prev = 0;
+        for(size_t i = 0; i < verticesNumber; ++i)
+        {
+            unsigned char value = vertices[i*vertexSize + k];
+            plane[i] = (unsigned char)(value - prev);
+            prev = value;
+        }
+    }
+
+    size_t compressedSize = lzCompress(planes, dataSize, outData);
+    free(planes);
+    return compressedSize;
+}
+
+#ifdef COMPRESS_SSE2
+// rows[k] become columns: after the call rows[v] has byte v of every row
+static void
+transpose16x16(__m128i* rows)
+{
+    __m128i tmp[16];
+    for(int stage = 0; stage < 4; ++stage)
+    {
+        for(int j = 0; j < 8; ++j)
+        {
+            tmp[2*j] = _mm_unpacklo_epi8(rows[j], rows[j + 8]);
+            tmp[2*j + 1] = _mm_unpackhi_epi8(rows[j], rows[j + 8]);
+        }
+        memcpy(rows, tmp, sizeof(tmp));
+    }
+}
+#endif
+
+/*
+ * Restores vertices from delta coded byte planes. Every output byte is
+ * written once and never read back, so out can be a write-combined
+ * buffer mapping.
+ */
+static void
+unfilterVertices(const unsigned char* planes, size_t verticesNumber,
+    size_t vertexSize, unsigned char* out)
+{
+    unsigned char prev[COMPRESS_MAX_VERTEX_SIZE];
+    memset(prev, 0, sizeof(prev));
+    size_t i = 0;
+
+#ifdef COMPRESS_SSE2
+    // 16 vertices x 16 planes at a time
+    size_t groups = (vertexSize + 15) / 16;
+    size_t outSize = verticesNumber * vertexSize;
+    __m128i acc[COMPRESS_MAX_VERTEX_SIZE / 16];
+    for(size_t g = 0; g < groups; ++g)
+        acc[g] = _mm_setzero_si128();
+
+    for(; i + 16 <= verticesNumber; i += 16)
+    {
+        __m128i columns[COMPRESS_MAX_VERTEX_SIZE / 16][16];
+        for(size_t g = 0; g < groups; ++g)
+        {
+            for(size_t j = 0; j < 16; ++j)
+            {
+                size_t k = g*16 + j;
+                columns[g][j] = k < vertexSize ?
+                    _mm_loadu_si128((const __m128i*)(planes +
+                                    k*verticesNumber + i)) :
+                    _mm_setzero_si128();
+            }
+            transpose16x16(columns[g]);
+        }
+
+        for(size_t v = 0; v < 16; ++v)
+        {
+            size_t offset = (i + v) * vertexSize;
+            for(size_t g = 0; g < groups; ++g)
+            {
+                acc[g] = _mm_add_epi8(acc[g], columns[g][v]);
+                // a store past the vertex end is overwritten by the
+                // next vertex, only the end of the buffer needs care
+                if(offset + g*16 + 16 <= outSize)
+                    _mm_storeu_si128((__m128i*)(out + offset + g*16), acc[g]);
+                else
+                {
+                    unsigned char tmp[16];
+                    _mm_storeu_si128((__m128i*)tmp, acc[g]);
+                    memcpy(out + offset + g*16, tmp, vertexSize - g*16);
+                }
+            }
+        }
+    }
+
+    for(size_t g = 0; g < groups; ++g)
+        _mm_storeu_si128((__m128i*)(prev + g*16), acc[g]);
+#endif
+
+    for(; i < verticesNumber; ++i)
+    {
+        for(size_t k = 0; k < vertexSize; ++k)
+            prev[k] = (unsigned char)(prev[k] + planes[k*verticesNumber + i]);
+        memcpy(out + i*vertexSize, prev, vertexSize);
+    }
+}
+
+/*
+ * Decodes vertices to outVertices, which should be verticesNumber *
+ * vertexSize bytes. Returns false if the data is corrupted.
+ */
+bool
+decompressVertices(const unsigned char* data, size_t dataSize,
+    size_t verticesNumber, size_t vertexSize, unsigned char* outVertices)
+{
+    if(vertexSize == 0 || vertexSize > COMPRESS_MAX_VERTEX_SIZE)
+        return false;
+
+    size_t planesSize = verticesNumber * vertexSize;
+    unsigned char* planes = (unsigned char*)malloc(planesSize + LZ_SLACK);
+    if(planes == NULL)
+    {
+        fprintf(stderr, "decompressVertices - malloc failed\n");
+        return false;
+    }
+
+    if(!lzDecompress(data, dataSize, planes, planesSize))
+    {
+        free(planes);
+        return false;
+    }
+
+    unfilterVertices(planes, verticesNumber, vertexSize, outVertices);
+    free(planes);
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef AFISKON_COMPRESS_H
+#define AFISKON_COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// vertices are decoded 16 bytes at a time, see decompressVertices
+#define COMPRESS_MAX_VERTEX_SIZE 256
+
+size_t compressIndicesBound(size_t indicesNumber);
+size_t compressIndices(const unsigned int* indices, size_t indicesNumber,
+				unsigned char* outData);
+bool decompressIndices(const unsigned char* data, size_t dataSize,
+				size_t indicesNumber, unsigned int indexSize,
+				void* outIndices);
+
+size_t compressVerticesBound(size_t verticesDataSize);
+size_t compressVertices(const unsigned char* vertices, size_t verticesNumber,
+				size_t vertexSize, unsigned char* outData);
+bool decompressVertices(const unsigned char* data, size_t dataSize,
+				size_t verticesNumber, size_t vertexSize,
+				unsigned char* outVertices);
+
+#endif // AFISKON_COMPRESS_H
@@ -1,6 +1,51 @@
+// ftruncate and posix_fallocate are POSIX, and we build with -std=c11,
+// MAP_POPULATE and MADV_HUGEPAGE are Linux extensions
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifdef __linux__
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include "filemapping.h"
 
+/*
+ * Writable mappings are backed by a temporary file next to the target,
+ * fileMappingCommit renames it to the target. Readers of the target
+ * never see a partially written file.
+ */
+
+// temporary files left by crashed processes are skipped
+#define FILE_MAPPING_MAX_TEMP_ATTEMPTS 64
+
+static char*
+fileMappingNameCopy(const char* fname)
+{
+    size_t size = strlen(fname) + 1;
+    char* copy = (char*)malloc(size);
+    if(copy != NULL)
+        memcpy(copy, fname, size);
+    return copy;
+}
+
+// room for fname.<pid>.<attempt>.tmp
+static char*
+fileMappingTempNameAlloc(const char* fname)
+{
+    return (char*)malloc(strlen(fname) + 32);
+}
+
+static void
+fileMappingTempName(char* tempName, const char* fname, unsigned int pid,
+                    unsigned int attempt)
+{
+    sprintf(tempName, "%s.%u.%u.tmp", fname, pid, attempt);
+}
+
 #ifdef _WIN32
 
 #include <windows.h>
@@ -11,13 +56,27 @@ struct FileMapping
     HANDLE hMapping;
     size_t fsize;
     unsigned char* dataPtr;
+    char* tempName; // writable mappings only
+    char* fname;
+    size_t fileOffset; // of dataPtr, views only
+    bool isView; // shares the file and the mapping with another one
 };
 
+/*
+ * Only FILE_MAPPING_HINT_SEQUENTIAL and FILE_MAPPING_HINT_RANDOM are
+ * used on Windows, they are passed to CreateFile.
+ */
 FileMapping *
-fileMappingCreate(const char* fname)
+fileMappingCreateWithHints(const char* fname, unsigned int hints)
 {
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if(hints & FILE_MAPPING_HINT_SEQUENTIAL)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if(hints & FILE_MAPPING_HINT_RANDOM)
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+
     HANDLE hFile = CreateFile(fname, GENERIC_READ, 0, NULL, OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL, NULL);
+        flags, NULL);
     
     if(hFile == INVALID_HANDLE_VALUE)
     {
@@ -28,16 +87,19 @@ fileMappingCreate(const char* fname)
         return NULL;
     }
 
-    DWORD dwFileSize = GetFileSize(hFile, NULL);
-    if(dwFileSize == INVALID_FILE_SIZE)
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(hFile, &fileSize) ||
+       (unsigned long long)fileSize.QuadPart > SIZE_MAX)
     {
         fprintf(stderr,
-                "fileMappingCreate - GetFileSize failed, fname =  %s\n",
+                "fileMappingCreate - GetFileSizeEx failed or the file "
+                "is too large, fname =  %s\n",
                 fname
             );
         CloseHandle(hFile);
         return NULL;
     }
+    size_t fsize = (size_t)fileSize.QuadPart;
 
     HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0,
                                         NULL);
@@ -53,7 +115,7 @@ fileMappingCreate(const char* fname)
     }
 
     unsigned char* dataPtr = (unsigned char*)MapViewOfFile(
-                                hMapping, FILE_MAP_READ, 0, 0, dwFileSize);
+                                hMapping, FILE_MAP_READ, 0, 0, fsize);
     if(dataPtr == NULL)
     {
         fprintf(stderr,
@@ -81,17 +143,188 @@ fileMappingCreate(const char* fname)
     mapping->hFile = hFile;
     mapping->hMapping = hMapping;
     mapping->dataPtr = dataPtr;
-    mapping->fsize = (size_t)dwFileSize;
+    mapping->fsize = fsize;
+    mapping->tempName = NULL;
+    mapping->fname = NULL;
+    mapping->fileOffset = 0;
+    mapping->isView = false;
 
     return mapping;
 }
 
+FileMapping *
+fileMappingCreateWritable(const char* fname, size_t size)
+{
+    FileMapping* mapping = (FileMapping*)calloc(1, sizeof(FileMapping));
+    char* tempName = fileMappingTempNameAlloc(fname);
+    char* fnameCopy = fileMappingNameCopy(fname);
+    if(mapping == NULL || tempName == NULL || fnameCopy == NULL || size == 0)
+    {
+        fprintf(stderr,
+                "fileMappingCreateWritable - malloc failed, fname = %s\n",
+                fname
+            );
+        free(fnameCopy);
+        free(tempName);
+        free(mapping);
+        return NULL;
+    }
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    for(unsigned int i = 0; i < FILE_MAPPING_MAX_TEMP_ATTEMPTS &&
+                            hFile == INVALID_HANDLE_VALUE; ++i)
+    {
+        fileMappingTempName(tempName, fname,
+                            (unsigned int)GetCurrentProcessId(), i);
+        hFile = CreateFile(tempName, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                           CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(hFile == INVALID_HANDLE_VALUE &&
+           GetLastError() != ERROR_FILE_EXISTS)
+            break;
+    }
+    if(hFile == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr,
+                "fileMappingCreateWritable - CreateFile failed, "
+                "fname = %s\n", fname
+            );
+        free(fnameCopy);
+        free(tempName);
+        free(mapping);
+        return NULL;
+    }
+
+    // extends the file to size, so running out of space fails here
+    unsigned long long size64 = (unsigned long long)size;
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE,
+                                        (DWORD)(size64 >> 32),
+                                        (DWORD)size64, NULL);
+    unsigned char* dataPtr = hMapping == NULL ? NULL :
+        (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, size);
+    if(dataPtr == NULL)
+    {
+        fprintf(stderr,
+                "fileMappingCreateWritable - mapping failed, fname = %s\n",
+                fname
+            );
+        if(hMapping != NULL)
+            CloseHandle(hMapping);
+        CloseHandle(hFile);
+        DeleteFile(tempName);
+        free(fnameCopy);
+        free(tempName);
+        free(mapping);
+        return NULL;
+    }
+
+    mapping->hFile = hFile;
+    mapping->hMapping = hMapping;
+    mapping->dataPtr = dataPtr;
+    mapping->fsize = size;
+    mapping->tempName = tempName;
+    mapping->fname = fnameCopy;
+    return mapping;
+}
+
+/*
+ * Truncates the file to size and renames it to the target, the mapping
+ * is destroyed either way.
+ */
+bool
+fileMappingCommit(FileMapping* mapping, size_t size)
+{
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    bool res = size <= mapping->fsize &&
+               FlushViewOfFile(mapping->dataPtr, 0) &&
+               UnmapViewOfFile(mapping->dataPtr) &&
+               CloseHandle(mapping->hMapping) &&
+               SetFilePointerEx(mapping->hFile, end, NULL, FILE_BEGIN) &&
+               SetEndOfFile(mapping->hFile);
+    CloseHandle(mapping->hFile);
+
+    if(res)
+        res = MoveFileEx(mapping->tempName, mapping->fname,
+                         MOVEFILE_REPLACE_EXISTING) != 0;
+    if(!res)
+    {
+        fprintf(stderr, "fileMappingCommit - failed to write file, "
+                "fname = %s\n", mapping->fname);
+        DeleteFile(mapping->tempName);
+    }
+
+    free(mapping->fname);
+    free(mapping->tempName);
+    free(mapping);
+    return res;
+}
+
+/*
+ * Copies a range of the file through the file handle instead of the
+ * mapping, so no pages of the mapping are faulted in. Used to read
+ * straight into memory mapped by GL.
+ */
+bool
+fileMappingRead(FileMapping* mapping, size_t offset, void* buffer,
+                size_t size)
+{
+    if(offset > mapping->fsize || size > mapping->fsize - offset)
+        return false;
+
+    unsigned char* ptr = (unsigned char*)buffer;
+    while(size > 0)
+    {
+        DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        unsigned long long fileOffset = mapping->fileOffset + offset;
+        overlapped.Offset = (DWORD)(fileOffset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(fileOffset >> 32);
+
+        DWORD done;
+        if(!ReadFile(mapping->hFile, ptr, chunk, &done, &overlapped) ||
+           done == 0)
+        {
+            fprintf(stderr, "fileMappingRead - ReadFile failed, "
+                    "offset = %llu\n", (unsigned long long)offset);
+            return false;
+        }
+        ptr += done;
+        offset += done;
+        size -= done;
+    }
+    return true;
+}
+
+// not implemented, hints are CreateFile flags, PrefetchVirtualMemory
+// needs Windows 8
+void
+fileMappingAdvise(FileMapping* mapping, size_t offset, size_t size,
+                  unsigned int hints)
+{
+    (void)mapping;
+    (void)offset;
+    (void)size;
+    (void)hints;
+}
+
+// a writable mapping that isn't committed is removed
 void
 fileMappingDestroy(FileMapping* mapping)
 {
+    if(mapping->isView)
+    {
+        free(mapping);
+        return;
+    }
+
     UnmapViewOfFile(mapping->dataPtr);
     CloseHandle(mapping->hMapping);
     CloseHandle(mapping->hFile);
+    if(mapping->tempName != NULL)
+        DeleteFile(mapping->tempName);
+    free(mapping->fname);
+    free(mapping->tempName);
     free(mapping);
 }
 
@@ -101,8 +334,6 @@ fileMappingDestroy(FileMapping* mapping)
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <string.h>
-#include <stdlib.h>
 #include <errno.h>
 
 struct FileMapping
@@ -110,9 +341,50 @@ struct FileMapping
     int fd;
     size_t fsize;
     unsigned char* dataPtr;
+    char* tempName; // writable mappings only
+    char* fname;
+    size_t fileOffset; // of dataPtr, views only
+    bool isView; // shares the file and the mapping with another one
 };
 
-FileMapping * fileMappingCreate(const char* fname) {
+// only hints, errors are ignored
+static void
+fileMappingAdviseRange(unsigned char* ptr, size_t size, unsigned int hints)
+{
+    // posix_madvise needs a page-aligned address
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)ptr;
+    uintptr_t alignedStart = start & ~(pageSize - 1);
+    void* addr = (void*)alignedStart;
+    size += start - alignedStart;
+
+    if(hints & FILE_MAPPING_HINT_SEQUENTIAL)
+        posix_madvise(addr, size, POSIX_MADV_SEQUENTIAL);
+    else if(hints & FILE_MAPPING_HINT_RANDOM)
+        posix_madvise(addr, size, POSIX_MADV_RANDOM);
+
+    // without MADV_POPULATE_READ pages are read in the background
+    if(hints & FILE_MAPPING_HINT_POPULATE)
+    {
+#ifdef MADV_POPULATE_READ
+        if(madvise(addr, size, MADV_POPULATE_READ) == 0)
+            hints &= ~(unsigned int)FILE_MAPPING_HINT_POPULATE;
+#endif
+        if(hints & FILE_MAPPING_HINT_POPULATE)
+            hints |= FILE_MAPPING_HINT_WILL_NEED;
+    }
+
+    if(hints & FILE_MAPPING_HINT_WILL_NEED)
+        posix_madvise(addr, size, POSIX_MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    if(hints & FILE_MAPPING_HINT_HUGE_PAGES)
+        madvise(addr, size, MADV_HUGEPAGE);
+#endif
+}
+
+FileMapping *
+fileMappingCreateWithHints(const char* fname, unsigned int hints)
+{
     int fd = open(fname, O_RDONLY, 0);
     if(fd < 0)
     {
@@ -134,10 +406,30 @@ FileMapping * fileMappingCreate(const char* fname) {
         return NULL;
     }
 
+    // files over 4GB can't be mapped by 32-bit processes
+    if((uint64_t)st.st_size > SIZE_MAX)
+    {
+        fprintf(stderr,
+                "fileMappingCreate - file is too large, fname = %s\n",
+                fname
+            );
+        close(fd);
+        return NULL;
+    }
+
     size_t fsize = (size_t)st.st_size;
 
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if(hints & FILE_MAPPING_HINT_POPULATE)
+    {
+        flags |= MAP_POPULATE;
+        hints &= ~(unsigned int)FILE_MAPPING_HINT_POPULATE;
+    }
+#endif
+
     unsigned char* dataPtr = (unsigned char*)mmap(NULL, fsize, PROT_READ,
-                                                    MAP_PRIVATE, fd, 0);
+                                                    flags, fd, 0);
     if(dataPtr == MAP_FAILED)
     {
         fprintf(stderr,
@@ -148,6 +440,8 @@ FileMapping * fileMappingCreate(const char* fname) {
         return NULL;
     }
 
+    fileMappingAdviseRange(dataPtr, fsize, hints);
+
     FileMapping * mapping = (FileMapping *)malloc(sizeof(FileMapping));
     if(mapping == NULL)
     {
@@ -163,15 +457,185 @@ FileMapping * fileMappingCreate(const char* fname) {
     mapping->fd = fd;
     mapping->fsize = fsize;
     mapping->dataPtr = dataPtr;
+    mapping->tempName = NULL;
+    mapping->fname = NULL;
+    mapping->fileOffset = 0;
+    mapping->isView = false;
 
     return mapping;
 }
 
+FileMapping *
+fileMappingCreateWritable(const char* fname, size_t size)
+{
+    FileMapping* mapping = (FileMapping*)calloc(1, sizeof(FileMapping));
+    char* tempName = fileMappingTempNameAlloc(fname);
+    char* fnameCopy = fileMappingNameCopy(fname);
+    if(mapping == NULL || tempName == NULL || fnameCopy == NULL || size == 0)
+    {
+        fprintf(stderr,
+                "fileMappingCreateWritable - malloc failed, fname = %s\n",
+                fname
+            );
+        free(fnameCopy);
+        free(tempName);
+        free(mapping);
+        return NULL;
+    }
+
+    int fd = -1;
+    for(unsigned int i = 0; i < FILE_MAPPING_MAX_TEMP_ATTEMPTS && fd < 0; ++i)
+    {
+        fileMappingTempName(tempName, fname, (unsigned int)getpid(), i);
+        fd = open(tempName, O_RDWR | O_CREAT | O_EXCL, 0666);
+        if(fd < 0 && errno != EEXIST)
+            break;
+    }
+    if(fd < 0)
+    {
+        fprintf(stderr,
+                "fileMappingCreateWritable - open failed, "
+                "fname = %s, strerror = %s\n", tempName, strerror(errno)
+            );
+        free(fnameCopy);
+        free(tempName);
+        free(mapping);
+        return NULL;
+    }
+
+    // Blocks are reserved up front, so running out of space fails here
+    // and not with SIGBUS when the mapping is written to. Other systems
+    // get a sparse file.
+    int err = 0;
+#ifdef __linux__
+    err = posix_fallocate(fd, 0, (off_t)size);
+    if(err == EOPNOTSUPP || err == EINVAL)
+        err = 0;
+#endif
+    if(err == 0 && ftruncate(fd, (off_t)size) < 0)
+        err = errno;
+
+    unsigned char* dataPtr = err != 0 ? (unsigned char*)MAP_FAILED :
+        (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             fd, 0);
+    if(dataPtr == MAP_FAILED)
+    {
+        fprintf(stderr,
+                "fileMappingCreateWritable - failed to allocate %llu bytes, "
+                "fname = %s, strerror = %s\n", (unsigned long long)size,
+                tempName, strerror(err != 0 ? err : errno)
+            );
+        close(fd);
+        unlink(tempName);
+        free(fnameCopy);
+        free(tempName);
+        free(mapping);
+        return NULL;
+    }
+
+    mapping->fd = fd;
+    mapping->fsize = size;
+    mapping->dataPtr = dataPtr;
+    mapping->tempName = tempName;
+    mapping->fname = fnameCopy;
+    return mapping;
+}
+
+/*
+ * Truncates the file to size and renames it to the target, the mapping
+ * is destroyed either way. rename replaces the target atomically.
+ */
+bool
+fileMappingCommit(FileMapping* mapping, size_t size)
+{
+    bool res = size <= mapping->fsize &&
+               munmap(mapping->dataPtr, mapping->fsize) == 0 &&
+               ftruncate(mapping->fd, (off_t)size) == 0;
+    if(close(mapping->fd) != 0)
+        res = false;
+
+    if(res)
+        res = rename(mapping->tempName, mapping->fname) == 0;
+    if(!res)
+    {
+        fprintf(stderr, "fileMappingCommit - failed to write file, "
+                "fname = %s, strerror = %s\n", mapping->fname,
+                strerror(errno));
+        unlink(mapping->tempName);
+    }
+
+    free(mapping->fname);
+    free(mapping->tempName);
+    free(mapping);
+    return res;
+}
+
+/*
+ * Copies a range of the file through the file descriptor instead of the
+ * mapping, so no pages of the mapping are faulted in. Used to read
+ * straight into memory mapped by GL.
+ */
+bool
+fileMappingRead(FileMapping* mapping, size_t offset, void* buffer,
+                size_t size)
+{
+    if(offset > mapping->fsize || size > mapping->fsize - offset)
+        return false;
+
+    unsigned char* ptr = (unsigned char*)buffer;
+    while(size > 0)
+    {
+        ssize_t done = pread(mapping->fd, ptr, size,
+                             (off_t)(mapping->fileOffset + offset));
+        if(done < 0 && errno == EINTR)
+            continue;
+        if(done <= 0)
+        {
+            fprintf(stderr, "fileMappingRead - pread failed, "
+                    "offset = %llu, strerror = %s\n",
+                    (unsigned long long)offset,
+                    done < 0 ? strerror(errno) : "end of file");
+            return false;
+        }
+        ptr += done;
+        offset += (size_t)done;
+        size -= (size_t)done;
+    }
+    return true;
+}
+
+/*
+ * Applies hints to a range of the mapping, e.g. to a view of a file in
+ * a pack. Pages next to the range that share a page with it get them too.
+ */
+void
+fileMappingAdvise(FileMapping* mapping, size_t offset, size_t size,
+                  unsigned int hints)
+{
+    if(offset >= mapping->fsize)
+        return;
+    if(size > mapping->fsize - offset)
+        size = mapping->fsize - offset;
+
+    fileMappingAdviseRange(mapping->dataPtr + offset, size, hints);
+}
+
+// a writable mapping that isn't committed is removed
 void
 fileMappingDestroy(FileMapping * mapping)
 {
+    if(mapping->isView)
+    {
+        free(mapping);
+        return;
+    }
+
     munmap(mapping->dataPtr, mapping->fsize);
     close(mapping->fd);
+    if(mapping->tempName != NULL)
+        unlink(mapping->tempName);
+    free(mapping->fname);
+    free(mapping->tempName);
     free(mapping);
 }
 
@@ -183,8 +647,57 @@ fileMappingGetPointer(FileMapping * mapping)
     return mapping->dataPtr;
 }
 
-unsigned int
+FileMapping *
+fileMappingCreate(const char* fname)
+{
+    return fileMappingCreateWithHints(fname, FILE_MAPPING_HINT_NONE);
+}
+
+/*
+ * Starts reading a range of the file into the page cache and returns
+ * right away, e.g. for files of a pack which will be loaded soon.
+ */
+void
+fileMappingPrefetch(FileMapping* mapping, size_t offset, size_t size)
+{
+    fileMappingAdvise(mapping, offset, size, FILE_MAPPING_HINT_WILL_NEED);
+}
+
+size_t
 fileMappingGetSize(FileMapping * mapping)
 {
-    return (unsigned int)mapping->fsize;
-}
\ No newline at end of file
+    return mapping->fsize;
+}
+
+/*
+ * A part of a read-only mapping which can be used like a mapping of
+ * a separate file, e.g. a file in an asset pack. The view must be
+ * destroyed before the mapping.
+ */
+FileMapping*
+fileMappingCreateView(FileMapping* mapping, size_t offset, size_t size)
+{
+    if(offset > mapping->fsize || size > mapping->fsize - offset)
+    {
+        fprintf(stderr, "fileMappingCreateView - invalid range, "
+                "offset = %llu, size = %llu\n", (unsigned long long)offset,
+                (unsigned long long)size);
+        return NULL;
+    }
+
+    FileMapping* view = (FileMapping*)malloc(sizeof(FileMapping));
+    if(view == NULL)
+    {
+        fprintf(stderr, "fileMappingCreateView - malloc failed\n");
+        return NULL;
+    }
+
+    *view = *mapping;
+    view->dataPtr = mapping->dataPtr + offset;
+    view->fsize = size;
+    view->fileOffset = mapping->fileOffset + offset;
+    view->tempName = NULL;
+    view->fname = NULL;
+    view->isView = true;
+    return view;
+}
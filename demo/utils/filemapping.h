@@ -1,12 +1,34 @@
 #ifndef AFISKON_FILEMAPPING_H
 #define AFISKON_FILEMAPPING_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+// access hints of read-only mappings, they can be combined
+#define FILE_MAPPING_HINT_NONE       0
+#define FILE_MAPPING_HINT_SEQUENTIAL 1 // read once from start to end
+#define FILE_MAPPING_HINT_RANDOM     2 // no readahead
+#define FILE_MAPPING_HINT_WILL_NEED  4 // start reading all of it now
+#define FILE_MAPPING_HINT_POPULATE   8 // read all of it before returning
+#define FILE_MAPPING_HINT_HUGE_PAGES 16
+
 struct FileMapping;
 typedef struct FileMapping FileMapping;
 
 FileMapping * fileMappingCreate(const char* fname);
+FileMapping * fileMappingCreateWithHints(const char* fname,
+				unsigned int hints);
+FileMapping * fileMappingCreateWritable(const char* fname, size_t size);
+FileMapping * fileMappingCreateView(FileMapping* mapping, size_t offset,
+				size_t size);
+bool fileMappingCommit(FileMapping* mapping, size_t size);
 unsigned char* fileMappingGetPointer(FileMapping * mapping);
-unsigned int fileMappingGetSize(FileMapping * mapping);
+size_t fileMappingGetSize(FileMapping * mapping);
+void fileMappingPrefetch(FileMapping* mapping, size_t offset, size_t size);
+void fileMappingAdvise(FileMapping* mapping, size_t offset, size_t size,
+				unsigned int hints);
+bool fileMappingRead(FileMapping* mapping, size_t offset, void* buffer,
+				size_t size);
 void fileMappingDestroy(FileMapping * mapping);
 
 #endif //AFISKON_FILEMAPPING_H
@@ -182,6 +182,45 @@ matrixMulMat(const Matrix* m1, const Matrix* m2)
     return out;
 }
 
+// inverse of a matrix made of rotations, scales and translations only
+Matrix
+matrixInverseAffine(const Matrix* m)
+{
+    // a is the upper left 3x3 part, a[column][row]
+    float a[3][3];
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+            a[i][j] = m->m[i*4 + j];
+
+    float c00 = a[1][1]*a[2][2] - a[2][1]*a[1][2];
+    float c01 = a[2][1]*a[0][2] - a[0][1]*a[2][2];
+    float c02 = a[0][1]*a[1][2] - a[1][1]*a[0][2];
+    float det = a[0][0]*c00 + a[1][0]*c01 + a[2][0]*c02;
+
+    Matrix out = matrixIdentity();
+    if(REAL_NUM_EQ(det, 0))
+        return out;
+    float invDet = 1.0f / det;
+
+    out.m[0*4 + 0] = c00 * invDet;
+    out.m[0*4 + 1] = c01 * invDet;
+    out.m[0*4 + 2] = c02 * invDet;
+    out.m[1*4 + 0] = (a[2][0]*a[1][2] - a[1][0]*a[2][2]) * invDet;
+    out.m[1*4 + 1] = (a[0][0]*a[2][2] - a[2][0]*a[0][2]) * invDet;
+    out.m[1*4 + 2] = (a[1][0]*a[0][2] - a[0][0]*a[1][2]) * invDet;
+    out.m[2*4 + 0] = (a[1][0]*a[2][1] - a[2][0]*a[1][1]) * invDet;
+    out.m[2*4 + 1] = (a[2][0]*a[0][1] - a[0][0]*a[2][1]) * invDet;
+    out.m[2*4 + 2] = (a[0][0]*a[1][1] - a[1][0]*a[0][1]) * invDet;
+
+    // translation is -inverse(a) * t
+    for(int j = 0; j < 3; j++)
+        out.m[3*4 + j] = -(out.m[0*4 + j] * m->m[3*4 + 0] +
+                           out.m[1*4 + j] * m->m[3*4 + 1] +
+                           out.m[2*4 + j] * m->m[3*4 + 2]);
+
+    return out;
+}
+
 Matrix
 matrixRotate(const Matrix* in, float angle,
     float axis_x, float axis_y, float axis_z)
@@ -29,6 +29,7 @@ Matrix matrixLookAt(Vector eye, Vector center, Vector up);
 
 Vector matrixMulVec(const Matrix* m, const Vector* v);
 Matrix matrixMulMat(const Matrix* m1, const Matrix* m2);
+Matrix matrixInverseAffine(const Matrix* m);
 Matrix matrixRotate(const Matrix* m, float angle,
 	float axis_x, float axis_y, float axis_z);
 void matrixScaleInplace(Matrix* m, float x, float y, float z);
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "meshclean.h"
+
+#define MESHCLEAN_EMPTY 0xFFFFFFFFu
+
+// Triangles with the height below this fraction of the longest edge
+// are degenerate. It's about the precision of float positions, so only
+// triangles that have no area up to rounding are removed.
+#define MESHCLEAN_AREA_EPS 1.0e-7
+
+/*
+ * Zero area triangles: with repeated vertices, or with positions on one
+ * line. Positions are compared after welding, so vertices at the same
+ * place with different normals or UVs count as repeated too.
+ */
+static bool
+meshTriangleDegenerate(const unsigned int* triangle, const GLfloat* vertices,
+    unsigned int floatsPerVertex)
+{
+    if(triangle[0] == triangle[1] || triangle[1] == triangle[2] ||
+       triangle[2] == triangle[0])
+        return true;
+
+    const GLfloat* p0 = vertices + (size_t)triangle[0]*floatsPerVertex;
+    const GLfloat* p1 = vertices + (size_t)triangle[1]*floatsPerVertex;
+    const GLfloat* p2 = vertices + (size_t)triangle[2]*floatsPerVertex;
+
+    double e1[3], e2[3], e3[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        e1[k] = (double)p1[k] - (double)p0[k];
+        e2[k] = (double)p2[k] - (double)p0[k];
+        e3[k] = (double)p2[k] - (double)p1[k];
+    }
+
+    double cross[3] = {
+        e1[1]*e2[2] - e1[2]*e2[1],
+        e1[2]*e2[0] - e1[0]*e2[2],
+        e1[0]*e2[1] - e1[1]*e2[0]
+    };
+    double crossSq = cross[0]*cross[0] + cross[1]*cross[1] +
+                     cross[2]*cross[2];
+
+    double edgeSq = e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2];
+    double e2Sq = e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2];
+    double e3Sq = e3[0]*e3[0] + e3[1]*e3[1] + e3[2]*e3[2];
+    if(e2Sq > edgeSq)
+        edgeSq = e2Sq;
+    if(e3Sq > edgeSq)
+        edgeSq = e3Sq;
+
+    // |cross| is the height times the longest edge, NaNs are kept
+    return crossSq <= MESHCLEAN_AREA_EPS*MESHCLEAN_AREA_EPS*edgeSq*edgeSq;
+}
+
+// rotation of the triangle that starts with its smallest index, the
+// winding is kept
+static void
+meshTriangleCanonical(const unsigned int* triangle, unsigned int* outTriangle)
+{
+    unsigned int first = 0;
+    if(triangle[1] < triangle[first])
+        first = 1;
+    if(triangle[2] < triangle[first])
+        first = 2;
+
+    outTriangle[0] = triangle[first];
+    outTriangle[1] = triangle[(first + 1) % 3];
+    outTriangle[2] = triangle[(first + 2) % 3];
+}
+
+static size_t
+meshTriangleHash(const unsigned int* triangle)
+{
+    uint64_t h = (uint64_t)triangle[0] * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)triangle[1] * 0xC2B2AE3D27D4EB4FULL;
+    h ^= (uint64_t)triangle[2] * 0x165667B19E3779F9ULL;
+    h ^= h >> 29;
+    return (size_t)(h ^ (h >> 32));
+}
+
+/*
+ * Removes degenerate triangles and repeated triangles, the first one of
+ * the repeated is kept. Triangles are repeated if they have the same
+ * indices in the same winding starting from any corner, so two sides
+ * of a double-sided face are both kept. Kept triangles are moved to the
+ * beginning of indices in the same order and rotation.
+ *
+ * Repeated triangles are found with an open addressing hash table of
+ * canonical rotations, so it takes linear time.
+ */
+bool
+meshRemoveBadTriangles(unsigned int* indices, size_t indicesNumber,
+    const GLfloat* vertices, unsigned int floatsPerVertex,
+    size_t* outIndicesNumber, size_t* outDegenerateNumber,
+    size_t* outDuplicatesNumber)
+{
+    *outIndicesNumber = indicesNumber;
+    *outDegenerateNumber = 0;
+    *outDuplicatesNumber = 0;
+
+    size_t trianglesNumber = indicesNumber / 3;
+    if(trianglesNumber >= MESHCLEAN_EMPTY)
+    {
+        fprintf(stderr, "meshRemoveBadTriangles - too many triangles: %llu\n",
+                (unsigned long long)trianglesNumber);
+        return false;
+    }
+
+    // at most half full
+    size_t tableSize = 16;
+    while(tableSize < trianglesNumber*2)
+        tableSize *= 2;
+
+    unsigned int* table = (unsigned int*)malloc(
+                                sizeof(unsigned int) * tableSize);
+    if(table == NULL)
+    {
+        fprintf(stderr, "meshRemoveBadTriangles - malloc failed\n");
+        return false;
+    }
+    memset(table, 0xFF, sizeof(unsigned int) * tableSize);
+
+    size_t keptNumber = 0;
+    for(size_t i = 0; i < trianglesNumber; ++i)
+    {
+        const unsigned int* triangle = indices + i*3;
+        if(meshTriangleDegenerate(triangle, vertices, floatsPerVertex))
+        {
+            (*outDegenerateNumber)++;
+            continue;
+        }
+
+        unsigned int canonical[3];
+        meshTriangleCanonical(triangle, canonical);
+
+        bool duplicate = false;
+        size_t slot = meshTriangleHash(canonical) & (tableSize - 1);
+        while(table[slot] != MESHCLEAN_EMPTY)
+        {
+            unsigned int kept[3];
+            meshTriangleCanonical(indices + (size_t)table[slot]*3, kept);
+            if(memcmp(kept, canonical, sizeof(kept)) == 0)
+            {
+                duplicate = true;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if(duplicate)
+        {
+            (*outDuplicatesNumber)++;
+            continue;
+        }
+
+        // kept triangles never overwrite ones that are not checked yet
+        table[slot] = (unsigned int)keptNumber;
+        memmove(indices + keptNumber*3, triangle, sizeof(unsigned int)*3);
+        keptNumber++;
+    }
+
+    free(table);
+    *outIndicesNumber = keptNumber*3;
+    return true;
+}
+
+/*
+ * Removes vertices no index refers to, the rest keep their order.
+ */
+bool
+meshRemoveUnusedVertices(GLfloat* vertices, unsigned int verticesNumber,
+    unsigned int floatsPerVertex, unsigned int* indices, size_t indicesNumber,
+    unsigned int* outVerticesNumber)
+{
+    *outVerticesNumber = verticesNumber;
+
+    unsigned int* remap = (unsigned int*)malloc(
+                                sizeof(unsigned int) * verticesNumber + 1);
+    if(remap == NULL)
+    {
+        fprintf(stderr, "meshRemoveUnusedVertices - malloc failed\n");
+        return false;
+    }
+    memset(remap, 0xFF, sizeof(unsigned int) * verticesNumber);
+
+    for(size_t i = 0; i < indicesNumber; ++i)
+        remap[indices[i]] = 0;
+
+    unsigned int usedNumber = 0;
+    size_t vertexSize = sizeof(GLfloat) * floatsPerVertex;
+    for(unsigned int i = 0; i < verticesNumber; ++i)
+    {
+        if(remap[i] == MESHCLEAN_EMPTY)
+            continue;
+
+        if(usedNumber != i)
+            memcpy(vertices + (size_t)usedNumber*floatsPerVertex,
+                   vertices + (size_t)i*floatsPerVertex, vertexSize);
+        remap[i] = usedNumber++;
+    }
+
+    for(size_t i = 0; i < indicesNumber; ++i)
+        indices[i] = remap[indices[i]];
+
+    free(remap);
+    *outVerticesNumber = usedNumber;
+    return true;
+}
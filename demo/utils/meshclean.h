@@ -0,0 +1,16 @@
+#ifndef AFISKON_MESHCLEAN_H
+#define AFISKON_MESHCLEAN_H
+
+#include <GLXW/glxw.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+bool meshRemoveBadTriangles(unsigned int* indices, size_t indicesNumber,
+				const GLfloat* vertices, unsigned int floatsPerVertex,
+				size_t* outIndicesNumber, size_t* outDegenerateNumber,
+				size_t* outDuplicatesNumber);
+bool meshRemoveUnusedVertices(GLfloat* vertices, unsigned int verticesNumber,
+				unsigned int floatsPerVertex, unsigned int* indices,
+				size_t indicesNumber, unsigned int* outVerticesNumber);
+
+#endif // AFISKON_MESHCLEAN_H
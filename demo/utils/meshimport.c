@@ -0,0 +1,1294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "meshimport.h"
+#include "filemapping.h"
+#include "utils.h"
+
+/*
+ * Streaming importer of OBJ and binary PLY files. The file is read
+ * through FileMapping in a single pass and only the mesh itself is kept
+ * in memory: attribute arrays and joined vertices for OBJ, vertices
+ * for PLY, and triangulated indices. Faces are triangulated as fans.
+ * Missing normals are generated, missing UVs are zero.
+ */
+
+#define FPV MESH_IMPORT_FLOATS_PER_VERTEX
+
+// no attribute, e.g. an OBJ face corner without a normal
+#define IMPORT_NONE 0xFFFFFFFFu
+
+#define IMPORT_MIN_CAPACITY 1024
+
+// bytes of a PLY file checked for the format line
+#define IMPORT_PLY_HEADER_PEEK 1024
+
+// mantissas stay at most 2^53, so they are exact doubles: one more digit
+// is appended while less than these, 8 more - while less than the second
+#define IMPORT_MAX_MANTISSA_DIGIT 900719925474099ull
+#define IMPORT_MAX_MANTISSA_EIGHT_DIGITS 90071992ull
+
+// digits are parsed 8 at a time on little endian CPUs
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define IMPORT_SWAR 0
+#else
+#define IMPORT_SWAR 1
+#endif
+
+static const double importPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Grows an array to hold at least needed elements. Returns the new
+ * array, or NULL if realloc failed and the old one is still valid.
+ */
+static void*
+importGrow(void* data, size_t* capacity, size_t needed, size_t elementSize)
+{
+    if(needed <= *capacity)
+        return data;
+
+    size_t newCapacity = *capacity < IMPORT_MIN_CAPACITY ?
+                         IMPORT_MIN_CAPACITY : *capacity;
+    while(newCapacity < needed)
+        newCapacity *= 2;
+
+    void* newData = realloc(data, newCapacity * elementSize);
+    if(newData != NULL)
+        *capacity = newCapacity;
+    return newData;
+}
+
+// number of the line ptr is on, only used for error messages
+static unsigned long long
+importLineNumber(const char* start, const char* ptr)
+{
+    unsigned long long line = 1;
+    for(; start < ptr; ++start)
+        if(*start == '\n')
+            line++;
+    return line;
+}
+
+#if IMPORT_SWAR
+static bool
+importIsEightDigits(uint64_t word)
+{
+    return ((word & 0xF0F0F0F0F0F0F0F0ull) |
+            (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))
+           == 0x3333333333333333ull;
+}
+
+// SWAR conversion of 8 ASCII digits, the first one is the lowest byte
+static uint32_t
+importParseEightDigits(uint64_t word)
+{
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 100 + (1000000ull << 32);
+    const uint64_t mul2 = 1 + (10000ull << 32);
+    word -= 0x3030303030303030ull;
+    word = word*10 + (word >> 8);
+    word = (((word & mask)*mul1) + (((word >> 16) & mask)*mul2)) >> 32;
+    return (uint32_t)word;
+}
+#endif
+
+/*
+ * Appends decimal digits to mantissa. Digits that would make it larger
+ * than 2^53, i.e. after about 15 significant ones, are counted in
+ * outDropped and don't change mantissa.
+ */
+static const char*
+importDigits(const char* ptr, const char* end, uint64_t* mantissa,
+             int* outDigits, int* outDropped)
+{
+    uint64_t value = *mantissa;
+    int digits = 0;
+    int dropped = 0;
+
+#if IMPORT_SWAR
+    while(end - ptr >= 8 && value < IMPORT_MAX_MANTISSA_EIGHT_DIGITS)
+    {
+        uint64_t word;
+        memcpy(&word, ptr, sizeof(word));
+        if(!importIsEightDigits(word))
+            break;
+        value = value*100000000ull + importParseEightDigits(word);
+        ptr += 8;
+        digits += 8;
+    }
+#endif
+
+    for(; ptr < end && *ptr >= '0' && *ptr <= '9'; ++ptr)
+    {
+        if(value < IMPORT_MAX_MANTISSA_DIGIT)
+            value = value*10 + (uint64_t)(*ptr - '0');
+        else
+            dropped++;
+        digits++;
+    }
+
+    *mantissa = value;
+    *outDigits = digits;
+    *outDropped = dropped;
+    return ptr;
+}
+
+/*
+ * Parses a decimal float like strtof, but without locales and with an
+ * explicit end. The result may differ from strtof by an ulp when the
+ * exponent is large or the mantissa has more than about 15 significant
+ * digits, the rest are truncated. Returns NULL if there is no number
+ * at ptr.
+ */
+static const char*
+importParseFloat(const char* ptr, const char* end, GLfloat* outValue)
+{
+    bool negative = false;
+    if(ptr < end && (*ptr == '-' || *ptr == '+'))
+    {
+        negative = (*ptr == '-');
+        ptr++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits, dropped;
+    ptr = importDigits(ptr, end, &mantissa, &digits, &dropped);
+    int exponent = dropped;
+
+    int fractionDigits = 0;
+    if(ptr < end && *ptr == '.')
+    {
+        int fractionDropped;
+        ptr = importDigits(ptr + 1, end, &mantissa, &fractionDigits,
+                           &fractionDropped);
+        exponent -= fractionDigits - fractionDropped;
+    }
+
+    if(digits + fractionDigits == 0)
+        return NULL;
+
+    if(ptr < end && (*ptr == 'e' || *ptr == 'E'))
+    {
+        const char* expPtr = ptr + 1;
+        bool expNegative = false;
+        if(expPtr < end && (*expPtr == '-' || *expPtr == '+'))
+        {
+            expNegative = (*expPtr == '-');
+            expPtr++;
+        }
+
+        const char* expStart = expPtr;
+        int value = 0;
+        for(; expPtr < end && *expPtr >= '0' && *expPtr <= '9'; ++expPtr)
+            if(value < 100000)
+                value = value*10 + (*expPtr - '0');
+        if(expPtr == expStart)
+            return NULL;
+
+        exponent += expNegative ? -value : value;
+        ptr = expPtr;
+    }
+
+    // both the mantissa and the power are exact doubles in this range,
+    // so the double is correctly rounded, rounding it to float again
+    // is off by an ulp only for rare halfway cases
+    double value = (double)mantissa;
+    if(mantissa == 0)
+        value = 0.0;
+    else if(exponent >= 0 && exponent <= 22)
+        value *= importPowersOf10[exponent];
+    else if(exponent < 0 && exponent >= -22)
+        value /= importPowersOf10[-exponent];
+    else
+        value *= pow(10.0, (double)exponent);
+
+    *outValue = (GLfloat)(negative ? -value : value);
+    return ptr;
+}
+
+static const char*
+importSkipSpaces(const char* ptr, const char* end)
+{
+    while(ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r'))
+        ptr++;
+    return ptr;
+}
+
+/*
+ * Area weighted normals for vertices without them. Vertices of the same
+ * group, e.g. OBJ vertices with the same position and different UVs, get
+ * the same normal. If groups is NULL every vertex is a group of its own
+ * and all of them need normals.
+ */
+static bool
+importNormalsGenerate(const char* fname, GLfloat* vertices,
+                      size_t verticesNumber, const unsigned int* indices,
+                      size_t indicesNumber, const uint32_t* groups,
+                      size_t groupsNumber)
+{
+    if(groups == NULL)
+        groupsNumber = verticesNumber;
+
+    double* sums = (double*)calloc(groupsNumber*3 + 1, sizeof(double));
+    if(sums == NULL)
+    {
+        fprintf(stderr, "importNormalsGenerate - malloc failed, "
+                "fname = %s\n", fname);
+        return false;
+    }
+
+    for(size_t i = 0; i + 2 < indicesNumber; i += 3)
+    {
+        const GLfloat* a = vertices + (size_t)indices[i]*FPV;
+        const GLfloat* b = vertices + (size_t)indices[i + 1]*FPV;
+        const GLfloat* c = vertices + (size_t)indices[i + 2]*FPV;
+        double ab[3], ac[3];
+        for(int k = 0; k < 3; ++k)
+        {
+            ab[k] = (double)b[k] - a[k];
+            ac[k] = (double)c[k] - a[k];
+        }
+
+        // the length of the cross product is twice the area
+        double normal[3] = {
+            ab[1]*ac[2] - ab[2]*ac[1],
+            ab[2]*ac[0] - ab[0]*ac[2],
+            ab[0]*ac[1] - ab[1]*ac[0]
+        };
+        for(int j = 0; j < 3; ++j)
+        {
+            size_t group = groups != NULL ? groups[indices[i + j]*3] :
+                                            indices[i + j];
+            for(int k = 0; k < 3; ++k)
+                sums[group*3 + k] += normal[k];
+        }
+    }
+
+    for(size_t i = 0; i < verticesNumber; ++i)
+    {
+        if(groups != NULL && groups[i*3 + 2] != IMPORT_NONE)
+            continue;
+
+        size_t group = groups != NULL ? groups[i*3] : i;
+        const double* sum = sums + group*3;
+        double length = sqrt(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+        GLfloat* normal = vertices + i*FPV + 3;
+        if(length > 0.0)
+        {
+            for(int k = 0; k < 3; ++k)
+                normal[k] = (GLfloat)(sum[k] / length);
+        }
+        else
+        {
+            normal[0] = 0.0f;
+            normal[1] = 0.0f;
+            normal[2] = 1.0f;
+        }
+    }
+
+    free(sums);
+    return true;
+}
+
+// keys are copied to the table, so a lookup touches a single cache line
+typedef struct
+{
+    uint32_t key[3];
+    uint32_t vertex; // index + 1, 0 is an empty slot
+} ObjSlot;
+
+typedef struct
+{
+    const char* fname;
+    unsigned int maxVerticesNumber;
+
+    GLfloat* positions;
+    size_t positionsNumber;
+    size_t positionsCapacity;
+    GLfloat* normals;
+    size_t normalsNumber;
+    size_t normalsCapacity;
+    GLfloat* uvs;
+    size_t uvsNumber;
+    size_t uvsCapacity;
+
+    // joined vertices, keys are indices of position, UV and normal
+    GLfloat* vertices;
+    uint32_t* keys;
+    size_t verticesNumber;
+    size_t verticesCapacity;
+    size_t keysCapacity;
+    bool missingNormals;
+
+    ObjSlot* table;
+    size_t tableSize;
+
+    unsigned int* indices;
+    size_t indicesNumber;
+    size_t indicesCapacity;
+} ObjParser;
+
+static size_t
+objKeyHash(uint32_t position, uint32_t uv, uint32_t normal)
+{
+    uint64_t hash = (uint64_t)position * 0x9E3779B97F4A7C15ull ^
+                    (uint64_t)uv * 0xC2B2AE3D27D4EB4Full ^
+                    (uint64_t)normal * 0x165667B19E3779F9ull;
+    return (size_t)(hash ^ (hash >> 29));
+}
+
+static bool
+objTableGrow(ObjParser* parser)
+{
+    size_t tableSize = parser->tableSize < IMPORT_MIN_CAPACITY ?
+                       IMPORT_MIN_CAPACITY : parser->tableSize * 2;
+    ObjSlot* table = (ObjSlot*)calloc(tableSize, sizeof(ObjSlot));
+    if(table == NULL)
+        return false;
+
+    for(size_t i = 0; i < parser->tableSize; ++i)
+    {
+        const ObjSlot* old = &parser->table[i];
+        if(old->vertex == 0)
+            continue;
+
+        size_t slot = objKeyHash(old->key[0], old->key[1], old->key[2]) &
+                      (tableSize - 1);
+        while(table[slot].vertex != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        table[slot] = *old;
+    }
+
+    free(parser->table);
+    parser->table = table;
+    parser->tableSize = tableSize;
+    return true;
+}
+
+// index of the vertex with these attributes, it's added if it's new
+static bool
+objVertex(ObjParser* parser, uint32_t position, uint32_t uv,
+          uint32_t normal, unsigned int* outIndex)
+{
+    if((parser->verticesNumber + 1)*2 > parser->tableSize &&
+       !objTableGrow(parser))
+    {
+        fprintf(stderr, "objVertex - malloc failed, fname = %s\n",
+                parser->fname);
+        return false;
+    }
+
+    size_t mask = parser->tableSize - 1;
+    size_t slot = objKeyHash(position, uv, normal) & mask;
+    for(; parser->table[slot].vertex != 0; slot = (slot + 1) & mask)
+    {
+        const ObjSlot* entry = &parser->table[slot];
+        if(entry->key[0] == position && entry->key[1] == uv &&
+           entry->key[2] == normal)
+        {
+            *outIndex = entry->vertex - 1;
+            return true;
+        }
+    }
+
+    if(parser->verticesNumber >= parser->maxVerticesNumber)
+    {
+        fprintf(stderr, "objVertex - too many vertices, fname = %s\n",
+                parser->fname);
+        return false;
+    }
+
+    size_t needed = parser->verticesNumber + 1;
+    GLfloat* vertices = (GLfloat*)importGrow(parser->vertices,
+                                             &parser->verticesCapacity,
+                                             needed, sizeof(GLfloat)*FPV);
+    if(vertices != NULL)
+        parser->vertices = vertices;
+    uint32_t* keys = (uint32_t*)importGrow(parser->keys,
+                                           &parser->keysCapacity, needed,
+                                           sizeof(uint32_t)*3);
+    if(keys != NULL)
+        parser->keys = keys;
+    if(vertices == NULL || keys == NULL)
+    {
+        fprintf(stderr, "objVertex - malloc failed, fname = %s\n",
+                parser->fname);
+        return false;
+    }
+
+    size_t index = parser->verticesNumber++;
+    uint32_t* key = parser->keys + index*3;
+    key[0] = position;
+    key[1] = uv;
+    key[2] = normal;
+    ObjSlot* entry = &parser->table[slot];
+    memcpy(entry->key, key, sizeof(entry->key));
+    entry->vertex = (uint32_t)(index + 1);
+
+    GLfloat* vertex = parser->vertices + index*FPV;
+    memcpy(vertex, parser->positions + (size_t)position*3,
+           sizeof(GLfloat)*3);
+    if(normal != IMPORT_NONE)
+        memcpy(vertex + 3, parser->normals + (size_t)normal*3,
+               sizeof(GLfloat)*3);
+    else
+    {
+        memset(vertex + 3, 0, sizeof(GLfloat)*3);
+        parser->missingNormals = true;
+    }
+    if(uv != IMPORT_NONE)
+    {
+        // flipped like UVs imported with assimp
+        vertex[6] = parser->uvs[(size_t)uv*2];
+        vertex[7] = 1.0f - parser->uvs[(size_t)uv*2 + 1];
+    }
+    else
+    {
+        vertex[6] = 0.0f;
+        vertex[7] = 0.0f;
+    }
+
+    *outIndex = (unsigned int)index;
+    return true;
+}
+
+// 1-based or negative, i.e. relative to the end, attribute index
+static const char*
+objParseIndex(const char* ptr, const char* end, size_t number,
+              uint32_t* outIndex)
+{
+    bool negative = false;
+    if(ptr < end && *ptr == '-')
+    {
+        negative = true;
+        ptr++;
+    }
+
+    const char* start = ptr;
+    uint64_t value = 0;
+    for(; ptr < end && *ptr >= '0' && *ptr <= '9'; ++ptr)
+        if(value <= number)
+            value = value*10 + (uint64_t)(*ptr - '0');
+
+    if(ptr == start || value == 0 || value > number)
+        return NULL;
+
+    *outIndex = (uint32_t)(negative ? number - value : value - 1);
+    return ptr;
+}
+
+// reads up to count floats, the rest are zero
+static const char*
+objParseFloats(const char* ptr, const char* end, GLfloat* outValues,
+               unsigned int count, unsigned int required)
+{
+    for(unsigned int i = 0; i < count; ++i)
+    {
+        ptr = importSkipSpaces(ptr, end);
+        if(ptr == end || *ptr == '#')
+        {
+            if(i < required)
+                return NULL;
+            for(; i < count; ++i)
+                outValues[i] = 0.0f;
+            return ptr;
+        }
+
+        ptr = importParseFloat(ptr, end, &outValues[i]);
+        if(ptr == NULL)
+            return NULL;
+    }
+    return ptr;
+}
+
+static bool
+objParseFace(ObjParser* parser, const char* ptr, const char* end)
+{
+    unsigned int first = 0, previous = 0;
+    unsigned int cornersNumber = 0;
+    for(;;)
+    {
+        ptr = importSkipSpaces(ptr, end);
+        if(ptr == end || *ptr == '#')
+            break;
+
+        uint32_t position, uv = IMPORT_NONE, normal = IMPORT_NONE;
+        ptr = objParseIndex(ptr, end, parser->positionsNumber, &position);
+        if(ptr != NULL && ptr < end && *ptr == '/')
+        {
+            ptr++;
+            if(ptr < end && *ptr != '/')
+                ptr = objParseIndex(ptr, end, parser->uvsNumber, &uv);
+            if(ptr != NULL && ptr < end && *ptr == '/')
+                ptr = objParseIndex(ptr + 1, end, parser->normalsNumber,
+                                   &normal);
+        }
+        if(ptr == NULL)
+            return false;
+
+        unsigned int index;
+        if(!objVertex(parser, position, uv, normal, &index))
+            return false;
+
+        cornersNumber++;
+        if(cornersNumber == 1)
+            first = index;
+        else if(cornersNumber >= 3)
+        {
+            unsigned int* indices = (unsigned int*)importGrow(
+                                        parser->indices,
+                                        &parser->indicesCapacity,
+                                        parser->indicesNumber + 3,
+                                        sizeof(unsigned int));
+            if(indices == NULL)
+            {
+                fprintf(stderr, "objParseFace - malloc failed, "
+                        "fname = %s\n", parser->fname);
+                return false;
+            }
+            parser->indices = indices;
+            indices += parser->indicesNumber;
+            indices[0] = first;
+            indices[1] = previous;
+            indices[2] = index;
+            parser->indicesNumber += 3;
+        }
+        previous = index;
+    }
+    return true;
+}
+
+// appends count floats to an attribute array
+static bool
+objParseAttribute(ObjParser* parser, const char* ptr, const char* end,
+                  GLfloat** values, size_t* number, size_t* capacity,
+                  unsigned int count, unsigned int required)
+{
+    if(*number >= IMPORT_NONE)
+        return false;
+
+    GLfloat* newValues = (GLfloat*)importGrow(*values, capacity,
+                                              *number + 1,
+                                              sizeof(GLfloat)*count);
+    if(newValues == NULL)
+    {
+        fprintf(stderr, "objParseAttribute - malloc failed, fname = %s\n",
+                parser->fname);
+        return false;
+    }
+    *values = newValues;
+
+    if(objParseFloats(ptr, end, newValues + *number*count, count,
+                      required) == NULL)
+        return false;
+    (*number)++;
+    return true;
+}
+
+static void
+objParserFree(ObjParser* parser)
+{
+    free(parser->positions);
+    free(parser->normals);
+    free(parser->uvs);
+    free(parser->vertices);
+    free(parser->keys);
+    free(parser->table);
+    free(parser->indices);
+}
+
+static bool
+objLoad(const char* fname, const char* data, size_t size,
+        unsigned int maxVerticesNumber, MeshImport* outMesh)
+{
+    ObjParser parser;
+    memset(&parser, 0, sizeof(parser));
+    parser.fname = fname;
+    parser.maxVerticesNumber = maxVerticesNumber;
+
+    const char* ptr = data;
+    const char* end = data + size;
+    while(ptr < end)
+    {
+        const char* lineEnd = (const char*)memchr(ptr, '\n',
+                                                  (size_t)(end - ptr));
+        if(lineEnd == NULL)
+            lineEnd = end;
+
+        const char* line = importSkipSpaces(ptr, lineEnd);
+        bool res = true;
+        if(lineEnd - line >= 2 && isspace((unsigned char)line[1]))
+        {
+            if(line[0] == 'v')
+                res = objParseAttribute(&parser, line + 1, lineEnd,
+                                        &parser.positions,
+                                        &parser.positionsNumber,
+                                        &parser.positionsCapacity, 3, 3);
+            else if(line[0] == 'f')
+                res = objParseFace(&parser, line + 1, lineEnd);
+        }
+        else if(lineEnd - line >= 3 && line[0] == 'v' &&
+                isspace((unsigned char)line[2]))
+        {
+            if(line[1] == 'n')
+                res = objParseAttribute(&parser, line + 2, lineEnd,
+                                        &parser.normals,
+                                        &parser.normalsNumber,
+                                        &parser.normalsCapacity, 3, 3);
+            else if(line[1] == 't')
+                res = objParseAttribute(&parser, line + 2, lineEnd,
+                                        &parser.uvs, &parser.uvsNumber,
+                                        &parser.uvsCapacity, 2, 1);
+        }
+
+        if(!res)
+        {
+            fprintf(stderr, "objLoad - invalid line %llu, fname = %s\n",
+                    importLineNumber(data, line), fname);
+            objParserFree(&parser);
+            return false;
+        }
+        ptr = lineEnd + (lineEnd < end ? 1 : 0);
+    }
+
+    if(parser.indicesNumber == 0)
+    {
+        fprintf(stderr, "objLoad - no faces, fname = %s\n", fname);
+        objParserFree(&parser);
+        return false;
+    }
+
+    if(parser.missingNormals &&
+       !importNormalsGenerate(fname, parser.vertices, parser.verticesNumber,
+                              parser.indices, parser.indicesNumber,
+                              parser.keys, parser.positionsNumber))
+    {
+        objParserFree(&parser);
+        return false;
+    }
+
+    outMesh->vertices = parser.vertices;
+    outMesh->verticesNumber = (unsigned int)parser.verticesNumber;
+    outMesh->indices = parser.indices;
+    outMesh->indicesNumber = parser.indicesNumber;
+    parser.vertices = NULL;
+    parser.indices = NULL;
+    objParserFree(&parser);
+    return true;
+}
+
+#define PLY_MAX_ELEMENTS 16
+#define PLY_MAX_PROPERTIES 32
+#define PLY_MAX_NAME 32
+
+enum
+{
+    PLY_NONE = 0,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+static const size_t plyTypeSize[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+typedef struct
+{
+    char name[PLY_MAX_NAME];
+    unsigned char type;
+    unsigned char countType; // PLY_NONE unless it's a list
+} PlyProperty;
+
+typedef struct
+{
+    char name[PLY_MAX_NAME];
+    size_t count;
+    unsigned int propertiesNumber;
+    PlyProperty properties[PLY_MAX_PROPERTIES];
+} PlyElement;
+
+typedef struct
+{
+    bool swap; // the file and the CPU have different byte orders
+    unsigned int elementsNumber;
+    PlyElement elements[PLY_MAX_ELEMENTS];
+    size_t headerSize;
+} PlyHeader;
+
+static unsigned char
+plyTypeParse(const char* name)
+{
+    static const char* const names[][2] = {
+        { "", "" },
+        { "char", "int8" }, { "uchar", "uint8" },
+        { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" },
+        { "float", "float32" }, { "double", "float64" }
+    };
+
+    for(unsigned char type = PLY_INT8; type <= PLY_FLOAT64; ++type)
+        if(strcmp(name, names[type][0]) == 0 ||
+           strcmp(name, names[type][1]) == 0)
+            return type;
+    return PLY_NONE;
+}
+
+static double
+plyRead(const unsigned char* ptr, unsigned char type, bool swap)
+{
+    unsigned char bytes[8];
+    size_t size = plyTypeSize[type];
+    if(swap)
+    {
+        for(size_t i = 0; i < size; ++i)
+            bytes[i] = ptr[size - 1 - i];
+    }
+    else
+        memcpy(bytes, ptr, size);
+
+    switch(type)
+    {
+    case PLY_INT8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+    case PLY_UINT8: { uint8_t v; memcpy(&v, bytes, 1); return v; }
+    case PLY_INT16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+    default: { double v; memcpy(&v, bytes, 8); return v; }
+    }
+}
+
+// most files are in the byte order of the CPU and use floats and ints
+static GLfloat
+plyReadFloat(const unsigned char* ptr, unsigned char type, bool swap)
+{
+    if(type == PLY_FLOAT32 && !swap)
+    {
+        GLfloat value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    return (GLfloat)plyRead(ptr, type, swap);
+}
+
+// -1 for values that can't be an index
+static int64_t
+plyReadIndex(const unsigned char* ptr, unsigned char type, bool swap)
+{
+    if((type == PLY_INT32 || type == PLY_UINT32) && !swap)
+    {
+        uint32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return type == PLY_INT32 && value > 0x7FFFFFFFu ? -1 :
+                                                          (int64_t)value;
+    }
+
+    double value = plyRead(ptr, type, swap);
+    if(!(value >= 0.0 && value < 4294967296.0))
+        return -1;
+    return (int64_t)value;
+}
+
+static bool
+plyHostIsLittleEndian()
+{
+    uint16_t value = 1;
+    unsigned char byte;
+    memcpy(&byte, &value, 1);
+    return byte == 1;
+}
+
+/*
+ * Parses the ASCII header. Only binary files are supported, ASCII ones
+ * are left to assimp, see meshImportSupported.
+ */
+static bool
+plyHeaderParse(const char* fname, const char* data, size_t size,
+               PlyHeader* outHeader)
+{
+    memset(outHeader, 0, sizeof(PlyHeader));
+
+    const char* ptr = data;
+    const char* end = data + size;
+    bool formatFound = false;
+    unsigned int lineNumber = 0;
+    while(ptr < end)
+    {
+        const char* lineEnd = (const char*)memchr(ptr, '\n',
+                                                  (size_t)(end - ptr));
+        if(lineEnd == NULL)
+            break;
+
+        char line[256];
+        size_t lineSize = (size_t)(lineEnd - ptr);
+        if(lineSize >= sizeof(line))
+            lineSize = sizeof(line) - 1;
+        memcpy(line, ptr, lineSize);
+        line[lineSize] = '\0';
+        if(lineSize > 0 && line[lineSize - 1] == '\r')
+            line[lineSize - 1] = '\0';
+        ptr = lineEnd + 1;
+        lineNumber++;
+
+        char word[PLY_MAX_NAME], type1[PLY_MAX_NAME], type2[PLY_MAX_NAME];
+        char name[PLY_MAX_NAME];
+        unsigned long long count;
+        if(lineNumber == 1)
+        {
+            if(strcmp(line, "ply") != 0)
+                break;
+        }
+        else if(strcmp(line, "end_header") == 0)
+        {
+            if(!formatFound)
+                break;
+            outHeader->headerSize = (size_t)(ptr - data);
+            return true;
+        }
+        else if(sscanf(line, "format %31s", word) == 1)
+        {
+            bool little;
+            if(strcmp(word, "binary_little_endian") == 0)
+                little = true;
+            else if(strcmp(word, "binary_big_endian") == 0)
+                little = false;
+            else
+                break;
+            outHeader->swap = little != plyHostIsLittleEndian();
+            formatFound = true;
+        }
+        else if(sscanf(line, "element %31s %llu", name, &count) == 2)
+        {
+            if(outHeader->elementsNumber == PLY_MAX_ELEMENTS)
+                break;
+            PlyElement* element =
+                        &outHeader->elements[outHeader->elementsNumber++];
+            strcpy(element->name, name);
+            element->count = (size_t)count;
+        }
+        else if(sscanf(line, "property list %31s %31s %31s", type1, type2,
+                       name) == 3 ||
+                sscanf(line, "property %31s %31s", type2, name) == 2)
+        {
+            if(outHeader->elementsNumber == 0)
+                break;
+            PlyElement* element =
+                        &outHeader->elements[outHeader->elementsNumber - 1];
+            if(element->propertiesNumber == PLY_MAX_PROPERTIES)
+                break;
+            PlyProperty* property =
+                        &element->properties[element->propertiesNumber++];
+            bool list = strncmp(line, "property list ", 14) == 0;
+            strcpy(property->name, name);
+            property->type = plyTypeParse(type2);
+            property->countType = list ? plyTypeParse(type1) : PLY_NONE;
+            if(property->type == PLY_NONE ||
+               (list && (property->countType == PLY_NONE ||
+                         property->countType == PLY_FLOAT32 ||
+                         property->countType == PLY_FLOAT64)))
+                break;
+        }
+        else if(strncmp(line, "comment", 7) != 0 &&
+                strncmp(line, "obj_info", 8) != 0)
+            break;
+    }
+
+    fprintf(stderr, "plyHeaderParse - invalid header line %u, fname = %s\n",
+            lineNumber, fname);
+    return false;
+}
+
+static int
+plyPropertyFind(const PlyElement* element, const char* const* names)
+{
+    for(unsigned int i = 0; i < element->propertiesNumber; ++i)
+        for(const char* const* name = names; *name != NULL; ++name)
+            if(strcmp(element->properties[i].name, *name) == 0)
+                return (int)i;
+    return -1;
+}
+
+// size of a row without lists, 0 if there are lists
+static size_t
+plyElementStride(const PlyElement* element)
+{
+    size_t stride = 0;
+    for(unsigned int i = 0; i < element->propertiesNumber; ++i)
+    {
+        if(element->properties[i].countType != PLY_NONE)
+            return 0;
+        stride += plyTypeSize[element->properties[i].type];
+    }
+    return stride;
+}
+
+static bool
+plyVerticesRead(const char* fname, const PlyHeader* header,
+                const PlyElement* element, const unsigned char** ptr,
+                const unsigned char* end, unsigned int maxVerticesNumber,
+                MeshImport* mesh)
+{
+    static const char* const names[FPV][4] = {
+        { "x", NULL }, { "y", NULL }, { "z", NULL },
+        { "nx", NULL }, { "ny", NULL }, { "nz", NULL },
+        { "u", "s", "texture_u", NULL }, { "v", "t", "texture_v", NULL }
+    };
+
+    size_t stride = plyElementStride(element);
+    if(mesh->vertices != NULL || stride == 0 || element->count == 0 ||
+       element->count > maxVerticesNumber ||
+       element->count > (size_t)(end - *ptr) / stride)
+    {
+        fprintf(stderr, "plyVerticesRead - invalid vertices, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    int properties[FPV];
+    size_t offsets[FPV];
+    for(int k = 0; k < FPV; ++k)
+    {
+        properties[k] = plyPropertyFind(element, names[k]);
+        offsets[k] = 0;
+        for(int i = 0; i < properties[k]; ++i)
+            offsets[k] += plyTypeSize[element->properties[i].type];
+    }
+    if(properties[0] < 0 || properties[1] < 0 || properties[2] < 0)
+    {
+        fprintf(stderr, "plyVerticesRead - no positions, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    GLfloat* vertices = (GLfloat*)malloc(element->count*FPV*sizeof(GLfloat));
+    if(vertices == NULL)
+    {
+        fprintf(stderr, "plyVerticesRead - malloc failed, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    const unsigned char* row = *ptr;
+    for(size_t i = 0; i < element->count; ++i, row += stride)
+    {
+        GLfloat* vertex = vertices + i*FPV;
+        for(int k = 0; k < FPV; ++k)
+        {
+            if(properties[k] < 0)
+                vertex[k] = 0.0f;
+            else
+                vertex[k] = plyReadFloat(row + offsets[k],
+                                element->properties[properties[k]].type,
+                                header->swap);
+        }
+        // flipped like UVs imported with assimp
+        if(properties[7] >= 0)
+            vertex[7] = 1.0f - vertex[7];
+    }
+
+    *ptr = row;
+    mesh->vertices = vertices;
+    mesh->verticesNumber = (unsigned int)element->count;
+    return true;
+}
+
+// reads faces, or just skips the element if it's not the face one
+static bool
+plyElementRead(const char* fname, const PlyHeader* header,
+               const PlyElement* element, const unsigned char** ptr,
+               const unsigned char* end, MeshImport* mesh,
+               size_t* indicesCapacity)
+{
+    static const char* const indicesNames[] = {
+        "vertex_indices", "vertex_index", NULL
+    };
+
+    bool faces = strcmp(element->name, "face") == 0;
+    int indicesProperty = faces ? plyPropertyFind(element, indicesNames) :
+                                  -1;
+    size_t stride = plyElementStride(element);
+    if(indicesProperty < 0 && stride != 0)
+    {
+        if(element->count > (size_t)(end - *ptr) / stride)
+            return false;
+        *ptr += element->count * stride;
+        return true;
+    }
+
+    if(indicesProperty >= 0 && mesh->vertices == NULL)
+    {
+        fprintf(stderr, "plyElementRead - faces before vertices, "
+                "fname = %s\n", fname);
+        return false;
+    }
+
+    const unsigned char* cur = *ptr;
+    for(size_t i = 0; i < element->count; ++i)
+    {
+        for(unsigned int j = 0; j < element->propertiesNumber; ++j)
+        {
+            const PlyProperty* property = &element->properties[j];
+            if(property->countType == PLY_NONE)
+            {
+                if((size_t)(end - cur) < plyTypeSize[property->type])
+                    return false;
+                cur += plyTypeSize[property->type];
+                continue;
+            }
+
+            size_t countSize = plyTypeSize[property->countType];
+            size_t itemSize = plyTypeSize[property->type];
+            if((size_t)(end - cur) < countSize)
+                return false;
+            double count = plyRead(cur, property->countType, header->swap);
+            cur += countSize;
+            if(count < 0.0 || count > (double)((size_t)(end - cur) /
+                                               itemSize))
+                return false;
+
+            size_t itemsNumber = (size_t)count;
+            if((int)j == indicesProperty && itemsNumber >= 3)
+            {
+                unsigned int* indices = (unsigned int*)importGrow(
+                            mesh->indices, indicesCapacity,
+                            mesh->indicesNumber + (itemsNumber - 2)*3,
+                            sizeof(unsigned int));
+                if(indices == NULL)
+                {
+                    fprintf(stderr, "plyElementRead - malloc failed, "
+                            "fname = %s\n", fname);
+                    return false;
+                }
+                mesh->indices = indices;
+
+                unsigned int first = 0, previous = 0;
+                for(size_t k = 0; k < itemsNumber; ++k)
+                {
+                    int64_t value = plyReadIndex(cur + k*itemSize,
+                                                 property->type, header->swap);
+                    if(value < 0 || value >= (int64_t)mesh->verticesNumber)
+                    {
+                        fprintf(stderr, "plyElementRead - invalid index, "
+                                "fname = %s\n", fname);
+                        return false;
+                    }
+
+                    unsigned int index = (unsigned int)value;
+                    if(k == 0)
+                        first = index;
+                    else if(k >= 2)
+                    {
+                        unsigned int* triangle = mesh->indices +
+                                                 mesh->indicesNumber;
+                        triangle[0] = first;
+                        triangle[1] = previous;
+                        triangle[2] = index;
+                        mesh->indicesNumber += 3;
+                    }
+                    previous = index;
+                }
+            }
+            cur += itemsNumber*itemSize;
+        }
+    }
+
+    *ptr = cur;
+    return true;
+}
+
+/*
+ * Puts vertices in order of first use and drops unused ones, so vertices
+ * are ordered like joined OBJ vertices and vertices imported with
+ * assimp.
+ */
+static bool
+plyVerticesCompact(const char* fname, MeshImport* mesh)
+{
+    uint32_t* remap = (uint32_t*)malloc(sizeof(uint32_t) *
+                                        ((size_t)mesh->verticesNumber + 1));
+    GLfloat* vertices = (GLfloat*)malloc(sizeof(GLfloat) * FPV *
+                                         ((size_t)mesh->verticesNumber + 1));
+    if(remap == NULL || vertices == NULL)
+    {
+        fprintf(stderr, "plyVerticesCompact - malloc failed, fname = %s\n",
+                fname);
+        free(vertices);
+        free(remap);
+        return false;
+    }
+    memset(remap, 0xFF, sizeof(uint32_t) * mesh->verticesNumber);
+
+    unsigned int verticesNumber = 0;
+    for(size_t i = 0; i < mesh->indicesNumber; ++i)
+    {
+        unsigned int index = mesh->indices[i];
+        if(remap[index] == IMPORT_NONE)
+        {
+            remap[index] = verticesNumber;
+            memcpy(vertices + (size_t)verticesNumber*FPV,
+                   mesh->vertices + (size_t)index*FPV,
+                   sizeof(GLfloat)*FPV);
+            verticesNumber++;
+        }
+        mesh->indices[i] = remap[index];
+    }
+
+    free(remap);
+    free(mesh->vertices);
+    mesh->vertices = vertices;
+    mesh->verticesNumber = verticesNumber;
+    return true;
+}
+
+static bool
+plyLoad(const char* fname, const unsigned char* data, size_t size,
+        unsigned int maxVerticesNumber, MeshImport* outMesh)
+{
+    PlyHeader header;
+    if(!plyHeaderParse(fname, (const char*)data, size, &header))
+        return false;
+
+    const unsigned char* ptr = data + header.headerSize;
+    const unsigned char* end = data + size;
+    size_t indicesCapacity = 0;
+    bool normals = false;
+    for(unsigned int i = 0; i < header.elementsNumber; ++i)
+    {
+        const PlyElement* element = &header.elements[i];
+        bool res;
+        if(strcmp(element->name, "vertex") == 0)
+        {
+            static const char* const nxNames[] = { "nx", NULL };
+            normals = plyPropertyFind(element, nxNames) >= 0;
+            res = plyVerticesRead(fname, &header, element, &ptr, end,
+                                  maxVerticesNumber, outMesh);
+        }
+        else
+            res = plyElementRead(fname, &header, element, &ptr, end,
+                                 outMesh, &indicesCapacity);
+
+        if(!res)
+        {
+            fprintf(stderr, "plyLoad - invalid element %s, fname = %s\n",
+                    element->name, fname);
+            meshImportFree(outMesh);
+            return false;
+        }
+    }
+
+    if(outMesh->indicesNumber == 0)
+    {
+        fprintf(stderr, "plyLoad - no faces, fname = %s\n", fname);
+        meshImportFree(outMesh);
+        return false;
+    }
+
+    if(!normals &&
+       !importNormalsGenerate(fname, outMesh->vertices,
+                              outMesh->verticesNumber, outMesh->indices,
+                              outMesh->indicesNumber, NULL, 0))
+    {
+        meshImportFree(outMesh);
+        return false;
+    }
+
+    if(!plyVerticesCompact(fname, outMesh))
+    {
+        meshImportFree(outMesh);
+        return false;
+    }
+    return true;
+}
+
+static const char*
+importExtension(const char* fname)
+{
+    const char* dot = strrchr(fname, '.');
+    return dot != NULL ? dot + 1 : "";
+}
+
+static bool
+importExtensionIs(const char* fname, const char* extension)
+{
+    const char* ext = importExtension(fname);
+    for(; *ext != '\0' && *extension != '\0'; ++ext, ++extension)
+        if(tolower((unsigned char)*ext) != *extension)
+            return false;
+    return *ext == '\0' && *extension == '\0';
+}
+
+/*
+ * OBJ files and binary PLY files are supported, ASCII PLY files are rare
+ * and are left to assimp.
+ */
+bool
+meshImportSupported(const char* fname)
+{
+    if(importExtensionIs(fname, "obj"))
+        return true;
+    if(!importExtensionIs(fname, "ply"))
+        return false;
+
+    FILE* fd = fopen(fname, "rb");
+    if(fd == NULL)
+        return false;
+
+    char header[IMPORT_PLY_HEADER_PEEK + 1];
+    size_t size = fread(header, 1, IMPORT_PLY_HEADER_PEEK, fd);
+    fclose(fd);
+    header[size] = '\0';
+    return strstr(header, "\nformat binary_") != NULL;
+}
+
+bool
+meshImportLoad(const char* fname, unsigned int maxVerticesNumber,
+               MeshImport* outMesh)
+{
+    memset(outMesh, 0, sizeof(MeshImport));
+
+    uint64_t startTimeUs = getCurrentTimeUs();
+    // parsed once from the start to the end
+    FileMapping* mapping = fileMappingCreateWithHints(fname,
+                                        FILE_MAPPING_HINT_SEQUENTIAL);
+    if(mapping == NULL)
+        return false;
+
+    const unsigned char* data = fileMappingGetPointer(mapping);
+    size_t size = fileMappingGetSize(mapping);
+    bool res = importExtensionIs(fname, "obj") ?
+        objLoad(fname, (const char*)data, size, maxVerticesNumber, outMesh) :
+        plyLoad(fname, data, size, maxVerticesNumber, outMesh);
+    fileMappingDestroy(mapping);
+    if(!res)
+        return false;
+
+    double timeSec = (double)(getCurrentTimeUs() - startTimeUs) / 1e6;
+    if(timeSec <= 0.0)
+        timeSec = 1e-6;
+    double sizeMb = (double)size / (1024.0*1024.0);
+    fprintf(stderr, "meshImportLoad - fname = %s, %u vertices, %llu "
+            "triangles, %.2f MB in %.1f ms, %.1f MB/s\n", fname,
+            outMesh->verticesNumber,
+            (unsigned long long)(outMesh->indicesNumber / 3), sizeMb,
+            timeSec * 1000.0, sizeMb / timeSec);
+    return true;
+}
+
+void
+meshImportFree(MeshImport* mesh)
+{
+    free(mesh->indices);
+    free(mesh->vertices);
+    memset(mesh, 0, sizeof(MeshImport));
+}
@@ -0,0 +1,26 @@
+#ifndef AFISKON_MESHIMPORT_H
+#define AFISKON_MESHIMPORT_H
+
+#include <GLXW/glxw.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// position, normal, UV, the same layout as vertices of emdconv
+#define MESH_IMPORT_FLOATS_PER_VERTEX (3 + 3 + 2)
+
+// Indexed triangles, vertices with equal attribute indices of an OBJ
+// file are already joined like with aiProcess_JoinIdenticalVertices.
+typedef struct
+{
+    GLfloat* vertices;
+    unsigned int verticesNumber;
+    unsigned int* indices;
+    size_t indicesNumber;
+} MeshImport;
+
+bool meshImportSupported(const char* fname);
+bool meshImportLoad(const char* fname, unsigned int maxVerticesNumber,
+				MeshImport* outMesh);
+void meshImportFree(MeshImport* mesh);
+
+#endif // AFISKON_MESHIMPORT_H
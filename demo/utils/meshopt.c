@@ -0,0 +1,730 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "meshopt.h"
+
+/*
+ * Simulates FIFO post-transform cache of cacheSize vertices.
+ * ACMR - average cache miss ratio, transformed vertices per triangle,
+ * 0.5 is the best possible value for large meshes, 3.0 is the worst.
+ * ATVR - average transform to vertex ratio, 1.0 is the best.
+ */
+void
+meshAnalyzeVertexCache(const unsigned int* indices, size_t indicesNumber,
+    unsigned int verticesNumber, unsigned int cacheSize, float* outAcmr,
+    float* outAtvr)
+{
+    *outAcmr = 0.0f;
+    *outAtvr = 0.0f;
+
+    if(indicesNumber == 0 || verticesNumber == 0)
+        return;
+
+    // number of misses when vertex entered the cache (starting from 1,
+    // 0 means never), FIFO cache doesn't update it on hits
+    size_t* timestamps = (size_t*)calloc(verticesNumber, sizeof(size_t));
+    if(timestamps == NULL)
+    {
+        fprintf(stderr, "meshAnalyzeVertexCache - calloc failed\n");
+        return;
+    }
+
+    size_t misses = 0;
+    for(size_t i = 0; i < indicesNumber; ++i)
+    {
+        unsigned int v = indices[i];
+        if(timestamps[v] == 0 || misses - timestamps[v] + 1 > cacheSize)
+        {
+            misses++;
+            timestamps[v] = misses;
+        }
+    }
+
+    free(timestamps);
+
+    *outAcmr = (float)misses / (float)(indicesNumber / 3);
+    *outAtvr = (float)misses / (float)verticesNumber;
+}
+
+/*
+ * Skips to the next vertex that still has triangles to emit: first
+ * the recently used ones from dead-end stack, then in input order.
+ */
+static unsigned int
+tipsifySkipDeadEnd(const unsigned int* liveTriangles,
+    unsigned int* deadEndStack, size_t* deadEndTop,
+    unsigned int verticesNumber, unsigned int* inputCursor)
+{
+    while(*deadEndTop > 0)
+    {
+        unsigned int v = deadEndStack[--(*deadEndTop)];
+        if(liveTriangles[v] > 0)
+            return v;
+    }
+
+    while(*inputCursor < verticesNumber)
+    {
+        unsigned int v = (*inputCursor)++;
+        if(liveTriangles[v] > 0)
+            return v;
+    }
+
+    return verticesNumber;
+}
+
+static void
+tipsifyReorder(const unsigned int* indices, unsigned int verticesNumber,
+    unsigned int cacheSize, const size_t* offsets, const size_t* adjacency,
+    unsigned int* liveTriangles, size_t* timestamps,
+    unsigned int* deadEndStack, unsigned char* emitted,
+    unsigned int* candidates, unsigned int* result, size_t* outResultSize)
+{
+    size_t resultSize = 0;
+    size_t deadEndTop = 0;
+    size_t time = cacheSize + 1;
+    unsigned int inputCursor = 0;
+    unsigned int fanningVertex = 0;
+
+    while(fanningVertex < verticesNumber)
+    {
+        size_t candidatesNumber = 0;
+
+        for(size_t a = offsets[fanningVertex];
+            a < offsets[fanningVertex + 1]; ++a)
+        {
+            size_t t = adjacency[a];
+            if(emitted[t])
+                continue;
+
+            for(unsigned int k = 0; k < 3; ++k)
+            {
+                unsigned int v = indices[t*3 + k];
+                result[resultSize++] = v;
+                deadEndStack[deadEndTop++] = v;
+                candidates[candidatesNumber++] = v;
+                liveTriangles[v]--;
+
+                if(time - timestamps[v] > cacheSize)
+                    timestamps[v] = time++;
+            }
+
+            emitted[t] = 1;
+        }
+
+        // pick the candidate that is still in the cache and will stay
+        // there while all of its triangles are emitted, the oldest first
+        unsigned int nextVertex = verticesNumber;
+        size_t bestPriority = 0;
+        for(size_t c = 0; c < candidatesNumber; ++c)
+        {
+            unsigned int v = candidates[c];
+            if(liveTriangles[v] == 0)
+                continue;
+
+            size_t priority = 0;
+            if(time - timestamps[v] + 2*(size_t)liveTriangles[v] <= cacheSize)
+                priority = time - timestamps[v];
+
+            if(nextVertex == verticesNumber || priority > bestPriority)
+            {
+                bestPriority = priority;
+                nextVertex = v;
+            }
+        }
+
+        if(nextVertex == verticesNumber)
+            nextVertex = tipsifySkipDeadEnd(liveTriangles, deadEndStack,
+                                            &deadEndTop, verticesNumber,
+                                            &inputCursor);
+
+        fanningVertex = nextVertex;
+    }
+
+    *outResultSize = resultSize;
+}
+
+/*
+ * Reorders triangles for better post-transform cache use, see
+ * "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+ * by Sander, Nehab and Barczak (Tipsify). Runs in linear time. Vertex
+ * order inside each triangle and so the winding are not changed.
+ */
+bool
+meshOptimizeVertexCache(unsigned int* indices, size_t indicesNumber,
+    unsigned int verticesNumber, unsigned int cacheSize)
+{
+    size_t trianglesNumber = indicesNumber / 3;
+    if(trianglesNumber == 0 || verticesNumber == 0)
+        return true;
+
+    // vertex -> triangles adjacency, in compressed form:
+    // triangles of vertex v are adjacency[offsets[v]...offsets[v+1]-1]
+    size_t* offsets = (size_t*)calloc((size_t)verticesNumber + 1,
+                                      sizeof(size_t));
+    unsigned int* liveTriangles = (unsigned int*)calloc(verticesNumber,
+                                      sizeof(unsigned int));
+    size_t* timestamps = (size_t*)calloc(verticesNumber, sizeof(size_t));
+    size_t* adjacency = (size_t*)malloc(sizeof(size_t) * trianglesNumber*3);
+    unsigned int* deadEndStack = (unsigned int*)malloc(
+                                      sizeof(unsigned int) * trianglesNumber*3);
+    unsigned char* emitted = (unsigned char*)calloc(trianglesNumber, 1);
+    unsigned int* candidates = (unsigned int*)malloc(
+                                      sizeof(unsigned int) * trianglesNumber*3);
+    unsigned int* result = (unsigned int*)malloc(
+                                      sizeof(unsigned int) * trianglesNumber*3);
+
+    bool res = (offsets != NULL && liveTriangles != NULL &&
+                timestamps != NULL && adjacency != NULL &&
+                deadEndStack != NULL && emitted != NULL &&
+                candidates != NULL && result != NULL);
+    if(!res)
+        fprintf(stderr, "meshOptimizeVertexCache - malloc failed\n");
+
+    if(res)
+    {
+        for(size_t i = 0; i < trianglesNumber*3; ++i)
+            liveTriangles[indices[i]]++;
+
+        for(unsigned int v = 0; v < verticesNumber; ++v)
+            offsets[v + 1] = offsets[v] + liveTriangles[v];
+
+        // offsets[v] is used as insertion point and restored afterwards
+        for(size_t t = 0; t < trianglesNumber; ++t)
+            for(unsigned int k = 0; k < 3; ++k)
+                adjacency[offsets[indices[t*3 + k]]++] = t;
+
+        for(unsigned int v = verticesNumber; v > 0; --v)
+            offsets[v] = offsets[v - 1];
+        offsets[0] = 0;
+
+        size_t resultSize = 0;
+        tipsifyReorder(indices, verticesNumber, cacheSize,
+                       offsets, adjacency, liveTriangles, timestamps,
+                       deadEndStack, emitted, candidates, result,
+                       &resultSize);
+
+        if(resultSize == trianglesNumber*3)
+            memcpy(indices, result, sizeof(unsigned int) * resultSize);
+        else
+        {
+            fprintf(stderr,
+                    "meshOptimizeVertexCache - %llu indices emitted instead "
+                    "of %llu\n", (unsigned long long)resultSize,
+                    (unsigned long long)(trianglesNumber*3));
+            res = false;
+        }
+    }
+
+    free(result);
+    free(candidates);
+    free(emitted);
+    free(deadEndStack);
+    free(adjacency);
+    free(timestamps);
+    free(liveTriangles);
+    free(offsets);
+    return res;
+}
+
+/*
+ * Simulates fetching vertices through FIFO memory cache of
+ * MESHOPT_FETCH_CACHE_LINES lines. Overfetch is the number of bytes
+ * fetched divided by the vertex buffer size, 1.0 is the best value.
+ */
+void
+meshAnalyzeVertexFetch(const unsigned int* indices, size_t indicesNumber,
+    unsigned int verticesNumber, size_t vertexSize, float* outOverfetch)
+{
+    *outOverfetch = 0.0f;
+
+    if(indicesNumber == 0 || verticesNumber == 0)
+        return;
+
+    size_t linesNumber = ((size_t)verticesNumber * vertexSize +
+                          MESHOPT_FETCH_LINE_SIZE - 1) /
+                         MESHOPT_FETCH_LINE_SIZE;
+
+    // same as in meshAnalyzeVertexCache, but for cache lines
+    size_t* timestamps = (size_t*)calloc(linesNumber, sizeof(size_t));
+    if(timestamps == NULL)
+    {
+        fprintf(stderr, "meshAnalyzeVertexFetch - calloc failed\n");
+        return;
+    }
+
+    size_t misses = 0;
+    for(size_t i = 0; i < indicesNumber; ++i)
+    {
+        size_t start = (size_t)indices[i] * vertexSize;
+        size_t end = start + vertexSize - 1;
+        for(size_t line = start / MESHOPT_FETCH_LINE_SIZE;
+            line <= end / MESHOPT_FETCH_LINE_SIZE; ++line)
+        {
+            if(timestamps[line] == 0 ||
+               misses - timestamps[line] + 1 > MESHOPT_FETCH_CACHE_LINES)
+            {
+                misses++;
+                timestamps[line] = misses;
+            }
+        }
+    }
+
+    free(timestamps);
+
+    *outOverfetch = (float)(misses * MESHOPT_FETCH_LINE_SIZE) /
+                    (float)((size_t)verticesNumber * vertexSize);
+}
+
+/*
+ * Reorders vertices in the order they are first used by indices and
+ * updates indices accordingly, so vertices of consecutive triangles are
+ * close to each other in memory. Vertices that are not used at all are
+ * removed. Should be done after meshOptimizeVertexCache, since it
+ * depends on triangle order.
+ */
+bool
+meshOptimizeVertexFetch(void* vertices, size_t vertexSize,
+    unsigned int* indices, size_t indicesNumber, unsigned int verticesNumber,
+    unsigned int* outVerticesNumber)
+{
+    *outVerticesNumber = verticesNumber;
+
+    if(verticesNumber == 0)
+        return true;
+
+    unsigned int* remap = (unsigned int*)malloc(
+                                sizeof(unsigned int) * verticesNumber);
+    unsigned char* reordered = (unsigned char*)malloc(
+                                (size_t)verticesNumber * vertexSize);
+    if(remap == NULL || reordered == NULL)
+    {
+        fprintf(stderr, "meshOptimizeVertexFetch - malloc failed\n");
+        free(reordered);
+        free(remap);
+        return false;
+    }
+
+    memset(remap, 0xFF, sizeof(unsigned int) * verticesNumber);
+
+    const unsigned char* src = (const unsigned char*)vertices;
+    unsigned int usedVertices = 0;
+    for(size_t i = 0; i < indicesNumber; ++i)
+    {
+        unsigned int v = indices[i];
+        if(remap[v] == 0xFFFFFFFFu)
+        {
+            memcpy(reordered + (size_t)usedVertices * vertexSize,
+                   src + (size_t)v * vertexSize, vertexSize);
+            remap[v] = usedVertices++;
+        }
+        indices[i] = remap[v];
+    }
+
+    memcpy(vertices, reordered, (size_t)usedVertices * vertexSize);
+
+    free(reordered);
+    free(remap);
+
+    *outVerticesNumber = usedVertices;
+    return true;
+}
+
+/*
+ * Rasterizes a triangle given in pixel coordinates with depth, back
+ * facing triangles are culled. Pixels on edges shared by two triangles
+ * are drawn by one of them only.
+ */
+static void
+overdrawRasterize(const float* a, const float* b, const float* c,
+    float* depth, size_t* shaded)
+{
+    float area = (b[0] - a[0])*(c[1] - a[1]) - (b[1] - a[1])*(c[0] - a[0]);
+    if(!(area > 0.0f))
+        return;
+
+    const float* corners[3] = { a, b, c };
+    float minX = a[0], maxX = a[0], minY = a[1], maxY = a[1];
+    for(int k = 1; k < 3; ++k)
+    {
+        if(corners[k][0] < minX) minX = corners[k][0];
+        if(corners[k][0] > maxX) maxX = corners[k][0];
+        if(corners[k][1] < minY) minY = corners[k][1];
+        if(corners[k][1] > maxY) maxY = corners[k][1];
+    }
+
+    int x0 = minX < 0.0f ? 0 : (int)minX;
+    int y0 = minY < 0.0f ? 0 : (int)minY;
+    int x1 = maxX >= (float)MESHOPT_OVERDRAW_RESOLUTION ?
+             MESHOPT_OVERDRAW_RESOLUTION - 1 : (int)maxX;
+    int y1 = maxY >= (float)MESHOPT_OVERDRAW_RESOLUTION ?
+             MESHOPT_OVERDRAW_RESOLUTION - 1 : (int)maxY;
+
+    // edge k is opposite to corner k, the tie-breaking rule takes
+    // the edge with the same sign of dy or dx in one of two triangles
+    float edgeDx[3], edgeDy[3];
+    bool edgeInclusive[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        const float* from = corners[(k + 1) % 3];
+        const float* to = corners[(k + 2) % 3];
+        edgeDx[k] = to[0] - from[0];
+        edgeDy[k] = to[1] - from[1];
+        edgeInclusive[k] = edgeDy[k] > 0.0f ||
+                           (edgeDy[k] == 0.0f && edgeDx[k] < 0.0f);
+    }
+
+    for(int y = y0; y <= y1; ++y)
+    {
+        float py = (float)y + 0.5f;
+        for(int x = x0; x <= x1; ++x)
+        {
+            float px = (float)x + 0.5f;
+            float w[3];
+            bool inside = true;
+            for(int k = 0; k < 3 && inside; ++k)
+            {
+                const float* from = corners[(k + 1) % 3];
+                w[k] = edgeDx[k]*(py - from[1]) - edgeDy[k]*(px - from[0]);
+                inside = w[k] > 0.0f || (w[k] == 0.0f && edgeInclusive[k]);
+            }
+            if(!inside)
+                continue;
+
+            float z = (w[0]*a[2] + w[1]*b[2] + w[2]*c[2]) / area;
+            float* pixel = &depth[(size_t)y*MESHOPT_OVERDRAW_RESOLUTION + x];
+            if(z < *pixel)
+            {
+                *pixel = z;
+                (*shaded)++;
+            }
+        }
+    }
+}
+
+/*
+ * Renders the mesh with a depth test and back face culling from six
+ * orthographic views along the axes, triangles in the given order.
+ * Overdraw is the number of pixels that passed the depth test divided
+ * by the number of covered pixels, 1.0 is the best value. Front faces
+ * are counter-clockwise, like in OpenGL by default.
+ */
+void
+meshAnalyzeOverdraw(const unsigned int* indices, size_t indicesNumber,
+    const float* vertices, unsigned int floatsPerVertex,
+    unsigned int verticesNumber, float* outOverdraw)
+{
+    *outOverdraw = 0.0f;
+
+    if(indicesNumber == 0 || verticesNumber == 0)
+        return;
+
+    size_t pixelsNumber = (size_t)MESHOPT_OVERDRAW_RESOLUTION *
+                          MESHOPT_OVERDRAW_RESOLUTION;
+    float* depth = (float*)malloc(sizeof(float) * pixelsNumber);
+    float* projected = (float*)malloc(sizeof(float) * 3 * verticesNumber);
+    if(depth == NULL || projected == NULL)
+    {
+        fprintf(stderr, "meshAnalyzeOverdraw - malloc failed\n");
+        free(projected);
+        free(depth);
+        return;
+    }
+
+    size_t shaded = 0, covered = 0;
+    for(unsigned int view = 0; view < 6; ++view)
+    {
+        // looking along -axis or +axis, u is mirrored for the second
+        // so that screen axes and the view direction stay right-handed
+        unsigned int axis = view / 2;
+        float side = (view % 2 == 0) ? 1.0f : -1.0f;
+
+        float minU = 0.0f, maxU = 0.0f, minV = 0.0f, maxV = 0.0f;
+        for(unsigned int i = 0; i < verticesNumber; ++i)
+        {
+            const float* p = vertices + (size_t)i*floatsPerVertex;
+            float* q = projected + (size_t)i*3;
+            q[0] = side * p[(axis + 1) % 3];
+            q[1] = p[(axis + 2) % 3];
+            q[2] = -side * p[axis];
+            if(i == 0 || q[0] < minU) minU = q[0];
+            if(i == 0 || q[0] > maxU) maxU = q[0];
+            if(i == 0 || q[1] < minV) minV = q[1];
+            if(i == 0 || q[1] > maxV) maxV = q[1];
+        }
+
+        float extent = maxU - minU > maxV - minV ? maxU - minU : maxV - minV;
+        if(!(extent > 0.0f))
+            continue;
+
+        // a bit less than the resolution, so the far edge stays inside
+        float scale = (float)MESHOPT_OVERDRAW_RESOLUTION * 0.999f / extent;
+        for(unsigned int i = 0; i < verticesNumber; ++i)
+        {
+            float* q = projected + (size_t)i*3;
+            q[0] = (q[0] - minU) * scale;
+            q[1] = (q[1] - minV) * scale;
+        }
+
+        for(size_t i = 0; i < pixelsNumber; ++i)
+            depth[i] = FLT_MAX;
+
+        for(size_t i = 0; i + 2 < indicesNumber; i += 3)
+            overdrawRasterize(projected + (size_t)indices[i]*3,
+                              projected + (size_t)indices[i + 1]*3,
+                              projected + (size_t)indices[i + 2]*3,
+                              depth, &shaded);
+
+        for(size_t i = 0; i < pixelsNumber; ++i)
+            if(depth[i] != FLT_MAX)
+                covered++;
+    }
+
+    free(projected);
+    free(depth);
+
+    if(covered > 0)
+        *outOverdraw = (float)shaded / (float)covered;
+}
+
+/*
+ * FIFO cache like in meshAnalyzeVertexCache, a vertex is in the cache
+ * if less than cacheSize vertices were added after it. Adding
+ * cacheSize + 1 to the clock flushes the cache.
+ */
+static unsigned int
+overdrawCacheUpdate(const unsigned int* triangle, unsigned int cacheSize,
+    size_t* timestamps, size_t* clock)
+{
+    unsigned int misses = 0;
+    for(int k = 0; k < 3; ++k)
+    {
+        unsigned int v = triangle[k];
+        if(*clock - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = (*clock)++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+/*
+ * Clusters start where the cache order starts a new disjoint patch,
+ * a triangle missing all 3 vertices in the cache. Every cluster is
+ * split further as soon as its ACMR so far is not worse than threshold
+ * times the ACMR of the whole cluster, so reordering clusters costs at
+ * most about that much. Returns the number of clusters, the first
+ * triangles of clusters are written to outStarts.
+ */
+static size_t
+overdrawClusters(const unsigned int* indices, size_t trianglesNumber,
+    unsigned int verticesNumber, unsigned int cacheSize, float threshold,
+    size_t* timestamps, size_t* hardStarts, size_t* outStarts)
+{
+    memset(timestamps, 0, sizeof(size_t) * verticesNumber);
+    size_t clock = (size_t)cacheSize + 1;
+    size_t hardNumber = 0;
+    for(size_t i = 0; i < trianglesNumber; ++i)
+    {
+        unsigned int misses = overdrawCacheUpdate(indices + i*3, cacheSize,
+                                                  timestamps, &clock);
+        if(i == 0 || misses == 3)
+            hardStarts[hardNumber++] = i;
+    }
+
+    size_t clustersNumber = 0;
+    for(size_t h = 0; h < hardNumber; ++h)
+    {
+        size_t start = hardStarts[h];
+        size_t end = (h + 1 < hardNumber) ? hardStarts[h + 1] :
+                                            trianglesNumber;
+
+        clock += (size_t)cacheSize + 1;
+        size_t clusterMisses = 0;
+        for(size_t i = start; i < end; ++i)
+            clusterMisses += overdrawCacheUpdate(indices + i*3, cacheSize,
+                                                 timestamps, &clock);
+        float targetAcmr = threshold * (float)clusterMisses /
+                           (float)(end - start);
+
+        outStarts[clustersNumber++] = start;
+        clock += (size_t)cacheSize + 1;
+        size_t misses = 0, triangles = 0;
+        for(size_t i = start; i < end; ++i)
+        {
+            misses += overdrawCacheUpdate(indices + i*3, cacheSize,
+                                          timestamps, &clock);
+            triangles++;
+            if((float)misses / (float)triangles <= targetAcmr &&
+               i + 1 < end)
+            {
+                outStarts[clustersNumber++] = i + 1;
+                clock += (size_t)cacheSize + 1;
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+    return clustersNumber;
+}
+
+typedef struct
+{
+    float key;
+    size_t cluster;
+} OverdrawSortItem;
+
+static int
+overdrawSortCompare(const void* a, const void* b)
+{
+    const OverdrawSortItem* itemA = (const OverdrawSortItem*)a;
+    const OverdrawSortItem* itemB = (const OverdrawSortItem*)b;
+    if(itemA->key != itemB->key)
+        return itemA->key > itemB->key ? -1 : 1;
+    return itemA->cluster < itemB->cluster ? -1 :
+           (itemA->cluster > itemB->cluster ? 1 : 0);
+}
+
+/*
+ * Clusters facing away from the center of the mesh go first, they are
+ * likely to occlude the rest from most viewpoints.
+ */
+static void
+overdrawSortKeys(const unsigned int* indices, size_t trianglesNumber,
+    const float* vertices, unsigned int floatsPerVertex,
+    const size_t* starts, size_t clustersNumber, OverdrawSortItem* outItems)
+{
+    double meshCenter[3] = { 0.0, 0.0, 0.0 };
+    for(size_t i = 0; i < trianglesNumber*3; ++i)
+        for(int k = 0; k < 3; ++k)
+            meshCenter[k] += vertices[(size_t)indices[i]*floatsPerVertex + k];
+    for(int k = 0; k < 3; ++k)
+        meshCenter[k] /= (double)(trianglesNumber*3);
+
+    for(size_t c = 0; c < clustersNumber; ++c)
+    {
+        size_t end = (c + 1 < clustersNumber) ? starts[c + 1] :
+                                                trianglesNumber;
+        double center[3] = { 0.0, 0.0, 0.0 };
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double areaSum = 0.0;
+        for(size_t t = starts[c]; t < end; ++t)
+        {
+            const float* p0 = vertices + (size_t)indices[t*3]*floatsPerVertex;
+            const float* p1 = vertices +
+                              (size_t)indices[t*3 + 1]*floatsPerVertex;
+            const float* p2 = vertices +
+                              (size_t)indices[t*3 + 2]*floatsPerVertex;
+            double e1[3], e2[3];
+            for(int k = 0; k < 3; ++k)
+            {
+                e1[k] = (double)p1[k] - p0[k];
+                e2[k] = (double)p2[k] - p0[k];
+            }
+            double n[3] = {
+                e1[1]*e2[2] - e1[2]*e2[1],
+                e1[2]*e2[0] - e1[0]*e2[2],
+                e1[0]*e2[1] - e1[1]*e2[0]
+            };
+            double area = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            for(int k = 0; k < 3; ++k)
+            {
+                center[k] += ((double)p0[k] + p1[k] + p2[k]) * area / 3.0;
+                normal[k] += n[k];
+            }
+            areaSum += area;
+        }
+
+        double normalLength = sqrt(normal[0]*normal[0] +
+                                   normal[1]*normal[1] +
+                                   normal[2]*normal[2]);
+        double key = 0.0;
+        if(areaSum > 0.0 && normalLength > 0.0)
+            for(int k = 0; k < 3; ++k)
+                key += (center[k] / areaSum - meshCenter[k]) *
+                       normal[k] / normalLength;
+
+        outItems[c].key = (float)key;
+        outItems[c].cluster = c;
+    }
+}
+
+/*
+ * Reorders triangles to reduce overdraw, see the same paper as for
+ * meshOptimizeVertexCache. Triangles in the cache order are split into
+ * clusters and the clusters are sorted so the ones on the outside of
+ * the mesh are drawn first. Should be done after
+ * meshOptimizeVertexCache. threshold is how much ACMR may grow, e.g.
+ * 1.05 for 5%, the order is left as is if it would grow more.
+ */
+bool
+meshOptimizeOverdraw(unsigned int* indices, size_t indicesNumber,
+    const float* vertices, unsigned int floatsPerVertex,
+    unsigned int verticesNumber, unsigned int cacheSize, float threshold)
+{
+    size_t trianglesNumber = indicesNumber / 3;
+    if(trianglesNumber == 0 || verticesNumber == 0)
+        return true;
+
+    size_t* timestamps = (size_t*)malloc(sizeof(size_t) * verticesNumber);
+    size_t* hardStarts = (size_t*)malloc(sizeof(size_t) * trianglesNumber);
+    size_t* starts = (size_t*)malloc(sizeof(size_t) * trianglesNumber);
+    OverdrawSortItem* items = (OverdrawSortItem*)malloc(
+                                sizeof(OverdrawSortItem) * trianglesNumber);
+    unsigned int* result = (unsigned int*)malloc(
+                                sizeof(unsigned int) * trianglesNumber*3);
+    if(timestamps == NULL || hardStarts == NULL || starts == NULL ||
+       items == NULL || result == NULL)
+    {
+        fprintf(stderr, "meshOptimizeOverdraw - malloc failed\n");
+        free(result);
+        free(items);
+        free(starts);
+        free(hardStarts);
+        free(timestamps);
+        return false;
+    }
+
+    size_t clustersNumber = overdrawClusters(indices, trianglesNumber,
+                                             verticesNumber, cacheSize,
+                                             threshold, timestamps,
+                                             hardStarts, starts);
+    overdrawSortKeys(indices, trianglesNumber, vertices, floatsPerVertex,
+                     starts, clustersNumber, items);
+    qsort(items, clustersNumber, sizeof(OverdrawSortItem),
+          overdrawSortCompare);
+
+    size_t resultSize = 0;
+    for(size_t i = 0; i < clustersNumber; ++i)
+    {
+        size_t c = items[i].cluster;
+        size_t end = (c + 1 < clustersNumber) ? starts[c + 1] :
+                                                trianglesNumber;
+        size_t size = (end - starts[c]) * 3;
+        memcpy(result + resultSize, indices + starts[c]*3,
+               sizeof(unsigned int) * size);
+        resultSize += size;
+    }
+
+    // clusters only bound the loss approximately
+    float acmrBefore, acmrAfter, atvr;
+    meshAnalyzeVertexCache(indices, trianglesNumber*3, verticesNumber,
+                           cacheSize, &acmrBefore, &atvr);
+    meshAnalyzeVertexCache(result, trianglesNumber*3, verticesNumber,
+                           cacheSize, &acmrAfter, &atvr);
+    if(acmrAfter <= acmrBefore * threshold)
+        memcpy(indices, result, sizeof(unsigned int) * trianglesNumber*3);
+    else
+        fprintf(stderr,
+                "meshOptimizeOverdraw - ACMR would grow from %.3f to %.3f, "
+                "order is kept\n", acmrBefore, acmrAfter);
+
+    free(result);
+    free(items);
+    free(starts);
+    free(hardStarts);
+    free(timestamps);
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef AFISKON_MESHOPT_H
+#define AFISKON_MESHOPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// typical size of post-transform vertex cache, in vertices
+#define MESHOPT_CACHE_SIZE 16
+
+// vertex fetch cache simulated by meshAnalyzeVertexFetch
+#define MESHOPT_FETCH_LINE_SIZE 64
+#define MESHOPT_FETCH_CACHE_LINES 128
+
+// width and height of views rendered by meshAnalyzeOverdraw
+#define MESHOPT_OVERDRAW_RESOLUTION 256
+
+void meshAnalyzeVertexCache(const unsigned int* indices, size_t indicesNumber,
+				unsigned int verticesNumber, unsigned int cacheSize,
+				float* outAcmr, float* outAtvr);
+bool meshOptimizeVertexCache(unsigned int* indices, size_t indicesNumber,
+				unsigned int verticesNumber, unsigned int cacheSize);
+
+void meshAnalyzeVertexFetch(const unsigned int* indices, size_t indicesNumber,
+				unsigned int verticesNumber, size_t vertexSize,
+				float* outOverfetch);
+bool meshOptimizeVertexFetch(void* vertices, size_t vertexSize,
+				unsigned int* indices, size_t indicesNumber,
+				unsigned int verticesNumber,
+				unsigned int* outVerticesNumber);
+
+void meshAnalyzeOverdraw(const unsigned int* indices, size_t indicesNumber,
+				const float* vertices, unsigned int floatsPerVertex,
+				unsigned int verticesNumber, float* outOverdraw);
+bool meshOptimizeOverdraw(unsigned int* indices, size_t indicesNumber,
+				const float* vertices, unsigned int floatsPerVertex,
+				unsigned int verticesNumber, unsigned int cacheSize,
+				float threshold);
+
+#endif // AFISKON_MESHOPT_H
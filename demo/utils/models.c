@@ -1,12 +1,17 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include "utils.h"
 #include "models.h"
 #include "filemapping.h"
+#include "pack.h"
+#include "compress.h"
+#include "threads.h"
 
 #pragma pack(push, 1)
 
+// version 2, sizes are limited to 4 GB
 typedef struct
 {
     char signature[7];
@@ -15,23 +20,359 @@ typedef struct
     uint32_t verticesDataSize;
     uint32_t indicesDataSize;
     unsigned char indexSize;
+} EaxmodHeaderV2;
+
+// version 3, single level of detail
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+} EaxmodHeaderV3;
+
+// version 4, vertices are always 8 floats
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+    unsigned char lodsNumber;
+} EaxmodHeaderV4;
+
+// version 5, no compression
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+    unsigned char lodsNumber;
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    float positionScale[3];
+    float positionBias[3];
+    float uvScale[2];
+    float uvBias[2];
+} EaxmodHeaderV5;
+
+// version 6, no bounds
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+    unsigned char lodsNumber;
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    float positionScale[3];
+    float positionBias[3];
+    float uvScale[2];
+    float uvBias[2];
+    unsigned char compression;
+    uint64_t verticesPayloadSize;
+    uint64_t indicesPayloadSize;
+} EaxmodHeaderV6;
+
+typedef struct
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+} EaxmodBounds;
+
+// version 7, single mesh. The header is followed by lodsNumber
+// EaxmodLod entries, headerSize includes them.
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+    unsigned char lodsNumber;
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    float positionScale[3];
+    float positionBias[3];
+    float uvScale[2];
+    float uvBias[2];
+    unsigned char compression;
+    uint64_t verticesPayloadSize;
+    uint64_t indicesPayloadSize;
+    unsigned char hasBounds;
+    EaxmodBounds bounds;
+} EaxmodHeaderV7;
+
+// version 8, no clusters
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+    unsigned char lodsNumber;
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    float positionScale[3];
+    float positionBias[3];
+    float uvScale[2];
+    float uvBias[2];
+    unsigned char compression;
+    uint64_t verticesPayloadSize;
+    uint64_t indicesPayloadSize;
+    unsigned char hasBounds;
+    EaxmodBounds bounds;
+    uint32_t submeshesNumber;
+    uint64_t submeshesSize;
+} EaxmodHeaderV8;
+
+// indexSize and lodsNumber are not used since version 8, the header is
+// followed by submeshesSize bytes of submeshes, every EaxmodSubmesh is
+// followed by its lodsNumber EaxmodLod entries. clustersNumber
+// EaxmodCluster entries follow the submeshes. *DataSize are sizes of
+// decoded data, *PayloadSize are sizes in the file.
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint16_t headerSize;
+    unsigned char indexSize;
+    uint64_t verticesDataSize;
+    uint64_t indicesDataSize;
+    unsigned char lodsNumber;
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    float positionScale[3];
+    float positionBias[3];
+    float uvScale[2];
+    float uvBias[2];
+    unsigned char compression;
+    uint64_t verticesPayloadSize;
+    uint64_t indicesPayloadSize;
+    unsigned char hasBounds;
+    EaxmodBounds bounds;
+    uint32_t submeshesNumber;
+    uint64_t submeshesSize;
+    uint64_t clustersNumber;
 } EaxmodHeader;
 
+// versions 4-6, no bounds
+typedef struct
+{
+    uint64_t indicesOffset;
+    uint64_t indicesNumber;
+    float error;
+} EaxmodLodV4;
+
+// versions 7-8, no clusters
+typedef struct
+{
+    uint64_t indicesOffset;
+    uint64_t indicesNumber;
+    float error;
+    EaxmodBounds bounds;
+} EaxmodLodV7;
+
+typedef struct
+{
+    uint64_t indicesOffset;
+    uint64_t indicesNumber;
+    float error;
+    EaxmodBounds bounds;
+    uint64_t firstCluster;
+    uint64_t clustersNumber;
+} EaxmodLod;
+
+// indicesOffset is in indices from the start of the LOD
+typedef struct
+{
+    uint64_t indicesOffset;
+    uint32_t indicesNumber;
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+} EaxmodCluster;
+
+// indices are stored with their own size and are relative to baseVertex,
+// indicesOffset is in bytes of decoded data and is a multiple of indexSize.
+// Compressed indices of every submesh are a separate stream.
+typedef struct
+{
+    uint32_t baseVertex;
+    uint32_t verticesNumber;
+    unsigned char indexSize;
+    uint64_t indicesOffset;
+    uint64_t indicesNumber;
+    uint64_t indicesPayloadOffset;
+    uint64_t indicesPayloadSize;
+    uint32_t materialIndex;
+    unsigned char lodsNumber;
+    EaxmodBounds bounds;
+} EaxmodSubmesh;
+
 #pragma pack(pop)
 
 static const char eaxmodSignature[] = "EAXMOD";
-static const char eaxmodVersion = 2;
+static const char eaxmodVersion = 9;
+static const char eaxmodVersionV8 = 8;
+static const char eaxmodVersionV7 = 7;
+static const char eaxmodVersionV6 = 6;
+static const char eaxmodVersionV5 = 5;
+static const char eaxmodVersionV4 = 4;
+static const char eaxmodVersionV3 = 3;
+static const char eaxmodVersionV2 = 2;
+
+void
+modelVertexFormatDefault(ModelVertexFormat* format)
+{
+    memset(format, 0, sizeof(ModelVertexFormat));
+    format->positionFormat = MODEL_POSITION_FLOAT3;
+    format->normalFormat = MODEL_NORMAL_FLOAT3;
+    format->uvFormat = MODEL_UV_FLOAT2;
+    format->positionScale[0] = 1.0f;
+    format->positionScale[1] = 1.0f;
+    format->positionScale[2] = 1.0f;
+    format->uvScale[0] = 1.0f;
+    format->uvScale[1] = 1.0f;
+}
+
+static size_t
+alignOffset(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * Attributes are stored as position, normal, UV with no padding except
+ * for alignment of every attribute to the size of its components.
+ * Returns the vertex size (a multiple of 4) or 0 for unknown formats.
+ */
+unsigned int
+modelVertexLayout(const ModelVertexFormat* format,
+                  unsigned int* outNormalOffset, unsigned int* outUVOffset)
+{
+    unsigned int offset;
+    if(format->positionFormat == MODEL_POSITION_FLOAT3)
+        offset = 3*sizeof(GLfloat);
+    else if(format->positionFormat == MODEL_POSITION_HALF3 ||
+            format->positionFormat == MODEL_POSITION_UNORM16)
+        offset = 3*sizeof(uint16_t);
+    else
+        return 0;
+
+    if(format->normalFormat == MODEL_NORMAL_FLOAT3)
+    {
+        offset = alignOffset(offset, sizeof(GLfloat));
+        *outNormalOffset = offset;
+        offset += 3*sizeof(GLfloat);
+    }
+    else if(format->normalFormat == MODEL_NORMAL_OCT16)
+    {
+        offset = alignOffset(offset, sizeof(uint16_t));
+        *outNormalOffset = offset;
+        offset += 2*sizeof(uint16_t);
+    }
+    else if(format->normalFormat == MODEL_NORMAL_OCT8)
+    {
+        *outNormalOffset = offset;
+        offset += 2*sizeof(uint8_t);
+    }
+    else
+        return 0;
+
+    if(format->uvFormat == MODEL_UV_FLOAT2)
+    {
+        offset = alignOffset(offset, sizeof(GLfloat));
+        *outUVOffset = offset;
+        offset += 2*sizeof(GLfloat);
+    }
+    else if(format->uvFormat == MODEL_UV_UNORM16)
+    {
+        offset = alignOffset(offset, sizeof(uint16_t));
+        *outUVOffset = offset;
+        offset += 2*sizeof(uint16_t);
+    }
+    else
+        return 0;
+
+    return (unsigned int)alignOffset(offset, 4);
+}
+
+// indices are delta, zigzag and varint coded; vertices are split
+// to byte planes, delta coded and compressed with LZ, see compress.c
+#define EAXMOD_COMPRESSION_NONE    0
+#define EAXMOD_COMPRESSION_DEFAULT 1
+
+// size of the header structure of the given version without the LOD table
+static size_t
+headerStructSize(unsigned char version)
+{
+    if(version == eaxmodVersionV3)
+        return sizeof(EaxmodHeaderV3);
+    else if(version == eaxmodVersionV4)
+        return sizeof(EaxmodHeaderV4);
+    else if(version == eaxmodVersionV5)
+        return sizeof(EaxmodHeaderV5);
+    else if(version == eaxmodVersionV6)
+        return sizeof(EaxmodHeaderV6);
+    else if(version == eaxmodVersionV7)
+        return sizeof(EaxmodHeaderV7);
+    else if(version == eaxmodVersionV8)
+        return sizeof(EaxmodHeaderV8);
+    else if(version == eaxmodVersion)
+        return sizeof(EaxmodHeader);
+    return 0;
+}
+
+// size of a LOD table entry, LOD entries also only grow between versions
+static size_t
+lodStructSize(unsigned char version)
+{
+    if(version < eaxmodVersionV7)
+        return sizeof(EaxmodLodV4);
+    else if(version < eaxmodVersion)
+        return sizeof(EaxmodLodV7);
+    return sizeof(EaxmodLod);
+}
 
+/*
+ * Checks the header and the file size and converts the header to
+ * the current version. Only the fields of EaxmodHeader are converted,
+ * the header itself is still headerSize bytes long in the file.
+ */
 static bool
-checkFileSizeAndHeader(const char* fname, const EaxmodHeader * header,
-					   unsigned int fileSize)
+checkFileSizeAndHeader(const char* fname, const unsigned char* dataPtr,
+                       size_t fileSize, EaxmodHeader* outHeader)
 {
-    if(fileSize < sizeof(EaxmodHeader))
+    if(fileSize < sizeof(EaxmodHeaderV2))
     {
         fprintf(stderr, "modelLoad - file is too small, fname = %s\n", fname);
         return false;
     }
 
+    const EaxmodHeaderV2* headerV2 = (const EaxmodHeaderV2*)dataPtr;
+    const EaxmodHeader* header = (const EaxmodHeader*)dataPtr;
     if(strncmp(header->signature, eaxmodSignature,
                             sizeof(eaxmodSignature)) != 0)
     {
@@ -39,7 +380,47 @@ checkFileSizeAndHeader(const char* fname, const EaxmodHeader * header,
         return false;
     }
 
-    if(header->version != eaxmodVersion)
+    // fields missing in older versions
+    ModelVertexFormat defaultFormat;
+    modelVertexFormatDefault(&defaultFormat);
+    memset(outHeader, 0, sizeof(EaxmodHeader));
+    outHeader->positionFormat = defaultFormat.positionFormat;
+    outHeader->normalFormat = defaultFormat.normalFormat;
+    outHeader->uvFormat = defaultFormat.uvFormat;
+    memcpy(outHeader->positionScale, defaultFormat.positionScale,
+           sizeof(outHeader->positionScale));
+    memcpy(outHeader->positionBias, defaultFormat.positionBias,
+           sizeof(outHeader->positionBias));
+    memcpy(outHeader->uvScale, defaultFormat.uvScale,
+           sizeof(outHeader->uvScale));
+    memcpy(outHeader->uvBias, defaultFormat.uvBias,
+           sizeof(outHeader->uvBias));
+
+    size_t structSize = headerStructSize(header->version);
+    if(header->version == eaxmodVersionV2)
+    {
+        memcpy(outHeader->signature, headerV2->signature,
+               sizeof(outHeader->signature));
+        outHeader->version = headerV2->version;
+        outHeader->headerSize = headerV2->headerSize;
+        outHeader->indexSize = headerV2->indexSize;
+        outHeader->verticesDataSize = headerV2->verticesDataSize;
+        outHeader->indicesDataSize = headerV2->indicesDataSize;
+    }
+    else if(structSize != 0)
+    {
+        if(fileSize < structSize)
+        {
+            fprintf(stderr,
+                    "modelLoad - file is too small, fname = %s\n",
+                    fname
+                );
+            return false;
+        }
+        // every version since 3 only appends fields to the previous one
+        memcpy(outHeader, header, structSize);
+    }
+    else
     {
         fprintf(stderr,
                 "modelLoad - unsupported version %d, fname = %s\n",
@@ -48,26 +429,73 @@ checkFileSizeAndHeader(const char* fname, const EaxmodHeader * header,
         return false;
     }
 
-    if(sizeof(eaxmodSignature) > header->headerSize)
+    if(outHeader->version < eaxmodVersionV6)
+    {
+        outHeader->verticesPayloadSize = outHeader->verticesDataSize;
+        outHeader->indicesPayloadSize = outHeader->indicesDataSize;
+    }
+    header = outHeader;
+
+    size_t minHeaderSize = sizeof(eaxmodSignature);
+    if(header->version >= eaxmodVersionV8)
+        minHeaderSize = structSize;
+    else if(header->version >= eaxmodVersionV4)
+        minHeaderSize = structSize +
+                        header->lodsNumber*lodStructSize(header->version);
+
+    if(minHeaderSize > header->headerSize)
     {
         fprintf(stderr,
                 "modelLoad - invalid header size, "
                 "actual: %d, , expected at least: %d, fname = %s\n",
-                (int)header->headerSize, (int)sizeof(eaxmodSignature), fname
+                (int)header->headerSize, (int)minHeaderSize, fname
             );
         return false;
     }
 
-    uint32_t expectedSize = header->headerSize +
-                            header->verticesDataSize +
-                            header->indicesDataSize;
+    if(header->compression != EAXMOD_COMPRESSION_NONE &&
+       header->compression != EAXMOD_COMPRESSION_DEFAULT)
+    {
+        fprintf(stderr,
+                "modelLoad - unsupported compression %d, fname = %s\n",
+                (int)header->compression, fname
+            );
+        return false;
+    }
+
+    if(header->compression == EAXMOD_COMPRESSION_NONE &&
+       (header->verticesPayloadSize != header->verticesDataSize ||
+        header->indicesPayloadSize != header->indicesDataSize))
+    {
+        fprintf(stderr,
+                "modelLoad - payload sizes don't match data sizes, "
+                "fname = %s\n",
+                fname
+            );
+        return false;
+    }
+
+    // sizes come from the file, so check them before adding up
+    uint64_t expectedSize = header->headerSize;
+    if(header->verticesPayloadSize > fileSize ||
+       header->indicesPayloadSize > fileSize ||
+       header->submeshesSize > fileSize ||
+       header->clustersNumber > fileSize / sizeof(EaxmodCluster))
+        expectedSize = UINT64_MAX;
+    else
+        expectedSize += header->submeshesSize +
+                        header->clustersNumber*sizeof(EaxmodCluster) +
+                        header->verticesPayloadSize +
+                        header->indicesPayloadSize;
+
     if(fileSize != expectedSize)
     {
         fprintf(
                 stderr,
                 "modelLoad - invalid size, "
-                "actual: %u, expected: %u, fname = %s\n",
-                fileSize, expectedSize, fname
+                "actual: %llu, expected: %llu, fname = %s\n",
+                (unsigned long long)fileSize,
+                (unsigned long long)expectedSize, fname
             );
         return false;
     }
@@ -75,175 +503,1734 @@ checkFileSizeAndHeader(const char* fname, const EaxmodHeader * header,
     return true;
 }
 
-bool
-modelSave(const char *fname, const GLfloat *verticesData,
-            size_t verticesDataSize, const unsigned int *indices,
-            unsigned int indicesNumber)
+static void
+boundsRead(const EaxmodBounds* bounds, ModelBounds* outBounds)
 {
-    unsigned char indexSize = 1;
-    if(indicesNumber > 255) indexSize *= 2;
-    if(indicesNumber > 65535) indexSize *= 2;
+    memcpy(outBounds->min, bounds->min, sizeof(outBounds->min));
+    memcpy(outBounds->max, bounds->max, sizeof(outBounds->max));
+    memcpy(outBounds->center, bounds->center, sizeof(outBounds->center));
+    outBounds->radius = bounds->radius;
+}
 
-    void* indicesData = NULL;
-    uint32_t indicesDataSize = indicesNumber*indexSize;
+static void
+boundsWrite(const ModelBounds* bounds, EaxmodBounds* outBounds)
+{
+    memcpy(outBounds->min, bounds->min, sizeof(outBounds->min));
+    memcpy(outBounds->max, bounds->max, sizeof(outBounds->max));
+    memcpy(outBounds->center, bounds->center, sizeof(outBounds->center));
+    outBounds->radius = bounds->radius;
+}
 
-    if(indexSize == sizeof(unsigned int))
-        indicesData = (void*)indices;
-    else if(indexSize == sizeof(unsigned short))
+/*
+ * Reads lodsNumber LOD entries of the submesh, LOD ranges are checked
+ * against the submesh indices and the cluster table.
+ */
+static bool
+readLods(const char* fname, const unsigned char* lodsPtr,
+         unsigned int lodsNumber, const EaxmodHeader* header,
+         ModelSubmesh* outSubmesh)
+{
+    if(lodsNumber == 0 || lodsNumber > MODEL_MAX_LODS)
     {
-        indicesData = malloc(indicesDataSize);
-        unsigned short *copyToPtr = (unsigned short*)indicesData;
-        const unsigned int *copyFromPtr = indices;
-        for(unsigned int i = 0; i < indicesNumber; ++i)
-        {
-            *copyToPtr = (unsigned short)*copyFromPtr;
-            copyToPtr++;
-            copyFromPtr++;
-        }
+        fprintf(stderr,
+                "modelLoad - unsupported lodsNumber: %u, fname = %s\n",
+                lodsNumber, fname
+            );
+        return false;
     }
-    else // if(indexSize == sizeof(unsigned char))
-    { 
-        indicesData = malloc(indicesDataSize);
-        unsigned char *copyToPtr = (unsigned char*)indicesData;
-        const unsigned int *copyFromPtr = indices;
-        for(unsigned int i = 0; i < indicesNumber; ++i)
+
+    uint64_t indicesNumber = outSubmesh->indicesNumber;
+    size_t lodSize = lodStructSize(header->version);
+    for(unsigned int i = 0; i < lodsNumber; ++i)
+    {
+        EaxmodLod lod;
+        memset(&lod, 0, sizeof(EaxmodLod));
+        memcpy(&lod, lodsPtr + i*lodSize, lodSize);
+        if(lod.indicesOffset > indicesNumber ||
+           lod.indicesNumber > indicesNumber - lod.indicesOffset ||
+           lod.firstCluster > header->clustersNumber ||
+           lod.clustersNumber > header->clustersNumber - lod.firstCluster)
         {
-            *copyToPtr = (unsigned char)*copyFromPtr;
-            copyToPtr++;
-            copyFromPtr++;
+            fprintf(stderr,
+                    "modelLoad - invalid LOD %u range, fname = %s\n",
+                    i, fname
+                );
+            return false;
         }
+
+        outSubmesh->lods[i].indicesOffset = (size_t)lod.indicesOffset;
+        outSubmesh->lods[i].indicesNumber = (size_t)lod.indicesNumber;
+        outSubmesh->lods[i].error = lod.error;
+        outSubmesh->lods[i].firstCluster = (size_t)lod.firstCluster;
+        outSubmesh->lods[i].clustersNumber = (size_t)lod.clustersNumber;
+        boundsRead(&lod.bounds, &outSubmesh->lods[i].bounds);
     }
 
-    FILE* fd = fopen(fname, "wb");
-    if(fd == NULL)
+    outSubmesh->lodsNumber = lodsNumber;
+    return true;
+}
+
+/*
+ * Checks ranges of the submesh record and converts it to ModelSubmesh
+ * except for LODs.
+ */
+static bool
+readSubmesh(const char* fname, const EaxmodHeader* header,
+            const EaxmodSubmesh* record, uint64_t verticesNumber,
+            ModelSubmesh* outSubmesh)
+{
+    unsigned int indexSize = record->indexSize;
+    if(indexSize == 1)
+        outSubmesh->indicesType = GL_UNSIGNED_BYTE;
+    else if(indexSize == 2)
+        outSubmesh->indicesType = GL_UNSIGNED_SHORT;
+    else if(indexSize == 4)
+        outSubmesh->indicesType = GL_UNSIGNED_INT;
+    else
     {
-        fprintf(stderr,
-                "modelSave - failed to open file, fname = %s\n",
-                fname
+        fprintf(
+                stderr,
+                "modelLoad - unsupported indexSize: %d, fname = %s\n",
+                (int)indexSize, fname
             );
-        if(indicesData != (void*)indices)
-            free(indicesData);
         return false;
     }
 
-    EaxmodHeader header;
-    strcpy(&(header.signature[0]), eaxmodSignature);
-    header.version = eaxmodVersion;
-    header.headerSize = sizeof(header);
-    header.verticesDataSize = (uint32_t)verticesDataSize;
-    header.indicesDataSize = (uint32_t)indicesDataSize;
-    header.indexSize = indexSize;
+    if(record->baseVertex > verticesNumber ||
+       record->verticesNumber > verticesNumber - record->baseVertex ||
+       record->indicesOffset % indexSize != 0 ||
+       record->indicesOffset > header->indicesDataSize ||
+       record->indicesNumber > (header->indicesDataSize -
+                                record->indicesOffset) / indexSize ||
+       record->indicesPayloadOffset > header->indicesPayloadSize ||
+       record->indicesPayloadSize > header->indicesPayloadSize -
+                                    record->indicesPayloadOffset)
+    {
+        fprintf(stderr, "modelLoad - invalid submesh range, fname = %s\n",
+                fname);
+        return false;
+    }
 
-    if(fwrite(&header, sizeof(header), 1, fd) != 1)
+    outSubmesh->baseVertex = record->baseVertex;
+    outSubmesh->verticesNumber = record->verticesNumber;
+    outSubmesh->indexSize = indexSize;
+    outSubmesh->indicesOffset = (size_t)record->indicesOffset;
+    outSubmesh->indicesNumber = (size_t)record->indicesNumber;
+    outSubmesh->materialIndex = record->materialIndex;
+    boundsRead(&record->bounds, &outSubmesh->bounds);
+    return true;
+}
+
+/*
+ * Reads the submesh table, files before version 8 have a single submesh
+ * made of the header and the LOD table after it, files before version 4
+ * also have a single LOD. Returns submesh records for decompression of
+ * indices, the caller frees them.
+ */
+static EaxmodSubmesh*
+readSubmeshes(const char* fname, const unsigned char* dataPtr,
+              const EaxmodHeader* header, uint64_t verticesNumber,
+              ModelInfo* outInfo)
+{
+    unsigned int submeshesNumber = 1;
+    if(header->version >= eaxmodVersionV8)
+        submeshesNumber = header->submeshesNumber;
+    if(submeshesNumber == 0 || (header->version >= eaxmodVersionV8 &&
+       submeshesNumber > header->submeshesSize / sizeof(EaxmodSubmesh)))
     {
         fprintf(stderr,
-                "modelSave - failed to write header, fname = %s\n",
-                fname
+                "modelLoad - invalid submeshesNumber: %u, fname = %s\n",
+                submeshesNumber, fname
             );
-          if(indicesData != (void*)indices)
-            free(indicesData);
-          fclose(fd);
-          return false;
+        return NULL;
     }
 
-    if(fwrite(verticesData, verticesDataSize, 1, fd) != 1)
+    EaxmodSubmesh* records = (EaxmodSubmesh*)malloc(
+                                sizeof(EaxmodSubmesh)*submeshesNumber);
+    outInfo->submeshes = (ModelSubmesh*)calloc(submeshesNumber,
+                                               sizeof(ModelSubmesh));
+    if(records == NULL || outInfo->submeshes == NULL)
     {
-        fprintf(
-                stderr,
-                "modelSave - failed to write verticesData, fname = %s\n",
-                fname
-            );
-        if(indicesData != (void*)indices)
-            free(indicesData);
-        fclose(fd);
-        return false;
+        fprintf(stderr, "modelLoad - malloc failed, fname = %s\n", fname);
+        free(records);
+        return NULL;
     }
+    outInfo->submeshesNumber = submeshesNumber;
 
-    if(fwrite(indicesData, indicesDataSize, 1, fd) != 1)
+    if(header->version < eaxmodVersionV8)
     {
-        fprintf(
-                stderr,
-                "modelSave - failed to write indicesData, fname = %s\n",
-                fname
-            );
-        if(indicesData != (void*)indices)
-            free(indicesData);
-        fclose(fd);
-        return false;
+        EaxmodSubmesh* record = &records[0];
+        memset(record, 0, sizeof(EaxmodSubmesh));
+        record->verticesNumber = (uint32_t)verticesNumber;
+        record->indexSize = header->indexSize;
+        if(record->indexSize != 0)
+            record->indicesNumber = header->indicesDataSize /
+                                    header->indexSize;
+        record->indicesPayloadSize = header->indicesPayloadSize;
+        record->bounds = header->bounds;
+
+        ModelSubmesh* submesh = &outInfo->submeshes[0];
+        if(!readSubmesh(fname, header, record, verticesNumber, submesh))
+        {
+            free(records);
+            return NULL;
+        }
+
+        if(header->version < eaxmodVersionV4)
+        {
+            submesh->lodsNumber = 1;
+            submesh->lods[0].indicesNumber = submesh->indicesNumber;
+            return records;
+        }
+
+        if(!readLods(fname, dataPtr + headerStructSize(header->version),
+                     header->lodsNumber, header, submesh))
+        {
+            free(records);
+            return NULL;
+        }
+        return records;
     }
 
-    if(indicesData != (void*)indices)
-        free(indicesData);
-    fclose(fd);
-    return true;
+    const unsigned char* ptr = dataPtr + header->headerSize;
+    uint64_t sizeLeft = header->submeshesSize;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        EaxmodSubmesh* record = &records[i];
+        if(sizeLeft < sizeof(EaxmodSubmesh))
+        {
+            fprintf(stderr, "modelLoad - submesh table is too small, "
+                    "fname = %s\n", fname);
+            free(records);
+            return NULL;
+        }
+        memcpy(record, ptr, sizeof(EaxmodSubmesh));
+        ptr += sizeof(EaxmodSubmesh);
+        sizeLeft -= sizeof(EaxmodSubmesh);
+
+        uint64_t lodsSize = (uint64_t)record->lodsNumber*
+                            lodStructSize(header->version);
+        if(sizeLeft < lodsSize)
+        {
+            fprintf(stderr, "modelLoad - submesh table is too small, "
+                    "fname = %s\n", fname);
+            free(records);
+            return NULL;
+        }
+
+        ModelSubmesh* submesh = &outInfo->submeshes[i];
+        if(!readSubmesh(fname, header, record, verticesNumber, submesh) ||
+           !readLods(fname, ptr, record->lodsNumber, header, submesh))
+        {
+            free(records);
+            return NULL;
+        }
+        ptr += lodsSize;
+        sizeLeft -= lodsSize;
+    }
+
+    return records;
 }
 
-bool
-modelLoad(const char *fname, GLuint modelVAO, GLuint modelVBO,
-            GLuint indicesVBO, GLsizei* outIndicesNumber,
-            GLenum* outIndicesType)
+/*
+ * Reads the cluster table, every cluster is checked against ranges of
+ * the LODs using it. Files before version 9 have no clusters.
+ */
+static bool
+readClusters(const char* fname, const unsigned char* clustersPtr,
+             const EaxmodHeader* header, ModelInfo* outInfo)
 {
-    *outIndicesNumber = 0;
-    *outIndicesType = GL_UNSIGNED_BYTE;
+    size_t clustersNumber = (size_t)header->clustersNumber;
+    if(clustersNumber == 0)
+        return true;
 
-    FileMapping* mapping = fileMappingCreate(fname);
-    if(mapping == NULL)
+    outInfo->clusters = (ModelCluster*)malloc(
+                                sizeof(ModelCluster)*clustersNumber);
+    if(outInfo->clusters == NULL)
+    {
+        fprintf(stderr, "modelLoad - malloc failed, fname = %s\n", fname);
         return false;
+    }
+    outInfo->clustersNumber = clustersNumber;
 
-    unsigned char* dataPtr = fileMappingGetPointer(mapping);
-    unsigned int dataSize = fileMappingGetSize(mapping);
+    for(size_t i = 0; i < clustersNumber; ++i)
+    {
+        EaxmodCluster record;
+        memcpy(&record, clustersPtr + i*sizeof(EaxmodCluster),
+               sizeof(EaxmodCluster));
+        ModelCluster* cluster = &outInfo->clusters[i];
+        cluster->indicesOffset = (size_t)record.indicesOffset;
+        cluster->indicesNumber = record.indicesNumber;
+        memcpy(cluster->center, record.center, sizeof(cluster->center));
+        cluster->radius = record.radius;
+        memcpy(cluster->coneAxis, record.coneAxis, sizeof(cluster->coneAxis));
+        cluster->coneCutoff = record.coneCutoff;
+    }
 
-    EaxmodHeader * header = (EaxmodHeader *)dataPtr;
-    if(!checkFileSizeAndHeader(fname, header, dataSize))
+    for(unsigned int i = 0; i < outInfo->submeshesNumber; ++i)
     {
-        fileMappingDestroy(mapping);
-        return false;
-    } 
+        const ModelSubmesh* submesh = &outInfo->submeshes[i];
+        for(unsigned int j = 0; j < submesh->lodsNumber; ++j)
+        {
+            const ModelLod* lod = &submesh->lods[j];
+            for(size_t k = 0; k < lod->clustersNumber; ++k)
+            {
+                const ModelCluster* cluster =
+                                &outInfo->clusters[lod->firstCluster + k];
+                if(cluster->indicesOffset > lod->indicesNumber ||
+                   cluster->indicesNumber > lod->indicesNumber -
+                                            cluster->indicesOffset)
+                {
+                    fprintf(stderr,
+                            "modelLoad - invalid cluster range, "
+                            "fname = %s\n", fname);
+                    return false;
+                }
+            }
+        }
+    }
 
-    unsigned char indexSize = header->indexSize;
-    if(indexSize == 1)
-        *outIndicesType = GL_UNSIGNED_BYTE;
-    else if(indexSize == 2)
-        *outIndicesType = GL_UNSIGNED_SHORT;
-    else if(indexSize == 4)
-        *outIndicesType = GL_UNSIGNED_INT;
-    else
+    return true;
+}
+
+static bool
+readVertexFormat(const char* fname, const EaxmodHeader* header,
+                 ModelInfo* outInfo)
+{
+    ModelVertexFormat* format = &outInfo->vertexFormat;
+    format->positionFormat = header->positionFormat;
+    format->normalFormat = header->normalFormat;
+    format->uvFormat = header->uvFormat;
+    memcpy(format->positionScale, header->positionScale,
+           sizeof(format->positionScale));
+    memcpy(format->positionBias, header->positionBias,
+           sizeof(format->positionBias));
+    memcpy(format->uvScale, header->uvScale, sizeof(format->uvScale));
+    memcpy(format->uvBias, header->uvBias, sizeof(format->uvBias));
+
+    unsigned int normalOffset, uvOffset;
+    unsigned int vertexSize = modelVertexLayout(format, &normalOffset,
+                                                &uvOffset);
+    if(vertexSize == 0)
     {
-        fprintf(
-                stderr,
-                "modelLoad - unsupported indexSize: %d, fname = %s\n",
-                (int)indexSize, fname
+        fprintf(stderr,
+                "modelLoad - unsupported vertex format: %d/%d/%d, "
+                "fname = %s\n",
+                (int)format->positionFormat, (int)format->normalFormat,
+                (int)format->uvFormat, fname
             );
-        fileMappingDestroy(mapping);
         return false;
     }
 
-    *outIndicesNumber = header->indicesDataSize / indexSize;
-
-    unsigned char* verticesPtr = dataPtr + header->headerSize;
-    unsigned char* indicesPtr = verticesPtr + header->verticesDataSize;
+    if(header->verticesDataSize % vertexSize != 0)
+    {
+        fprintf(stderr,
+                "modelLoad - verticesDataSize is not a multiple of vertex "
+                "size %u, fname = %s\n",
+                vertexSize, fname
+            );
+        return false;
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicesVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, header->indicesDataSize,
-                    indicesPtr, GL_STATIC_DRAW);
+    return true;
+}
 
-    glBindVertexArray(modelVAO);
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+/*
+ * Index size of a submesh with the given number of vertices, indices
+ * are relative to baseVertex so only this number limits them.
+ * All policies but MODEL_INDICES_SMALLEST choose the same, 32 bits only
+ * above 65535 vertices. For MODEL_INDICES_PREFER_16BIT meshes have to be
+ * split before saving to stay on 16 bits.
+ */
+unsigned int
+modelIndexSize(unsigned int verticesNumber, unsigned int indexPolicy)
+{
+    if(verticesNumber > MODEL_MAX_16BIT_VERTICES)
+        return 4;
+    if(indexPolicy == MODEL_INDICES_SMALLEST && verticesNumber <= 255)
+        return 1;
+    return 2;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
-    glBufferData(GL_ARRAY_BUFFER, header->verticesDataSize,
-                    verticesPtr, GL_STATIC_DRAW);
+/*
+ * Chooses index sizes of submeshes if they are not given, never 8 bits,
+ * and places their indices one after another, every submesh starts at
+ * a multiple of 4 bytes. Fails if a given index size can't address
+ * vertices of the submesh.
+ */
+static bool
+submeshesLayout(const char* fname, const ModelSubmesh* submeshes,
+                unsigned int submeshesNumber, EaxmodSubmesh* outRecords,
+                size_t* outIndicesDataSize)
+{
+    size_t offset = 0;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        const ModelSubmesh* submesh = &submeshes[i];
+        EaxmodSubmesh* record = &outRecords[i];
+        memset(record, 0, sizeof(EaxmodSubmesh));
 
-    GLsizei stride = 8*sizeof(GLfloat);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
-        NULL);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
-        (const void*)(3*sizeof(GLfloat)));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
-        (const void*)(6*sizeof(GLfloat)));
+        unsigned int indexSize = modelIndexSize(submesh->verticesNumber,
+                                                MODEL_INDICES_NEVER_8BIT);
+        if(submesh->indexSize != 0)
+        {
+            if((submesh->indexSize != 1 && submesh->indexSize != 2 &&
+                submesh->indexSize != 4) || submesh->indexSize < indexSize)
+            {
+                fprintf(stderr,
+                        "modelSave - indexSize %u is invalid for submesh %u, "
+                        "fname = %s\n", submesh->indexSize, i, fname
+                    );
+                return false;
+            }
+            indexSize = submesh->indexSize;
+        }
 
-    fileMappingDestroy(mapping);
+        offset = alignOffset(offset, 4);
+        record->baseVertex = submesh->baseVertex;
+        record->verticesNumber = submesh->verticesNumber;
+        record->indexSize = (unsigned char)indexSize;
+        record->indicesOffset = (uint64_t)offset;
+        record->indicesNumber = (uint64_t)submesh->indicesNumber;
+        record->indicesPayloadOffset = (uint64_t)offset;
+        record->indicesPayloadSize = (uint64_t)(submesh->indicesNumber *
+                                                indexSize);
+        record->materialIndex = submesh->materialIndex;
+        record->lodsNumber = (unsigned char)submesh->lodsNumber;
+        offset += submesh->indicesNumber*indexSize;
+    }
+    *outIndicesDataSize = offset;
     return true;
 }
+
+/*
+ * Converts indices of every submesh to its index size right into the
+ * file. indices of submeshes follow each other. Padding between
+ * submeshes is left as is, the mapping of a new file is zeroed.
+ */
+static void
+packIndices(const unsigned int* indices, const EaxmodSubmesh* records,
+            unsigned int submeshesNumber, unsigned char* data)
+{
+    const unsigned int* copyFromPtr = indices;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        const EaxmodSubmesh* record = &records[i];
+        unsigned char* copyToPtr = data + record->indicesOffset;
+        if(record->indexSize == sizeof(unsigned int))
+            memcpy(copyToPtr, copyFromPtr,
+                   (size_t)record->indicesNumber*sizeof(unsigned int));
+        else if(record->indexSize == sizeof(unsigned short))
+        {
+            for(uint64_t j = 0; j < record->indicesNumber; ++j)
+            {
+                // the mapping is aligned but the payload isn't
+                unsigned short index = (unsigned short)copyFromPtr[j];
+                memcpy(copyToPtr + j*sizeof(index), &index, sizeof(index));
+            }
+        }
+        else // if(record->indexSize == sizeof(unsigned char))
+        {
+            for(uint64_t j = 0; j < record->indicesNumber; ++j)
+                copyToPtr[j] = (unsigned char)copyFromPtr[j];
+        }
+        copyFromPtr += record->indicesNumber;
+    }
+}
+
+// upper bound of the size of compressed payloads
+static size_t
+compressedPayloadsBound(size_t verticesDataSize,
+                        const EaxmodSubmesh* records,
+                        unsigned int submeshesNumber)
+{
+    size_t bound = compressVerticesBound(verticesDataSize);
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+        bound += compressIndicesBound((size_t)records[i].indicesNumber);
+    return bound;
+}
+
+/*
+ * Compresses vertices and then indices of every submesh right into the
+ * file. Fills payload ranges of records, they are relative to the start
+ * of the indices payload.
+ */
+static bool
+compressPayloads(const void* verticesData, size_t verticesDataSize,
+                 unsigned int vertexSize, const unsigned int* indices,
+                 EaxmodSubmesh* records, unsigned int submeshesNumber,
+                 unsigned char* data, size_t* outVerticesPayloadSize,
+                 size_t* outIndicesPayloadSize)
+{
+    size_t verticesPayloadSize = compressVertices(
+                                    (const unsigned char*)verticesData,
+                                    verticesDataSize / vertexSize,
+                                    vertexSize, data
+                                );
+    if(verticesPayloadSize == 0 && verticesDataSize != 0)
+        return false;
+
+    unsigned char* indicesPayload = data + verticesPayloadSize;
+    size_t indicesPayloadSize = 0;
+    const unsigned int* submeshIndices = indices;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        EaxmodSubmesh* record = &records[i];
+        size_t payloadSize = compressIndices(submeshIndices,
+                                             (size_t)record->indicesNumber,
+                                             indicesPayload +
+                                                indicesPayloadSize);
+        record->indicesPayloadOffset = (uint64_t)indicesPayloadSize;
+        record->indicesPayloadSize = (uint64_t)payloadSize;
+        indicesPayloadSize += payloadSize;
+        submeshIndices += record->indicesNumber;
+    }
+
+    *outVerticesPayloadSize = verticesPayloadSize;
+    *outIndicesPayloadSize = indicesPayloadSize;
+    return true;
+}
+
+// returns the end of written records
+static unsigned char*
+writeSubmeshes(unsigned char* dataPtr, const ModelSubmesh* submeshes,
+               const EaxmodSubmesh* records, unsigned int submeshesNumber,
+               bool hasBounds)
+{
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        const ModelSubmesh* submesh = &submeshes[i];
+        EaxmodSubmesh record = records[i];
+        if(hasBounds)
+            boundsWrite(&submesh->bounds, &record.bounds);
+
+        EaxmodLod lodsData[MODEL_MAX_LODS];
+        memset(lodsData, 0, sizeof(lodsData));
+        for(unsigned int j = 0; j < submesh->lodsNumber; ++j)
+        {
+            lodsData[j].indicesOffset = (uint64_t)submesh->lods[j].indicesOffset;
+            lodsData[j].indicesNumber = (uint64_t)submesh->lods[j].indicesNumber;
+            lodsData[j].error = submesh->lods[j].error;
+            lodsData[j].firstCluster = (uint64_t)submesh->lods[j].firstCluster;
+            lodsData[j].clustersNumber =
+                                (uint64_t)submesh->lods[j].clustersNumber;
+            if(hasBounds)
+                boundsWrite(&submesh->lods[j].bounds, &lodsData[j].bounds);
+        }
+
+        memcpy(dataPtr, &record, sizeof(record));
+        dataPtr += sizeof(record);
+        memcpy(dataPtr, lodsData, sizeof(EaxmodLod)*submesh->lodsNumber);
+        dataPtr += sizeof(EaxmodLod)*submesh->lodsNumber;
+    }
+    return dataPtr;
+}
+
+static unsigned char*
+writeClusters(unsigned char* dataPtr, const ModelCluster* clusters,
+              size_t clustersNumber)
+{
+    for(size_t i = 0; i < clustersNumber; ++i)
+    {
+        const ModelCluster* cluster = &clusters[i];
+        EaxmodCluster record;
+        memset(&record, 0, sizeof(record));
+        record.indicesOffset = (uint64_t)cluster->indicesOffset;
+        record.indicesNumber = cluster->indicesNumber;
+        memcpy(record.center, cluster->center, sizeof(record.center));
+        record.radius = cluster->radius;
+        memcpy(record.coneAxis, cluster->coneAxis, sizeof(record.coneAxis));
+        record.coneCutoff = cluster->coneCutoff;
+        memcpy(dataPtr, &record, sizeof(record));
+        dataPtr += sizeof(record);
+    }
+    return dataPtr;
+}
+
+// LODs of submeshes reference clusters, clusters lie inside their LODs
+static bool
+checkClusters(const char* fname, const ModelSubmesh* submeshes,
+              unsigned int submeshesNumber, const ModelCluster* clusters,
+              size_t clustersNumber)
+{
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        for(unsigned int j = 0; j < submeshes[i].lodsNumber; ++j)
+        {
+            const ModelLod* lod = &submeshes[i].lods[j];
+            bool res = lod->firstCluster <= clustersNumber &&
+                       lod->clustersNumber <= clustersNumber -
+                                              lod->firstCluster;
+            for(size_t k = 0; k < lod->clustersNumber && res; ++k)
+            {
+                const ModelCluster* cluster = &clusters[lod->firstCluster + k];
+                res = cluster->indicesOffset <= lod->indicesNumber &&
+                      cluster->indicesNumber <= lod->indicesNumber -
+                                                cluster->indicesOffset;
+            }
+
+            if(!res)
+            {
+                fprintf(stderr,
+                        "modelSave - invalid clusters of LOD %u of submesh "
+                        "%u, fname = %s\n", j, i, fname
+                    );
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * indices of every submesh are relative to its baseVertex and follow
+ * indices of the previous submesh. indicesType and indicesOffset of
+ * submeshes are chosen here and ignored, so is indexSize if it's 0.
+ * LODs reference clusters, clusters can be NULL if there are none.
+ * vertexFormat can be NULL, then vertices are 8 floats. bounds can be
+ * NULL, then the file has no bounds and bounds of submeshes and LODs
+ * are ignored.
+ */
+bool
+modelSave(const char *fname, const void *verticesData,
+            size_t verticesDataSize, const unsigned int *indices,
+            const ModelSubmesh *submeshes, unsigned int submeshesNumber,
+            const ModelCluster *clusters, size_t clustersNumber,
+            const ModelVertexFormat *vertexFormat,
+            const ModelBounds *bounds, bool compress)
+{
+    ModelVertexFormat defaultFormat;
+    if(vertexFormat == NULL)
+    {
+        modelVertexFormatDefault(&defaultFormat);
+        vertexFormat = &defaultFormat;
+    }
+
+    unsigned int normalOffset, uvOffset;
+    unsigned int vertexSize = modelVertexLayout(vertexFormat,
+                                                &normalOffset, &uvOffset);
+    if(vertexSize == 0 || verticesDataSize % vertexSize != 0)
+    {
+        fprintf(stderr, "modelSave - invalid vertex size, fname = %s\n",
+                fname);
+        return false;
+    }
+
+    if(submeshesNumber == 0)
+    {
+        fprintf(stderr, "modelSave - no submeshes, fname = %s\n", fname);
+        return false;
+    }
+
+    uint64_t submeshesSize = 0;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        unsigned int lodsNumber = submeshes[i].lodsNumber;
+        if(lodsNumber == 0 || lodsNumber > MODEL_MAX_LODS)
+        {
+            fprintf(stderr,
+                    "modelSave - unsupported lodsNumber: %u, fname = %s\n",
+                    lodsNumber, fname
+                );
+            return false;
+        }
+        submeshesSize += sizeof(EaxmodSubmesh) + lodsNumber*sizeof(EaxmodLod);
+    }
+
+    if(!checkClusters(fname, submeshes, submeshesNumber, clusters,
+                      clustersNumber))
+        return false;
+
+    EaxmodSubmesh* records = (EaxmodSubmesh*)malloc(
+                                sizeof(EaxmodSubmesh)*submeshesNumber);
+    if(records == NULL)
+    {
+        fprintf(stderr, "modelSave - malloc failed, fname = %s\n", fname);
+        return false;
+    }
+
+    size_t indicesDataSize;
+    if(!submeshesLayout(fname, submeshes, submeshesNumber, records,
+                        &indicesDataSize))
+    {
+        free(records);
+        return false;
+    }
+
+    // The file is preallocated and mapped, payloads are packed or
+    // compressed right into it. Compressed payloads take at most the
+    // bound, the file is truncated to their actual size on commit.
+    size_t payloadsOffset = sizeof(EaxmodHeader) + (size_t)submeshesSize +
+                            clustersNumber*sizeof(EaxmodCluster);
+    size_t fileSize = payloadsOffset + (compress ?
+                        compressedPayloadsBound(verticesDataSize, records,
+                                                submeshesNumber) :
+                        verticesDataSize + indicesDataSize);
+
+    FileMapping* mapping = fileMappingCreateWritable(fname, fileSize);
+    if(mapping == NULL)
+    {
+        fprintf(stderr,
+                "modelSave - failed to open file, fname = %s\n",
+                fname
+            );
+        free(records);
+        return false;
+    }
+
+    unsigned char* dataPtr = fileMappingGetPointer(mapping);
+    unsigned char* payloadsPtr = dataPtr + payloadsOffset;
+    size_t verticesPayloadSize = verticesDataSize;
+    size_t indicesPayloadSize = indicesDataSize;
+
+    if(compress)
+    {
+        if(!compressPayloads(verticesData, verticesDataSize, vertexSize,
+                             indices, records, submeshesNumber, payloadsPtr,
+                             &verticesPayloadSize, &indicesPayloadSize))
+        {
+            fprintf(stderr, "modelSave - compression failed, fname = %s\n",
+                    fname);
+            fileMappingDestroy(mapping);
+            free(records);
+            return false;
+        }
+    }
+    else
+    {
+        if(verticesDataSize != 0)
+            memcpy(payloadsPtr, verticesData, verticesDataSize);
+        packIndices(indices, records, submeshesNumber,
+                    payloadsPtr + verticesDataSize);
+    }
+
+    unsigned char* tablesPtr = writeSubmeshes(dataPtr + sizeof(EaxmodHeader),
+                                              submeshes, records,
+                                              submeshesNumber,
+                                              bounds != NULL);
+    writeClusters(tablesPtr, clusters, clustersNumber);
+    free(records);
+
+    EaxmodHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(&(header.signature[0]), eaxmodSignature);
+    header.version = eaxmodVersion;
+    header.headerSize = (uint16_t)sizeof(header);
+    header.verticesDataSize = (uint64_t)verticesDataSize;
+    header.indicesDataSize = (uint64_t)indicesDataSize;
+    header.positionFormat = vertexFormat->positionFormat;
+    header.normalFormat = vertexFormat->normalFormat;
+    header.uvFormat = vertexFormat->uvFormat;
+    memcpy(header.positionScale, vertexFormat->positionScale,
+           sizeof(header.positionScale));
+    memcpy(header.positionBias, vertexFormat->positionBias,
+           sizeof(header.positionBias));
+    memcpy(header.uvScale, vertexFormat->uvScale, sizeof(header.uvScale));
+    memcpy(header.uvBias, vertexFormat->uvBias, sizeof(header.uvBias));
+    header.compression = compress ? EAXMOD_COMPRESSION_DEFAULT :
+                                    EAXMOD_COMPRESSION_NONE;
+    header.verticesPayloadSize = (uint64_t)verticesPayloadSize;
+    header.indicesPayloadSize = (uint64_t)indicesPayloadSize;
+    header.hasBounds = bounds != NULL;
+    if(bounds != NULL)
+        boundsWrite(bounds, &header.bounds);
+    header.submeshesNumber = submeshesNumber;
+    header.submeshesSize = submeshesSize;
+    header.clustersNumber = (uint64_t)clustersNumber;
+    memcpy(dataPtr, &header, sizeof(header));
+
+    // renames the temporary file to fname, readers never see
+    // a partially written file
+    return fileMappingCommit(mapping, payloadsOffset + verticesPayloadSize +
+                                      indicesPayloadSize);
+}
+
+/*
+ * Allocates the buffer bound to the target and maps it, so the payload
+ * is read or decompressed right into it.
+ */
+static void*
+payloadMap(const char* fname, GLenum target, uint64_t dataSize)
+{
+    void* ptr = mapNewBuffer(target, (size_t)dataSize, GL_STATIC_DRAW);
+    if(ptr == NULL)
+        fprintf(stderr, "modelLoad - glMapBufferRange failed, fname = %s\n",
+                fname);
+    return ptr;
+}
+
+static bool
+payloadUnmap(const char* fname, GLenum target, bool res)
+{
+    // the contents are lost if the mapping was corrupted meanwhile
+    if(glUnmapBuffer(target) == GL_FALSE)
+        res = false;
+
+    if(!res)
+        fprintf(stderr, "modelLoad - failed to read or decompress data, "
+                "fname = %s\n", fname);
+    return res;
+}
+
+static bool
+decodeVertices(const EaxmodHeader* header, const unsigned char* payload,
+               unsigned int vertexSize, unsigned char* outData)
+{
+    return decompressVertices(payload, (size_t)header->verticesPayloadSize,
+                              (size_t)(header->verticesDataSize / vertexSize),
+                              vertexSize, outData);
+}
+
+// every submesh has its own stream of compressed indices
+static bool
+decodeIndices(const unsigned char* payload, const EaxmodSubmesh* records,
+              unsigned int submeshesNumber, unsigned char* outData)
+{
+    bool res = true;
+    for(unsigned int i = 0; i < submeshesNumber && res; ++i)
+    {
+        const EaxmodSubmesh* record = &records[i];
+        res = decompressIndices(payload + record->indicesPayloadOffset,
+                                (size_t)record->indicesPayloadSize,
+                                (size_t)record->indicesNumber,
+                                record->indexSize,
+                                outData + record->indicesOffset);
+    }
+    return res;
+}
+
+// uncompressed payloads are read from the file without the mapping
+static bool
+uploadVertices(const char* fname, FileMapping* mapping,
+               const EaxmodHeader* header, const unsigned char* payload,
+               unsigned int vertexSize)
+{
+    uint64_t dataSize = header->verticesDataSize;
+    if(dataSize == 0)
+    {
+        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+        return true;
+    }
+
+    void* ptr = payloadMap(fname, GL_ARRAY_BUFFER, dataSize);
+    if(ptr == NULL)
+        return false;
+
+    bool res;
+    if(header->compression == EAXMOD_COMPRESSION_NONE)
+        res = fileMappingRead(mapping,
+                    (size_t)(payload - fileMappingGetPointer(mapping)),
+                    ptr, (size_t)dataSize);
+    else
+        res = decodeVertices(header, payload, vertexSize,
+                             (unsigned char*)ptr);
+    return payloadUnmap(fname, GL_ARRAY_BUFFER, res);
+}
+
+static bool
+uploadIndices(const char* fname, FileMapping* mapping,
+              const EaxmodHeader* header, const unsigned char* payload,
+              const EaxmodSubmesh* records, unsigned int submeshesNumber)
+{
+    uint64_t dataSize = header->indicesDataSize;
+    if(dataSize == 0)
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+        return true;
+    }
+
+    unsigned char* ptr = (unsigned char*)payloadMap(fname,
+                            GL_ELEMENT_ARRAY_BUFFER, dataSize);
+    if(ptr == NULL)
+        return false;
+
+    bool res;
+    if(header->compression == EAXMOD_COMPRESSION_NONE)
+        res = fileMappingRead(mapping,
+                    (size_t)(payload - fileMappingGetPointer(mapping)),
+                    ptr, (size_t)dataSize);
+    else
+        res = decodeIndices(payload, records, submeshesNumber, ptr);
+    return payloadUnmap(fname, GL_ELEMENT_ARRAY_BUFFER, res);
+}
+
+/*
+ * Validates the file and reads everything but the payloads into
+ * outInfo. Returns submesh records, which decompression of indices
+ * needs, the caller frees them. outInfo is freed on failure.
+ */
+static EaxmodSubmesh*
+modelParse(const char* fname, const unsigned char* dataPtr,
+           size_t dataSize, EaxmodHeader* outHeader,
+           ModelInfo* outInfo, const unsigned char** outVerticesPtr,
+           const unsigned char** outIndicesPtr)
+{
+    if(!checkFileSizeAndHeader(fname, dataPtr, dataSize, outHeader))
+        return NULL;
+
+    outInfo->hasBounds = outHeader->hasBounds != 0;
+    boundsRead(&outHeader->bounds, &outInfo->bounds);
+    if(!readVertexFormat(fname, outHeader, outInfo))
+        return NULL;
+
+    unsigned int normalOffset, uvOffset;
+    unsigned int stride = modelVertexLayout(&outInfo->vertexFormat,
+                                            &normalOffset, &uvOffset);
+
+    uint64_t verticesNumber = outHeader->verticesDataSize / (uint64_t)stride;
+    EaxmodSubmesh* records = readSubmeshes(fname, dataPtr, outHeader,
+                                           verticesNumber, outInfo);
+    const unsigned char* clustersPtr = dataPtr + outHeader->headerSize +
+                                       outHeader->submeshesSize;
+    if(records == NULL ||
+       !readClusters(fname, clustersPtr, outHeader, outInfo))
+    {
+        free(records);
+        modelInfoFree(outInfo);
+        return NULL;
+    }
+
+    *outVerticesPtr = clustersPtr +
+                      outHeader->clustersNumber*sizeof(EaxmodCluster);
+    *outIndicesPtr = *outVerticesPtr + outHeader->verticesPayloadSize;
+    return records;
+}
+
+// binds attributes of the vertex buffer and the index buffer to the
+// vertex array
+static void
+modelSetupVertexArray(GLuint modelVAO, GLuint modelVBO, GLuint indicesVBO,
+                      const ModelVertexFormat* format)
+{
+    unsigned int normalOffset, uvOffset;
+    GLsizei stride = (GLsizei)modelVertexLayout(format, &normalOffset,
+                                                &uvOffset);
+
+    glBindVertexArray(modelVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicesVBO);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
+
+    if(format->positionFormat == MODEL_POSITION_HALF3)
+        glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, NULL);
+    else if(format->positionFormat == MODEL_POSITION_UNORM16)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, NULL);
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+
+    if(format->normalFormat == MODEL_NORMAL_OCT16)
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+            (const void*)(size_t)normalOffset);
+    else if(format->normalFormat == MODEL_NORMAL_OCT8)
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+            (const void*)(size_t)normalOffset);
+    else
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
+            (const void*)(size_t)normalOffset);
+
+    if(format->uvFormat == MODEL_UV_UNORM16)
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+            (const void*)(size_t)uvOffset);
+    else
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+            (const void*)(size_t)uvOffset);
+}
+
+// pack is NULL to load loose files
+bool
+modelLoad(Pack* pack, const char *fname, GLuint modelVAO, GLuint modelVBO,
+            GLuint indicesVBO, ModelInfo* outInfo)
+{
+    memset(outInfo, 0, sizeof(ModelInfo));
+
+    // compressed payloads are decompressed from the start to the end
+    FileMapping* mapping = packOpenFile(pack, fname,
+                                        FILE_MAPPING_HINT_SEQUENTIAL);
+    if(mapping == NULL)
+        return false;
+
+    EaxmodHeader header;
+    const unsigned char* verticesPtr;
+    const unsigned char* indicesPtr;
+    EaxmodSubmesh* records = modelParse(fname,
+                                        fileMappingGetPointer(mapping),
+                                        fileMappingGetSize(mapping),
+                                        &header, outInfo, &verticesPtr,
+                                        &indicesPtr);
+    if(records == NULL)
+    {
+        fileMappingDestroy(mapping);
+        return false;
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicesVBO);
+    bool res = uploadIndices(fname, mapping, &header, indicesPtr, records,
+                             outInfo->submeshesNumber);
+    free(records);
+    if(!res)
+    {
+        modelInfoFree(outInfo);
+        fileMappingDestroy(mapping);
+        return false;
+    }
+
+    unsigned int normalOffset, uvOffset;
+    unsigned int stride = modelVertexLayout(&outInfo->vertexFormat,
+                                            &normalOffset, &uvOffset);
+    glBindBuffer(GL_ARRAY_BUFFER, modelVBO);
+    if(!uploadVertices(fname, mapping, &header, verticesPtr, stride))
+    {
+        modelInfoFree(outInfo);
+        fileMappingDestroy(mapping);
+        return false;
+    }
+
+    modelSetupVertexArray(modelVAO, modelVBO, indicesVBO,
+                          &outInfo->vertexFormat);
+    outInfo->vertexArray = modelVAO;
+    fileMappingDestroy(mapping);
+
+    fprintf(stderr, "modelLoad - fname = %s, %llu bytes %s right into "
+            "GL buffers\n", fname,
+            (unsigned long long)(header.verticesDataSize +
+                                 header.indicesDataSize),
+            header.compression == EAXMOD_COMPRESSION_NONE ? "read" :
+                                                            "decompressed");
+    return true;
+}
+
+/*
+ * Geometry arena. Models with the same vertex format are appended to
+ * one vertex buffer and one index buffer, which are bound to one vertex
+ * array, so drawing them doesn't need to bind anything else. Offsets of
+ * submeshes are moved to where the model is placed, base vertices of
+ * draws point to its vertices. Space is never reused.
+ */
+
+typedef struct
+{
+    GLuint vertexArray; // 0 until the first model of the format
+    GLuint verticesBuffer;
+    GLuint indicesBuffer;
+    size_t verticesSize;
+    size_t indicesSize;
+} GeometryArenaPool;
+
+struct GeometryArena
+{
+    size_t verticesCapacity;
+    size_t indicesCapacity;
+    GeometryArenaPool pools[MODEL_POSITION_FORMATS_NUMBER *
+                            MODEL_NORMAL_FORMATS_NUMBER *
+                            MODEL_UV_FORMATS_NUMBER];
+};
+
+// capacities are for every vertex format, buffers are allocated on use
+GeometryArena*
+geometryArenaCreate(size_t verticesCapacity, size_t indicesCapacity)
+{
+    GeometryArena* arena = (GeometryArena*)calloc(1, sizeof(GeometryArena));
+    if(arena == NULL)
+    {
+        fprintf(stderr, "geometryArenaCreate - malloc failed\n");
+        return NULL;
+    }
+
+    arena->verticesCapacity = verticesCapacity;
+    arena->indicesCapacity = indicesCapacity;
+    return arena;
+}
+
+void
+geometryArenaDestroy(GeometryArena* arena)
+{
+    size_t poolsNumber = sizeof(arena->pools)/sizeof(arena->pools[0]);
+    for(size_t i = 0; i < poolsNumber; ++i)
+    {
+        GeometryArenaPool* pool = &arena->pools[i];
+        if(pool->vertexArray == 0)
+            continue;
+
+        glDeleteVertexArrays(1, &pool->vertexArray);
+        glDeleteBuffers(1, &pool->verticesBuffer);
+        glDeleteBuffers(1, &pool->indicesBuffer);
+    }
+    free(arena);
+}
+
+static GeometryArenaPool*
+geometryArenaPool(GeometryArena* arena, const ModelVertexFormat* format)
+{
+    size_t index = ((size_t)format->positionFormat *
+                        MODEL_NORMAL_FORMATS_NUMBER +
+                    (size_t)format->normalFormat) *
+                        MODEL_UV_FORMATS_NUMBER +
+                   (size_t)format->uvFormat;
+    GeometryArenaPool* pool = &arena->pools[index];
+    if(pool->vertexArray != 0)
+        return pool;
+
+    glGenVertexArrays(1, &pool->vertexArray);
+    glGenBuffers(1, &pool->verticesBuffer);
+    glGenBuffers(1, &pool->indicesBuffer);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool->verticesBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)arena->verticesCapacity,
+                 NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool->indicesBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)arena->indicesCapacity,
+                 NULL, GL_STATIC_DRAW);
+
+    // callers may cache the bound vertex array, so bindings changed by
+    // the setup are restored
+    GLint boundVertexArray, boundArrayBuffer;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVertexArray);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &boundArrayBuffer);
+    modelSetupVertexArray(pool->vertexArray, pool->verticesBuffer,
+                          pool->indicesBuffer, format);
+    glBindVertexArray((GLuint)boundVertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)boundArrayBuffer);
+    return pool;
+}
+
+/*
+ * Reserves space for a model, indices start at a multiple of 4 bytes
+ * so every index size is aligned. Vertex data sizes are multiples of
+ * the vertex size, so vertices are aligned too.
+ */
+static GeometryArenaPool*
+geometryArenaAlloc(GeometryArena* arena, const ModelVertexFormat* format,
+                   uint64_t verticesSize, uint64_t indicesSize,
+                   size_t* outVerticesOffset, size_t* outIndicesOffset)
+{
+    GeometryArenaPool* pool = geometryArenaPool(arena, format);
+    size_t indicesOffset = (pool->indicesSize + 3) & ~(size_t)3;
+    if(verticesSize > arena->verticesCapacity - pool->verticesSize ||
+       indicesOffset > arena->indicesCapacity ||
+       indicesSize > arena->indicesCapacity - indicesOffset)
+        return NULL;
+
+    *outVerticesOffset = pool->verticesSize;
+    *outIndicesOffset = indicesOffset;
+    pool->verticesSize += (size_t)verticesSize;
+    pool->indicesSize = indicesOffset + (size_t)indicesSize;
+    return pool;
+}
+
+/*
+ * Asynchronous loading. Requests are queued to a ModelLoader, which has
+ * a fixed number of worker threads. A worker maps the file, validates
+ * it and reads the submeshes and clusters. modelLoadPoll on the GL
+ * thread then reserves space in the arena and maps a staging buffer,
+ * and the request is queued again: a worker reads uncompressed payloads
+ * from the file right into the staging buffer, or decompresses them
+ * into it. The arena buffers can't stay mapped, models loaded before
+ * are drawn from them meanwhile, so the GPU copies the staging buffer
+ * to the arena, at most the given number of bytes per modelLoadPoll
+ * call. The CPU never copies the payloads.
+ */
+
+enum
+{
+    MODEL_LOAD_STATE_QUEUED, // waits for a worker
+    MODEL_LOAD_STATE_DECODING, // a worker parses or writes payloads
+    MODEL_LOAD_STATE_PARSED, // waits for a staging buffer
+    MODEL_LOAD_STATE_WRITTEN, // payloads are in the staging buffer
+    MODEL_LOAD_STATE_FAILED,
+    MODEL_LOAD_STATE_DONE
+};
+
+struct ModelLoader
+{
+    Mutex* mutex;
+    // broadcast when a request is queued or decoded and on destroy
+    Condition* condition;
+    ModelLoadRequest* queueHead; // guarded by mutex
+    ModelLoadRequest* queueTail;
+    bool quit;
+    Thread** threads;
+    unsigned int threadsNumber;
+};
+
+struct ModelLoadRequest
+{
+    ModelLoader* loader;
+    ModelLoadRequest* next; // in the queue of the loader
+    Pack* pack;
+    char* fname;
+    int state; // guarded by the mutex of the loader while queued
+
+    // written by the worker before it sets the state
+    ModelInfo info;
+    FileMapping* mapping; // NULL once payloads are written
+    EaxmodHeader header;
+    EaxmodSubmesh* records; // decompression of indices needs them
+    const unsigned char* verticesPayload;
+    const unsigned char* indicesPayload;
+    uint64_t decodeTimeUs;
+
+    // set by the GL thread before the request is queued again
+    GLuint stagingBuffer; // indices followed by vertices
+    unsigned char* stagingData; // NULL when not mapped
+
+    // used by the GL thread only
+    GeometryArenaPool* pool; // NULL until space is reserved
+    size_t verticesOffset;
+    size_t indicesOffset;
+    uint64_t copiedBytes;
+    unsigned int copyCalls;
+    uint64_t requestTimeUs;
+};
+
+static bool
+modelLoadParse(ModelLoadRequest* request)
+{
+    const char* fname = request->fname;
+    request->mapping = packOpenFile(request->pack, fname,
+                                    FILE_MAPPING_HINT_SEQUENTIAL);
+    if(request->mapping == NULL)
+        return false;
+
+    EaxmodHeader* header = &request->header;
+    request->records = modelParse(fname,
+                                  fileMappingGetPointer(request->mapping),
+                                  fileMappingGetSize(request->mapping),
+                                  header, &request->info,
+                                  &request->verticesPayload,
+                                  &request->indicesPayload);
+    if(request->records == NULL)
+        return false;
+
+    // decompressed sizes are not limited by the file size
+    if(header->compression != EAXMOD_COMPRESSION_NONE &&
+       (header->verticesDataSize > SIZE_MAX / 4 ||
+        header->indicesDataSize > SIZE_MAX / 4))
+    {
+        fprintf(stderr, "modelLoadRequest - data is too large, "
+                "fname = %s\n", fname);
+        return false;
+    }
+    return true;
+}
+
+// fills the mapped staging buffer, the file isn't needed after that
+static bool
+modelLoadWrite(ModelLoadRequest* request)
+{
+    const EaxmodHeader* header = &request->header;
+    unsigned char* indicesData = request->stagingData;
+    unsigned char* verticesData = indicesData + header->indicesDataSize;
+    bool res;
+    if(header->compression == EAXMOD_COMPRESSION_NONE)
+    {
+        const unsigned char* dataPtr = fileMappingGetPointer(
+                                           request->mapping);
+        res = fileMappingRead(request->mapping,
+                    (size_t)(request->indicesPayload - dataPtr),
+                    indicesData, (size_t)header->indicesDataSize) &&
+              fileMappingRead(request->mapping,
+                    (size_t)(request->verticesPayload - dataPtr),
+                    verticesData, (size_t)header->verticesDataSize);
+    }
+    else
+    {
+        unsigned int normalOffset, uvOffset;
+        unsigned int stride = modelVertexLayout(&request->info.vertexFormat,
+                                                &normalOffset, &uvOffset);
+        res = decodeIndices(request->indicesPayload, request->records,
+                            request->info.submeshesNumber, indicesData) &&
+              decodeVertices(header, request->verticesPayload, stride,
+                             verticesData);
+    }
+
+    if(!res)
+        fprintf(stderr, "modelLoadRequest - failed to read or decompress "
+                "data, fname = %s\n", request->fname);
+
+    free(request->records);
+    request->records = NULL;
+    fileMappingDestroy(request->mapping);
+    request->mapping = NULL;
+    return res;
+}
+
+// parses queued requests or writes their payloads until the loader is
+// destroyed
+static void
+modelLoadWorker(void* arg)
+{
+    ModelLoader* loader = (ModelLoader*)arg;
+    mutexLock(loader->mutex);
+    for(;;)
+    {
+        while(loader->queueHead == NULL && !loader->quit)
+            conditionWait(loader->condition, loader->mutex);
+        if(loader->quit)
+            break;
+
+        ModelLoadRequest* request = loader->queueHead;
+        loader->queueHead = request->next;
+        if(loader->queueHead == NULL)
+            loader->queueTail = NULL;
+        request->next = NULL;
+        request->state = MODEL_LOAD_STATE_DECODING;
+        bool parsed = request->stagingData != NULL;
+        mutexUnlock(loader->mutex);
+
+        uint64_t startTimeUs = getCurrentTimeUs();
+        bool res = parsed ? modelLoadWrite(request) :
+                            modelLoadParse(request);
+        request->decodeTimeUs += getCurrentTimeUs() - startTimeUs;
+
+        mutexLock(loader->mutex);
+        if(!res)
+            request->state = MODEL_LOAD_STATE_FAILED;
+        else
+            request->state = parsed ? MODEL_LOAD_STATE_WRITTEN :
+                                      MODEL_LOAD_STATE_PARSED;
+        conditionBroadcast(loader->condition);
+    }
+    mutexUnlock(loader->mutex);
+}
+
+// stops the workers which were started and frees the loader
+static void
+modelLoaderStop(ModelLoader* loader, unsigned int startedThreads)
+{
+    mutexLock(loader->mutex);
+    loader->quit = true;
+    conditionBroadcast(loader->condition);
+    mutexUnlock(loader->mutex);
+
+    for(unsigned int i = 0; i < startedThreads; ++i)
+        threadJoin(loader->threads[i]);
+
+    conditionDestroy(loader->condition);
+    mutexDestroy(loader->mutex);
+    free(loader->threads);
+    free(loader);
+}
+
+/*
+ * Starts threadsNumber worker threads which decode models queued by
+ * modelLoadRequest. The number of threads doesn't depend on the number
+ * of requests, queued requests just wait for a free worker.
+ */
+ModelLoader*
+modelLoaderCreate(unsigned int threadsNumber)
+{
+    if(threadsNumber == 0)
+        threadsNumber = 1;
+
+    ModelLoader* loader = (ModelLoader*)calloc(1, sizeof(ModelLoader));
+    if(loader == NULL)
+    {
+        fprintf(stderr, "modelLoaderCreate - malloc failed\n");
+        return NULL;
+    }
+
+    loader->threads = (Thread**)calloc(threadsNumber, sizeof(Thread*));
+    loader->mutex = mutexCreate();
+    loader->condition = conditionCreate();
+    if(loader->threads == NULL || loader->mutex == NULL ||
+       loader->condition == NULL)
+    {
+        fprintf(stderr, "modelLoaderCreate - malloc failed\n");
+        if(loader->condition != NULL)
+            conditionDestroy(loader->condition);
+        if(loader->mutex != NULL)
+            mutexDestroy(loader->mutex);
+        free(loader->threads);
+        free(loader);
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < threadsNumber; ++i)
+    {
+        loader->threads[i] = threadCreate(modelLoadWorker, loader);
+        if(loader->threads[i] == NULL)
+        {
+            modelLoaderStop(loader, i);
+            return NULL;
+        }
+    }
+
+    loader->threadsNumber = threadsNumber;
+    return loader;
+}
+
+// all requests of the loader must be freed before
+void
+modelLoaderDestroy(ModelLoader* loader)
+{
+    modelLoaderStop(loader, loader->threadsNumber);
+}
+
+static void
+modelLoaderQueue(ModelLoader* loader, ModelLoadRequest* request)
+{
+    mutexLock(loader->mutex);
+    request->state = MODEL_LOAD_STATE_QUEUED;
+    if(loader->queueTail == NULL)
+        loader->queueHead = request;
+    else
+        loader->queueTail->next = request;
+    loader->queueTail = request;
+    conditionBroadcast(loader->condition);
+    mutexUnlock(loader->mutex);
+}
+
+/*
+ * Queues fname to be decoded by a worker of the loader, pack must stay
+ * open until the request is freed.
+ */
+ModelLoadRequest*
+modelLoadRequest(ModelLoader* loader, Pack* pack, const char* fname)
+{
+    ModelLoadRequest* request = (ModelLoadRequest*)calloc(
+                                    1, sizeof(ModelLoadRequest));
+    size_t fnameSize = strlen(fname) + 1;
+    char* fnameCopy = (char*)malloc(fnameSize);
+    if(request == NULL || fnameCopy == NULL)
+    {
+        fprintf(stderr, "modelLoadRequest - malloc failed, fname = %s\n",
+                fname);
+        free(fnameCopy);
+        free(request);
+        return NULL;
+    }
+
+    memcpy(fnameCopy, fname, fnameSize);
+    request->loader = loader;
+    request->pack = pack;
+    request->fname = fnameCopy;
+    request->requestTimeUs = getCurrentTimeUs();
+    modelLoaderQueue(loader, request);
+    return request;
+}
+
+/*
+ * Reserves space in the arena and maps the staging buffer, which
+ * a worker then fills. Empty models don't need a staging buffer.
+ */
+static bool
+modelLoadStage(ModelLoadRequest* request, GeometryArena* arena)
+{
+    uint64_t verticesSize = request->header.verticesDataSize;
+    uint64_t indicesSize = request->header.indicesDataSize;
+    request->pool = geometryArenaAlloc(arena, &request->info.vertexFormat,
+                                       verticesSize, indicesSize,
+                                       &request->verticesOffset,
+                                       &request->indicesOffset);
+    if(request->pool == NULL)
+    {
+        fprintf(stderr, "modelLoadPoll - geometry arena is full, "
+                "fname = %s\n", request->fname);
+        return false;
+    }
+
+    if(verticesSize + indicesSize == 0)
+        return true;
+
+    glGenBuffers(1, &request->stagingBuffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, request->stagingBuffer);
+    request->stagingData = (unsigned char*)mapNewBuffer(GL_COPY_READ_BUFFER,
+                                (size_t)(verticesSize + indicesSize),
+                                GL_STREAM_COPY);
+    if(request->stagingData == NULL)
+    {
+        fprintf(stderr, "modelLoadPoll - glMapBufferRange failed, "
+                "fname = %s\n", request->fname);
+        return false;
+    }
+
+    modelLoaderQueue(request->loader, request);
+    return true;
+}
+
+// the GPU copies the next part of the staging buffer within the budget
+static void
+copyPart(GLuint stagingBuffer, size_t stagingOffset, GLuint buffer,
+         size_t offset, uint64_t dataSize, uint64_t* copied,
+         size_t* budgetBytes)
+{
+    if(*copied >= dataSize || *budgetBytes == 0)
+        return;
+
+    uint64_t size = dataSize - *copied;
+    if(size > *budgetBytes)
+        size = *budgetBytes;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        (GLintptr)(stagingOffset + *copied),
+                        (GLintptr)(offset + *copied), (GLsizeiptr)size);
+    *copied += size;
+    *budgetBytes -= (size_t)size;
+}
+
+// moves submeshes to where the model is placed in the arena
+static void
+modelMoveToArena(ModelInfo* info, const GeometryArenaPool* pool,
+                 size_t verticesOffset, size_t indicesOffset)
+{
+    unsigned int normalOffset, uvOffset;
+    unsigned int stride = modelVertexLayout(&info->vertexFormat,
+                                            &normalOffset, &uvOffset);
+    for(unsigned int i = 0; i < info->submeshesNumber; ++i)
+    {
+        info->submeshes[i].baseVertex +=
+            (unsigned int)(verticesOffset / stride);
+        info->submeshes[i].indicesOffset += indicesOffset;
+    }
+    info->vertexArray = pool->vertexArray;
+}
+
+// the worker is done with the staging buffer when it's unmapped
+static bool
+modelLoadUnmapStaging(ModelLoadRequest* request)
+{
+    if(request->stagingData == NULL)
+        return true;
+
+    // the contents are lost if the mapping was corrupted meanwhile
+    request->stagingData = NULL;
+    glBindBuffer(GL_COPY_READ_BUFFER, request->stagingBuffer);
+    return glUnmapBuffer(GL_COPY_READ_BUFFER) != GL_FALSE;
+}
+
+static void
+modelLoadFreeStaging(ModelLoadRequest* request)
+{
+    modelLoadUnmapStaging(request);
+    if(request->stagingBuffer != 0)
+    {
+        glDeleteBuffers(1, &request->stagingBuffer);
+        request->stagingBuffer = 0;
+    }
+}
+
+/*
+ * Called on the GL thread, e.g. once per frame. Makes the GPU copy at
+ * most *budgetBytes bytes to the arena and subtracts the copied size,
+ * so several requests can share one budget. When the model is
+ * completely copied outInfo is filled and MODEL_LOAD_DONE is returned.
+ * The first model of a vertex format also allocates the whole pool of
+ * the format in the arena and sets up its vertex array, which isn't
+ * counted in the budget since no data is copied. The bound vertex array
+ * and GL_ARRAY_BUFFER are restored after that, so callers can cache
+ * them.
+ */
+int
+modelLoadPoll(ModelLoadRequest* request, GeometryArena* arena,
+              size_t* budgetBytes, ModelInfo* outInfo)
+{
+    mutexLock(request->loader->mutex);
+    int state = request->state;
+    mutexUnlock(request->loader->mutex);
+
+    if(state == MODEL_LOAD_STATE_DONE)
+        return MODEL_LOAD_DONE;
+    if(state == MODEL_LOAD_STATE_QUEUED ||
+       state == MODEL_LOAD_STATE_DECODING)
+        return MODEL_LOAD_PENDING;
+    if(state == MODEL_LOAD_STATE_FAILED)
+        return MODEL_LOAD_FAILED;
+
+    // the worker is done with the request
+    if(state == MODEL_LOAD_STATE_PARSED)
+    {
+        if(!modelLoadStage(request, arena))
+        {
+            request->state = MODEL_LOAD_STATE_FAILED;
+            return MODEL_LOAD_FAILED;
+        }
+        // queued again unless the model is empty
+        if(request->stagingData != NULL)
+            return MODEL_LOAD_PENDING;
+    }
+
+    if(!modelLoadUnmapStaging(request))
+    {
+        fprintf(stderr, "modelLoadPoll - staging buffer was corrupted, "
+                "fname = %s\n", request->fname);
+        request->state = MODEL_LOAD_STATE_FAILED;
+        return MODEL_LOAD_FAILED;
+    }
+
+    // indices first, then vertices right after them
+    uint64_t indicesSize = request->header.indicesDataSize;
+    uint64_t verticesSize = request->header.verticesDataSize;
+    uint64_t indicesCopied = request->copiedBytes;
+    if(indicesCopied > indicesSize)
+        indicesCopied = indicesSize;
+    uint64_t verticesCopied = request->copiedBytes - indicesCopied;
+    copyPart(request->stagingBuffer, 0, request->pool->indicesBuffer,
+             request->indicesOffset, indicesSize, &indicesCopied,
+             budgetBytes);
+    if(indicesCopied == indicesSize)
+        copyPart(request->stagingBuffer, (size_t)indicesSize,
+                 request->pool->verticesBuffer, request->verticesOffset,
+                 verticesSize, &verticesCopied, budgetBytes);
+    request->copiedBytes = indicesCopied + verticesCopied;
+    request->copyCalls++;
+
+    if(request->copiedBytes < indicesSize + verticesSize)
+        return MODEL_LOAD_PENDING;
+
+    modelLoadFreeStaging(request);
+    modelMoveToArena(&request->info, request->pool, request->verticesOffset,
+                     request->indicesOffset);
+    *outInfo = request->info;
+    memset(&request->info, 0, sizeof(ModelInfo));
+    request->state = MODEL_LOAD_STATE_DONE;
+
+    fprintf(stderr,
+            "modelLoadPoll - fname = %s, %llu bytes %s right into a "
+            "staging buffer in %u ms, copied by the GPU in %u calls, "
+            "loaded in %u ms\n",
+            request->fname,
+            (unsigned long long)request->copiedBytes,
+            request->header.compression == EAXMOD_COMPRESSION_NONE ?
+                "read" : "decompressed",
+            (unsigned int)(request->decodeTimeUs / 1000),
+            request->copyCalls,
+            (unsigned int)((getCurrentTimeUs() - request->requestTimeUs) /
+                           1000)
+        );
+    return MODEL_LOAD_DONE;
+}
+
+/*
+ * Removes the request from the queue if no worker took it yet, or waits
+ * for the worker if it's still busy with it. Called on the GL thread,
+ * the staging buffer is deleted.
+ */
+void
+modelLoadRequestFree(ModelLoadRequest* request)
+{
+    ModelLoader* loader = request->loader;
+    mutexLock(loader->mutex);
+    if(request->state == MODEL_LOAD_STATE_QUEUED)
+    {
+        ModelLoadRequest* prev = NULL;
+        ModelLoadRequest* curr = loader->queueHead;
+        while(curr != request)
+        {
+            prev = curr;
+            curr = curr->next;
+        }
+
+        if(prev == NULL)
+            loader->queueHead = request->next;
+        else
+            prev->next = request->next;
+        if(loader->queueTail == request)
+            loader->queueTail = prev;
+    }
+    while(request->state == MODEL_LOAD_STATE_DECODING)
+        conditionWait(loader->condition, loader->mutex);
+    mutexUnlock(loader->mutex);
+
+    modelLoadFreeStaging(request);
+    modelInfoFree(&request->info);
+    if(request->mapping != NULL)
+        fileMappingDestroy(request->mapping);
+    free(request->records);
+    free(request->fname);
+    free(request);
+}
+
+void
+modelInfoFree(ModelInfo* info)
+{
+    free(info->clusters);
+    info->clusters = NULL;
+    info->clustersNumber = 0;
+    free(info->submeshes);
+    info->submeshes = NULL;
+    info->submeshesNumber = 0;
+}
+
+/*
+ * Selects the coarsest LOD which error projected to the screen is
+ * below maxErrorPixels. pixelsPerUnit is the size in pixels of one unit
+ * at distance 1, e.g. viewportHeight / (2 * tan(fovY / 2)).
+ */
+const ModelLod*
+modelLodSelect(const ModelSubmesh* submesh, float distance,
+               float pixelsPerUnit, float maxErrorPixels)
+{
+    const ModelLod* result = &submesh->lods[0];
+    if(distance <= 0.0f)
+        return result;
+
+    for(unsigned int i = 1; i < submesh->lodsNumber; ++i)
+    {
+        float errorPixels = submesh->lods[i].error * pixelsPerUnit / distance;
+        if(errorPixels > maxErrorPixels)
+            break;
+        result = &submesh->lods[i];
+    }
+
+    return result;
+}
+
+/*
+ * Extracts 6 planes of the view frustum from the column-major
+ * model-view-projection matrix, so the planes are in model space.
+ * Every plane is 4 floats (a, b, c, d), normalized so that
+ * a*x + b*y + c*z + d is the distance to it, positive inside.
+ */
+void
+modelFrustumPlanes(const float* mvp, float* outPlanes)
+{
+    for(int i = 0; i < 6; ++i)
+    {
+        // row 3 plus or minus row 0, 1 or 2 of the matrix
+        int row = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        float* plane = outPlanes + i*4;
+        for(int j = 0; j < 4; ++j)
+            plane[j] = mvp[j*4 + 3] + sign*mvp[j*4 + row];
+
+        float len = sqrtf(plane[0]*plane[0] + plane[1]*plane[1] +
+                          plane[2]*plane[2]);
+        if(len > 0.0f)
+            for(int j = 0; j < 4; ++j)
+                plane[j] /= len;
+    }
+}
+
+/*
+ * Returns false if the bounding sphere of the cluster is outside of one
+ * of the planes, or if the cluster is back-facing for any point of its
+ * sphere, i.e. the camera is inside the cone of its normals turned
+ * away. planes come from modelFrustumPlanes, cameraPos is in model
+ * space.
+ */
+bool
+modelClusterVisible(const ModelCluster* cluster, const float* planes,
+                    const float* cameraPos)
+{
+    const float* center = cluster->center;
+    for(int i = 0; i < 6; ++i)
+    {
+        const float* plane = planes + i*4;
+        float distance = plane[0]*center[0] + plane[1]*center[1] +
+                         plane[2]*center[2] + plane[3];
+        if(distance < -cluster->radius)
+            return false;
+    }
+
+    float dx = center[0] - cameraPos[0];
+    float dy = center[1] - cameraPos[1];
+    float dz = center[2] - cameraPos[2];
+    float len = sqrtf(dx*dx + dy*dy + dz*dz);
+    float dot = dx*cluster->coneAxis[0] + dy*cluster->coneAxis[1] +
+                dz*cluster->coneAxis[2];
+    return dot < cluster->coneCutoff*len + cluster->radius;
+}
@@ -3,12 +3,152 @@
 
 #include <stdbool.h>
 #include <GLXW/glxw.h>
+#include "pack.h"
 
-bool modelSave(const char *fname, const GLfloat *verticesData,
+#define MODEL_MAX_LODS 8
+
+// attribute formats, positions and UVs are decoded in the vertex shader
+// as stored * scale + bias
+#define MODEL_POSITION_FLOAT3  0
+#define MODEL_POSITION_HALF3   1
+#define MODEL_POSITION_UNORM16 2
+#define MODEL_POSITION_FORMATS_NUMBER 3
+
+// octahedral normals are two unorm values mapped to [-1, 1]
+#define MODEL_NORMAL_FLOAT3    0
+#define MODEL_NORMAL_OCT16     1
+#define MODEL_NORMAL_OCT8      2
+#define MODEL_NORMAL_FORMATS_NUMBER 3
+
+#define MODEL_UV_FLOAT2        0
+#define MODEL_UV_UNORM16       1
+#define MODEL_UV_FORMATS_NUMBER 2
+
+// index size policies of modelIndexSize, GL_UNSIGNED_BYTE indices are
+// a slow path on many drivers
+#define MODEL_INDICES_SMALLEST     0 // 8, 16 or 32 bits, whatever fits
+#define MODEL_INDICES_NEVER_8BIT   1 // 16 or 32 bits
+#define MODEL_INDICES_PREFER_16BIT 2 // the same, emdconv splits big meshes
+#define MODEL_INDICES_ALLOW_32BIT  3 // 16 or 32 bits, never split
+
+// 16-bit indices address this many vertices of a submesh
+#define MODEL_MAX_16BIT_VERTICES 65535
+
+typedef struct
+{
+    unsigned char positionFormat;
+    unsigned char normalFormat;
+    unsigned char uvFormat;
+    float positionScale[3];
+    float positionBias[3];
+    float uvScale[2];
+    float uvBias[2];
+} ModelVertexFormat;
+
+// axis aligned box and bounding sphere in model space
+typedef struct
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+} ModelBounds;
+
+// a range of triangles of a LOD culled on the CPU as a whole, it's
+// back-facing for cameras inside the cone around coneAxis, see
+// modelClusterVisible. coneCutoff is 1 if the cone is empty.
+typedef struct
+{
+    size_t indicesOffset; // in indices from the start of the LOD
+    unsigned int indicesNumber;
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+} ModelCluster;
+
+typedef struct
+{
+    size_t indicesOffset; // in indices, not bytes
+    size_t indicesNumber;
+    float error; // geometric error in model space units
+    ModelBounds bounds;
+    size_t firstCluster; // in ModelInfo::clusters
+    size_t clustersNumber; // 0 if the LOD has no clusters
+} ModelLod;
+
+// a mesh sharing the vertex and index buffers with others in the file,
+// indices are relative to baseVertex
+typedef struct
+{
+    unsigned int baseVertex;
+    unsigned int verticesNumber;
+    GLenum indicesType;
+    unsigned int indexSize; // 0 lets modelSave choose the smallest one
+    size_t indicesOffset; // in bytes from the start of the index buffer
+    size_t indicesNumber; // of all LODs
+    unsigned int materialIndex;
+    unsigned int lodsNumber;
+    ModelLod lods[MODEL_MAX_LODS]; // lods[0] is the most detailed one
+    ModelBounds bounds;
+} ModelSubmesh;
+
+typedef struct
+{
+    ModelVertexFormat vertexFormat;
+    bool hasBounds; // files before version 7 have no bounds
+    ModelBounds bounds; // of all vertices
+    unsigned int submeshesNumber; // files before version 8 have one
+    ModelSubmesh* submeshes;
+    size_t clustersNumber; // files before version 9 have none
+    ModelCluster* clusters;
+    GLuint vertexArray; // with the index buffer bound, set when loaded
+} ModelInfo;
+
+void modelVertexFormatDefault(ModelVertexFormat* format);
+unsigned int modelVertexLayout(const ModelVertexFormat* format,
+				unsigned int* outNormalOffset, unsigned int* outUVOffset);
+unsigned int modelIndexSize(unsigned int verticesNumber,
+				unsigned int indexPolicy);
+bool modelSave(const char *fname, const void *verticesData,
 				size_t verticesDataSize, const unsigned int *indices,
-				unsigned int indicesNumber);
-bool modelLoad(const char *fname, GLuint modelVAO, GLuint modelVBO,
-				GLuint indicesVBO, GLsizei* outIndicesNumber,
-				GLenum* outIndicesType);
+				const ModelSubmesh *submeshes, unsigned int submeshesNumber,
+				const ModelCluster *clusters, size_t clustersNumber,
+				const ModelVertexFormat *vertexFormat,
+				const ModelBounds *bounds, bool compress);
+bool modelLoad(Pack* pack, const char *fname, GLuint modelVAO,
+				GLuint modelVBO, GLuint indicesVBO, ModelInfo* outInfo);
+
+// results of modelLoadPoll
+#define MODEL_LOAD_PENDING 0
+#define MODEL_LOAD_DONE 1
+#define MODEL_LOAD_FAILED 2
+
+struct ModelLoader;
+typedef struct ModelLoader ModelLoader;
+
+struct ModelLoadRequest;
+typedef struct ModelLoadRequest ModelLoadRequest;
+
+struct GeometryArena;
+typedef struct GeometryArena GeometryArena;
+
+GeometryArena* geometryArenaCreate(size_t verticesCapacity,
+				size_t indicesCapacity);
+void geometryArenaDestroy(GeometryArena* arena);
+
+ModelLoader* modelLoaderCreate(unsigned int threadsNumber);
+void modelLoaderDestroy(ModelLoader* loader);
+ModelLoadRequest* modelLoadRequest(ModelLoader* loader, Pack* pack,
+				const char* fname);
+int modelLoadPoll(ModelLoadRequest* request, GeometryArena* arena,
+				size_t* budgetBytes, ModelInfo* outInfo);
+void modelLoadRequestFree(ModelLoadRequest* request);
+void modelInfoFree(ModelInfo* info);
+const ModelLod* modelLodSelect(const ModelSubmesh* submesh, float distance,
+				float pixelsPerUnit, float maxErrorPixels);
+void modelFrustumPlanes(const float* mvp, float* outPlanes);
+bool modelClusterVisible(const ModelCluster* cluster, const float* planes,
+				const float* cameraPos);
 
 #endif // AFISKON_MODELS_H
@@ -0,0 +1,343 @@
+// stat is POSIX, and we build with -std=c11, sizes of files over 2 GB
+// need 64-bit offsets on 32-bit targets
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "pack.h"
+
+#ifdef _WIN32
+typedef struct _stat64 PackStat;
+#define packStat(fname, st) _stat64(fname, st)
+#else
+typedef struct stat PackStat;
+#define packStat(fname, st) stat(fname, st)
+#endif
+
+/*
+ * An asset pack is a header, a table of contents sorted by name and the
+ * files. Entries of the table take a cache line each, files start at
+ * page boundaries, so reading one of them never touches pages of
+ * another. The demo maps the pack once and opens the files as views of
+ * the mapping.
+ */
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint32_t filesNumber;
+    uint32_t reserved[13]; // up to 64 bytes
+} PackHeader;
+
+typedef struct
+{
+    char name[PACK_MAX_NAME_SIZE]; // zero-padded
+    uint64_t offset; // from the start of the pack
+    uint64_t size;
+} PackEntry;
+
+#pragma pack(pop)
+
+static const char packSignature[] = "EAXPAK";
+static const char packVersion = 1;
+
+#define PACK_FILE_ALIGNMENT 4096
+
+struct Pack
+{
+    FileMapping* mapping;
+    const PackEntry* entries;
+    size_t filesNumber;
+};
+
+static bool
+packCheckEntries(const char* fname, const PackEntry* entries,
+                 size_t filesNumber, size_t fsize)
+{
+    for(size_t i = 0; i < filesNumber; ++i)
+    {
+        const PackEntry* entry = &entries[i];
+        if(memchr(entry->name, 0, PACK_MAX_NAME_SIZE) == NULL ||
+           entry->offset > fsize || entry->size > fsize - entry->offset ||
+           entry->offset % PACK_FILE_ALIGNMENT != 0)
+        {
+            fprintf(stderr, "packOpen - invalid entry %u, fname = %s\n",
+                    (unsigned int)i, fname);
+            return false;
+        }
+
+        // lookups are binary searches
+        if(i > 0 && strcmp(entries[i - 1].name, entry->name) >= 0)
+        {
+            fprintf(stderr, "packOpen - entries are not sorted, "
+                    "fname = %s\n", fname);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Files are read one by one from different places of the pack, so there is
+ * no read-ahead past the page touched, unless packOpenFile is given other
+ * hints for the file. packPrefetch reads everything ahead.
+ */
+Pack*
+packOpen(const char* fname)
+{
+    FileMapping* mapping = fileMappingCreateWithHints(fname,
+                                            FILE_MAPPING_HINT_RANDOM);
+    if(mapping == NULL)
+        return NULL;
+
+    const unsigned char* dataPtr = fileMappingGetPointer(mapping);
+    size_t fsize = fileMappingGetSize(mapping);
+
+    PackHeader header;
+    if(fsize < sizeof(header))
+    {
+        fprintf(stderr, "packOpen - file is too small, fname = %s\n", fname);
+        fileMappingDestroy(mapping);
+        return NULL;
+    }
+
+    memcpy(&header, dataPtr, sizeof(header));
+    if(strncmp(header.signature, packSignature,
+               sizeof(packSignature)) != 0 ||
+       header.version != packVersion)
+    {
+        fprintf(stderr, "packOpen - invalid signature or version, "
+                "fname = %s\n", fname);
+        fileMappingDestroy(mapping);
+        return NULL;
+    }
+
+    if(header.filesNumber > (fsize - sizeof(header)) / sizeof(PackEntry))
+    {
+        fprintf(stderr, "packOpen - invalid files number, fname = %s\n",
+                fname);
+        fileMappingDestroy(mapping);
+        return NULL;
+    }
+
+    const PackEntry* entries = (const PackEntry*)(dataPtr + sizeof(header));
+    if(!packCheckEntries(fname, entries, header.filesNumber, fsize))
+    {
+        fileMappingDestroy(mapping);
+        return NULL;
+    }
+
+    Pack* pack = (Pack*)malloc(sizeof(Pack));
+    if(pack == NULL)
+    {
+        fprintf(stderr, "packOpen - malloc failed, fname = %s\n", fname);
+        fileMappingDestroy(mapping);
+        return NULL;
+    }
+
+    pack->mapping = mapping;
+    pack->entries = entries;
+    pack->filesNumber = header.filesNumber;
+    return pack;
+}
+
+static int
+packEntryCompare(const void* name, const void* entry)
+{
+    return strcmp((const char*)name, ((const PackEntry*)entry)->name);
+}
+
+/*
+ * Opens the file from the pack, files not found in the pack and all
+ * files when pack is NULL are opened from the disk. Hints are applied
+ * to the file either way. The returned mapping is destroyed with
+ * fileMappingDestroy before the pack is closed.
+ */
+FileMapping*
+packOpenFile(Pack* pack, const char* name, unsigned int hints)
+{
+    if(pack == NULL)
+        return fileMappingCreateWithHints(name, hints);
+
+    const PackEntry* entry = (const PackEntry*)bsearch(name, pack->entries,
+                                pack->filesNumber, sizeof(PackEntry),
+                                packEntryCompare);
+    if(entry == NULL)
+        return fileMappingCreateWithHints(name, hints);
+
+    FileMapping* view = fileMappingCreateView(pack->mapping,
+                                              (size_t)entry->offset,
+                                              (size_t)entry->size);
+    // files start at page boundaries, so neighbours keep their hints
+    if(view != NULL && hints != FILE_MAPPING_HINT_NONE)
+        fileMappingAdvise(view, 0, (size_t)entry->size, hints);
+    return view;
+}
+
+// starts reading the whole pack in the background, doesn't wait for it
+void
+packPrefetch(Pack* pack)
+{
+    fileMappingPrefetch(pack->mapping, 0, fileMappingGetSize(pack->mapping));
+}
+
+size_t
+packGetFilesNumber(Pack* pack)
+{
+    return pack->filesNumber;
+}
+
+const char*
+packGetFileName(Pack* pack, size_t index, size_t* outSize)
+{
+    *outSize = (size_t)pack->entries[index].size;
+    return pack->entries[index].name;
+}
+
+void
+packClose(Pack* pack)
+{
+    fileMappingDestroy(pack->mapping);
+    free(pack);
+}
+
+static int
+packNameCompare(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static size_t
+packAlign(size_t offset)
+{
+    return (offset + PACK_FILE_ALIGNMENT - 1) &
+           ~(size_t)(PACK_FILE_ALIGNMENT - 1);
+}
+
+// reads the whole file to dataPtr, which has room for size bytes
+static bool
+packReadFile(const char* fname, unsigned char* dataPtr, size_t size)
+{
+    FILE* fd = fopen(fname, "rb");
+    if(fd == NULL)
+        return false;
+
+    bool res = fread(dataPtr, 1, size, fd) == size && fgetc(fd) == EOF &&
+               ferror(fd) == 0;
+    fclose(fd);
+    return res;
+}
+
+// st_size is 64 bits, unlike the long ftell returns on Windows
+static bool
+packFileSize(const char* fname, size_t* outSize)
+{
+    PackStat st;
+    if(packStat(fname, &st) != 0 || st.st_size < 0 ||
+       (uint64_t)st.st_size > SIZE_MAX)
+        return false;
+
+    *outSize = (size_t)st.st_size;
+    return true;
+}
+
+/*
+ * Stores the files under their names, e.g. "models/sphere.emd" is
+ * opened by packOpenFile(pack, "models/sphere.emd") just like the loose
+ * file.
+ */
+bool
+packSave(const char* fname, const char* const* names, size_t namesNumber)
+{
+    const char** sorted = (const char**)malloc(
+                                (namesNumber + 1) * sizeof(const char*));
+    PackEntry* entries = (PackEntry*)calloc(namesNumber + 1,
+                                            sizeof(PackEntry));
+    if(sorted == NULL || entries == NULL)
+    {
+        fprintf(stderr, "packSave - malloc failed, fname = %s\n", fname);
+        free(entries);
+        free(sorted);
+        return false;
+    }
+
+    memcpy(sorted, names, namesNumber * sizeof(const char*));
+    qsort(sorted, namesNumber, sizeof(const char*), packNameCompare);
+
+    // the last file is not padded
+    size_t offset = packAlign(sizeof(PackHeader) +
+                              namesNumber * sizeof(PackEntry));
+    size_t packSize = offset;
+    for(size_t i = 0; i < namesNumber; ++i)
+    {
+        const char* name = sorted[i];
+        size_t size;
+        if(strlen(name) >= PACK_MAX_NAME_SIZE ||
+           (i > 0 && strcmp(sorted[i - 1], name) == 0) ||
+           !packFileSize(name, &size))
+        {
+            fprintf(stderr, "packSave - name is too long, repeated or the "
+                    "file can't be read, name = %s\n", name);
+            free(entries);
+            free(sorted);
+            return false;
+        }
+
+        strcpy(entries[i].name, name);
+        entries[i].offset = offset;
+        entries[i].size = size;
+        packSize = offset + size;
+        offset = packAlign(packSize);
+    }
+
+    FileMapping* mapping = fileMappingCreateWritable(fname, offset);
+    if(mapping == NULL)
+    {
+        free(entries);
+        free(sorted);
+        return false;
+    }
+
+    unsigned char* dataPtr = fileMappingGetPointer(mapping);
+    bool res = true;
+    for(size_t i = 0; i < namesNumber && res; ++i)
+    {
+        res = packReadFile(sorted[i], dataPtr + entries[i].offset,
+                           (size_t)entries[i].size);
+        if(!res)
+            fprintf(stderr, "packSave - failed to read file or it has "
+                    "changed, name = %s\n", sorted[i]);
+    }
+
+    if(!res)
+    {
+        fileMappingDestroy(mapping);
+        free(entries);
+        free(sorted);
+        return false;
+    }
+
+    // the gaps are zeroes already, the file is new
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.signature, packSignature);
+    header.version = packVersion;
+    header.filesNumber = (uint32_t)namesNumber;
+    memcpy(dataPtr, &header, sizeof(header));
+    memcpy(dataPtr + sizeof(header), entries,
+           namesNumber * sizeof(PackEntry));
+
+    free(entries);
+    free(sorted);
+    return fileMappingCommit(mapping, packSize);
+}
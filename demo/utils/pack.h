@@ -0,0 +1,24 @@
+#ifndef AFISKON_PACK_H
+#define AFISKON_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "filemapping.h"
+
+// including the terminating zero
+#define PACK_MAX_NAME_SIZE 48
+
+struct Pack;
+typedef struct Pack Pack;
+
+Pack* packOpen(const char* fname);
+FileMapping* packOpenFile(Pack* pack, const char* name, unsigned int hints);
+void packPrefetch(Pack* pack);
+size_t packGetFilesNumber(Pack* pack);
+const char* packGetFileName(Pack* pack, size_t index, size_t* outSize);
+void packClose(Pack* pack);
+
+bool packSave(const char* fname, const char* const* names,
+				size_t namesNumber);
+
+#endif // AFISKON_PACK_H
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "quantize.h"
+
+// source vertices are 3 floats of position, 3 of normal and 2 of UV
+#define QUANTIZE_FLOATS_PER_VERTEX 8
+
+#define QUANTIZE_HALF_MAX 65504.0f
+
+/*
+ * Converts float to IEEE 754 half, rounding to nearest even. Values
+ * that don't fit become infinities.
+ */
+static uint16_t
+quantizeHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t absBits = bits & 0x7FFFFFFF;
+
+    if(absBits > 0x7F800000) // NaN
+        return sign | 0x7E00;
+
+    if(absBits >= 0x477FF000) // rounds to more than QUANTIZE_HALF_MAX
+        return sign | 0x7C00;
+
+    if(absBits < 0x38800000) // subnormal half, step is 2^-24
+        return sign | (uint16_t)(fabsf(value) * 16777216.0f + 0.5f);
+
+    // rebias exponent from 127 to 15 and drop 13 bits of mantissa
+    uint32_t half = (absBits - 0x38000000) >> 13;
+    uint32_t rest = absBits & 0x1FFF;
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | (uint16_t)half;
+}
+
+static float
+quantizeClamp01(float value)
+{
+    if(value < 0.0f) return 0.0f;
+    if(value > 1.0f) return 1.0f;
+    return value;
+}
+
+static uint16_t
+quantizeUnorm16(float value, float scale, float bias)
+{
+    if(scale == 0.0f)
+        return 0;
+    return (uint16_t)(quantizeClamp01((value - bias) / scale) * 65535.0f +
+                      0.5f);
+}
+
+/*
+ * Octahedral encoding, see "A Survey of Efficient Representations for
+ * Independent Unit Vectors" by Cigolle et al. The result is in [-1, 1].
+ */
+static void
+quantizeOctahedral(const GLfloat* normal, float* outX, float* outY)
+{
+    float len = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if(len == 0.0f)
+    {
+        *outX = 0.0f;
+        *outY = 0.0f;
+        return;
+    }
+
+    float x = normal[0] / len;
+    float y = normal[1] / len;
+    if(normal[2] < 0.0f)
+    {
+        float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    *outX = x;
+    *outY = y;
+}
+
+/*
+ * Chooses scale and bias for the given attribute formats so the
+ * quantized values cover bounds of the vertices.
+ */
+void
+quantizeVertexFormatInit(ModelVertexFormat* format,
+    unsigned char positionFormat, unsigned char normalFormat,
+    unsigned char uvFormat, const GLfloat* vertices,
+    unsigned int verticesNumber)
+{
+    modelVertexFormatDefault(format);
+    format->positionFormat = positionFormat;
+    format->normalFormat = normalFormat;
+    format->uvFormat = uvFormat;
+
+    if(verticesNumber == 0)
+        return;
+
+    float minValues[QUANTIZE_FLOATS_PER_VERTEX];
+    float maxValues[QUANTIZE_FLOATS_PER_VERTEX];
+    memcpy(minValues, vertices, sizeof(minValues));
+    memcpy(maxValues, vertices, sizeof(maxValues));
+    for(unsigned int v = 1; v < verticesNumber; ++v)
+    {
+        const GLfloat* vertex = vertices + (size_t)v*QUANTIZE_FLOATS_PER_VERTEX;
+        for(unsigned int k = 0; k < QUANTIZE_FLOATS_PER_VERTEX; ++k)
+        {
+            if(vertex[k] < minValues[k]) minValues[k] = vertex[k];
+            if(vertex[k] > maxValues[k]) maxValues[k] = vertex[k];
+        }
+    }
+
+    if(positionFormat == MODEL_POSITION_UNORM16)
+    {
+        for(unsigned int k = 0; k < 3; ++k)
+        {
+            format->positionScale[k] = maxValues[k] - minValues[k];
+            format->positionBias[k] = minValues[k];
+        }
+    }
+    else if(positionFormat == MODEL_POSITION_HALF3)
+    {
+        for(unsigned int k = 0; k < 3; ++k)
+            if(minValues[k] < -QUANTIZE_HALF_MAX ||
+               maxValues[k] > QUANTIZE_HALF_MAX)
+                fprintf(stderr, "quantizeVertexFormatInit - positions "
+                        "don't fit into half floats\n");
+    }
+
+    if(uvFormat == MODEL_UV_UNORM16)
+    {
+        for(unsigned int k = 0; k < 2; ++k)
+        {
+            format->uvScale[k] = maxValues[6 + k] - minValues[6 + k];
+            format->uvBias[k] = minValues[6 + k];
+        }
+    }
+}
+
+/*
+ * Largest distance along every axis between a position inside bounds and
+ * its quantized value.
+ */
+void
+quantizePositionError(const ModelVertexFormat* format,
+    const ModelBounds* bounds, float* outError)
+{
+    for(unsigned int k = 0; k < 3; ++k)
+    {
+        if(format->positionFormat == MODEL_POSITION_UNORM16)
+            outError[k] = format->positionScale[k] / 65535.0f * 0.5f;
+        else if(format->positionFormat == MODEL_POSITION_HALF3)
+        {
+            // half has 11 significant bits, plus the subnormal step
+            float maxValue = fmaxf(fabsf(bounds->min[k]),
+                                   fabsf(bounds->max[k]));
+            outError[k] = maxValue / 2048.0f + 1.0f / 33554432.0f;
+        }
+        else
+            outError[k] = 0.0f;
+    }
+}
+
+/*
+ * Returns a new buffer with vertices in the given format, the caller
+ * frees it.
+ */
+void*
+quantizeVertices(const ModelVertexFormat* format, const GLfloat* vertices,
+    unsigned int verticesNumber, size_t* outVerticesDataSize)
+{
+    *outVerticesDataSize = 0;
+
+    unsigned int normalOffset, uvOffset;
+    unsigned int vertexSize = modelVertexLayout(format, &normalOffset,
+                                                &uvOffset);
+    if(vertexSize == 0)
+    {
+        fprintf(stderr, "quantizeVertices - unsupported vertex format\n");
+        return NULL;
+    }
+
+    size_t dataSize = (size_t)verticesNumber * vertexSize;
+    unsigned char* data = (unsigned char*)calloc(dataSize, 1);
+    if(data == NULL)
+    {
+        fprintf(stderr, "quantizeVertices - calloc failed\n");
+        return NULL;
+    }
+
+    for(unsigned int v = 0; v < verticesNumber; ++v)
+    {
+        const GLfloat* src = vertices + (size_t)v*QUANTIZE_FLOATS_PER_VERTEX;
+        unsigned char* dst = data + (size_t)v*vertexSize;
+
+        if(format->positionFormat == MODEL_POSITION_HALF3)
+        {
+            uint16_t position[3];
+            for(unsigned int k = 0; k < 3; ++k)
+                position[k] = quantizeHalf(src[k]);
+            memcpy(dst, position, sizeof(position));
+        }
+        else if(format->positionFormat == MODEL_POSITION_UNORM16)
+        {
+            uint16_t position[3];
+            for(unsigned int k = 0; k < 3; ++k)
+                position[k] = quantizeUnorm16(src[k],
+                                format->positionScale[k],
+                                format->positionBias[k]);
+            memcpy(dst, position, sizeof(position));
+        }
+        else
+            memcpy(dst, src, 3*sizeof(GLfloat));
+
+        if(format->normalFormat == MODEL_NORMAL_FLOAT3)
+            memcpy(dst + normalOffset, src + 3, 3*sizeof(GLfloat));
+        else
+        {
+            float x, y;
+            quantizeOctahedral(src + 3, &x, &y);
+            x = quantizeClamp01(x * 0.5f + 0.5f);
+            y = quantizeClamp01(y * 0.5f + 0.5f);
+            if(format->normalFormat == MODEL_NORMAL_OCT16)
+            {
+                uint16_t normal[2];
+                normal[0] = (uint16_t)(x * 65535.0f + 0.5f);
+                normal[1] = (uint16_t)(y * 65535.0f + 0.5f);
+                memcpy(dst + normalOffset, normal, sizeof(normal));
+            }
+            else
+            {
+                dst[normalOffset] = (uint8_t)(x * 255.0f + 0.5f);
+                dst[normalOffset + 1] = (uint8_t)(y * 255.0f + 0.5f);
+            }
+        }
+
+        if(format->uvFormat == MODEL_UV_UNORM16)
+        {
+            uint16_t uv[2];
+            for(unsigned int k = 0; k < 2; ++k)
+                uv[k] = quantizeUnorm16(src[6 + k], format->uvScale[k],
+                                        format->uvBias[k]);
+            memcpy(dst + uvOffset, uv, sizeof(uv));
+        }
+        else
+            memcpy(dst + uvOffset, src + 6, 2*sizeof(GLfloat));
+    }
+
+    *outVerticesDataSize = dataSize;
+    return data;
+}
@@ -0,0 +1,18 @@
+#ifndef AFISKON_QUANTIZE_H
+#define AFISKON_QUANTIZE_H
+
+#include <stdbool.h>
+#include <GLXW/glxw.h>
+#include "models.h"
+
+void quantizeVertexFormatInit(ModelVertexFormat* format,
+				unsigned char positionFormat, unsigned char normalFormat,
+				unsigned char uvFormat, const GLfloat* vertices,
+				unsigned int verticesNumber);
+void quantizePositionError(const ModelVertexFormat* format,
+				const ModelBounds* bounds, float* outError);
+void* quantizeVertices(const ModelVertexFormat* format,
+				const GLfloat* vertices, unsigned int verticesNumber,
+				size_t* outVerticesDataSize);
+
+#endif // AFISKON_QUANTIZE_H
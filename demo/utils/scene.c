@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scene.h"
+
+#pragma pack(push, 1)
+
+// sections are aligned to 16 bytes, names are the last one
+typedef struct
+{
+    char signature[7];
+    unsigned char version;
+    uint32_t headerSize;
+    uint32_t submeshesNumber;
+    uint32_t modelNameOffset; // in names
+    uint32_t nodesNumber;
+    uint32_t meshesNumber;
+    uint32_t groupsNumber;
+    uint32_t instancesNumber;
+    uint64_t namesSize;
+    uint64_t nodesOffset;
+    uint64_t meshesOffset;
+    uint64_t groupsOffset;
+    uint64_t instancesOffset;
+    uint64_t namesOffset;
+} EaxscnHeader;
+
+#pragma pack(pop)
+
+static const char eaxscnSignature[] = "EAXSCN";
+static const char eaxscnVersion = 1;
+
+#define SCENE_SECTION_ALIGNMENT 16
+
+static uint64_t
+sectionAlign(uint64_t offset)
+{
+    return (offset + SCENE_SECTION_ALIGNMENT - 1) /
+           SCENE_SECTION_ALIGNMENT * SCENE_SECTION_ALIGNMENT;
+}
+
+static bool
+sectionWrite(FILE* fd, uint64_t* offset, const void* data, uint64_t size)
+{
+    static const unsigned char padding[SCENE_SECTION_ALIGNMENT] = { 0 };
+    uint64_t aligned = sectionAlign(*offset);
+    if(aligned != *offset &&
+       fwrite(padding, (size_t)(aligned - *offset), 1, fd) != 1)
+        return false;
+    if(size != 0 && fwrite(data, (size_t)size, 1, fd) != 1)
+        return false;
+    *offset = aligned + size;
+    return true;
+}
+
+/*
+ * Groups mesh references of the nodes by submesh, so every submesh
+ * referenced by several nodes becomes a single instanced draw.
+ * The caller frees outGroups and outInstances.
+ */
+static bool
+sceneInstancesBuild(const char* fname, unsigned int submeshesNumber,
+                    const SceneNode* nodes, unsigned int nodesNumber,
+                    const uint32_t* meshes, unsigned int meshesNumber,
+                    SceneGroup** outGroups, unsigned int* outGroupsNumber,
+                    SceneInstance** outInstances)
+{
+    uint32_t* counts = (uint32_t*)calloc((size_t)submeshesNumber + 1,
+                                         sizeof(uint32_t));
+    SceneGroup* groups = (SceneGroup*)calloc((size_t)submeshesNumber + 1,
+                                             sizeof(SceneGroup));
+    SceneInstance* instances = (SceneInstance*)calloc(
+                                    (size_t)meshesNumber + 1,
+                                    sizeof(SceneInstance));
+    if(counts == NULL || groups == NULL || instances == NULL)
+    {
+        fprintf(stderr, "sceneSave - malloc failed, fname = %s\n", fname);
+        free(instances);
+        free(groups);
+        free(counts);
+        return false;
+    }
+
+    for(unsigned int i = 0; i < meshesNumber; ++i)
+        counts[meshes[i]]++;
+
+    unsigned int groupsNumber = 0;
+    uint32_t firstInstance = 0;
+    for(unsigned int i = 0; i < submeshesNumber; ++i)
+    {
+        if(counts[i] == 0)
+            continue;
+        groups[groupsNumber].submesh = i;
+        groups[groupsNumber].firstInstance = firstInstance;
+        firstInstance += counts[i];
+        // the index of the group for the second pass
+        counts[i] = groupsNumber++;
+    }
+
+    for(unsigned int i = 0; i < nodesNumber; ++i)
+    {
+        const SceneNode* node = &nodes[i];
+        for(uint32_t j = 0; j < node->meshesNumber; ++j)
+        {
+            uint32_t submesh = meshes[node->firstMesh + j];
+            SceneGroup* group = &groups[counts[submesh]];
+            SceneInstance* instance = &instances[group->firstInstance +
+                                                 group->instancesNumber];
+            memcpy(instance->transform, node->transform,
+                   sizeof(instance->transform));
+            instance->node = i;
+            instance->submesh = submesh;
+            group->instancesNumber++;
+        }
+    }
+
+    free(counts);
+    *outGroups = groups;
+    *outGroupsNumber = groupsNumber;
+    *outInstances = instances;
+    return true;
+}
+
+/*
+ * Mesh references of nodes are indices of submeshes of the modelName
+ * EMD file. Instance groups are built here.
+ */
+bool
+sceneSave(const char* fname, const char* modelName,
+          unsigned int submeshesNumber, const SceneNode* nodes,
+          unsigned int nodesNumber, const uint32_t* meshes,
+          unsigned int meshesNumber, const char* names, size_t namesSize)
+{
+    for(unsigned int i = 0; i < meshesNumber; ++i)
+    {
+        if(meshes[i] >= submeshesNumber)
+        {
+            fprintf(stderr,
+                    "sceneSave - invalid submesh %u, fname = %s\n",
+                    meshes[i], fname
+                );
+            return false;
+        }
+    }
+
+    SceneGroup* groups;
+    SceneInstance* instances;
+    unsigned int groupsNumber;
+    if(!sceneInstancesBuild(fname, submeshesNumber, nodes, nodesNumber,
+                            meshes, meshesNumber, &groups, &groupsNumber,
+                            &instances))
+        return false;
+
+    FILE* fd = fopen(fname, "wb");
+    if(fd == NULL)
+    {
+        fprintf(stderr, "sceneSave - failed to open file, fname = %s\n",
+                fname);
+        free(instances);
+        free(groups);
+        return false;
+    }
+
+    size_t modelNameSize = strlen(modelName) + 1;
+
+    EaxscnHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.signature, eaxscnSignature);
+    header.version = eaxscnVersion;
+    header.headerSize = sizeof(header);
+    header.submeshesNumber = submeshesNumber;
+    header.modelNameOffset = (uint32_t)namesSize;
+    header.nodesNumber = nodesNumber;
+    header.meshesNumber = meshesNumber;
+    header.groupsNumber = groupsNumber;
+    header.instancesNumber = meshesNumber;
+    header.namesSize = (uint64_t)(namesSize + modelNameSize);
+    header.nodesOffset = sectionAlign(sizeof(header));
+    header.meshesOffset = sectionAlign(header.nodesOffset +
+                                (uint64_t)nodesNumber*sizeof(SceneNode));
+    header.groupsOffset = sectionAlign(header.meshesOffset +
+                                (uint64_t)meshesNumber*sizeof(uint32_t));
+    header.instancesOffset = sectionAlign(header.groupsOffset +
+                                (uint64_t)groupsNumber*sizeof(SceneGroup));
+    header.namesOffset = sectionAlign(header.instancesOffset +
+                                (uint64_t)meshesNumber*sizeof(SceneInstance));
+
+    uint64_t offset = 0;
+    bool res = sectionWrite(fd, &offset, &header, sizeof(header)) &&
+        sectionWrite(fd, &offset, nodes,
+                     (uint64_t)nodesNumber*sizeof(SceneNode)) &&
+        sectionWrite(fd, &offset, meshes,
+                     (uint64_t)meshesNumber*sizeof(uint32_t)) &&
+        sectionWrite(fd, &offset, groups,
+                     (uint64_t)groupsNumber*sizeof(SceneGroup)) &&
+        sectionWrite(fd, &offset, instances,
+                     (uint64_t)meshesNumber*sizeof(SceneInstance)) &&
+        sectionWrite(fd, &offset, names, namesSize) &&
+        fwrite(modelName, modelNameSize, 1, fd) == 1;
+
+    free(instances);
+    free(groups);
+    if(fclose(fd) != 0)
+        res = false;
+
+    if(!res)
+        fprintf(stderr, "sceneSave - failed to write file, fname = %s\n",
+                fname);
+    return res;
+}
+
+// the section fits into the file and is aligned for direct access
+static bool
+sectionCheck(uint64_t offset, uint64_t number, size_t elementSize,
+             uint64_t fileSize)
+{
+    return offset % sizeof(uint32_t) == 0 && offset <= fileSize &&
+           number <= (fileSize - offset) / elementSize;
+}
+
+/*
+ * Checks references between sections, so nodes, groups and instances
+ * can be used right from the file mapping.
+ */
+static bool
+sceneCheck(const Scene* scene, uint64_t namesSize)
+{
+    if(scene->nodesNumber == 0 ||
+       scene->nodes[0].parent != SCENE_NO_PARENT)
+        return false;
+
+    for(unsigned int i = 0; i < scene->nodesNumber; ++i)
+    {
+        const SceneNode* node = &scene->nodes[i];
+        if((i > 0 && node->parent >= i) ||
+           node->nameOffset >= namesSize ||
+           node->firstMesh > scene->meshesNumber ||
+           node->meshesNumber > scene->meshesNumber - node->firstMesh)
+            return false;
+    }
+
+    for(unsigned int i = 0; i < scene->meshesNumber; ++i)
+        if(scene->meshes[i] >= scene->submeshesNumber)
+            return false;
+
+    for(unsigned int i = 0; i < scene->groupsNumber; ++i)
+    {
+        const SceneGroup* group = &scene->groups[i];
+        if(group->submesh >= scene->submeshesNumber ||
+           group->firstInstance > scene->instancesNumber ||
+           group->instancesNumber > scene->instancesNumber -
+                                    group->firstInstance)
+            return false;
+    }
+
+    for(unsigned int i = 0; i < scene->instancesNumber; ++i)
+    {
+        const SceneInstance* instance = &scene->instances[i];
+        if(instance->node >= scene->nodesNumber ||
+           instance->submesh >= scene->submeshesNumber)
+            return false;
+    }
+
+    return true;
+}
+
+bool
+sceneLoad(const char* fname, Scene* outScene)
+{
+    memset(outScene, 0, sizeof(Scene));
+
+    FileMapping* mapping = fileMappingCreate(fname);
+    if(mapping == NULL)
+        return false;
+
+    const unsigned char* dataPtr = fileMappingGetPointer(mapping);
+    uint64_t fileSize = fileMappingGetSize(mapping);
+
+    EaxscnHeader header;
+    if(fileSize < sizeof(header))
+    {
+        fprintf(stderr, "sceneLoad - file is too small, fname = %s\n", fname);
+        fileMappingDestroy(mapping);
+        return false;
+    }
+    memcpy(&header, dataPtr, sizeof(header));
+
+    if(strncmp(header.signature, eaxscnSignature,
+               sizeof(eaxscnSignature)) != 0 ||
+       header.version != eaxscnVersion)
+    {
+        fprintf(stderr,
+                "sceneLoad - invalid signature or unsupported version, "
+                "fname = %s\n", fname
+            );
+        fileMappingDestroy(mapping);
+        return false;
+    }
+
+    if(!sectionCheck(header.nodesOffset, header.nodesNumber,
+                     sizeof(SceneNode), fileSize) ||
+       !sectionCheck(header.meshesOffset, header.meshesNumber,
+                     sizeof(uint32_t), fileSize) ||
+       !sectionCheck(header.groupsOffset, header.groupsNumber,
+                     sizeof(SceneGroup), fileSize) ||
+       !sectionCheck(header.instancesOffset, header.instancesNumber,
+                     sizeof(SceneInstance), fileSize) ||
+       !sectionCheck(header.namesOffset, header.namesSize, 1, fileSize) ||
+       header.namesSize == 0 ||
+       dataPtr[header.namesOffset + header.namesSize - 1] != '\0' ||
+       header.modelNameOffset >= header.namesSize)
+    {
+        fprintf(stderr, "sceneLoad - invalid section, fname = %s\n", fname);
+        fileMappingDestroy(mapping);
+        return false;
+    }
+
+    outScene->mapping = mapping;
+    outScene->names = (const char*)(dataPtr + header.namesOffset);
+    outScene->modelName = outScene->names + header.modelNameOffset;
+    outScene->submeshesNumber = header.submeshesNumber;
+    outScene->nodesNumber = header.nodesNumber;
+    outScene->nodes = (const SceneNode*)(dataPtr + header.nodesOffset);
+    outScene->meshesNumber = header.meshesNumber;
+    outScene->meshes = (const uint32_t*)(dataPtr + header.meshesOffset);
+    outScene->groupsNumber = header.groupsNumber;
+    outScene->groups = (const SceneGroup*)(dataPtr + header.groupsOffset);
+    outScene->instancesNumber = header.instancesNumber;
+    outScene->instances = (const SceneInstance*)(dataPtr +
+                                                 header.instancesOffset);
+
+    if(!sceneCheck(outScene, header.namesSize))
+    {
+        fprintf(stderr, "sceneLoad - invalid references, fname = %s\n",
+                fname);
+        sceneFree(outScene);
+        return false;
+    }
+
+    return true;
+}
+
+void
+sceneFree(Scene* scene)
+{
+    if(scene->mapping != NULL)
+        fileMappingDestroy(scene->mapping);
+    memset(scene, 0, sizeof(Scene));
+}
@@ -0,0 +1,65 @@
+#ifndef AFISKON_SCENE_H
+#define AFISKON_SCENE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filemapping.h"
+
+#define SCENE_NO_PARENT 0xFFFFFFFFu
+
+// Nodes, groups and instances are stored in the file exactly like this,
+// sceneLoad only checks them and points into the file mapping.
+// Matrices are column-major like Matrix in linearalg.h.
+typedef struct
+{
+    float localTransform[16]; // relative to the parent
+    float transform[16]; // in the world
+    uint32_t parent; // less than the index of the node, or SCENE_NO_PARENT
+    uint32_t nameOffset; // in names
+    uint32_t firstMesh; // in meshes
+    uint32_t meshesNumber;
+} SceneNode;
+
+// all instances of a submesh, they follow each other in instances
+typedef struct
+{
+    uint32_t submesh;
+    uint32_t firstInstance;
+    uint32_t instancesNumber;
+    uint32_t reserved;
+} SceneGroup;
+
+typedef struct
+{
+    float transform[16];
+    uint32_t node;
+    uint32_t submesh;
+    uint32_t reserved[2];
+} SceneInstance;
+
+typedef struct
+{
+    FileMapping* mapping;
+    const char* modelName; // EMD file with the submeshes
+    unsigned int submeshesNumber; // in the EMD file
+    unsigned int nodesNumber;
+    const SceneNode* nodes; // nodes[0] is the root
+    unsigned int meshesNumber;
+    const uint32_t* meshes; // submesh indices referenced by nodes
+    unsigned int groupsNumber;
+    const SceneGroup* groups;
+    unsigned int instancesNumber;
+    const SceneInstance* instances;
+    const char* names; // zero terminated strings
+} Scene;
+
+bool sceneSave(const char* fname, const char* modelName,
+				unsigned int submeshesNumber, const SceneNode* nodes,
+				unsigned int nodesNumber, const uint32_t* meshes,
+				unsigned int meshesNumber, const char* names,
+				size_t namesSize);
+bool sceneLoad(const char* fname, Scene* outScene);
+void sceneFree(Scene* scene);
+
+#endif // AFISKON_SCENE_H
@@ -0,0 +1,749 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "simplify.h"
+#include "weld.h"
+
+/*
+ * Quadric error metric simplification, see "Surface Simplification Using
+ * Quadric Error Metrics" by Garland and Heckbert. Edges are collapsed
+ * into one of their existing vertices, so all levels of detail share
+ * the same vertex buffer and differ only in indices.
+ *
+ * Vertices with the same position but different normals or UVs (wedges)
+ * are collapsed together. Every wedge of the removed vertex is replaced
+ * by the wedge of the remaining vertex with the closest attributes. Along
+ * a UV seam the wedges on each side are replaced by the wedges on the
+ * same side.
+ */
+
+#define SIMPLIFY_NONE 0xFFFFFFFFu
+
+// vertices on UV seam have wedges with different UVs
+#define SIMPLIFY_UV_EPS 0.0001f
+
+// triangles whose normal turns more than this are considered flipped
+#define SIMPLIFY_MIN_NORMAL_DOT 0.2
+
+typedef struct
+{
+    // symmetric 4x4 matrix: a00 a01 a02 a11 a12 a22 b0 b1 b2 c,
+    // error(p) = p*A*p + 2*b*p + c, w is the sum of triangle areas
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double w;
+} Quadric;
+
+typedef struct
+{
+    unsigned int from;
+    unsigned int to;
+    double cost;
+} Collapse;
+
+typedef struct
+{
+    unsigned int positionsNumber;
+    const float* positions;         // unique positions, 3 floats each
+    const unsigned int* positionOf; // wedge -> position
+    const size_t* wedgeOffsets;     // position -> wedges, CSR
+    const unsigned int* wedges;
+    const unsigned char* locked;    // border or non-manifold
+    const unsigned char* seam;
+    // wedge -> the first wedge of its position with the same UV
+    const unsigned int* uvClass;
+} SimplifyTopology;
+
+// triangles and the positions around them in the current pass
+typedef struct
+{
+    const unsigned int* triangles;      // positions
+    const unsigned int* triangleWedges; // wedges of the same corners
+    const size_t* adjacencyOffsets;     // position -> triangles, CSR
+    const size_t* adjacency;
+} SimplifyMesh;
+
+static void
+quadricFromTriangle(Quadric* q, const float* p0, const float* p1,
+    const float* p2)
+{
+    double e1[3], e2[3], n[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        e1[k] = (double)p1[k] - p0[k];
+        e2[k] = (double)p2[k] - p0[k];
+    }
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+
+    double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    memset(q, 0, sizeof(Quadric));
+    if(len == 0.0)
+        return;
+
+    double area = len * 0.5;
+    n[0] /= len;
+    n[1] /= len;
+    n[2] /= len;
+    double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+
+    q->a00 = area*n[0]*n[0];
+    q->a01 = area*n[0]*n[1];
+    q->a02 = area*n[0]*n[2];
+    q->a11 = area*n[1]*n[1];
+    q->a12 = area*n[1]*n[2];
+    q->a22 = area*n[2]*n[2];
+    q->b0 = area*n[0]*d;
+    q->b1 = area*n[1]*d;
+    q->b2 = area*n[2]*d;
+    q->c = area*d*d;
+    q->w = area;
+}
+
+static void
+quadricAdd(Quadric* q, const Quadric* other)
+{
+    q->a00 += other->a00;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a11 += other->a11;
+    q->a12 += other->a12;
+    q->a22 += other->a22;
+    q->b0 += other->b0;
+    q->b1 += other->b1;
+    q->b2 += other->b2;
+    q->c += other->c;
+    q->w += other->w;
+}
+
+// squared distance to the planes, weighted by areas
+static double
+quadricError(const Quadric* q1, const Quadric* q2, const float* p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double a00 = q1->a00 + q2->a00, a01 = q1->a01 + q2->a01;
+    double a02 = q1->a02 + q2->a02, a11 = q1->a11 + q2->a11;
+    double a12 = q1->a12 + q2->a12, a22 = q1->a22 + q2->a22;
+    double b0 = q1->b0 + q2->b0, b1 = q1->b1 + q2->b1;
+    double b2 = q1->b2 + q2->b2, c = q1->c + q2->c;
+    double w = q1->w + q2->w;
+
+    double err = x*(a00*x + a01*y + a02*z) + y*(a01*x + a11*y + a12*z) +
+                 z*(a02*x + a12*y + a22*z) + 2.0*(b0*x + b1*y + b2*z) + c;
+    if(err < 0.0)
+        err = 0.0;
+    return w > 0.0 ? err / w : err;
+}
+
+static int
+collapseCompare(const void* p1, const void* p2)
+{
+    const Collapse* c1 = (const Collapse*)p1;
+    const Collapse* c2 = (const Collapse*)p2;
+    if(c1->cost < c2->cost) return -1;
+    if(c1->cost > c2->cost) return 1;
+    // keep the result independent of qsort implementation
+    if(c1->from != c2->from) return c1->from < c2->from ? -1 : 1;
+    if(c1->to != c2->to) return c1->to < c2->to ? -1 : 1;
+    return 0;
+}
+
+static int
+edgeCompare(const void* p1, const void* p2)
+{
+    uint64_t e1 = *(const uint64_t*)p1;
+    uint64_t e2 = *(const uint64_t*)p2;
+    return e1 < e2 ? -1 : (e1 > e2 ? 1 : 0);
+}
+
+/*
+ * A seam vertex may only slide along a seam edge: the two triangles of
+ * the edge have different UVs at both of its ends. The vertex should have
+ * no other UVs, otherwise more seams meet there. outPairs are UV classes
+ * of "from" and "to" on the first and the second side of the edge.
+ */
+static bool
+seamCollapseAllowed(const SimplifyTopology* topo, const SimplifyMesh* mesh,
+    unsigned int from, unsigned int to, unsigned int* outPairs)
+{
+    unsigned int sides = 0;
+    for(size_t a = mesh->adjacencyOffsets[from];
+        a < mesh->adjacencyOffsets[from + 1]; ++a)
+    {
+        size_t t = mesh->adjacency[a];
+        int cornerFrom = -1, cornerTo = -1;
+        for(int k = 0; k < 3; ++k)
+        {
+            if(mesh->triangles[t*3 + k] == from)
+                cornerFrom = k;
+            else if(mesh->triangles[t*3 + k] == to)
+                cornerTo = k;
+        }
+
+        if(cornerFrom < 0 || cornerTo < 0)
+            continue;
+
+        if(sides == 2)
+            return false;
+
+        outPairs[sides*2] =
+            topo->uvClass[mesh->triangleWedges[t*3 + cornerFrom]];
+        outPairs[sides*2 + 1] =
+            topo->uvClass[mesh->triangleWedges[t*3 + cornerTo]];
+        sides++;
+    }
+
+    if(sides != 2 || outPairs[0] == outPairs[2] ||
+       outPairs[1] == outPairs[3])
+        return false;
+
+    for(size_t w = topo->wedgeOffsets[from];
+        w < topo->wedgeOffsets[from + 1]; ++w)
+    {
+        unsigned int uvClass = topo->uvClass[topo->wedges[w]];
+        if(uvClass != outPairs[0] && uvClass != outPairs[2])
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+collapseAllowed(const SimplifyTopology* topo, const SimplifyMesh* mesh,
+    unsigned int from, unsigned int to)
+{
+    if(topo->locked[from])
+        return false;
+
+    if(topo->seam[from])
+    {
+        unsigned int pairs[4];
+        return seamCollapseAllowed(topo, mesh, from, to, pairs);
+    }
+
+    return true;
+}
+
+static void
+triangleNormal(const float* p0, const float* p1, const float* p2,
+    double* n)
+{
+    double e1[3], e2[3];
+    for(int k = 0; k < 3; ++k)
+    {
+        e1[k] = (double)p1[k] - p0[k];
+        e2[k] = (double)p2[k] - p0[k];
+    }
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+/*
+ * Checks that moving position "from" to position "to" doesn't flip any
+ * of the triangles around "from". Triangles are given by positions,
+ * remap is the collapses done so far in the current pass.
+ */
+static bool
+collapseFlipsTriangles(const SimplifyTopology* topo,
+    const unsigned int* triangles, const size_t* adjacencyOffsets,
+    const size_t* adjacency, const unsigned int* remap, unsigned int from,
+    unsigned int to)
+{
+    const float* positions = topo->positions;
+
+    for(size_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1];
+        ++a)
+    {
+        size_t t = adjacency[a];
+        unsigned int corners[3];
+        for(int k = 0; k < 3; ++k)
+            corners[k] = remap[triangles[t*3 + k]];
+
+        // triangles with both vertices disappear
+        if(corners[0] == to || corners[1] == to || corners[2] == to)
+            continue;
+
+        // already degenerate because of other collapses
+        if(corners[0] == corners[1] || corners[1] == corners[2] ||
+           corners[0] == corners[2])
+            continue;
+
+        double before[3], after[3];
+        triangleNormal(positions + (size_t)corners[0]*3,
+                       positions + (size_t)corners[1]*3,
+                       positions + (size_t)corners[2]*3, before);
+
+        for(int k = 0; k < 3; ++k)
+            if(corners[k] == from)
+                corners[k] = to;
+
+        triangleNormal(positions + (size_t)corners[0]*3,
+                       positions + (size_t)corners[1]*3,
+                       positions + (size_t)corners[2]*3, after);
+
+        double dot = before[0]*after[0] + before[1]*after[1] +
+                     before[2]*after[2];
+        double lenBefore = sqrt(before[0]*before[0] + before[1]*before[1] +
+                                before[2]*before[2]);
+        double lenAfter = sqrt(after[0]*after[0] + after[1]*after[1] +
+                               after[2]*after[2]);
+        if(dot <= SIMPLIFY_MIN_NORMAL_DOT * lenBefore * lenAfter)
+            return true;
+    }
+
+    return false;
+}
+
+static float
+wedgeAttributesDistance(const float* vertices, unsigned int floatsPerVertex,
+    unsigned int w1, unsigned int w2)
+{
+    const float* v1 = vertices + (size_t)w1*floatsPerVertex;
+    const float* v2 = vertices + (size_t)w2*floatsPerVertex;
+    float dist = 0.0f;
+    for(unsigned int k = 3; k < floatsPerVertex; ++k)
+        dist += (v1[k] - v2[k]) * (v1[k] - v2[k]);
+    return dist;
+}
+
+/*
+ * Finds unique positions, wedges of every position, and which positions
+ * are on borders or UV seams.
+ */
+static bool
+topologyBuild(const unsigned int* indices, size_t indicesNumber,
+    const float* vertices, unsigned int verticesNumber,
+    unsigned int floatsPerVertex, float positionEps,
+    SimplifyTopology* topo, float** outPositions,
+    unsigned int** outPositionOf, size_t** outWedgeOffsets,
+    unsigned int** outWedges, unsigned char** outLocked,
+    unsigned char** outSeam, unsigned int** outUvClass)
+{
+    float* coords = (float*)malloc(sizeof(float) * 3 * verticesNumber);
+    float* positions = (float*)malloc(sizeof(float) * 3 * verticesNumber);
+    unsigned int* positionOf = (unsigned int*)malloc(
+                                sizeof(unsigned int) * verticesNumber);
+    if(coords == NULL || positions == NULL || positionOf == NULL)
+    {
+        fprintf(stderr, "meshSimplify - malloc failed\n");
+        free(positionOf);
+        free(positions);
+        free(coords);
+        return false;
+    }
+
+    for(unsigned int v = 0; v < verticesNumber; ++v)
+        memcpy(coords + (size_t)v*3, vertices + (size_t)v*floatsPerVertex,
+               sizeof(float) * 3);
+
+    unsigned int positionsNumber = 0;
+    bool res = weldVertices(coords, verticesNumber, 3, positionEps,
+                            verticesNumber, positions, positionOf,
+                            &positionsNumber);
+    free(coords);
+    if(!res)
+    {
+        free(positionOf);
+        free(positions);
+        return false;
+    }
+
+    size_t* wedgeOffsets = (size_t*)calloc((size_t)positionsNumber + 1,
+                                           sizeof(size_t));
+    unsigned int* wedges = (unsigned int*)malloc(
+                                sizeof(unsigned int) * verticesNumber);
+    unsigned char* locked = (unsigned char*)calloc(positionsNumber, 1);
+    unsigned char* seam = (unsigned char*)calloc(positionsNumber, 1);
+    unsigned int* uvClass = (unsigned int*)malloc(
+                                sizeof(unsigned int) * verticesNumber);
+    uint64_t* edges = (uint64_t*)malloc(sizeof(uint64_t) * indicesNumber);
+    if(wedgeOffsets == NULL || wedges == NULL || locked == NULL ||
+       seam == NULL || uvClass == NULL || edges == NULL)
+    {
+        fprintf(stderr, "meshSimplify - malloc failed\n");
+        free(edges);
+        free(uvClass);
+        free(seam);
+        free(locked);
+        free(wedges);
+        free(wedgeOffsets);
+        free(positionOf);
+        free(positions);
+        return false;
+    }
+
+    for(unsigned int v = 0; v < verticesNumber; ++v)
+        wedgeOffsets[positionOf[v] + 1]++;
+    for(unsigned int p = 0; p < positionsNumber; ++p)
+        wedgeOffsets[p + 1] += wedgeOffsets[p];
+    for(unsigned int v = 0; v < verticesNumber; ++v)
+        wedges[wedgeOffsets[positionOf[v]]++] = v;
+    for(unsigned int p = positionsNumber; p > 0; --p)
+        wedgeOffsets[p] = wedgeOffsets[p - 1];
+    wedgeOffsets[0] = 0;
+
+    for(unsigned int p = 0; p < positionsNumber; ++p)
+    {
+        for(size_t w = wedgeOffsets[p]; w < wedgeOffsets[p + 1]; ++w)
+        {
+            unsigned int wedge = wedges[w];
+            const float* uv1 = vertices + (size_t)wedge*floatsPerVertex +
+                               floatsPerVertex - 2;
+            uvClass[wedge] = wedge;
+            for(size_t prev = wedgeOffsets[p]; prev < w; ++prev)
+            {
+                const float* uv2 = vertices +
+                                   (size_t)wedges[prev]*floatsPerVertex +
+                                   floatsPerVertex - 2;
+                if(fabsf(uv1[0] - uv2[0]) <= SIMPLIFY_UV_EPS &&
+                   fabsf(uv1[1] - uv2[1]) <= SIMPLIFY_UV_EPS)
+                {
+                    uvClass[wedge] = uvClass[wedges[prev]];
+                    break;
+                }
+            }
+
+            if(uvClass[wedge] != uvClass[wedges[wedgeOffsets[p]]])
+                seam[p] = 1;
+        }
+    }
+
+    // edges used by one triangle are borders, by more than two -
+    // non-manifold, vertices of both are never removed
+    size_t edgesNumber = 0;
+    for(size_t t = 0; t < indicesNumber / 3; ++t)
+    {
+        for(int k = 0; k < 3; ++k)
+        {
+            uint64_t p1 = positionOf[indices[t*3 + k]];
+            uint64_t p2 = positionOf[indices[t*3 + (k + 1) % 3]];
+            if(p1 == p2)
+                continue;
+            edges[edgesNumber++] = p1 < p2 ? (p1 << 32) | p2 : (p2 << 32) | p1;
+        }
+    }
+
+    qsort(edges, edgesNumber, sizeof(uint64_t), edgeCompare);
+
+    for(size_t e = 0; e < edgesNumber; )
+    {
+        size_t next = e + 1;
+        while(next < edgesNumber && edges[next] == edges[e])
+            next++;
+
+        if(next - e != 2)
+        {
+            locked[edges[e] >> 32] = 1;
+            locked[edges[e] & 0xFFFFFFFFu] = 1;
+        }
+        e = next;
+    }
+
+    free(edges);
+
+    topo->positionsNumber = positionsNumber;
+    topo->positions = positions;
+    topo->positionOf = positionOf;
+    topo->wedgeOffsets = wedgeOffsets;
+    topo->wedges = wedges;
+    topo->locked = locked;
+    topo->seam = seam;
+    topo->uvClass = uvClass;
+
+    *outPositions = positions;
+    *outPositionOf = positionOf;
+    *outWedgeOffsets = wedgeOffsets;
+    *outWedges = wedges;
+    *outLocked = locked;
+    *outSeam = seam;
+    *outUvClass = uvClass;
+    return true;
+}
+
+/*
+ * One pass of edge collapses: every position is changed at most once,
+ * the cheapest collapses go first. Returns the number of collapses done.
+ * triangleWedges are the current indices of the triangles. For positions
+ * collapsed along a UV seam, seamPairs get 4 UV classes: of the position
+ * and of the one it was collapsed into on each side of the seam.
+ */
+static size_t
+simplifyPass(const SimplifyTopology* topo, const unsigned int* triangles,
+    const unsigned int* triangleWedges, size_t trianglesNumber,
+    size_t targetTrianglesNumber, Quadric* quadrics, Collapse* collapses,
+    size_t* adjacencyOffsets, size_t* adjacency, unsigned int* remap,
+    unsigned char* passLocked, unsigned int* seamPairs,
+    double* inOutMaxCost)
+{
+    unsigned int positionsNumber = topo->positionsNumber;
+
+    memset(adjacencyOffsets, 0, sizeof(size_t) * (positionsNumber + 1));
+    for(size_t i = 0; i < trianglesNumber*3; ++i)
+        adjacencyOffsets[triangles[i] + 1]++;
+    for(unsigned int p = 0; p < positionsNumber; ++p)
+        adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+    for(size_t i = 0; i < trianglesNumber*3; ++i)
+        adjacency[adjacencyOffsets[triangles[i]]++] = i / 3;
+    for(unsigned int p = positionsNumber; p > 0; --p)
+        adjacencyOffsets[p] = adjacencyOffsets[p - 1];
+    adjacencyOffsets[0] = 0;
+
+    SimplifyMesh mesh;
+    mesh.triangles = triangles;
+    mesh.triangleWedges = triangleWedges;
+    mesh.adjacencyOffsets = adjacencyOffsets;
+    mesh.adjacency = adjacency;
+
+    size_t collapsesNumber = 0;
+    for(size_t t = 0; t < trianglesNumber; ++t)
+    {
+        for(int k = 0; k < 3; ++k)
+        {
+            unsigned int p1 = triangles[t*3 + k];
+            unsigned int p2 = triangles[t*3 + (k + 1) % 3];
+
+            // every edge of a closed mesh is seen twice, once from each
+            // triangle, check it only from the triangle where p1 < p2
+            if(p1 > p2 && !topo->locked[p1] && !topo->locked[p2])
+                continue;
+
+            double cost12 = collapseAllowed(topo, &mesh, p1, p2) ?
+                quadricError(&quadrics[p1], &quadrics[p2],
+                             topo->positions + (size_t)p2*3) : -1.0;
+            double cost21 = collapseAllowed(topo, &mesh, p2, p1) ?
+                quadricError(&quadrics[p1], &quadrics[p2],
+                             topo->positions + (size_t)p1*3) : -1.0;
+
+            if(cost12 < 0.0 && cost21 < 0.0)
+                continue;
+
+            Collapse* c = &collapses[collapsesNumber++];
+            if(cost21 < 0.0 || (cost12 >= 0.0 && cost12 <= cost21))
+            {
+                c->from = p1;
+                c->to = p2;
+                c->cost = cost12;
+            }
+            else
+            {
+                c->from = p2;
+                c->to = p1;
+                c->cost = cost21;
+            }
+        }
+    }
+
+    qsort(collapses, collapsesNumber, sizeof(Collapse), collapseCompare);
+
+    for(unsigned int p = 0; p < positionsNumber; ++p)
+        remap[p] = p;
+    memset(passLocked, 0, positionsNumber);
+
+    // an edge collapse removes two triangles of a closed mesh
+    size_t removeBudget = (trianglesNumber - targetTrianglesNumber + 1) / 2;
+    size_t done = 0;
+    double maxCost = *inOutMaxCost;
+
+    for(size_t i = 0; i < collapsesNumber && done < removeBudget; ++i)
+    {
+        const Collapse* c = &collapses[i];
+        if(passLocked[c->from] || passLocked[c->to])
+            continue;
+
+        if(collapseFlipsTriangles(topo, triangles, adjacencyOffsets,
+                                  adjacency, remap, c->from, c->to))
+            continue;
+
+        // nothing was collapsed into the edge yet, so it is still valid
+        if(topo->seam[c->from])
+            seamCollapseAllowed(topo, &mesh, c->from, c->to,
+                                seamPairs + (size_t)c->from*4);
+
+        remap[c->from] = c->to;
+        quadricAdd(&quadrics[c->to], &quadrics[c->from]);
+        passLocked[c->from] = 1;
+        passLocked[c->to] = 1;
+        if(c->cost > maxCost)
+            maxCost = c->cost;
+        done++;
+    }
+
+    *inOutMaxCost = maxCost;
+    return done;
+}
+
+/*
+ * Simplifies the mesh to about targetIndicesNumber indices (less if
+ * possible, more if the mesh can't be simplified further). Positions
+ * closer than positionEps are considered the same. outIndices should
+ * have room for indicesNumber indices. outError is the approximate
+ * geometric error, in model space units.
+ */
+bool
+meshSimplify(const unsigned int* indices, size_t indicesNumber,
+    const float* vertices, unsigned int verticesNumber,
+    unsigned int floatsPerVertex, float positionEps,
+    size_t targetIndicesNumber, unsigned int* outIndices,
+    size_t* outIndicesNumber, float* outError)
+{
+    *outIndicesNumber = 0;
+    *outError = 0.0f;
+
+    SimplifyTopology topo;
+    float* positions;
+    unsigned int* positionOf;
+    size_t* wedgeOffsets;
+    unsigned int* wedges;
+    unsigned char* locked;
+    unsigned char* seam;
+    unsigned int* uvClass;
+    if(!topologyBuild(indices, indicesNumber, vertices, verticesNumber,
+                      floatsPerVertex, positionEps, &topo, &positions,
+                      &positionOf, &wedgeOffsets, &wedges, &locked, &seam,
+                      &uvClass))
+        return false;
+
+    unsigned int positionsNumber = topo.positionsNumber;
+    size_t trianglesNumber = indicesNumber / 3;
+
+    Quadric* quadrics = (Quadric*)calloc(positionsNumber, sizeof(Quadric));
+    unsigned int* triangles = (unsigned int*)malloc(
+                                sizeof(unsigned int) * trianglesNumber*3);
+    Collapse* collapses = (Collapse*)malloc(
+                                sizeof(Collapse) * trianglesNumber*3);
+    size_t* adjacencyOffsets = (size_t*)malloc(
+                                sizeof(size_t) * ((size_t)positionsNumber + 1));
+    size_t* adjacency = (size_t*)malloc(sizeof(size_t) * trianglesNumber*3);
+    unsigned int* remap = (unsigned int*)malloc(
+                                sizeof(unsigned int) * positionsNumber);
+    unsigned char* passLocked = (unsigned char*)malloc(positionsNumber);
+    unsigned int* seamPairs = (unsigned int*)malloc(
+                                sizeof(unsigned int) * positionsNumber*4);
+    // wedge -> wedge, the result of all collapses so far
+    unsigned int* wedgeRemap = (unsigned int*)malloc(
+                                sizeof(unsigned int) * verticesNumber);
+
+    bool res = (quadrics != NULL && triangles != NULL && collapses != NULL &&
+                adjacencyOffsets != NULL && adjacency != NULL &&
+                remap != NULL && passLocked != NULL && seamPairs != NULL &&
+                wedgeRemap != NULL);
+    if(!res)
+        fprintf(stderr, "meshSimplify - malloc failed\n");
+
+    size_t targetTrianglesNumber = targetIndicesNumber / 3;
+    double maxCost = 0.0;
+
+    if(res)
+    {
+        memcpy(outIndices, indices, sizeof(unsigned int) * trianglesNumber*3);
+        for(unsigned int v = 0; v < verticesNumber; ++v)
+            wedgeRemap[v] = v;
+
+        for(size_t t = 0; t < trianglesNumber; ++t)
+        {
+            Quadric q;
+            for(int k = 0; k < 3; ++k)
+                triangles[t*3 + k] = positionOf[indices[t*3 + k]];
+            quadricFromTriangle(&q, positions + (size_t)triangles[t*3]*3,
+                                positions + (size_t)triangles[t*3 + 1]*3,
+                                positions + (size_t)triangles[t*3 + 2]*3);
+            for(int k = 0; k < 3; ++k)
+                quadricAdd(&quadrics[triangles[t*3 + k]], &q);
+        }
+    }
+
+    while(res && trianglesNumber > targetTrianglesNumber)
+    {
+        size_t done = simplifyPass(&topo, triangles, outIndices,
+                                   trianglesNumber, targetTrianglesNumber,
+                                   quadrics, collapses, adjacencyOffsets,
+                                   adjacency, remap, passLocked, seamPairs,
+                                   &maxCost);
+        if(done == 0)
+            break;
+
+        // move wedges of removed positions to the closest wedges
+        // of the positions they were collapsed into, along a seam -
+        // to the wedges on the same side of it
+        for(unsigned int v = 0; v < verticesNumber; ++v)
+        {
+            unsigned int w = wedgeRemap[v];
+            unsigned int from = positionOf[w];
+            unsigned int to = remap[from];
+            if(to == from)
+                continue;
+
+            unsigned int toClass = SIMPLIFY_NONE;
+            if(seam[from])
+            {
+                const unsigned int* pairs = seamPairs + (size_t)from*4;
+                toClass = uvClass[w] == pairs[0] ? pairs[1] : pairs[3];
+            }
+
+            unsigned int best = SIMPLIFY_NONE;
+            float bestDist = 0.0f;
+            for(size_t i = wedgeOffsets[to]; i < wedgeOffsets[to + 1]; ++i)
+            {
+                if(toClass != SIMPLIFY_NONE && uvClass[wedges[i]] != toClass)
+                    continue;
+
+                float dist = wedgeAttributesDistance(vertices,
+                                floatsPerVertex, w, wedges[i]);
+                if(best == SIMPLIFY_NONE || dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = wedges[i];
+                }
+            }
+            wedgeRemap[v] = best;
+        }
+
+        // rebuild triangles, dropping degenerate ones
+        size_t kept = 0;
+        for(size_t t = 0; t < trianglesNumber; ++t)
+        {
+            unsigned int p0 = remap[triangles[t*3]];
+            unsigned int p1 = remap[triangles[t*3 + 1]];
+            unsigned int p2 = remap[triangles[t*3 + 2]];
+            if(p0 == p1 || p1 == p2 || p0 == p2)
+                continue;
+
+            triangles[kept*3] = p0;
+            triangles[kept*3 + 1] = p1;
+            triangles[kept*3 + 2] = p2;
+            for(int k = 0; k < 3; ++k)
+                outIndices[kept*3 + k] = wedgeRemap[outIndices[t*3 + k]];
+            kept++;
+        }
+        trianglesNumber = kept;
+    }
+
+    free(wedgeRemap);
+    free(seamPairs);
+    free(passLocked);
+    free(remap);
+    free(adjacency);
+    free(adjacencyOffsets);
+    free(collapses);
+    free(triangles);
+    free(quadrics);
+    free(uvClass);
+    free(seam);
+    free(locked);
+    free(wedges);
+    free(wedgeOffsets);
+    free(positionOf);
+    free(positions);
+
+    if(!res)
+        return false;
+
+    *outIndicesNumber = trianglesNumber*3;
+    *outError = (float)sqrt(maxCost);
+    return true;
+}
@@ -0,0 +1,13 @@
+#ifndef AFISKON_SIMPLIFY_H
+#define AFISKON_SIMPLIFY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool meshSimplify(const unsigned int* indices, size_t indicesNumber,
+				const float* vertices, unsigned int verticesNumber,
+				unsigned int floatsPerVertex, float positionEps,
+				size_t targetIndicesNumber, unsigned int* outIndices,
+				size_t* outIndicesNumber, float* outError);
+
+#endif // AFISKON_SIMPLIFY_H
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+struct Thread
+{
+    HANDLE hThread;
+    ThreadFunc func;
+    void* arg;
+};
+
+struct Mutex
+{
+    CRITICAL_SECTION cs;
+};
+
+struct Condition
+{
+    CONDITION_VARIABLE cv;
+};
+
+static DWORD WINAPI
+threadProc(LPVOID param)
+{
+    Thread* thread = (Thread*)param;
+    thread->func(thread->arg);
+    return 0;
+}
+
+Thread*
+threadCreate(ThreadFunc func, void* arg)
+{
+    Thread* thread = (Thread*)malloc(sizeof(Thread));
+    if(thread == NULL)
+    {
+        fprintf(stderr, "threadCreate - malloc failed\n");
+        return NULL;
+    }
+
+    thread->func = func;
+    thread->arg = arg;
+    thread->hThread = CreateThread(NULL, 0, threadProc, thread, 0, NULL);
+    if(thread->hThread == NULL)
+    {
+        fprintf(stderr, "threadCreate - CreateThread failed\n");
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void
+threadJoin(Thread* thread)
+{
+    WaitForSingleObject(thread->hThread, INFINITE);
+    CloseHandle(thread->hThread);
+    free(thread);
+}
+
+Mutex*
+mutexCreate()
+{
+    Mutex* mutex = (Mutex*)malloc(sizeof(Mutex));
+    if(mutex == NULL)
+    {
+        fprintf(stderr, "mutexCreate - malloc failed\n");
+        return NULL;
+    }
+
+    InitializeCriticalSection(&mutex->cs);
+    return mutex;
+}
+
+void
+mutexLock(Mutex* mutex)
+{
+    EnterCriticalSection(&mutex->cs);
+}
+
+void
+mutexUnlock(Mutex* mutex)
+{
+    LeaveCriticalSection(&mutex->cs);
+}
+
+void
+mutexDestroy(Mutex* mutex)
+{
+    DeleteCriticalSection(&mutex->cs);
+    free(mutex);
+}
+
+Condition*
+conditionCreate()
+{
+    Condition* condition = (Condition*)malloc(sizeof(Condition));
+    if(condition == NULL)
+    {
+        fprintf(stderr, "conditionCreate - malloc failed\n");
+        return NULL;
+    }
+
+    InitializeConditionVariable(&condition->cv);
+    return condition;
+}
+
+// mutex must be locked, it's locked again when the call returns
+void
+conditionWait(Condition* condition, Mutex* mutex)
+{
+    SleepConditionVariableCS(&condition->cv, &mutex->cs, INFINITE);
+}
+
+void
+conditionBroadcast(Condition* condition)
+{
+    WakeAllConditionVariable(&condition->cv);
+}
+
+void
+conditionDestroy(Condition* condition)
+{
+    // Windows condition variables don't need to be deleted
+    free(condition);
+}
+
+#else // Linux, MacOS, etc
+
+#include <pthread.h>
+#include <string.h>
+
+struct Thread
+{
+    pthread_t tid;
+    ThreadFunc func;
+    void* arg;
+};
+
+struct Mutex
+{
+    pthread_mutex_t mtx;
+};
+
+struct Condition
+{
+    pthread_cond_t cond;
+};
+
+static void*
+threadProc(void* param)
+{
+    Thread* thread = (Thread*)param;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+Thread*
+threadCreate(ThreadFunc func, void* arg)
+{
+    Thread* thread = (Thread*)malloc(sizeof(Thread));
+    if(thread == NULL)
+    {
+        fprintf(stderr, "threadCreate - malloc failed\n");
+        return NULL;
+    }
+
+    thread->func = func;
+    thread->arg = arg;
+    int err = pthread_create(&thread->tid, NULL, threadProc, thread);
+    if(err != 0)
+    {
+        fprintf(stderr,
+                "threadCreate - pthread_create failed, strerror = %s\n",
+                strerror(err)
+            );
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void
+threadJoin(Thread* thread)
+{
+    pthread_join(thread->tid, NULL);
+    free(thread);
+}
+
+Mutex*
+mutexCreate()
+{
+    Mutex* mutex = (Mutex*)malloc(sizeof(Mutex));
+    if(mutex == NULL)
+    {
+        fprintf(stderr, "mutexCreate - malloc failed\n");
+        return NULL;
+    }
+
+    pthread_mutex_init(&mutex->mtx, NULL);
+    return mutex;
+}
+
+void
+mutexLock(Mutex* mutex)
+{
+    pthread_mutex_lock(&mutex->mtx);
+}
+
+void
+mutexUnlock(Mutex* mutex)
+{
+    pthread_mutex_unlock(&mutex->mtx);
+}
+
+void
+mutexDestroy(Mutex* mutex)
+{
+    pthread_mutex_destroy(&mutex->mtx);
+    free(mutex);
+}
+
+Condition*
+conditionCreate()
+{
+    Condition* condition = (Condition*)malloc(sizeof(Condition));
+    if(condition == NULL)
+    {
+        fprintf(stderr, "conditionCreate - malloc failed\n");
+        return NULL;
+    }
+
+    pthread_cond_init(&condition->cond, NULL);
+    return condition;
+}
+
+// mutex must be locked, it's locked again when the call returns
+void
+conditionWait(Condition* condition, Mutex* mutex)
+{
+    pthread_cond_wait(&condition->cond, &mutex->mtx);
+}
+
+void
+conditionBroadcast(Condition* condition)
+{
+    pthread_cond_broadcast(&condition->cond);
+}
+
+void
+conditionDestroy(Condition* condition)
+{
+    pthread_cond_destroy(&condition->cond);
+    free(condition);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef AFISKON_THREADS_H
+#define AFISKON_THREADS_H
+
+struct Thread;
+typedef struct Thread Thread;
+
+struct Mutex;
+typedef struct Mutex Mutex;
+
+struct Condition;
+typedef struct Condition Condition;
+
+typedef void (*ThreadFunc)(void* arg);
+
+Thread* threadCreate(ThreadFunc func, void* arg);
+void threadJoin(Thread* thread);
+
+Mutex* mutexCreate();
+void mutexLock(Mutex* mutex);
+void mutexUnlock(Mutex* mutex);
+void mutexDestroy(Mutex* mutex);
+
+Condition* conditionCreate();
+void conditionWait(Condition* condition, Mutex* mutex);
+void conditionBroadcast(Condition* condition);
+void conditionDestroy(Condition* condition);
+
+#endif // AFISKON_THREADS_H
@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #define DDS_HEADER_SIZE 128
 #define DDS_SIGNATURE    0x20534444 // "DDS "
@@ -34,6 +36,20 @@ getCurrentTimeMs()
     return nowUnix / 10000ULL;
 }
 
+uint64_t
+getCurrentTimeUs()
+{
+    FILETIME filetime;
+    GetSystemTimeAsFileTime(&filetime);
+
+    uint64_t nowWindows = (uint64_t)filetime.dwLowDateTime
+        + ((uint64_t)(filetime.dwHighDateTime) << 32ULL);
+
+    uint64_t nowUnix = nowWindows - 116444736000000000ULL;
+
+    return nowUnix / 10ULL;
+}
+
 #else // Linux, MacOS, etc
 
 #include <sys/time.h>
@@ -46,18 +62,76 @@ getCurrentTimeMs()
 
     return ((uint64_t)tv.tv_sec) * 1000 + ((uint64_t)tv.tv_usec) / 1000;
 }
+
+uint64_t
+getCurrentTimeUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return ((uint64_t)tv.tv_sec) * 1000000 + (uint64_t)tv.tv_usec;
+}
 #endif
 
+static bool
+bufferStorageSupported()
+{
+    static int supported = -1;
+    if(supported >= 0)
+        return supported != 0;
+
+    supported = 0;
+    if(glBufferStorage == NULL)
+        return false;
+
+    GLint extensionsNumber = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionsNumber);
+    for(GLint i = 0; i < extensionsNumber; ++i)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS,
+                                                     (GLuint)i);
+        if(name != NULL && strcmp(name, "GL_ARB_buffer_storage") == 0)
+            supported = 1;
+    }
+    return supported != 0;
+}
+
+/*
+ * Allocates storage for the buffer bound to target and maps all of it
+ * for writing, so file data can be read or decoded right into memory
+ * the GPU can use. Storage is immutable when ARB_buffer_storage is
+ * available. Returns NULL if mapping failed, the caller unmaps the
+ * buffer with glUnmapBuffer otherwise.
+ */
+void*
+mapNewBuffer(GLenum target, size_t size, GLenum usage)
+{
+    if(bufferStorageSupported())
+        glBufferStorage(target, (GLsizeiptr)size, NULL, GL_MAP_WRITE_BIT);
+    else
+        glBufferData(target, (GLsizeiptr)size, NULL, usage);
+
+    return glMapBufferRange(target, 0, (GLsizeiptr)size,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+/*
+ * Mipmaps are read from the file right into a pixel unpack buffer,
+ * the texture is then filled from it by the GPU. Only the header is
+ * read through the mapping.
+ */
 static bool
 loadDDSTextureCommon(const char* fname, GLuint textureId,
-                     unsigned int fsize, unsigned char* dataPtr)
+                     FileMapping* mapping)
 {
+    size_t fsize = fileMappingGetSize(mapping);
+    unsigned char* dataPtr = fileMappingGetPointer(mapping);
     if(fsize < DDS_HEADER_SIZE)
     {
         fprintf(stderr, "loadDDSTexture failed, fname = %s, "
-                    "fsize = %u, less then"
+                    "fsize = %llu, less then"
                     " DDS_HEADER_SIZE ( %d )\n",
-                fname, fsize,  DDS_HEADER_SIZE);
+                fname, (unsigned long long)fsize,  DDS_HEADER_SIZE);
         return false;
     }
 
@@ -94,49 +168,94 @@ loadDDSTextureCommon(const char* fname, GLuint textureId,
             return false;
     }
 
-    glBindTexture(GL_TEXTURE_2D, textureId);
-
     unsigned int blockSize = (format ==
         GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = DDS_HEADER_SIZE;
 
-    // load mipmaps
+    // check sizes of all mipmaps before reading anything
+    size_t offset = DDS_HEADER_SIZE;
+    unsigned int levelWidth = width, levelHeight = height;
     for (unsigned int level = 0; level < mipMapNumber; ++level)
     {
-        unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize;
-        if(fsize < offset + size) {
+        size_t size = (size_t)((levelWidth+3)/4)*((levelHeight+3)/4)*
+                      blockSize;
+        if(fsize < offset || fsize - offset < size) {
             fprintf(stderr, "loadDDSTexture failed, fname = %s,"
-                        " fsize = %u, level ="
-                        " %u, offset = %u, size = %u\n",
-                    fname, fsize, level, offset, size);
+                        " fsize = %llu, level ="
+                        " %u, offset = %llu, size = %llu\n",
+                    fname, (unsigned long long)fsize, level,
+                    (unsigned long long)offset, (unsigned long long)size);
             return false;
         }
+
+        levelWidth = levelWidth > 1 ? levelWidth >> 1 : 1;
+        levelHeight = levelHeight > 1 ? levelHeight >> 1 : 1;
+        offset += size;
+    }
+
+    size_t dataSize = offset - DDS_HEADER_SIZE;
+    GLuint unpackBuffer = 0;
+    if(dataSize > 0)
+    {
+        glGenBuffers(1, &unpackBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+        void* ptr = mapNewBuffer(GL_PIXEL_UNPACK_BUFFER, dataSize,
+                                 GL_STREAM_DRAW);
+        bool res = ptr != NULL &&
+                   fileMappingRead(mapping, DDS_HEADER_SIZE, ptr, dataSize);
+        if(ptr != NULL && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE)
+            res = false;
+
+        if(!res)
+        {
+            fprintf(stderr, "loadDDSTexture failed, fname = %s,"
+                " can't read mipmaps to unpack buffer\n", fname);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &unpackBuffer);
+            return false;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    // load mipmaps, pointers are offsets in the unpack buffer
+    offset = 0;
+    for (unsigned int level = 0; level < mipMapNumber; ++level)
+    {
+        size_t size = (size_t)((width+3)/4)*((height+3)/4)*blockSize;
         glCompressedTexImage2D(GL_TEXTURE_2D,
-            level, format, width, height, 0, size, dataPtr + offset);
+            level, format, width, height, 0, (GLsizei)size,
+            (const void*)offset);
 
         width = width > 1 ? width >> 1 : 1;
         height = height > 1 ? height >> 1 : 1;
         offset += size;
     }
 
+    if(unpackBuffer != 0)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &unpackBuffer);
+    }
+
     glTexParameteri(GL_TEXTURE_2D,
         GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D,
         GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
+    fprintf(stderr, "loadDDSTexture - fname = %s, %llu bytes read right "
+            "into an unpack buffer\n", fname, (unsigned long long)dataSize);
     return true;
 }
 
+// pack is NULL to load loose files
 bool
-loadDDSTexture(const char *fname, GLuint textureId)
+loadDDSTexture(Pack* pack, const char *fname, GLuint textureId)
 {
-    FileMapping* mapping = fileMappingCreate(fname);
+    // mipmaps are read with fileMappingRead, hints wouldn't change anything
+    FileMapping* mapping = packOpenFile(pack, fname, FILE_MAPPING_HINT_NONE);
     if(mapping == NULL) return false;
 
-    unsigned char* dataPtr = fileMappingGetPointer(mapping);
-    unsigned int fsize = fileMappingGetSize(mapping);
-
-    bool res = loadDDSTextureCommon(fname, textureId, fsize, dataPtr);
+    bool res = loadDDSTextureCommon(fname, textureId, mapping);
 
     fileMappingDestroy(mapping);
 
@@ -200,22 +319,32 @@ checkProgramLinkStatus(GLuint obj)
 }
 
 GLuint
-loadShader(const char *fname, GLenum shaderType, bool *errorFlagPtr)
+loadShader(Pack* pack, const char *fname, GLenum shaderType,
+           bool *errorFlagPtr)
 {
     *errorFlagPtr = false;
 
-    FileMapping* mapping = fileMappingCreate(fname);
+    FileMapping* mapping = packOpenFile(pack, fname,
+                                        FILE_MAPPING_HINT_NONE);
     if(mapping == NULL) {
         *errorFlagPtr = true;
         return 0;
     }
 
+    if(fileMappingGetSize(mapping) > INT_MAX) {
+        fprintf(stderr, "loadShader - file is too large, fname = %s\n",
+                fname);
+        fileMappingDestroy(mapping);
+        *errorFlagPtr = true;
+        return 0;
+    }
+
     GLuint shaderId = glCreateShader(shaderType);
     GLchar* stringArray[1];
     GLint lengthArray[1];
 
     stringArray[0] = (GLchar*)fileMappingGetPointer(mapping);
-    lengthArray[0] = fileMappingGetSize(mapping);
+    lengthArray[0] = (GLint)fileMappingGetSize(mapping);
 
     glShaderSource(shaderId, 1,
         (GLchar const * const *)stringArray, lengthArray);
@@ -3,11 +3,15 @@
 
 #include <GLXW/glxw.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "pack.h"
 
-bool loadDDSTexture(const char *fname, GLuint textureId);
+void* mapNewBuffer(GLenum target, size_t size, GLenum usage);
+bool loadDDSTexture(Pack* pack, const char *fname, GLuint textureId);
 void loadOneColorTexture(GLfloat r, GLfloat g, GLfloat b, GLuint textureId);
 
-GLuint loadShader(const char * fname, GLenum shaderType, bool * errorFlagPtr);
+GLuint loadShader(Pack* pack, const char * fname, GLenum shaderType,
+				bool * errorFlagPtr);
 GLuint prepareProgram(const GLuint* shaders, int nshaders, bool *errorFlagPtr);
 GLint getUniformLocation(GLuint programId, const char* uniformName);
 void setUniform1f(GLuint programId, const char* uniformName, float value);
@@ -15,5 +19,6 @@ void setUniform3f(GLuint programId, const char* uniformName,
 	float v1, float v2, float v3);
 
 uint64_t getCurrentTimeMs();
+uint64_t getCurrentTimeUs();
 
 #endif // AFISKON_UTILS_H
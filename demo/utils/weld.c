@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "weld.h"
+
+// Vertices are hashed by position only, using cells WELD_CELL_SCALE*eps
+// wide. Two vertices can be welded only if every component differs by at
+// most eps, so a match is always in the same cell or in a neighbour one.
+// A cell wider than eps means that for most vertices only one or two
+// cells per axis have to be checked instead of three.
+#define WELD_CELL_SCALE 4.0
+
+// eps plus a small margin for rounding errors, in eps units
+#define WELD_CELL_MARGIN 1.01
+
+#define WELD_EMPTY 0xFFFFFFFFu
+
+// false for NaN, infinity and anything too large to be a cell index
+static bool
+weldCellCoord(double value, double cellSize, int64_t* outCell,
+              int* outLowNeighbour, int* outHighNeighbour)
+{
+    double q = value / cellSize;
+    if(!(q > -1.0e15 && q < 1.0e15))
+        return false;
+
+    double cell = floor(q);
+    double offset = (q - cell) * WELD_CELL_SCALE; // in eps units
+    *outLowNeighbour = (offset <= WELD_CELL_MARGIN) ? -1 : 0;
+    *outHighNeighbour =
+        (offset >= WELD_CELL_SCALE - WELD_CELL_MARGIN) ? 1 : 0;
+    *outCell = (int64_t)cell;
+    return true;
+}
+
+static size_t
+weldCellHash(int64_t x, int64_t y, int64_t z)
+{
+    uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)y * 0xC2B2AE3D27D4EB4FULL;
+    h ^= (uint64_t)z * 0x165667B19E3779F9ULL;
+    h ^= h >> 29;
+    return (size_t)(h ^ (h >> 32));
+}
+
+static bool
+weldVerticesEqual(const GLfloat* v1, const GLfloat* v2,
+                  unsigned int floatsPerVertex, GLfloat eps)
+{
+    for(unsigned int k = 0; k < floatsPerVertex; ++k)
+        if(fabs(v1[k] - v2[k]) > eps)
+            return false;
+    return true;
+}
+
+/*
+ * Replaces duplicate vertices in verticesBuffer with indices. Vertices
+ * are considered equal if all their components differ by no more than eps.
+ * The result is exactly the same as comparing every vertex with every
+ * unique vertex found so far and taking the first match, but it takes
+ * about linear time instead of quadratic. Vertices with non-finite or
+ * huge positions don't fit the grid of cells and are still compared with
+ * every unique vertex, as a NaN is "equal" to anything.
+ *
+ * outVertices should have room for maxUniqueVertices vertices and
+ * outIndices - for verticesNumber indices. outVertices can be
+ * verticesBuffer to weld in place: a unique vertex is never written
+ * past the vertex it was read from.
+ */
+bool
+weldVertices(const GLfloat* verticesBuffer, size_t verticesNumber,
+             unsigned int floatsPerVertex, GLfloat eps,
+             unsigned int maxUniqueVertices, GLfloat* outVertices,
+             unsigned int* outIndices, unsigned int* outUniqueVerticesNumber)
+{
+    *outUniqueVerticesNumber = 0;
+
+    // there are never more unique vertices than input vertices
+    if(maxUniqueVertices > verticesNumber)
+        maxUniqueVertices = (unsigned int)verticesNumber;
+
+    size_t bucketsNumber = 1024;
+    while(bucketsNumber < (size_t)maxUniqueVertices * 2)
+        bucketsNumber *= 2;
+
+    unsigned int* buckets = (unsigned int*)malloc(
+                                    sizeof(unsigned int) * bucketsNumber
+                                );
+    if(buckets == NULL)
+    {
+        fprintf(stderr, "weldVertices - failed to allocate buckets\n");
+        return false;
+    }
+    memset(buckets, 0xFF, sizeof(unsigned int) * bucketsNumber);
+
+    // next unique vertex in the same bucket
+    unsigned int* chains = (unsigned int*)malloc(
+                                    sizeof(unsigned int) * maxUniqueVertices
+                                );
+    if(chains == NULL)
+    {
+        fprintf(stderr, "weldVertices - failed to allocate chains\n");
+        free(buckets);
+        return false;
+    }
+
+    double cellSize = (double)eps * WELD_CELL_SCALE;
+    size_t bucketsMask = bucketsNumber - 1;
+    unsigned int usedIndices = 0;
+    unsigned int outsideHead = WELD_EMPTY; // unique vertices not in cells
+
+    for(size_t vtx = 0; vtx < verticesNumber; ++vtx)
+    {
+        const GLfloat* vertex = verticesBuffer + (size_t)vtx*floatsPerVertex;
+        int64_t cell[3];
+        int low[3], high[3];
+        bool inGrid = true;
+        for(unsigned int k = 0; k < 3 && inGrid; ++k)
+            inGrid = weldCellCoord(vertex[k], cellSize, &cell[k], &low[k],
+                                   &high[k]);
+
+        unsigned int foundIndex = WELD_EMPTY;
+        if(inGrid)
+        {
+            for(int dx = low[0]; dx <= high[0]; ++dx)
+            for(int dy = low[1]; dy <= high[1]; ++dy)
+            for(int dz = low[2]; dz <= high[2]; ++dz)
+            {
+                size_t bucket = weldCellHash(cell[0] + dx, cell[1] + dy,
+                                               cell[2] + dz) & bucketsMask;
+                for(unsigned int idx = buckets[bucket]; idx != WELD_EMPTY;
+                    idx = chains[idx])
+                {
+                    // the first matching vertex wins, as in a linear search
+                    if(idx < foundIndex && weldVerticesEqual(vertex,
+                            outVertices + (size_t)idx*floatsPerVertex,
+                            floatsPerVertex, eps))
+                        foundIndex = idx;
+                }
+            }
+
+            // unique vertices outside of the grid may match any vertex
+            for(unsigned int idx = outsideHead; idx != WELD_EMPTY;
+                idx = chains[idx])
+            {
+                if(idx < foundIndex && weldVerticesEqual(vertex,
+                        outVertices + (size_t)idx*floatsPerVertex,
+                        floatsPerVertex, eps))
+                    foundIndex = idx;
+            }
+        }
+        else
+        {
+            for(unsigned int idx = 0; idx < usedIndices; ++idx)
+            {
+                if(weldVerticesEqual(vertex,
+                        outVertices + (size_t)idx*floatsPerVertex,
+                        floatsPerVertex, eps))
+                {
+                    foundIndex = idx;
+                    break;
+                }
+            }
+        }
+
+        if(foundIndex == WELD_EMPTY)
+        {
+            if(usedIndices >= maxUniqueVertices)
+            {
+                fprintf(stderr,
+                        "weldVertices - more than %u unique vertices\n",
+                        maxUniqueVertices
+                    );
+                free(chains);
+                free(buckets);
+                return false;
+            }
+
+            memmove(outVertices + (size_t)usedIndices*floatsPerVertex,
+                    vertex, sizeof(GLfloat)*floatsPerVertex);
+
+            if(inGrid)
+            {
+                size_t bucket = weldCellHash(cell[0], cell[1], cell[2]) &
+                                    bucketsMask;
+                chains[usedIndices] = buckets[bucket];
+                buckets[bucket] = usedIndices;
+            }
+            else
+            {
+                chains[usedIndices] = outsideHead;
+                outsideHead = usedIndices;
+            }
+
+            foundIndex = usedIndices;
+            usedIndices++;
+        }
+
+        outIndices[vtx] = foundIndex;
+    }
+
+    free(chains);
+    free(buckets);
+
+    *outUniqueVerticesNumber = usedIndices;
+    return true;
+}
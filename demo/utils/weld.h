@@ -0,0 +1,13 @@
+#ifndef AFISKON_WELD_H
+#define AFISKON_WELD_H
+
+#include <stdbool.h>
+#include <GLXW/glxw.h>
+
+bool weldVertices(const GLfloat* verticesBuffer, size_t verticesNumber,
+				unsigned int floatsPerVertex, GLfloat eps,
+				unsigned int maxUniqueVertices, GLfloat* outVertices,
+				unsigned int* outIndices,
+				unsigned int* outUniqueVerticesNumber);
+
+#endif // AFISKON_WELD_H
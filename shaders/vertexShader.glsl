@@ -7,14 +7,35 @@ layout(location = 2) in vec2 vertexUV;
 uniform mat4 MVP;
 uniform mat4 M;
 
+// quantized attributes, see ModelVertexFormat
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+uniform vec2 uvScale;
+uniform vec2 uvBias;
+uniform bool normalOctahedral;
+
 out vec2 fragmentUV;
 out vec3 fragmentNormal;
 out vec3 fragmentPos;
 
+vec3 decodeNormal() {
+    if(!normalOctahedral)
+        return vertexNorm;
+
+    vec2 e = vertexNorm.xy * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return n;
+}
+
 void main() {
-    fragmentUV = vertexUV;
-    fragmentNormal = (M * vec4(vertexNorm, 0)).xyz;
-    fragmentPos = (M * vec4(vertexPos, 1)).xyz;
+    vec3 pos = vertexPos * positionScale + positionBias;
+
+    fragmentUV = vertexUV * uvScale + uvBias;
+    fragmentNormal = (M * vec4(decodeNormal(), 0)).xyz;
+    fragmentPos = (M * vec4(pos, 1)).xyz;
 
-    gl_Position = MVP * vec4(vertexPos, 1);
+    gl_Position = MVP * vec4(pos, 1);
 }
\ No newline at end of file